@@ -0,0 +1,119 @@
+#include "CommandBuffer.h"
+#include "PipelineState.h"
+
+namespace Backend {
+
+	CommandBuffer::CommandBuffer(unsigned int initialCapacity) {
+		mData.resize(initialCapacity);
+
+		mSize = 0;
+		mCommandCount = 0;
+	}
+
+	void CommandBuffer::Reset() {
+		mSize = 0;
+		mCommandCount = 0;
+	}
+
+	unsigned char* CommandBuffer::BeginCommand(CommandType type, unsigned int payloadSize) {
+		unsigned int requiredSize = mSize + sizeof(CommandHeader) + payloadSize;
+
+		// Only grows while warming up, after that Reset() keeps the storage around
+		if (requiredSize > mData.size()) {
+			mData.resize(std::max<size_t>(requiredSize, mData.size() * 2));
+		}
+
+		CommandHeader header;
+		header.Type = type;
+		header.Size = payloadSize;
+		memcpy(&mData[mSize], &header, sizeof(header));
+
+		unsigned char* payloadPtr = &mData[mSize + sizeof(CommandHeader)];
+
+		mSize = requiredSize;
+		mCommandCount++;
+
+		return payloadPtr;
+	}
+
+	CommandBuffer* CommandBuffer::SetCullMode(CullingMode mode) {
+		return WriteCommand(CMD_SET_CULL_MODE, CmdMode{ (int)mode });
+	}
+
+	CommandBuffer* CommandBuffer::SetBlendMode(BlendingMode mode) {
+		return WriteCommand(CMD_SET_BLEND_MODE, CmdMode{ (int)mode });
+	}
+
+	CommandBuffer* CommandBuffer::SetDepthMode(DepthTestMode mode) {
+		return WriteCommand(CMD_SET_DEPTH_MODE, CmdMode{ (int)mode });
+	}
+
+	CommandBuffer* CommandBuffer::SetViewport(SViewport viewport, bool forceSet) {
+		return WriteCommand(CMD_SET_VIEWPORT, CmdViewport{ viewport, forceSet });
+	}
+
+	CommandBuffer* CommandBuffer::SetPipeline(PipelineState* pipeline) {
+		// Pipelines are immutable and owned by the Context, the id is enough to find them at replay
+		return WriteCommand(CMD_SET_PIPELINE, CmdPipeline{ pipeline ? pipeline->Id() : PipelineState::INVALID_ID });
+	}
+
+	CommandBuffer* CommandBuffer::SetDatabuffer(DataBuffer* buffer, bool forceSet) {
+		return WriteCommand(CMD_SET_DATABUFFER, CmdDatabuffer{ buffer, forceSet });
+	}
+
+	CommandBuffer* CommandBuffer::RenderV(RenderMode mode, int count, int startOffset) {
+		return WriteCommand(CMD_RENDER_V, CmdRender{ mode, count, startOffset, 0 });
+	}
+
+	CommandBuffer* CommandBuffer::RenderI(RenderMode mode, int count, int startOffset) {
+		return WriteCommand(CMD_RENDER_I, CmdRender{ mode, count, startOffset, 0 });
+	}
+
+	CommandBuffer* CommandBuffer::RenderI(RenderMode mode, int count, int indicesOffset, int verticesOffset) {
+		return WriteCommand(CMD_RENDER_I_BASE_VERTEX, CmdRender{ mode, count, indicesOffset, verticesOffset });
+	}
+
+	CommandBuffer* CommandBuffer::BindTextures(const std::vector<std::pair<int, TextureBuffer*>>& textures) {
+		if (textures.empty()) return this;
+
+		unsigned char* payloadPtr = BeginCommand(CMD_BIND_TEXTURES, (unsigned int)(sizeof(CmdTextureEntry) * textures.size()));
+
+		for (auto& tex : textures) {
+			CmdTextureEntry entry = { tex.first, tex.second };
+			memcpy(payloadPtr, &entry, sizeof(entry));
+			payloadPtr += sizeof(entry);
+		}
+
+		return this;
+	}
+
+	CommandBuffer* CommandBuffer::BindTextures(const TextureBindVector& textures) {
+		// The uniform name is copied inline so the stream does not depend on the caller's strings
+		for (auto& key : textures) {
+			CmdTextureKey entry = { key.Slot, key.Texture, (unsigned int)key.UniformName.length() };
+
+			unsigned char* payloadPtr = BeginCommand(CMD_BIND_TEXTURE_KEY, sizeof(entry) + entry.NameLength);
+			memcpy(payloadPtr, &entry, sizeof(entry));
+			memcpy(payloadPtr + sizeof(entry), key.UniformName.data(), entry.NameLength);
+		}
+
+		return this;
+	}
+
+	CommandBuffer* CommandBuffer::SetRenderbuffer(RenderBuffer* rb, bool setAnyway) {
+		return WriteCommand(CMD_SET_RENDERBUFFER, CmdRenderbuffer{ rb, setAnyway });
+	}
+
+	CommandBuffer* CommandBuffer::SetClearColor(float r, float g, float b, float a) {
+		return WriteCommand(CMD_SET_CLEAR_COLOR, CmdClearColor{ r, g, b, a });
+	}
+
+	CommandBuffer* CommandBuffer::ClearBuffer(bool clearColor, bool clearDepth, bool clearStencil) {
+		return WriteCommand(CMD_CLEAR_BUFFER, CmdClearBuffer{ clearColor, clearDepth, clearStencil });
+	}
+
+	CommandBuffer* CommandBuffer::SetShader(ShaderProgram* shader) {
+		return WriteCommand(CMD_SET_SHADER, CmdShader{ shader });
+	}
+
+}
@@ -0,0 +1,97 @@
+#ifndef COMMAND_BUFFER_R_H
+#define COMMAND_BUFFER_R_H
+
+#include "include.h"
+#include "Context.h"
+
+namespace Backend {
+	class Context;
+	class CommandBuffer;
+
+	class DataBuffer;
+	class ShaderProgram;
+	class RenderBuffer;
+	class TextureBuffer;
+	class PipelineState;
+
+	// Records Context operations into a flat binary stream without touching GL, so it can be filled from any thread.
+	// The stream keeps its capacity on Reset(), so recording the same workload every frame does not allocate.
+	class CommandBuffer {
+		public:
+			CommandBuffer(unsigned int initialCapacity = 64 * 1024);
+			~CommandBuffer() { }
+
+			void Reset();
+
+			bool Empty() { return mSize == 0; }
+			unsigned int Size() { return mSize; }
+			unsigned int CommandCount() { return mCommandCount; }
+
+			// Mode stuff
+			CommandBuffer* SetCullMode(CullingMode mode);
+			CommandBuffer* SetBlendMode(BlendingMode mode);
+			CommandBuffer* SetDepthMode(DepthTestMode mode);
+			CommandBuffer* SetViewport(SViewport viewport, bool forceSet = false);
+			CommandBuffer* SetPipeline(PipelineState* pipeline);
+
+			// Rendering stuff
+			CommandBuffer* SetDatabuffer(DataBuffer* buffer, bool forceSet = false);
+
+			CommandBuffer* RenderV(RenderMode mode, int count, int startOffset = 0);
+			CommandBuffer* RenderI(RenderMode mode, int count, int startOffset = 0);
+			CommandBuffer* RenderI(RenderMode mode, int count, int indicesOffset, int verticesOffset);
+
+			CommandBuffer* BindTextures(const std::vector<std::pair<int, TextureBuffer*>>& textures);
+			CommandBuffer* BindTextures(const TextureBindVector& textures);
+
+			// Render buffer stuff
+			CommandBuffer* SetRenderbuffer(RenderBuffer* rb, bool setAnyway = false);
+			CommandBuffer* SetClearColor(float r, float g, float b, float a);
+			CommandBuffer* ClearBuffer(bool clearColor = true, bool clearDepth = true, bool clearStencil = false);
+
+			// Shader stuff
+			CommandBuffer* SetShader(ShaderProgram* shader);
+
+		protected:
+			enum CommandType : unsigned int {
+				CMD_SET_CULL_MODE, CMD_SET_BLEND_MODE, CMD_SET_DEPTH_MODE, CMD_SET_VIEWPORT,
+				CMD_SET_DATABUFFER, CMD_RENDER_V, CMD_RENDER_I, CMD_RENDER_I_BASE_VERTEX,
+				CMD_BIND_TEXTURES, CMD_BIND_TEXTURE_KEY,
+				CMD_SET_RENDERBUFFER, CMD_SET_CLEAR_COLOR, CMD_CLEAR_BUFFER,
+				CMD_SET_SHADER, CMD_SET_PIPELINE
+			};
+
+			struct CommandHeader {
+				CommandType Type;
+				unsigned int Size; // payload size in bytes, header excluded
+			};
+
+			struct CmdMode { int Mode; };
+			struct CmdViewport { SViewport Viewport; bool Force; };
+			struct CmdDatabuffer { DataBuffer* Buffer; bool Force; };
+			struct CmdRender { RenderMode Mode; int Count; int Offset; int VerticesOffset; };
+			struct CmdTextureEntry { int Slot; TextureBuffer* Texture; };
+			struct CmdTextureKey { int Slot; TextureBuffer* Texture; unsigned int NameLength; }; // followed by NameLength chars
+			struct CmdRenderbuffer { RenderBuffer* Buffer; bool Force; };
+			struct CmdClearColor { float R, G, B, A; };
+			struct CmdClearBuffer { bool Color, Depth, Stencil; };
+			struct CmdShader { ShaderProgram* Shader; };
+			struct CmdPipeline { unsigned int Id; };
+
+			unsigned char* BeginCommand(CommandType type, unsigned int payloadSize);
+
+			template<typename T>
+			CommandBuffer* WriteCommand(CommandType type, const T& payload) { memcpy(BeginCommand(type, sizeof(T)), &payload, sizeof(T)); return this; }
+
+		protected:
+			std::vector<unsigned char> mData;
+			unsigned int mSize;
+			unsigned int mCommandCount;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -1,14 +1,59 @@
 #include "Context.h"
 
+#include "InternalStateManager.h"
 #include "DataBuffer.h"
 #include "RenderBuffer.h"
 #include "ShaderProgram.h"
+#include "CommandBuffer.h"
+#include "IndirectDrawBatch.h"
+#include "UniformBufferRing.h"
+#include "TextureArrayAtlas.h"
+#include "PipelineState.h"
+#include "GpuProfiler.h"
+#include "FrameStatistics.h"
+#include "TextureStreamer.h"
+#include "ProgramBinaryCache.h"
+#include "ShaderLibrary.h"
+#include "RenderTargetPool.h"
+#include "FrameGraph.h"
+#include "InstanceBatcher.h"
+#include "GeometryPool.h"
+#include "Sampler.h"
 
 namespace Backend {
-	Context::Context(int screenWidth, int screenHeight, int defaultFBO) {
+	Context::Context(int screenWidth, int screenHeight, int defaultFBO, bool allowDirectStateAccess) {
+		// Before any module is created, objects made with glCreate* and glGen* don't mix with the other path
+		mUseDirectStateAccess = allowDirectStateAccess && (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access);
+
+		mStateManager = new InternalStateManager();
+		mProfiler = new GpuProfiler(this);
+		mStatistics = new FrameStatistics(this, 120);
+		mRenderTargetPool = new RenderTargetPool(this);
+
 		CreateDefaultRB(screenWidth, screenHeight, defaultFBO);
 
-		memset(mBoundTextures, 0, sizeof(mBoundTextures));
+		memset(mFrameFences, 0, sizeof(mFrameFences));
+		mFrameCount = 0;
+
+		mUniformRing = nullptr;
+		mTextureStreamer = nullptr;
+		mProgramCache = nullptr;
+
+		mDrawBatch = nullptr;
+		mDrawBatchMode = RenderMode::RENDER_TRIANGLES;
+		mIsBatching = false;
+		mSupportsMultiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+		mSupportsBaseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+		mSupportsParallelCompile = GLEW_KHR_parallel_shader_compile;
+		mSupportsBufferStorage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+		mSupportsProgramUniform = GLEW_VERSION_4_1 || GLEW_ARB_separate_shader_objects;
+
+		GLint maxUniformBindings = 36; // GL 3.1 minimum for a vertex plus fragment pipeline
+		glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &maxUniformBindings);
+		mMaxUniformBufferBindings = (unsigned int)maxUniformBindings;
+
+		// Let the driver pick the number of compiler threads
+		if (mSupportsParallelCompile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
 
 		// Set these values so the compare logic will work
 		mCurrentState.BlendMode = BlendingMode::BLEND_NONE;
@@ -17,79 +62,604 @@ namespace Backend {
 		mCurrentState.Shader = nullptr;
 		mCurrentState.Renderbuffer = DefaultRenderBuffer;
 
-		// Default state
+		// Default state, the modes already match the values above so sync GL explicitly
+		mStateManager->SetCapability(GL_CULL_FACE, false);
+		mStateManager->SetCapability(GL_BLEND, false);
 		SetCullMode(mCurrentState.CullMode);
 		SetDepthMode(DepthTestMode::DEPTH_READ_WRITE);
 		SetBlendMode(mCurrentState.BlendMode);
 		
 	}
 
+	Context::~Context() {
+		for (auto fence : mFrameFences) {
+			if (fence) glDeleteSync(fence);
+		}
+
+		for (auto pipeline : mPipelines) {
+			delete pipeline;
+		}
+
+		for (auto sampler : mSamplers) {
+			delete sampler;
+		}
+
+		delete mRenderTargetPool;
+		mRenderTargetPool = nullptr; // textures deleted later skip the pool
+		delete DefaultRenderBuffer;
+
+		delete mDrawBatch;
+		delete mUniformRing;
+		delete mTextureStreamer;
+		delete mProgramCache;
+		delete mProfiler;
+		delete mStatistics;
+		delete mStateManager;
+	}
+
 	RenderBuffer* Context::CreateRenderBuffer(int w, int h) {
-		return new RenderBuffer(w, h);
-		//return new RenderBuffer(this, w, h);
+		return new RenderBuffer(this, w, h);
 	}
 
 	ShaderProgram* Context::CreateShaderProgram() {
-		return new ShaderProgram();
-		//return new ShaderProgram(this);
+		return new ShaderProgram(this);
+	}
+
+	ShaderLibrary* Context::CreateShaderLibrary() {
+		return new ShaderLibrary(this);
 	}
 
 	DataBuffer* Context::CreateDataBuffer() {
-		return new DataBuffer();
-		//return new DataBuffer(this);
+		return new DataBuffer(this);
 	}
 
 	TextureBuffer* Context::CreateTextureBuffer(TextureType type) {
-		return new TextureBuffer(type);
-		//return new TextureBuffer(this, type);
+		return new TextureBuffer(this, type);
+	}
+
+	CommandBuffer* Context::CreateCommandBuffer(unsigned int initialCapacity) {
+		return new CommandBuffer(initialCapacity);
+	}
+
+	IndirectDrawBatch* Context::CreateIndirectDrawBatch(unsigned int maxDraws) {
+		return new IndirectDrawBatch(this, maxDraws);
+	}
+
+	TextureArrayAtlas* Context::CreateTextureArrayAtlas(int layersPerArray, bool mipmapped) {
+		return new TextureArrayAtlas(this, layersPerArray, mipmapped);
+	}
+
+	GeometryPool* Context::CreateGeometryPool(unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity) {
+		return new GeometryPool(this, vertexStride, vertexCapacity, indexCapacity);
+	}
+
+	InstanceBatcher* Context::CreateInstanceBatcher(unsigned int instanceStride, unsigned int maxInstancesPerFrame) {
+		return new InstanceBatcher(this, instanceStride, maxInstancesPerFrame);
+	}
+
+	FrameGraph* Context::CreateFrameGraph() {
+		return new FrameGraph(this);
+	}
+
+	PipelineState* Context::CreatePipelineState(const PipelineDescription& description) {
+		unsigned long long hash = PipelineState::HashDescription(description);
+
+		auto& bucket = mPipelineLookup[hash];
+		for (auto pipeline : bucket) {
+			if (pipeline->mDescription == description) return pipeline;
+		}
+
+		PipelineState* pipeline = new PipelineState(description, (unsigned int)mPipelines.size() + 1);
+		mPipelines.push_back(pipeline);
+		bucket.push_back(pipeline);
+
+		return pipeline;
+	}
+
+	Sampler* Context::CreateSampler(const SamplerDescription& description) {
+		unsigned long long hash = Sampler::HashDescription(description);
+
+		auto& bucket = mSamplerLookup[hash];
+		for (auto sampler : bucket) {
+			if (sampler->mDescription == description) return sampler;
+		}
+
+		Sampler* sampler = new Sampler(this, description);
+		mSamplers.push_back(sampler);
+		bucket.push_back(sampler);
+
+		return sampler;
+	}
+
+	PipelineState* Context::GetPipelineState(unsigned int id) {
+		if (id == PipelineState::INVALID_ID || id > mPipelines.size()) return nullptr;
+
+		return mPipelines[id - 1];
+	}
+
+	PipelineState* Context::CapturePipeline() {
+		if (mCurrentState.Pipeline) return mCurrentState.Pipeline;
+
+		// State was set field by field, turn it into a pipeline (an existing one most of the time)
+		PipelineDescription description;
+		description.CullMode = mCurrentState.CullMode;
+		description.BlendMode = mCurrentState.BlendMode;
+		description.DepthMode = mCurrentState.DepthMode;
+		description.Shader = mCurrentState.Shader;
+
+		mCurrentState.Pipeline = CreatePipelineState(description);
+
+		return mCurrentState.Pipeline;
 	}
 
 	void Context::SaveState() {
-		mSavedStates.push_back(mCurrentState);
+		SavedState state;
+		state.PipelineId = CapturePipeline()->Id();
+		state.Databuffer = mCurrentState.Databuffer;
+		state.Renderbuffer = mCurrentState.Renderbuffer;
+		state.Viewport = mCurrentState.Viewport;
+
+		mSavedStates.push_back(state);
 	}
 
 	void Context::RestoreState() {
 		if (mSavedStates.empty()) return;
 
-		ContextState state = mSavedStates.back();
+		SavedState state = mSavedStates.back();
 		mSavedStates.pop_back();
 
-		SetCullMode(state.CullMode);
-		SetBlendMode(state.BlendMode);
-		SetDepthMode(state.DepthMode);
-		SetShader(state.Shader);
+		SetPipeline(state.PipelineId);
+		SetDatabuffer(state.Databuffer);
 		SetRenderbuffer(state.Renderbuffer);
 		SetViewport(state.Viewport);
 	}
 
 	void Context::FrameBegin() {
-		UnbindAllTextures();
+		// Wait until the GPU released the mapped regions this frame is about to overwrite
+		GLsync& fence = mFrameFences[FrameRegion()];
+		if (fence) {
+			GLenum waitResult = glClientWaitSync(fence, 0, 0);
+			while (waitResult == GL_TIMEOUT_EXPIRED) {
+				waitResult = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			}
+
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
+		mStatistics->BeginFrame();
+		mProfiler->BeginFrame(mFrameCount);
 
+		if (mTextureStreamer) mTextureStreamer->Update();
+		UpdateCompilingPrograms();
+
+		// Textures stay bound across frames, the per unit cache skips rebinding them
 		SetRenderbuffer(DefaultRenderBuffer, true);
 		SetDatabuffer(nullptr);
 		SetShader(nullptr);
 	}
 
 	void Context::FrameEnd() {
+		FlushDrawBatch();
+
+		mProfiler->EndFrame();
+		mStatistics->EndFrame(mFrameCount);
+		mRenderTargetPool->EndFrame(mFrameCount);
 
+		mFrameFences[FrameRegion()] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		mFrameCount++;
+	}
+
+	void Context::ReserveTextureStreaming(unsigned int stagingSize, unsigned int bytesPerFrame) {
+		if (mTextureStreamer && mTextureStreamer->GetStagingSize() >= stagingSize) {
+			mTextureStreamer->SetFrameBudget(bytesPerFrame);
+			return;
+		}
+
+		// Uploads still in flight keep their textures pending forever otherwise
+		if (mTextureStreamer && mTextureStreamer->GetPendingCount()) return;
+
+		delete mTextureStreamer;
+		mTextureStreamer = new TextureStreamer(this, stagingSize, bytesPerFrame);
+	}
+
+	TextureStreamer* Context::GetTextureStreamer() {
+		if (!mTextureStreamer) ReserveTextureStreaming(32 * 1024 * 1024);
+
+		return mTextureStreamer;
+	}
+
+	void Context::BeginGpuScope(const std::string& name) {
+		// Batched draws belong to the scope they were recorded in
+		FlushDrawBatch();
+
+		mProfiler->BeginScope(name);
+	}
+
+	void Context::EndGpuScope() {
+		FlushDrawBatch();
+
+		mProfiler->EndScope();
+	}
+
+	void Context::CompileProgramsAsync(const std::vector<ShaderProgram*>& programs) {
+		std::vector<ShaderProgram*> submitted;
+
+		// Every stage first, then every link, nothing is queried until UpdateCompilingPrograms
+		for (auto program : programs) {
+			if (!program || program->mStatus == ProgramStatus::PROGRAM_COMPILING) continue;
+
+			if (program->SubmitStages()) submitted.push_back(program);
+		}
+
+		for (auto program : submitted) {
+			program->SubmitLink();
+			mCompilingPrograms.push_back(program);
+		}
+	}
+
+	void Context::UpdateCompilingPrograms() {
+		// Without the extension there is no way to ask without blocking, but at least the driver had a frame to work
+		for (size_t i = 0; i < mCompilingPrograms.size(); ) {
+			ShaderProgram* program = mCompilingPrograms[i];
+
+			if (program->IsCompileDone()) {
+				program->FinishCompile();
+
+				mCompilingPrograms[i] = mCompilingPrograms.back();
+				mCompilingPrograms.pop_back();
+			}
+			else {
+				i++;
+			}
+		}
+	}
+
+	void Context::CancelProgramCompile(ShaderProgram* program) {
+		auto itr = std::find(mCompilingPrograms.begin(), mCompilingPrograms.end(), program);
+		if (itr != mCompilingPrograms.end()) mCompilingPrograms.erase(itr);
+	}
+
+	void Context::CancelTextureStreams(TextureBuffer* texture) {
+		if (mTextureStreamer) mTextureStreamer->Cancel(texture);
+	}
+
+	RenderBuffer* Context::AcquireRenderTarget(const RenderTargetDesc& desc) {
+		return mRenderTargetPool->Acquire(desc);
+	}
+
+	void Context::ReleaseRenderTarget(RenderBuffer* target) {
+		mRenderTargetPool->Release(target);
+	}
+
+	void Context::SetProgramCacheDirectory(const std::string& directory) {
+		delete mProgramCache;
+		mProgramCache = directory.empty() ? nullptr : new ProgramBinaryCache(this, directory);
+	}
+
+	void Context::ReserveUniformRing(unsigned int sizePerFrame) {
+		if (mUniformRing && mUniformRing->RegionSize() >= sizePerFrame) return;
+
+		delete mUniformRing;
+		mUniformRing = new UniformBufferRing(this, sizePerFrame);
+	}
+
+	UniformAllocation Context::AllocateUniforms(unsigned int size) {
+		if (!mUniformRing) ReserveUniformRing(4 * 1024 * 1024);
+
+		return mUniformRing->Allocate(size);
+	}
+
+	void Context::BindUniformBlock(unsigned int binding, const UniformAllocation& allocation) {
+		if (!allocation.Ptr) return;
+		if (binding >= mMaxUniformBufferBindings) {
+			std::cerr << "[Error] Uniform block binding " << binding << " is over GL_MAX_UNIFORM_BUFFER_BINDINGS (" << mMaxUniformBufferBindings << ")" << std::endl;
+			return;
+		}
+
+		GLuint handle = mUniformRing->GetNativeHandle();
+		if (!mStateManager->IsBufferRangeBound(GL_UNIFORM_BUFFER, binding, handle, allocation.Offset, allocation.Size)) FlushDrawBatch();
+
+		mStateManager->BindBufferRange(GL_UNIFORM_BUFFER, binding, handle, allocation.Offset, allocation.Size);
+	}
+
+	bool Context::UploadUniformBlock(unsigned int binding, const void* dataPtr, unsigned int dataSize) {
+		UniformAllocation allocation = AllocateUniforms(dataSize);
+		if (!allocation.Valid()) return false;
+
+		memcpy(allocation.Ptr, dataPtr, dataSize);
+		BindUniformBlock(binding, allocation);
+
+		return true;
+	}
+
+	void Context::ExecuteCommandBuffer(CommandBuffer* commandBuffer) {
+		if (!commandBuffer) return;
+
+		const unsigned char* readPtr = commandBuffer->mData.data();
+		const unsigned char* endPtr = readPtr + commandBuffer->mSize;
+
+		while (readPtr < endPtr) {
+			CommandBuffer::CommandHeader header;
+			memcpy(&header, readPtr, sizeof(header));
+			const unsigned char* payloadPtr = readPtr + sizeof(header);
+			readPtr = payloadPtr + header.Size;
+
+			switch (header.Type) {
+				case CommandBuffer::CMD_SET_CULL_MODE:
+				case CommandBuffer::CMD_SET_BLEND_MODE:
+				case CommandBuffer::CMD_SET_DEPTH_MODE: {
+					CommandBuffer::CmdMode cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+
+					if (header.Type == CommandBuffer::CMD_SET_CULL_MODE) SetCullMode((CullingMode)cmd.Mode);
+					else if (header.Type == CommandBuffer::CMD_SET_BLEND_MODE) SetBlendMode((BlendingMode)cmd.Mode);
+					else SetDepthMode((DepthTestMode)cmd.Mode);
+					break;
+				}
+				case CommandBuffer::CMD_SET_VIEWPORT: {
+					CommandBuffer::CmdViewport cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					SetViewport(cmd.Viewport, cmd.Force);
+					break;
+				}
+				case CommandBuffer::CMD_SET_DATABUFFER: {
+					CommandBuffer::CmdDatabuffer cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					SetDatabuffer(cmd.Buffer, cmd.Force);
+					break;
+				}
+				case CommandBuffer::CMD_RENDER_V:
+				case CommandBuffer::CMD_RENDER_I:
+				case CommandBuffer::CMD_RENDER_I_BASE_VERTEX: {
+					CommandBuffer::CmdRender cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+
+					if (header.Type == CommandBuffer::CMD_RENDER_V) RenderV(cmd.Mode, cmd.Count, cmd.Offset);
+					else if (header.Type == CommandBuffer::CMD_RENDER_I) RenderI(cmd.Mode, cmd.Count, cmd.Offset);
+					else RenderI(cmd.Mode, cmd.Count, cmd.Offset, cmd.VerticesOffset);
+					break;
+				}
+				case CommandBuffer::CMD_BIND_TEXTURES: {
+					unsigned int count = header.Size / sizeof(CommandBuffer::CmdTextureEntry);
+
+					mReplayTextures.clear();
+					for (unsigned int i = 0; i < count; ++i) {
+						CommandBuffer::CmdTextureEntry entry;
+						memcpy(&entry, payloadPtr + i * sizeof(entry), sizeof(entry));
+						mReplayTextures.push_back({ entry.Slot, entry.Texture });
+					}
+
+					BindTextures(mReplayTextures);
+					break;
+				}
+				case CommandBuffer::CMD_BIND_TEXTURE_KEY: {
+					CommandBuffer::CmdTextureKey cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					mReplayUniformName.assign((const char*)payloadPtr + sizeof(cmd), cmd.NameLength);
+
+					mCurrentState.Shader->SetInt(mReplayUniformName, cmd.Slot);
+					QueueTextureBind(cmd.Slot, cmd.Texture);
+					FlushTextureBinds();
+					break;
+				}
+				case CommandBuffer::CMD_SET_RENDERBUFFER: {
+					CommandBuffer::CmdRenderbuffer cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					SetRenderbuffer(cmd.Buffer, cmd.Force);
+					break;
+				}
+				case CommandBuffer::CMD_SET_CLEAR_COLOR: {
+					CommandBuffer::CmdClearColor cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					SetClearColor(cmd.R, cmd.G, cmd.B, cmd.A);
+					break;
+				}
+				case CommandBuffer::CMD_CLEAR_BUFFER: {
+					CommandBuffer::CmdClearBuffer cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					ClearBuffer(cmd.Color, cmd.Depth, cmd.Stencil);
+					break;
+				}
+				case CommandBuffer::CMD_SET_SHADER: {
+					CommandBuffer::CmdShader cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					SetShader(cmd.Shader);
+					break;
+				}
+				case CommandBuffer::CMD_SET_PIPELINE: {
+					CommandBuffer::CmdPipeline cmd;
+					memcpy(&cmd, payloadPtr, sizeof(cmd));
+					SetPipeline(cmd.Id);
+					break;
+				}
+			}
+		}
+	}
+
+	void Context::ExecuteCommandBuffers(const std::vector<CommandBuffer*>& commandBuffers) {
+		for (auto commandBuffer : commandBuffers) {
+			ExecuteCommandBuffer(commandBuffer);
+		}
 	}
 
 	void Context::RenderV(RenderMode mode, int count, int startOffset) {
+		FlushDrawBatch();
+		BindCurrentVertexArray();
+
 		GLenum renderTypeNative = ConvertRenderModeToNative(mode);
 
 		glDrawArrays(renderTypeNative, startOffset, count);
+
+		mStatistics->Add((FrameStatType)(FrameStatType::STAT_DRAWS_LINES + mode));
+		mStatistics->Add(FrameStatType::STAT_VERTICES, count);
 	}
 
 	void Context::RenderI(RenderMode mode, int count, int startOffset) {
+		if (mIsBatching) {
+			RenderI(mode, count, startOffset, 0);
+			return;
+		}
+
+		if (mCurrentState.Databuffer) startOffset += mCurrentState.Databuffer->IndicesFrameOffset();
+
+		BindCurrentVertexArray();
+
 		GLenum renderTypeNative = ConvertRenderModeToNative(mode);
 
-		glDrawElements(renderTypeNative, count, GL_UNSIGNED_INT, (const void*) startOffset);
+		glDrawElements(renderTypeNative, count, CurrentIndexTypeNative(), (const void*)(uintptr_t)startOffset);
+
+		mStatistics->Add((FrameStatType)(FrameStatType::STAT_DRAWS_LINES + mode));
+		mStatistics->Add(FrameStatType::STAT_INDICES, count);
 	}
 
 	void Context::RenderI(RenderMode mode, int count, int indicesOffset, int verticesOffset) {
+		if (mCurrentState.Databuffer) indicesOffset += mCurrentState.Databuffer->IndicesFrameOffset();
+
+		if (mIsBatching) {
+			if (mode != mDrawBatchMode || mDrawBatch->Full()) FlushDrawBatch();
+
+			mDrawBatchMode = mode;
+			mDrawBatch->Add(count, indicesOffset, verticesOffset, 1, CurrentIndexSize());
+			return;
+		}
+
+		BindCurrentVertexArray();
+
 		GLenum renderTypeNative = ConvertRenderModeToNative(mode);
 
-		glDrawElementsBaseVertex(renderTypeNative, count, GL_UNSIGNED_INT, (void*)indicesOffset, verticesOffset);
+		glDrawElementsBaseVertex(renderTypeNative, count, CurrentIndexTypeNative(), (const void*)(uintptr_t)indicesOffset, verticesOffset);
+
+		mStatistics->Add((FrameStatType)(FrameStatType::STAT_DRAWS_LINES + mode));
+		mStatistics->Add(FrameStatType::STAT_INDICES, count);
+	}
+
+	void Context::RenderIndirect(RenderMode mode, IndirectDrawBatch* batch) {
+		if (!batch || batch->Empty()) return;
+
+		// A user batch goes after the draws batched so far
+		if (batch != mDrawBatch) FlushDrawBatch();
+
+		BindCurrentVertexArray();
+
+		GLenum renderTypeNative = ConvertRenderModeToNative(mode);
+		FrameStatType drawStat = (FrameStatType)(FrameStatType::STAT_DRAWS_LINES + mode);
+
+		if (mSupportsMultiDrawIndirect) {
+			batch->Upload();
+
+			glMultiDrawElementsIndirect(renderTypeNative, CurrentIndexTypeNative(), (const void*)0, (GLsizei)batch->Size(), 0);
+
+			mStatistics->Add(drawStat);
+			mStatistics->Add(FrameStatType::STAT_MULTI_DRAW_COMMANDS, batch->Size());
+		}
+		else {
+			RenderIndirectFallback(renderTypeNative, batch);
+
+			mStatistics->Add(drawStat, batch->Size());
+		}
+
+		for (auto& command : batch->mCommands) {
+			mStatistics->Add(FrameStatType::STAT_INDICES, (unsigned long long)command.Count * command.InstanceCount);
+		}
+	}
+
+	void Context::RenderVInstanced(RenderMode mode, int count, int instanceCount, int startOffset, unsigned int baseInstance) {
+		if (instanceCount <= 0) return;
+
+		FlushDrawBatch();
+		BindCurrentVertexArray();
+
+		GLenum renderTypeNative = ConvertRenderModeToNative(mode);
+
+		if (baseInstance && mSupportsBaseInstance) glDrawArraysInstancedBaseInstance(renderTypeNative, startOffset, count, instanceCount, baseInstance);
+		else glDrawArraysInstanced(renderTypeNative, startOffset, count, instanceCount);
+
+		mStatistics->Add((FrameStatType)(FrameStatType::STAT_DRAWS_LINES + mode));
+		mStatistics->Add(FrameStatType::STAT_INSTANCED_DRAWS);
+		mStatistics->Add(FrameStatType::STAT_INSTANCES, instanceCount);
+		mStatistics->Add(FrameStatType::STAT_VERTICES, (unsigned long long)count * instanceCount);
+	}
+
+	void Context::RenderIInstanced(RenderMode mode, int count, int instanceCount, int indicesOffset, int verticesOffset, unsigned int baseInstance) {
+		if (instanceCount <= 0) return;
+
+		FlushDrawBatch();
+		BindCurrentVertexArray();
+
+		if (mCurrentState.Databuffer) indicesOffset += mCurrentState.Databuffer->IndicesFrameOffset();
+
+		GLenum renderTypeNative = ConvertRenderModeToNative(mode);
+
+		if (baseInstance && mSupportsBaseInstance) {
+			glDrawElementsInstancedBaseVertexBaseInstance(renderTypeNative, count, CurrentIndexTypeNative(), (const void*)(uintptr_t)indicesOffset, instanceCount, verticesOffset, baseInstance);
+		}
+		else {
+			glDrawElementsInstancedBaseVertex(renderTypeNative, count, CurrentIndexTypeNative(), (const void*)(uintptr_t)indicesOffset, instanceCount, verticesOffset);
+		}
+
+		mStatistics->Add((FrameStatType)(FrameStatType::STAT_DRAWS_LINES + mode));
+		mStatistics->Add(FrameStatType::STAT_INSTANCED_DRAWS);
+		mStatistics->Add(FrameStatType::STAT_INSTANCES, instanceCount);
+		mStatistics->Add(FrameStatType::STAT_INDICES, (unsigned long long)count * instanceCount);
+	}
+
+	void Context::RenderIndirectFallback(GLenum modeNative, IndirectDrawBatch* batch) {
+		GLenum indexType = CurrentIndexTypeNative();
+
+		for (auto& command : batch->mCommands) {
+			const void* indicesOffset = (const void*)(uintptr_t)(command.FirstIndex * CurrentIndexSize());
+
+			if (mSupportsBaseInstance) {
+				glDrawElementsInstancedBaseVertexBaseInstance(modeNative, command.Count, indexType, indicesOffset, command.InstanceCount, command.BaseVertex, command.BaseInstance);
+			}
+			else {
+				// Without base instance support the per draw data has to come from somewhere else, e.g. uniforms
+				glDrawElementsInstancedBaseVertex(modeNative, command.Count, indexType, indicesOffset, command.InstanceCount, command.BaseVertex);
+			}
+		}
+	}
+
+	void Context::BindCurrentVertexArray() {
+		// Bind-to-edit DataBuffer calls (uploads, attribute setup) bind their own vertex array and leave it there
+		if (mUseDirectStateAccess || !mCurrentState.Databuffer) return;
+
+		GLuint handle = mCurrentState.Databuffer->mArrayBufferHandle;
+		if (mStateManager->GetVertexArray() != handle) mStateManager->BindVertexArray(handle);
+	}
+
+	void Context::BeginDrawBatch(unsigned int maxDraws) {
+		if (mDrawBatch && mDrawBatch->mMaxDraws < maxDraws) {
+			FlushDrawBatch();
+
+			delete mDrawBatch;
+			mDrawBatch = nullptr;
+		}
+
+		if (!mDrawBatch) mDrawBatch = CreateIndirectDrawBatch(maxDraws);
+
+		mIsBatching = true;
+	}
+
+	void Context::EndDrawBatch() {
+		FlushDrawBatch();
+
+		mIsBatching = false;
+	}
+
+	void Context::FlushDrawBatch() {
+		if (!mIsBatching || mDrawBatch->Empty()) return;
+
+		RenderIndirect(mDrawBatchMode, mDrawBatch);
+		mDrawBatch->Clear();
+	}
+
+	GLenum Context::CurrentIndexTypeNative() {
+		return mCurrentState.Databuffer ? mCurrentState.Databuffer->IndexTypeNative() : GL_UNSIGNED_INT;
+	}
+
+	unsigned int Context::CurrentIndexSize() {
+		return mCurrentState.Databuffer ? mCurrentState.Databuffer->IndexSize() : sizeof(GLuint);
 	}
 
 	GLenum Context::ConvertRenderModeToNative(RenderMode mode) {
@@ -108,55 +678,63 @@ namespace Backend {
 	}
 
 	void Context::CreateDefaultRB(int w, int h, int defaultFBO) {
-		DefaultRenderBuffer = new RenderBuffer(w, h);
+		DefaultRenderBuffer = new RenderBuffer(this, w, h);
 		glDeleteFramebuffers(1, &DefaultRenderBuffer->mBufferHandle);
+		mStateManager->FramebufferDeleted(DefaultRenderBuffer->mBufferHandle);
 		DefaultRenderBuffer->mBufferHandle = defaultFBO;
+		DefaultRenderBuffer->mOwnsHandle = false;
 	}
 
 	void Context::SetShader(ShaderProgram* shader) {
-		if (shader != mCurrentState.Shader) {
-			if (shader) {
-				glUseProgram(shader->mProgramHandle);
-			}
-			else {
-				glUseProgram(0);
-			}
+		GLuint handle = shader ? shader->mProgramHandle : 0;
+
+		// Modules bind through the same state manager while editing, so the cached pointer alone isn't enough
+		if (shader != mCurrentState.Shader || mStateManager->GetShaderProgram() != handle) {
+			FlushDrawBatch();
 
+			mStateManager->BindShaderProgram(handle);
+
+			if (shader != mCurrentState.Shader) mCurrentState.Pipeline = nullptr;
 			mCurrentState.Shader = shader;
 		}
+		else {
+			// Stopped before the state manager, which would count it otherwise
+			mStatistics->Add(FrameStatType::STAT_SHADER_BINDS_SKIPPED);
+		}
 	}
 
 	void Context::BindTextures(const std::vector<std::pair<int, TextureBuffer*>>& textures) {
-		for (auto tex : textures) {
-			tex.second->BindForRendering(tex.first);
-
-			mBoundTextures[tex.first][tex.second->GetType()] = true;
+		for (auto& tex : textures) {
+			QueueTextureBind(tex.first, tex.second);
 		}
+
+		FlushTextureBinds();
 	}
 
 	void Context::UnbindAllTextures() {
-		for (int i = 0; i < 32;++i) {
-			for (int j = 0; j < 2; ++j) {
-				if (mBoundTextures[i][j]) {
-					glActiveTexture(GL_TEXTURE0 + i);
-					glBindTexture(TextureBuffer::TextureTypeConvertNative[j], 0);
-
-					mBoundTextures[i][j] = false;
-				}
+		FlushDrawBatch();
 
-			}
-		}
+		mStateManager->UnbindAllTextures();
 	}
 
 	void Context::UnbindTexturesByType(TextureType type) {
-		for (int i = 0; i < 32; ++i) {
-			if (mBoundTextures[i][type]) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(TextureBuffer::TextureTypeConvertNative[type], 0);
+		FlushDrawBatch();
 
-				mBoundTextures[i][type] = false;
-			}
-		}
+		mStateManager->UnbindTextures(TextureBuffer::TextureTypeConvertNative[type]);
+	}
+
+	void Context::QueueTextureBind(int unit, TextureBuffer* texture) {
+		if (!texture) return;
+
+		mStateManager->QueueTexture(unit, TextureBuffer::TextureTypeConvertNative[texture->GetType()], texture->GetNativeHandle());
+		mStateManager->QueueSampler(unit, texture->GetSampler()->GetNativeHandle());
+	}
+
+	void Context::FlushTextureBinds() {
+		if (!mStateManager->HasPendingTextures()) return;
+
+		FlushDrawBatch();
+		mStateManager->FlushTextures();
 	}
 
 	void Context::SetDefaultFramebufferInternalHandle(int handle) {
@@ -164,43 +742,64 @@ namespace Backend {
 	}
 
 	void Context::SetDatabuffer(DataBuffer* buffer, bool forceSet) {
-		if (buffer != mCurrentState.Databuffer || forceSet) {
+		GLuint handle = buffer ? buffer->mArrayBufferHandle : 0;
+
+		if (buffer != mCurrentState.Databuffer || mStateManager->GetVertexArray() != handle || forceSet) {
+			FlushDrawBatch();
+
 			if (buffer == nullptr) {
-				glBindVertexArray(0);
-				glBindBuffer(GL_ARRAY_BUFFER, 0);
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+				mStateManager->BindVertexArray(0);
+				mStateManager->BindBuffer(GL_ARRAY_BUFFER, 0);
 			}
 			else {
-				glBindVertexArray(buffer->mArrayBufferHandle);
-				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->mIndicesSlotHandle);
-
-				mCurrentState.Databuffer = buffer;
+				mStateManager->BindVertexArray(buffer->mArrayBufferHandle);
+				mStateManager->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer->mIndicesSlotHandle);
 			}
+
+			// Pipelines without a vertex layout stay valid whatever DataBuffer is bound
+			if (buffer != mCurrentState.Databuffer && mCurrentState.Pipeline && mCurrentState.Pipeline->Description().Databuffer) mCurrentState.Pipeline = nullptr;
+			mCurrentState.Databuffer = buffer;
+		}
+		else {
+			mStatistics->Add(FrameStatType::STAT_VAO_BINDS_SKIPPED);
 		}
 	}
 
 	void Context::BindTextures(const std::vector<TextureBindKey>& textures) {
 		for (auto& key : textures) {
 			mCurrentState.Shader->SetInt(key.UniformName, key.Slot);
-			key.Texture->BindForRendering(key.Slot);
-
-			mBoundTextures[key.Slot][key.Texture->GetType()] = true;
+			QueueTextureBind(key.Slot, key.Texture);
 		}
+
+		FlushTextureBinds();
 	}
 	
 	void Context::SetRenderbuffer(RenderBuffer* rb, bool setAnyway) {
 		if (!rb) rb = DefaultRenderBuffer;
 
 		if (setAnyway || rb != mCurrentState.Renderbuffer) {
+			FlushDrawBatch();
+
 			SetViewport({ rb->GetWidth(), rb->GetHeight() });
 
 			rb->Bind();
 
 			mCurrentState.Renderbuffer = rb;
 		}
+		else if (mStateManager->GetReadFramebuffer() != rb->mBufferHandle || mStateManager->GetDrawFramebuffer() != rb->mBufferHandle) {
+			// Something like Copy or AddSlot rebound the framebuffer behind our back
+			FlushDrawBatch();
+
+			rb->Bind();
+		}
+		else {
+			mStatistics->Add(FrameStatType::STAT_FBO_BINDS_SKIPPED);
+		}
 	}
 
 	void Context::ClearBuffer(bool clearColor, bool clearDepth, bool clearStencil) {
+		FlushDrawBatch();
+
 		GLbitfield clearMaskNative = 0;
 		if (clearColor) clearMaskNative = clearMaskNative | GL_COLOR_BUFFER_BIT;
 		if (clearDepth) clearMaskNative = clearMaskNative | GL_DEPTH_BUFFER_BIT;
@@ -210,64 +809,90 @@ namespace Backend {
 	}
 
 	void Context::SetClearColor(float r, float g, float b, float a) {
-		glClearColor(r, g, b, a);
+		mStateManager->SetClearColor(r, g, b, a);
 	}
 
 	void Context::SetCullMode(CullingMode mode) {
 		if (mode != mCurrentState.CullMode) {
+			FlushDrawBatch();
+
 			if (mode == CullingMode::CULL_NONE) {
-				glDisable(GL_CULL_FACE);
+				mStateManager->SetCapability(GL_CULL_FACE, false);
 			}
 			else {
-				if (mCurrentState.CullMode == CullingMode::CULL_NONE) glEnable(GL_CULL_FACE);
+				mStateManager->SetCapability(GL_CULL_FACE, true);
 
-				if (mode == CullingMode::CULL_BACK) glCullFace(GL_BACK);
-				else if (mode == CullingMode::CULL_FRONT) glCullFace(GL_FRONT);
-				else if (mode == CullingMode::CULL_FRONT_AND_BACK) glCullFace(GL_FRONT_AND_BACK);
+				if (mode == CullingMode::CULL_BACK) mStateManager->SetCullFace(GL_BACK);
+				else if (mode == CullingMode::CULL_FRONT) mStateManager->SetCullFace(GL_FRONT);
+				else if (mode == CullingMode::CULL_FRONT_AND_BACK) mStateManager->SetCullFace(GL_FRONT_AND_BACK);
 				else return;
 			}
 
 			mCurrentState.CullMode = mode;
+			mCurrentState.Pipeline = nullptr;
 		}
 	}
 
 	void Context::SetBlendMode(BlendingMode mode) {
 		if (mode != mCurrentState.BlendMode) {
+			FlushDrawBatch();
+
 			if (mode == BlendingMode::BLEND_NONE) {
-				glDisable(GL_BLEND);
+				mStateManager->SetCapability(GL_BLEND, false);
 			}
 			else {
-				if (mCurrentState.BlendMode == BlendingMode::BLEND_NONE) glEnable(GL_BLEND);
+				mStateManager->SetCapability(GL_BLEND, true);
 
-				if (mode == BlendingMode::BLEND_DEFAULT) glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+				if (mode == BlendingMode::BLEND_DEFAULT) mStateManager->SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 				else return;
 			}
 
 			mCurrentState.BlendMode = mode;
+			mCurrentState.Pipeline = nullptr;
 		}
 	}
 
 	void Context::SetDepthMode(DepthTestMode mode) {
 		if (mode != mCurrentState.DepthMode) {
+			FlushDrawBatch();
+
 			if (mode == DepthTestMode::DEPTH_OFF) {
-				glDisable(GL_DEPTH_TEST);
+				mStateManager->SetCapability(GL_DEPTH_TEST, false);
 			}
 			else {
-				if (mCurrentState.DepthMode == DepthTestMode::DEPTH_OFF) glEnable(GL_DEPTH_TEST);
+				mStateManager->SetCapability(GL_DEPTH_TEST, true);
 
-				if (mode == DepthTestMode::DEPTH_READ_ONLY) glDepthMask(GL_FALSE);
-				else if (mode == DepthTestMode::DEPTH_READ_WRITE) glDepthMask(GL_TRUE);
+				if (mode == DepthTestMode::DEPTH_READ_ONLY) mStateManager->SetDepthMask(false);
+				else if (mode == DepthTestMode::DEPTH_READ_WRITE) mStateManager->SetDepthMask(true);
 				else return;
 			}
 
 			mCurrentState.DepthMode = mode;
+			mCurrentState.Pipeline = nullptr;
 		}
 	}
 
+	void Context::SetPipeline(PipelineState* pipeline) {
+		if (!pipeline || pipeline == mCurrentState.Pipeline) return;
+
+		unsigned int mask = pipeline->Diff(mCurrentState.Pipeline);
+		const PipelineDescription& description = pipeline->Description();
+
+		if (mask & PipelineStateField::PIPELINE_CULL) SetCullMode(description.CullMode);
+		if (mask & PipelineStateField::PIPELINE_BLEND) SetBlendMode(description.BlendMode);
+		if (mask & PipelineStateField::PIPELINE_DEPTH) SetDepthMode(description.DepthMode);
+		if (mask & PipelineStateField::PIPELINE_SHADER) SetShader(description.Shader);
+		if ((mask & PipelineStateField::PIPELINE_VERTEX_LAYOUT) && description.Databuffer) SetDatabuffer(description.Databuffer);
+
+		mCurrentState.Pipeline = pipeline;
+	}
+
 	void Context::SetViewport(SViewport viewport, bool forceSet) {
 		if (viewport != mCurrentState.Viewport || forceSet) {
+			FlushDrawBatch();
+
 			mCurrentState.Viewport = viewport;
-			glViewport(0, 0, viewport.Width, viewport.Height);
+			mStateManager->SetViewport(0, 0, viewport.Width, viewport.Height);
 		}
 	}
 
@@ -12,6 +12,26 @@ namespace Backend {
 	class ShaderProgram;
 	class RenderBuffer;
 	class TextureBuffer;
+	class CommandBuffer;
+	class IndirectDrawBatch;
+	class UniformBufferRing;
+	class TextureArrayAtlas;
+	class InternalStateManager;
+	class PipelineState;
+	class GpuProfiler;
+	class FrameStatistics;
+	class TextureStreamer;
+	class ProgramBinaryCache;
+	class ShaderLibrary;
+	class RenderTargetPool;
+	class FrameGraph;
+	class InstanceBatcher;
+	class GeometryPool;
+	class Sampler;
+	struct RenderTargetDesc;
+	struct UniformAllocation;
+	struct PipelineDescription;
+	struct SamplerDescription;
 
 	enum TextureType;
 
@@ -62,10 +82,12 @@ namespace Backend {
 				RenderBuffer* Renderbuffer;
 				DataBuffer* Databuffer;
 				SViewport Viewport;
+				PipelineState* Pipeline; // last pipeline applied, reset when one of its fields is changed on its own
 
 				ContextState() {
 					Shader = nullptr;
 					Databuffer = nullptr;
+					Pipeline = nullptr;
 				}
 
 				void operator=(const ContextState& other) {
@@ -76,20 +98,50 @@ namespace Backend {
 					Renderbuffer = other.Renderbuffer;
 					Databuffer = other.Databuffer;
 					Viewport = other.Viewport;
+					Pipeline = other.Pipeline;
 				}
 			};
 
+			// Saving only keeps the pipeline id, the rest is what a pipeline doesn't cover
+			struct SavedState {
+				unsigned int PipelineId;
+				DataBuffer* Databuffer;
+				RenderBuffer* Renderbuffer;
+				SViewport Viewport;
+			};
+
+		public:
+			static const unsigned int FRAMES_IN_FLIGHT = 3;
+
 		public:
-			Context(int screenWidth, int screenHeight, int defaultFBO = 0);
-			~Context() { }
+			// Resources are edited through direct state access (GL 4.5 / ARB_direct_state_access) when available and allowed,
+			// otherwise they are bound to be edited. The choice is fixed for the lifetime of the context
+			Context(int screenWidth, int screenHeight, int defaultFBO = 0, bool allowDirectStateAccess = true);
+			~Context();
 
 			RenderBuffer* DefaultRenderBuffer;
 
 			// Factory
 			RenderBuffer* CreateRenderBuffer(int w, int h);
 			ShaderProgram* CreateShaderProgram();
+			ShaderLibrary* CreateShaderLibrary();
 			DataBuffer* CreateDataBuffer();
 			TextureBuffer* CreateTextureBuffer(TextureType type = TextureType::TEXTURE_STANDARD);
+			CommandBuffer* CreateCommandBuffer(unsigned int initialCapacity = 64 * 1024);
+			IndirectDrawBatch* CreateIndirectDrawBatch(unsigned int maxDraws = 1024);
+			TextureArrayAtlas* CreateTextureArrayAtlas(int layersPerArray = 64, bool mipmapped = false);
+			InstanceBatcher* CreateInstanceBatcher(unsigned int instanceStride, unsigned int maxInstancesPerFrame = 4096);
+			GeometryPool* CreateGeometryPool(unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity);
+			FrameGraph* CreateFrameGraph();
+
+			// Pipelines are owned by the Context and deduplicated, an equal description returns the existing object
+			PipelineState* CreatePipelineState(const PipelineDescription& description);
+			PipelineState* GetPipelineState(unsigned int id);
+			unsigned int GetPipelinesCount() { return (unsigned int)mPipelines.size(); }
+
+			// Samplers are deduplicated the same way, textures pick theirs from here when they are bound
+			Sampler* CreateSampler(const SamplerDescription& description);
+			unsigned int GetSamplersCount() { return (unsigned int)mSamplers.size(); }
 
 			// State setup and history
 			void SaveState();
@@ -98,12 +150,37 @@ namespace Backend {
 			void FrameBegin();
 			void FrameEnd();
 
+			// Profiling, scopes nest and are resolved a few frames later (see GpuProfiler)
+			void BeginGpuScope(const std::string& name);
+			void EndGpuScope();
+
+			GpuProfiler* Profiler() { return mProfiler; }
+
+			// Counters of the last N frames
+			FrameStatistics* Statistics() { return mStatistics; }
+
+			// Region of the persistently mapped buffers owned by the current frame, guarded by a fence until the GPU is done with it
+			unsigned int FrameRegion() { return (unsigned int)(mFrameCount % FRAMES_IN_FLIGHT); }
+			unsigned long long FrameCount() { return mFrameCount; }
+
+			bool SupportsBaseInstance() { return mSupportsBaseInstance; }
+			bool SupportsBufferStorage() { return mSupportsBufferStorage; } // STREAM_PERSISTENT falls back to STREAM_ORPHAN without it
+			bool SupportsProgramUniform() { return mSupportsProgramUniform; } // glProgramUniform*, uniforms written without binding the program
+			bool UsesDirectStateAccess() { return mUseDirectStateAccess; }
+			unsigned int MaxUniformBufferBindings() { return mMaxUniformBufferBindings; }
+
 			// Mode stuff
 			void SetCullMode(CullingMode mode);
 			void SetBlendMode(BlendingMode mode);
 			void SetDepthMode(DepthTestMode mode);
 			void SetViewport(SViewport viewport, bool forceSet = false);
 
+			// Only issues the GL calls for the fields that differ from the current pipeline
+			void SetPipeline(PipelineState* pipeline);
+			void SetPipeline(unsigned int id) { SetPipeline(GetPipelineState(id)); }
+
+			PipelineState* Pipeline() { return mCurrentState.Pipeline; }
+
 			CullingMode CullMode() { return mCurrentState.CullMode; }
 			BlendingMode BlendMode() { return mCurrentState.BlendMode; }
 			DepthTestMode DepthMode() { return mCurrentState.DepthMode; }
@@ -112,9 +189,22 @@ namespace Backend {
 			// Rendering stuff
 			void SetDatabuffer(DataBuffer* buffer, bool forceSet = false);
 
+			DataBuffer* Databuffer() { return mCurrentState.Databuffer; }
+
 			void RenderV(RenderMode mode, int count, int startOffset = 0);
 			void RenderI(RenderMode mode, int count, int startOffset = 0);
 			void RenderI(RenderMode mode, int count, int indicesOffset, int verticesOffset);
+			void RenderIndirect(RenderMode mode, IndirectDrawBatch* batch);
+
+			// Attributes with an instance divisor advance per instance, starting at baseInstance (ignored without ARB_base_instance)
+			void RenderVInstanced(RenderMode mode, int count, int instanceCount, int startOffset = 0, unsigned int baseInstance = 0);
+			void RenderIInstanced(RenderMode mode, int count, int instanceCount, int indicesOffset = 0, int verticesOffset = 0, unsigned int baseInstance = 0);
+
+			// While batching, RenderI calls are collected and flushed as one multi draw on the next state change,
+			// uniform changes included. Per draw data that should stay batched belongs in base instance attributes or a storage buffer
+			void BeginDrawBatch(unsigned int maxDraws = 1024);
+			void EndDrawBatch();
+			void FlushDrawBatch();
 
 			void BindTextures(const std::vector<std::pair<int, TextureBuffer*>>& textures);
 			void BindTextures(const TextureBindVector& textures);
@@ -124,6 +214,9 @@ namespace Backend {
 
 			void SetDefaultFramebufferInternalHandle(int handle);
 
+			// Shadow of the GL state, every module binds through it
+			InternalStateManager* StateManager() { return mStateManager; }
+
 			// Render buffer stuff
 			void SetRenderbuffer(RenderBuffer* rb, bool setAnyway = false);
 			void SetClearColor(float r, float g, float b, float a);
@@ -131,24 +224,105 @@ namespace Backend {
 
 			RenderBuffer* Renderbuffer() { return mCurrentState.Renderbuffer; }
 
+			// Temporary targets for the current frame, all of them go back to the pool at FrameEnd
+			RenderBuffer* AcquireRenderTarget(const RenderTargetDesc& desc);
+			void ReleaseRenderTarget(RenderBuffer* target);
+			RenderTargetPool* GetRenderTargetPool() { return mRenderTargetPool; }
+
 			// Shader stuff
 			void SetShader(ShaderProgram* shader);
 
 			ShaderProgram* Shader() { return mCurrentState.Shader; }
-			
+
+			// Submits every stage and link of the batch before asking anything, so the driver can compile them in parallel
+			// (KHR_parallel_shader_compile). Programs become ready over the next frames, check ShaderProgram::IsReady before drawing
+			void CompileProgramsAsync(const std::vector<ShaderProgram*>& programs);
+			void UpdateCompilingPrograms(); // called at FrameBegin
+			unsigned int GetCompilingProgramsCount() { return (unsigned int)mCompilingPrograms.size(); }
+
+			// Linked programs are cached on disk once a directory is set, the directory has to exist
+			void SetProgramCacheDirectory(const std::string& directory);
+			ProgramBinaryCache* GetProgramCache() { return mProgramCache; }
+
+			// Uniform blocks, sub-allocated from a per frame ring and shared by every program using the same binding point
+			void ReserveUniformRing(unsigned int sizePerFrame);
+			UniformAllocation AllocateUniforms(unsigned int size);
+			void BindUniformBlock(unsigned int binding, const UniformAllocation& allocation);
+			bool UploadUniformBlock(unsigned int binding, const void* dataPtr, unsigned int dataSize);
+
+			template<typename T>
+			bool UploadUniformBlock(unsigned int binding, const T& data) { return UploadUniformBlock(binding, &data, sizeof(T)); }
+
+			// Asynchronous texture uploads, workers write into staging memory and the uploads are issued at FrameBegin.
+			// The streamer is created on first use, get it on the GL thread before handing it to workers
+			void ReserveTextureStreaming(unsigned int stagingSize, unsigned int bytesPerFrame = 8 * 1024 * 1024);
+			TextureStreamer* GetTextureStreamer();
+
+			// Command buffers, replayed in order on the thread owning the GL context
+			void ExecuteCommandBuffer(CommandBuffer* commandBuffer);
+			void ExecuteCommandBuffers(const std::vector<CommandBuffer*>& commandBuffers);
+
 
 		protected:
 			GLenum ConvertRenderModeToNative(RenderMode mode);
 
+			// Index type of the bound DataBuffer
+			GLenum CurrentIndexTypeNative();
+			unsigned int CurrentIndexSize();
+
 			void CreateDefaultRB(int w, int h, int defaultFBO);
+
+			void QueueTextureBind(int unit, TextureBuffer* texture);
+			void FlushTextureBinds();
+
+			void RenderIndirectFallback(GLenum modeNative, IndirectDrawBatch* batch);
+			void BindCurrentVertexArray(); // the draws put the current DataBuffer's vertex array back if an edit replaced it
+
+			PipelineState* CapturePipeline();
+
+			void CancelProgramCompile(ShaderProgram* program);
+			void CancelTextureStreams(TextureBuffer* texture);
 			//void CheckStateChanges();
 
 
 		protected:
 			ContextState mCurrentState;
 
-			std::vector<ContextState> mSavedStates;
-			bool mBoundTextures[32][2];
+			std::vector<SavedState> mSavedStates;
+
+			std::vector<PipelineState*> mPipelines; // id - 1
+			std::map<unsigned long long, std::vector<PipelineState*>> mPipelineLookup;
+			std::vector<Sampler*> mSamplers;
+			std::map<unsigned long long, std::vector<Sampler*>> mSamplerLookup;
+			InternalStateManager* mStateManager;
+			GpuProfiler* mProfiler;
+			FrameStatistics* mStatistics;
+
+			UniformBufferRing* mUniformRing;
+			TextureStreamer* mTextureStreamer;
+			ProgramBinaryCache* mProgramCache;
+			RenderTargetPool* mRenderTargetPool;
+
+			GLsync mFrameFences[FRAMES_IN_FLIGHT];
+			unsigned long long mFrameCount;
+
+			IndirectDrawBatch* mDrawBatch;
+			RenderMode mDrawBatchMode;
+			bool mIsBatching;
+			bool mSupportsMultiDrawIndirect, mSupportsBaseInstance;
+			bool mSupportsParallelCompile;
+			bool mSupportsBufferStorage;
+			bool mSupportsProgramUniform;
+			bool mUseDirectStateAccess;
+			unsigned int mMaxUniformBufferBindings;
+
+			std::vector<ShaderProgram*> mCompilingPrograms;
+
+			std::vector<std::pair<int, TextureBuffer*>> mReplayTextures;
+			std::string mReplayUniformName;
+
+			friend class ShaderProgram;
+			friend class TextureBuffer;
 
 	};
 
@@ -1,58 +1,99 @@
 #include "DataBuffer.h"
 #include "Context.h"
+#include "InternalStateManager.h"
+#include "FrameStatistics.h"
 
 namespace Backend {
 
-	DataBuffer::DataBuffer() {
-		glGenVertexArrays(1, &mArrayBufferHandle);
+	DataBuffer::DataBuffer(Context* context) {
+		mContext = context;
+
+		if (mContext->UsesDirectStateAccess()) glCreateVertexArrays(1, &mArrayBufferHandle);
+		else glGenVertexArrays(1, &mArrayBufferHandle);
 
 		mIndicesSlotHandle = 0;
 		mDynamicIndices = false;
+		mIndicesStreamingMode = StreamingMode::STREAM_SUBDATA;
+		mIndicesReservedSize = 0;
+		mIndexType = IndexType::INDEX_UINT;
 
 		mAttributeCount = 0;
 	}
 
 	DataBuffer::~DataBuffer() {
+		InternalStateManager* stateManager = mContext->StateManager();
+
+		stateManager->VertexArrayDeleted(mArrayBufferHandle);
 		glDeleteVertexArrays(1, &mArrayBufferHandle);
 
+		if (mIndicesSlotHandle) {
+			stateManager->BufferDeleted(mIndicesSlotHandle);
+			glDeleteBuffers(1, &mIndicesSlotHandle);
+		}
+
 		for (auto key : mSlots) {
 			delete key.second;
 		}
 	}
 
-	void DataBuffer::ReserveIndices(unsigned int size) {
+	void DataBuffer::ReserveIndices(unsigned int size, StreamingMode streamingMode) {
+		if (streamingMode == StreamingMode::STREAM_PERSISTENT && !mContext->SupportsBufferStorage()) streamingMode = StreamingMode::STREAM_ORPHAN;
+
 		mDynamicIndices = true;
+		mIndicesStreamingMode = streamingMode;
+		mIndicesReservedSize = size;
 
-		if (!mIndicesSlotHandle) glGenBuffers(1, &mIndicesSlotHandle);
+		if (streamingMode == StreamingMode::STREAM_PERSISTENT) {
+			CreateMappedStorage(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle, mIndicesMapped, size);
+			AttachIndices();
+			return;
+		}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, 0, GL_DYNAMIC_DRAW);
+		if (!mIndicesSlotHandle) {
+			CreateBufferHandle(mIndicesSlotHandle);
+			AttachIndices();
+		}
+
+		BufferData(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle, size, 0, GL_DYNAMIC_DRAW);
 	}
 
 	void DataBuffer::UploadIndices(const void* indicesPtr, unsigned int dataSize, unsigned int dataOffset) {
 		if (dataSize == 0) return;
 
-		Bind();
+		mContext->Statistics()->Add(FrameStatType::STAT_BUFFER_BYTES_UPLOADED, dataSize);
 
-		if (!mIndicesSlotHandle) glGenBuffers(1, &mIndicesSlotHandle);
+		// Persistent indices are written straight into the mapped region of this frame, no GL call needed
+		if (mIndicesMapped.Ptr) {
+			if (dataOffset + dataSize > mIndicesMapped.RegionSize) return;
+
+			mIndicesMapped.CurrentRegion = GetFrameRegion();
+			memcpy(mIndicesMapped.Ptr + mIndicesMapped.CurrentOffset() + dataOffset, indicesPtr, dataSize);
+			return;
+		}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle);
+		if (!mIndicesSlotHandle) {
+			CreateBufferHandle(mIndicesSlotHandle);
+			AttachIndices();
+		}
 
 		if (!mDynamicIndices) {
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, dataSize, indicesPtr, GL_STATIC_DRAW);
+			BufferData(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle, dataSize, indicesPtr, GL_STATIC_DRAW);
 		}
 		else {
-			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, dataOffset, dataSize, indicesPtr);
+			// Orphan the old storage when a new frame starts writing, so we don't wait on draws still using it
+			if (mIndicesStreamingMode == StreamingMode::STREAM_ORPHAN && dataOffset == 0) {
+				BufferData(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle, std::max(mIndicesReservedSize, dataSize), 0, GL_STREAM_DRAW);
+			}
+
+			BufferSubData(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle, dataOffset, dataSize, indicesPtr);
 		}
 
 	}
 
-	BufferSlot* DataBuffer::AddBufferSlot(const std::string& name, bool dynamicSlot) {
+	BufferSlot* DataBuffer::AddBufferSlot(const std::string& name, bool dynamicSlot, StreamingMode streamingMode) {
 		if (name.empty()) return nullptr;
 
-		Bind();
-		
-		BufferSlot* bufPtr = new BufferSlot(this, dynamicSlot);
+		BufferSlot* bufPtr = new BufferSlot(this, dynamicSlot, streamingMode);
 		mSlots.insert({ name, bufPtr });
 
 		return bufPtr;
@@ -64,24 +105,124 @@ namespace Backend {
 		return mSlots[name];
 	}
 
+	void DataBuffer::Bind() {
+		mContext->StateManager()->BindVertexArray(mArrayBufferHandle);
+	}
+
+	unsigned int DataBuffer::GetFrameRegion() {
+		return mContext->FrameRegion();
+	}
+
+	unsigned char* DataBuffer::CreateMappedStorage(GLenum target, GLuint& handle, MappedRegions& mapped, unsigned int regionSize) {
+		InternalStateManager* stateManager = mContext->StateManager();
+
+		// Immutable storage can't be resized, so every reserve gets a new buffer
+		if (handle) {
+			stateManager->BufferDeleted(handle);
+			glDeleteBuffers(1, &handle);
+		}
+		CreateBufferHandle(handle);
+
+		regionSize = (regionSize + 255) & ~255u;
+		GLsizeiptr totalSize = (GLsizeiptr)regionSize * Context::FRAMES_IN_FLIGHT;
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		if (mContext->UsesDirectStateAccess()) {
+			glNamedBufferStorage(handle, totalSize, 0, flags);
+			mapped.Ptr = (unsigned char*)glMapNamedBufferRange(handle, 0, totalSize, flags);
+		}
+		else {
+			if (target == GL_ELEMENT_ARRAY_BUFFER) Bind();
+
+			stateManager->BindBuffer(target, handle);
+			glBufferStorage(target, totalSize, 0, flags);
+			mapped.Ptr = (unsigned char*)glMapBufferRange(target, 0, totalSize, flags);
+		}
+
+		mapped.RegionSize = regionSize;
+		mapped.CurrentRegion = 0;
+
+		return mapped.Ptr;
+	}
+
+	void DataBuffer::CreateBufferHandle(GLuint& handle) {
+		if (mContext->UsesDirectStateAccess()) glCreateBuffers(1, &handle);
+		else glGenBuffers(1, &handle);
+	}
+
+	void DataBuffer::BufferData(GLenum target, GLuint handle, GLsizeiptr size, const void* dataPtr, GLenum usage) {
+		if (mContext->UsesDirectStateAccess()) {
+			glNamedBufferData(handle, size, dataPtr, usage);
+			return;
+		}
+
+		// The element buffer binding is part of the vertex array state
+		if (target == GL_ELEMENT_ARRAY_BUFFER) Bind();
+
+		mContext->StateManager()->BindBuffer(target, handle);
+		glBufferData(target, size, dataPtr, usage);
+	}
+
+	void DataBuffer::BufferSubData(GLenum target, GLuint handle, GLintptr offset, GLsizeiptr size, const void* dataPtr) {
+		if (mContext->UsesDirectStateAccess()) {
+			glNamedBufferSubData(handle, offset, size, dataPtr);
+			return;
+		}
+
+		if (target == GL_ELEMENT_ARRAY_BUFFER) Bind();
+
+		mContext->StateManager()->BindBuffer(target, handle);
+		glBufferSubData(target, offset, size, dataPtr);
+	}
+
+	void DataBuffer::AttachIndices() {
+		if (mContext->UsesDirectStateAccess()) {
+			glVertexArrayElementBuffer(mArrayBufferHandle, mIndicesSlotHandle);
+			mContext->StateManager()->VertexArrayElementBufferSet(mArrayBufferHandle, mIndicesSlotHandle);
+			return;
+		}
+
+		Bind();
+		mContext->StateManager()->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mIndicesSlotHandle);
+	}
+
 	BufferSlot::~BufferSlot() {
+		mParentObject->mContext->StateManager()->BufferDeleted(mBufferHandle);
 		glDeleteBuffers(1, &mBufferHandle);
 	}
 
 	BufferSlot* BufferSlot::UploadData(const void* dataPtr, unsigned int dataSize, int dataOffset) {
-		glBindBuffer(GL_ARRAY_BUFFER, mBufferHandle);
+		mParentObject->mContext->Statistics()->Add(FrameStatType::STAT_BUFFER_BYTES_UPLOADED, dataSize);
+
+		if (mMapped.Ptr) {
+			if (dataOffset + dataSize > mMapped.RegionSize) return this;
+
+			unsigned int region = mParentObject->GetFrameRegion();
+			if (region != mMapped.CurrentRegion) {
+				mMapped.CurrentRegion = region;
+				BindDescriptorsToRegion();
+			}
+
+			memcpy(mMapped.Ptr + mMapped.CurrentOffset() + dataOffset, dataPtr, dataSize);
+
+			return this;
+		}
 
 		if (mIsDynamicSlot) {
-			glBufferSubData(GL_ARRAY_BUFFER, dataOffset, dataSize, dataPtr);
+			if (mStreamingMode == StreamingMode::STREAM_ORPHAN && dataOffset == 0) {
+				mParentObject->BufferData(GL_ARRAY_BUFFER, mBufferHandle, std::max(mReservedSize, dataSize), 0, GL_STREAM_DRAW);
+			}
+
+			mParentObject->BufferSubData(GL_ARRAY_BUFFER, mBufferHandle, dataOffset, dataSize, dataPtr);
 		}
 		else {
-			glBufferData(GL_ARRAY_BUFFER, dataSize, dataPtr, GL_STATIC_DRAW);
+			mParentObject->BufferData(GL_ARRAY_BUFFER, mBufferHandle, dataSize, dataPtr, GL_STATIC_DRAW);
 		}
 
 		return this;
 	}
 
-	BufferSlot* BufferSlot::AddDescriptor(int componentsCount, BufferDataType dataType, int blockSize, const void* startingOffset, int instanceDivisor) {
+	BufferSlot* BufferSlot::AddDescriptor(int componentsCount, BufferDataType dataType, int blockSize, const void* startingOffset, int instanceDivisor, bool normalized) {
 		if (mParentObject->mAttributeCount > 15) return this; // failsafe
 
 		BufferSlotDescriptor descriptor;
@@ -91,25 +232,18 @@ namespace Backend {
 		descriptor.mOffset = startingOffset;
 		descriptor.mInstanceDivisor = instanceDivisor;
 		descriptor.mDataType = dataType;
+		descriptor.mNormalized = normalized && dataType != BufferDataType::DATA_FLOAT && dataType != BufferDataType::DATA_HALF;
 
-		GLenum dataTypeNative;
-		if (dataType == BufferDataType::DATA_INT) dataTypeNative = GL_INT;
-		else dataTypeNative = GL_FLOAT;
-
-		glEnableVertexArrayAttrib(mParentObject->mArrayBufferHandle, descriptor.mID);
-
-		glBindBuffer(GL_ARRAY_BUFFER, mBufferHandle);
-
-		// For integer values, a different attrib setting method is used
-		if (dataType == BufferDataType::DATA_INT) {
-			glVertexAttribIPointer(descriptor.mID, descriptor.mComponentsCount, dataTypeNative, descriptor.mBlockSize, descriptor.mOffset);
+		if (mParentObject->mContext->UsesDirectStateAccess()) {
+			glEnableVertexArrayAttrib(mParentObject->mArrayBufferHandle, descriptor.mID);
 		}
-		// For float values, we use the basic method
 		else {
-			glVertexAttribPointer(descriptor.mID, descriptor.mComponentsCount, dataTypeNative, GL_FALSE, descriptor.mBlockSize, descriptor.mOffset);
+			mParentObject->Bind();
+			glEnableVertexAttribArray(descriptor.mID);
 		}
 
-		if (descriptor.mInstanceDivisor) glVertexAttribDivisor(descriptor.mID, descriptor.mInstanceDivisor);
+		// Persistent slots read from the region of the current frame
+		SpecifyAttribute(descriptor, (mMapped.Ptr ? mMapped.CurrentOffset() : 0) + (GLintptr)descriptor.mOffset);
 
 		mDescriptors.push_back(descriptor);
 
@@ -119,18 +253,98 @@ namespace Backend {
 	BufferSlot* BufferSlot::ReserveSpace(unsigned int size) {
 		if (!size || !mIsDynamicSlot) return this;
 
-		glBindBuffer(GL_ARRAY_BUFFER, mBufferHandle);
-		glBufferData(GL_ARRAY_BUFFER, size, 0, GL_DYNAMIC_DRAW);
+		mReservedSize = size;
+
+		if (mStreamingMode == StreamingMode::STREAM_PERSISTENT) {
+			mParentObject->CreateMappedStorage(GL_ARRAY_BUFFER, mBufferHandle, mMapped, size);
+			BindDescriptorsToRegion();
+
+			return this;
+		}
+
+		mParentObject->BufferData(GL_ARRAY_BUFFER, mBufferHandle, size, 0, GL_DYNAMIC_DRAW);
 
 		return this;
 	}
 
-	BufferSlot::BufferSlot(DataBuffer* parent, bool dynamicSlot) {
+	void BufferSlot::BindDescriptorsToRegion() {
+		GLintptr regionOffset = mMapped.CurrentOffset();
+
+		for (auto& descriptor : mDescriptors) {
+			SpecifyAttribute(descriptor, regionOffset + (GLintptr)descriptor.mOffset);
+		}
+	}
+
+	void BufferSlot::SpecifyAttribute(BufferSlotDescriptor& descriptor, GLintptr bufferOffset) {
+		GLenum dataTypeNative = BufferSlotDescriptor::GetDataTypeNative(descriptor.mDataType);
+		GLboolean normalized = descriptor.mNormalized ? GL_TRUE : GL_FALSE;
+
+		// With DSA every attribute gets the vertex buffer binding of the same index, like glVertexAttribPointer does
+		if (mParentObject->mContext->UsesDirectStateAccess()) {
+			GLuint vertexArray = mParentObject->mArrayBufferHandle;
+			GLsizei stride = descriptor.mBlockSize ? descriptor.mBlockSize : descriptor.Size();
+
+			if (descriptor.mDataType == BufferDataType::DATA_INT) glVertexArrayAttribIFormat(vertexArray, descriptor.mID, descriptor.mComponentsCount, dataTypeNative, 0);
+			else glVertexArrayAttribFormat(vertexArray, descriptor.mID, descriptor.mComponentsCount, dataTypeNative, normalized, 0);
+
+			glVertexArrayAttribBinding(vertexArray, descriptor.mID, descriptor.mID);
+			glVertexArrayVertexBuffer(vertexArray, descriptor.mID, mBufferHandle, bufferOffset, stride);
+			glVertexArrayBindingDivisor(vertexArray, descriptor.mID, descriptor.mInstanceDivisor);
+			return;
+		}
+
+		// The attribute pointers are recorded in whatever vertex array is bound
+		mParentObject->Bind();
+		mParentObject->mContext->StateManager()->BindBuffer(GL_ARRAY_BUFFER, mBufferHandle);
+
+		// For integer values, a different attrib setting method is used
+		if (descriptor.mDataType == BufferDataType::DATA_INT) {
+			glVertexAttribIPointer(descriptor.mID, descriptor.mComponentsCount, dataTypeNative, descriptor.mBlockSize, (const void*)bufferOffset);
+		}
+		// For float values, we use the basic method, it also converts the small and packed types
+		else {
+			glVertexAttribPointer(descriptor.mID, descriptor.mComponentsCount, dataTypeNative, normalized, descriptor.mBlockSize, (const void*)bufferOffset);
+		}
+
+		if (descriptor.mInstanceDivisor) glVertexAttribDivisor(descriptor.mID, descriptor.mInstanceDivisor);
+	}
+
+	int BufferSlotDescriptor::GetDataTypeSize(BufferDataType dataType, int componentsCount) {
+		switch (dataType) {
+			case BufferDataType::DATA_HALF:
+			case BufferDataType::DATA_SHORT:
+			case BufferDataType::DATA_USHORT: return componentsCount * 2;
+			case BufferDataType::DATA_BYTE:
+			case BufferDataType::DATA_UBYTE: return componentsCount;
+			case BufferDataType::DATA_INT_2_10_10_10_REV: return 4;
+			default: return componentsCount * 4;
+		}
+	}
+
+	GLenum BufferSlotDescriptor::GetDataTypeNative(BufferDataType dataType) {
+		switch (dataType) {
+			case BufferDataType::DATA_INT: return GL_INT;
+			case BufferDataType::DATA_HALF: return GL_HALF_FLOAT;
+			case BufferDataType::DATA_BYTE: return GL_BYTE;
+			case BufferDataType::DATA_UBYTE: return GL_UNSIGNED_BYTE;
+			case BufferDataType::DATA_SHORT: return GL_SHORT;
+			case BufferDataType::DATA_USHORT: return GL_UNSIGNED_SHORT;
+			case BufferDataType::DATA_INT_2_10_10_10_REV: return GL_INT_2_10_10_10_REV;
+			default: return GL_FLOAT;
+		}
+	}
+
+	BufferSlot::BufferSlot(DataBuffer* parent, bool dynamicSlot, StreamingMode streamingMode) {
 		mParentObject = parent;
 
-		mIsDynamicSlot = dynamicSlot;
+		// Persistent mapping needs immutable storage (GL 4.4 or ARB_buffer_storage)
+		if (streamingMode == StreamingMode::STREAM_PERSISTENT && !parent->mContext->SupportsBufferStorage()) streamingMode = StreamingMode::STREAM_ORPHAN;
+
+		mIsDynamicSlot = dynamicSlot || streamingMode != StreamingMode::STREAM_SUBDATA;
+		mStreamingMode = streamingMode;
+		mReservedSize = 0;
 
-		glGenBuffers(1, &mBufferHandle);
+		parent->CreateBufferHandle(mBufferHandle);
 	}
 
 }
@@ -9,7 +9,23 @@ namespace Backend {
 	class BufferSlot;
 	class BufferSlotDescriptor;
 
-	enum BufferDataType { DATA_INT, DATA_FLOAT };
+	// DATA_INT is fetched as an integer attribute, the others as floats (see the normalized flag of AddDescriptor).
+	// DATA_INT_2_10_10_10_REV packs 4 signed components in 32 bits and needs componentsCount = 4, see VertexPacking.h
+	enum BufferDataType { DATA_INT, DATA_FLOAT, DATA_HALF, DATA_BYTE, DATA_UBYTE, DATA_SHORT, DATA_USHORT, DATA_INT_2_10_10_10_REV };
+	enum IndexType { INDEX_UINT, INDEX_USHORT };
+	// STREAM_PERSISTENT needs GL 4.4 or ARB_buffer_storage and falls back to STREAM_ORPHAN without it
+	enum StreamingMode { STREAM_SUBDATA, STREAM_ORPHAN, STREAM_PERSISTENT };
+
+	// Storage of a persistently mapped buffer, split in one region per frame in flight (see Context::FRAMES_IN_FLIGHT)
+	struct MappedRegions {
+		unsigned char* Ptr;
+		unsigned int RegionSize;
+		unsigned int CurrentRegion;
+
+		MappedRegions() { Ptr = nullptr; RegionSize = 0; CurrentRegion = 0; }
+
+		unsigned int CurrentOffset() { return RegionSize * CurrentRegion; }
+	};
 
 	class BufferSlotDescriptor {
 		public:
@@ -19,12 +35,20 @@ namespace Backend {
 			const void* Offset() { return mOffset; }
 			int InstanceDivisor() { return mInstanceDivisor; }
 			BufferDataType DataType() { return mDataType; }
+			bool Normalized() { return mNormalized; }
+
+			// Bytes of one attribute
+			int Size() { return GetDataTypeSize(mDataType, mComponentsCount); }
+
+			static int GetDataTypeSize(BufferDataType dataType, int componentsCount);
+			static GLenum GetDataTypeNative(BufferDataType dataType);
 
 		protected:
 			BufferSlotDescriptor() { }
 
 			int mID, mComponentsCount, mBlockSize, mInstanceDivisor;
 			BufferDataType mDataType;
+			bool mNormalized;
 			const void* mOffset;
 
 			friend class BufferSlot;
@@ -35,8 +59,10 @@ namespace Backend {
 		public:
 			~BufferSlot();
 
+			// Persistent slots write into the current frame region, so every frame is expected to upload its whole data set
 			BufferSlot* UploadData(const void* dataPtr, unsigned int dataSize, int dataOffset = 0);
-			BufferSlot* AddDescriptor(int componentsCount, BufferDataType dataType = BufferDataType::DATA_FLOAT, int blockSize = 0, const void* startingOffset = (const void*)0, int instanceDivisor = 0);
+			// Normalized maps the integer types to [-1, 1] (signed) or [0, 1] (unsigned), otherwise they are converted to float as is
+			BufferSlot* AddDescriptor(int componentsCount, BufferDataType dataType = BufferDataType::DATA_FLOAT, int blockSize = 0, const void* startingOffset = (const void*)0, int instanceDivisor = 0, bool normalized = false);
 			
 			BufferSlot* ReserveSpace(unsigned int size);
 
@@ -50,12 +76,18 @@ namespace Backend {
 			BufferSlot* UploadData(const std::vector<T> arr, int dataOffset = 0) { if (arr.empty()) return this; return UploadData(&arr[0], sizeof(T) * arr.size(), dataOffset); }
 
 		protected:
-			BufferSlot(DataBuffer* parent, bool dynamicSlot = false);
+			BufferSlot(DataBuffer* parent, bool dynamicSlot = false, StreamingMode streamingMode = StreamingMode::STREAM_SUBDATA);
+
+			void BindDescriptorsToRegion();
+			void SpecifyAttribute(BufferSlotDescriptor& descriptor, GLintptr bufferOffset);
 
 			GLuint mBufferHandle;
 			DataBuffer* mParentObject;
 
 			bool mIsDynamicSlot;
+			StreamingMode mStreamingMode;
+			unsigned int mReservedSize;
+			MappedRegions mMapped;
 
 			std::vector<BufferSlotDescriptor> mDescriptors;
 
@@ -66,19 +98,40 @@ namespace Backend {
 
 	class DataBuffer {
 		public:
-			DataBuffer();
+			DataBuffer(Context* context);
 			~DataBuffer();
 
-			void ReserveIndices(unsigned int size);
+			void ReserveIndices(unsigned int size, StreamingMode streamingMode = StreamingMode::STREAM_SUBDATA);
 			void UploadIndices(const void* indicesPtr, unsigned int dataSize, unsigned int dataOffset = 0);
-			BufferSlot* AddBufferSlot(const std::string& name, bool dynamicSlot = false);
+			BufferSlot* AddBufferSlot(const std::string& name, bool dynamicSlot = false, StreamingMode streamingMode = StreamingMode::STREAM_SUBDATA);
 			BufferSlot* GetBufferSlot(const std::string& name);
 
+			// 32 bit by default, offsets passed to the Context draws stay in bytes
+			void SetIndexType(IndexType type) { mIndexType = type; }
+			IndexType GetIndexType() { return mIndexType; }
+			unsigned int IndexSize() { return mIndexType == IndexType::INDEX_USHORT ? sizeof(GLushort) : sizeof(GLuint); }
+			GLenum IndexTypeNative() { return mIndexType == IndexType::INDEX_USHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+
 			// Utility functions
-			void UploadIndices(const std::vector<unsigned int>& indices) { if(indices.size()) UploadIndices(&indices[0], (unsigned int)(sizeof(indices[0]) * indices.size())); }
-			
+			void UploadIndices(const std::vector<unsigned int>& indices) { SetIndexType(IndexType::INDEX_UINT); if(indices.size()) UploadIndices(&indices[0], (unsigned int)(sizeof(indices[0]) * indices.size())); }
+			void UploadIndices(const std::vector<unsigned short>& indices) { SetIndexType(IndexType::INDEX_USHORT); if(indices.size()) UploadIndices(&indices[0], (unsigned int)(sizeof(indices[0]) * indices.size())); }
+
+			// Byte offset of the current frame region for persistently mapped indices, added by the Context to every indexed draw
+			unsigned int IndicesFrameOffset() { return mIndicesMapped.Ptr ? mIndicesMapped.CurrentOffset() : 0; }
+
+			GLuint GetIndicesNativeHandle() { return mIndicesSlotHandle; }
+
 		protected:
-			void Bind() { glBindVertexArray(mArrayBufferHandle); }
+			void Bind();
+
+			unsigned int GetFrameRegion();
+			unsigned char* CreateMappedStorage(GLenum target, GLuint& handle, MappedRegions& mapped, unsigned int regionSize);
+
+			// Named buffer calls with DSA, bind-to-edit otherwise (the vertex array is bound first for element buffers)
+			void CreateBufferHandle(GLuint& handle);
+			void BufferData(GLenum target, GLuint handle, GLsizeiptr size, const void* dataPtr, GLenum usage);
+			void BufferSubData(GLenum target, GLuint handle, GLintptr offset, GLsizeiptr size, const void* dataPtr);
+			void AttachIndices();
 
 		protected:
 			GLuint mArrayBufferHandle;
@@ -88,6 +141,10 @@ namespace Backend {
 
 			int mAttributeCount;
 			bool mDynamicIndices;
+			IndexType mIndexType;
+			StreamingMode mIndicesStreamingMode;
+			unsigned int mIndicesReservedSize;
+			MappedRegions mIndicesMapped;
 
 			friend class BufferSlot;
 
@@ -0,0 +1,204 @@
+#include "DrawQueue.h"
+#include "Context.h"
+#include "ShaderProgram.h"
+
+namespace Backend {
+
+	DrawQueue::DrawQueue() {
+		mIsSorted = false;
+	}
+
+	void DrawQueue::Reset() {
+		mItems.clear();
+		mEntries.clear();
+		mOrder.clear();
+
+		mIsSorted = false;
+		mStats = DrawQueueStats();
+
+		ClearObjectIDs();
+	}
+
+	void DrawQueue::Add(const DrawItem& item) {
+		mEntries.push_back({ ComposeKey(item), (unsigned int)mItems.size() });
+		mItems.push_back(item);
+
+		mIsSorted = false;
+	}
+
+	void DrawQueue::Sort() {
+		if (mIsSorted) return;
+
+		mOrder.resize(mItems.size());
+		for (unsigned int i = 0; i < mOrder.size(); ++i) mOrder[i] = i;
+		mStats.StateChangesUnsorted = CountStateChanges(mOrder);
+
+		RadixSort();
+
+		for (unsigned int i = 0; i < mEntries.size(); ++i) mOrder[i] = mEntries[i].Index;
+		mStats.StateChangesSorted = CountStateChanges(mOrder);
+		mStats.Draws = (unsigned int)mItems.size();
+
+		mIsSorted = true;
+	}
+
+	void DrawQueue::Submit(Context* context) {
+		Sort();
+
+		const TextureSet* lastTextures = nullptr;
+		bool firstDraw = true;
+		mStats.SkippedNotReady = 0;
+
+		for (unsigned int index : mOrder) {
+			DrawItem& item = mItems[index];
+
+			// Programs still compiling in the background are skipped instead of waited on
+			if (item.Shader && !item.Shader->IsReady()) {
+				mStats.SkippedNotReady++;
+				continue;
+			}
+
+			// The Context setters already skip redundant binds, sorted input lets them skip most of them
+			context->SetRenderbuffer(item.Target);
+			context->SetBlendMode(item.Transparent ? BlendingMode::BLEND_DEFAULT : BlendingMode::BLEND_NONE);
+			context->SetShader(item.Shader);
+			context->SetDatabuffer(item.Databuffer);
+
+			if (item.Textures && (firstDraw || item.Textures != lastTextures)) {
+				context->BindTextures(*item.Textures);
+			}
+			lastTextures = item.Textures;
+			firstDraw = false;
+
+			if (item.Indexed) {
+				if (item.VerticesOffset) context->RenderI(item.Mode, item.Count, item.IndicesOffset, item.VerticesOffset);
+				else context->RenderI(item.Mode, item.Count, item.IndicesOffset);
+			}
+			else {
+				context->RenderV(item.Mode, item.Count, item.IndicesOffset);
+			}
+		}
+
+		// The keys are composed already, the next frame starts numbering from 1 again
+		ClearObjectIDs();
+	}
+
+	DrawKey DrawQueue::ComposeKey(const DrawItem& item) {
+		float depth = std::min(std::max(item.Depth, 0.0f), 1.0f);
+
+		DrawKey target = GetObjectID(mTargetIDs, item.Target) & 0x3F;
+		DrawKey layer = item.Layer & 0x3F;
+		DrawKey shader = GetObjectID(mShaderIDs, item.Shader) & 0x7FF;
+		DrawKey databuffer = GetObjectID(mDatabufferIDs, item.Databuffer) & 0x7FF;
+
+		DrawKey key = (target << 58) | (layer << 52);
+
+		if (item.Transparent) {
+			DrawKey depthBits = (DrawKey)((1.0f - depth) * 0xFFFFFF) & 0xFFFFFF;
+
+			key |= (DrawKey)1 << 51;
+			key |= depthBits << 27;
+			key |= shader << 16;
+			key |= databuffer & 0x3FF;
+		}
+		else {
+			DrawKey textures = GetObjectID(mTextureSetIDs, item.Textures) & 0x7FF;
+			DrawKey depthBits = (DrawKey)(depth * 0x3FFFF) & 0x3FFFF;
+
+			key |= shader << 40;
+			key |= databuffer << 29;
+			key |= textures << 18;
+			key |= depthBits;
+		}
+
+		return key;
+	}
+
+	unsigned int DrawQueue::GetObjectID(std::map<const void*, unsigned int>& ids, const void* object) {
+		if (!object) return 0;
+
+		// IDs only live for one frame, so they stay dense inside their key fields and freed addresses can't keep stale ones
+		auto itr = ids.find(object);
+		if (itr != ids.end()) return itr->second;
+
+		unsigned int id = (unsigned int)ids.size() + 1;
+		ids.insert({ object, id });
+
+		return id;
+	}
+
+	void DrawQueue::ClearObjectIDs() {
+		mTargetIDs.clear();
+		mShaderIDs.clear();
+		mDatabufferIDs.clear();
+		mTextureSetIDs.clear();
+	}
+
+	unsigned int DrawQueue::CountStateChanges(const std::vector<unsigned int>& order) {
+		unsigned int changes = 0;
+
+		for (unsigned int i = 0; i < order.size(); ++i) {
+			DrawItem& item = mItems[order[i]];
+
+			if (i == 0) {
+				changes += 4;
+				continue;
+			}
+
+			DrawItem& last = mItems[order[i - 1]];
+			if (item.Target != last.Target) changes++;
+			if (item.Shader != last.Shader) changes++;
+			if (item.Databuffer != last.Databuffer) changes++;
+			if (item.Textures != last.Textures) changes++;
+		}
+
+		return changes;
+	}
+
+	void DrawQueue::RadixSort() {
+		// Small queues don't pay for the histograms, stable so equal keys keep their submission order like the radix passes
+		const size_t SMALL_SORT_THRESHOLD = 256;
+		if (mEntries.size() <= SMALL_SORT_THRESHOLD) {
+			std::stable_sort(mEntries.begin(), mEntries.end(), [](const SortEntry& a, const SortEntry& b) { return a.Key < b.Key; });
+			return;
+		}
+
+		// LSD radix sort over 8 bit digits, the 256 buckets of a pass stay in L1. The histograms of every pass
+		// are built in one read of the keys, passes where every key has the same digit are skipped
+		const unsigned int DIGIT_BITS = 8;
+		const unsigned int BUCKETS = 1 << DIGIT_BITS;
+		const unsigned int PASSES = 64 / DIGIT_BITS;
+
+		std::vector<unsigned int>& histograms = mHistogram;
+		histograms.assign(BUCKETS * PASSES, 0);
+
+		for (auto& entry : mEntries) {
+			for (unsigned int pass = 0; pass < PASSES; ++pass) {
+				histograms[pass * BUCKETS + ((entry.Key >> (pass * DIGIT_BITS)) & (BUCKETS - 1))]++;
+			}
+		}
+
+		mEntriesTemp.resize(mEntries.size());
+
+		for (unsigned int pass = 0; pass < PASSES; ++pass) {
+			unsigned int shift = pass * DIGIT_BITS;
+			unsigned int* histogram = &histograms[pass * BUCKETS];
+
+			if (histogram[(mEntries[0].Key >> shift) & (BUCKETS - 1)] == mEntries.size()) continue;
+
+			unsigned int sum = 0;
+			for (unsigned int i = 0; i < BUCKETS; ++i) {
+				unsigned int count = histogram[i];
+				histogram[i] = sum;
+				sum += count;
+			}
+
+			for (auto& entry : mEntries) {
+				mEntriesTemp[histogram[(entry.Key >> shift) & (BUCKETS - 1)]++] = entry;
+			}
+
+			mEntries.swap(mEntriesTemp);
+		}
+	}
+
+}
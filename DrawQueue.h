@@ -0,0 +1,107 @@
+#ifndef DRAW_QUEUE_R_H
+#define DRAW_QUEUE_R_H
+
+#include "include.h"
+#include "Context.h"
+
+namespace Backend {
+	class Context;
+	class DrawQueue;
+
+	class DataBuffer;
+	class ShaderProgram;
+	class RenderBuffer;
+	class TextureBuffer;
+
+	using DrawKey = unsigned long long;
+	using TextureSet = std::vector<std::pair<int, TextureBuffer*>>;
+
+	struct DrawItem {
+		RenderBuffer* Target;
+		unsigned int Layer;
+		bool Transparent;
+		float Depth; // normalized view depth, 0 = near plane, 1 = far plane
+
+		ShaderProgram* Shader;
+		DataBuffer* Databuffer;
+		const TextureSet* Textures; // must stay alive until the queue is submitted
+
+		RenderMode Mode;
+		bool Indexed;
+		int Count, IndicesOffset, VerticesOffset; // IndicesOffset is the first vertex for non indexed draws
+
+		DrawItem() {
+			Target = nullptr;
+			Layer = 0;
+			Transparent = false;
+			Depth = 0.0f;
+			Shader = nullptr;
+			Databuffer = nullptr;
+			Textures = nullptr;
+			Mode = RenderMode::RENDER_TRIANGLES;
+			Indexed = true;
+			Count = IndicesOffset = VerticesOffset = 0;
+		}
+	};
+
+	struct DrawQueueStats {
+		unsigned int Draws;
+		unsigned int StateChangesUnsorted; // changes the submission order would have needed
+		unsigned int StateChangesSorted; // changes actually issued after sorting
+		unsigned int SkippedNotReady; // draws whose program was still compiling
+
+		DrawQueueStats() { Draws = StateChangesUnsorted = StateChangesSorted = SkippedNotReady = 0; }
+
+		int StateChangesSaved() { return (int)StateChangesUnsorted - (int)StateChangesSorted; }
+	};
+
+	// Collects the draws of a frame, sorts them by a packed 64 bit key and submits them through the Context.
+	//
+	// Key layout, most significant bits first:
+	//   opaque:      target(6) layer(6) 0 shader(11) databuffer(11) textures(11) depth(18, front to back)
+	//   transparent: target(6) layer(6) 1 depth(24, back to front) shader(11) databuffer(10)
+	// Opaque draws are grouped by state first and depth second, transparent draws must respect depth order.
+	// Object IDs are numbered from 1 every frame (Reset or Submit), so they only alias past 63 targets or 2047 objects in one frame.
+	class DrawQueue {
+		public:
+			DrawQueue();
+			~DrawQueue() { }
+
+			void Reset();
+			void Add(const DrawItem& item);
+
+			void Sort();
+			void Submit(Context* context);
+
+			unsigned int Size() { return (unsigned int)mItems.size(); }
+			DrawQueueStats& Stats() { return mStats; }
+
+		protected:
+			DrawKey ComposeKey(const DrawItem& item);
+			unsigned int GetObjectID(std::map<const void*, unsigned int>& ids, const void* object);
+			void ClearObjectIDs();
+			unsigned int CountStateChanges(const std::vector<unsigned int>& order);
+
+			void RadixSort();
+
+		protected:
+			struct SortEntry {
+				DrawKey Key;
+				unsigned int Index;
+			};
+
+			std::vector<DrawItem> mItems;
+			std::vector<SortEntry> mEntries, mEntriesTemp;
+			std::vector<unsigned int> mOrder;
+			std::vector<unsigned int> mHistogram;
+
+			std::map<const void*, unsigned int> mTargetIDs, mShaderIDs, mDatabufferIDs, mTextureSetIDs;
+
+			bool mIsSorted;
+			DrawQueueStats mStats;
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,385 @@
+#include "FrameGraph.h"
+#include "Context.h"
+#include "RenderBuffer.h"
+#include "RenderTargetPool.h"
+
+namespace Backend {
+
+	FrameGraphPass* FrameGraphPass::Read(int resource) {
+		if (resource >= 0 && resource < (int)mGraph->mResources.size()) mReads.push_back(resource);
+
+		return this;
+	}
+
+	FrameGraphPass* FrameGraphPass::Write(int resource) {
+		if (resource >= 0 && resource < (int)mGraph->mResources.size()) mColorWrites.push_back(resource);
+
+		return this;
+	}
+
+	FrameGraphPass* FrameGraphPass::WriteDepth(int resource) {
+		if (resource >= 0 && resource < (int)mGraph->mResources.size()) mDepthWrite = resource;
+
+		return this;
+	}
+
+	FrameGraph::FrameGraph(Context* context) {
+		mContext = context;
+
+		mCompiled = false;
+	}
+
+	FrameGraph::~FrameGraph() {
+		ReleaseTargets();
+	}
+
+	void FrameGraph::Reset() {
+		mResources.clear();
+		mPasses.clear();
+		mOrder.clear();
+
+		ReleaseTargets();
+
+		mCompiled = false;
+	}
+
+	int FrameGraph::CreateTexture(const std::string& name, int width, int height, TextureFormat format) {
+		Resource resource;
+		resource.Name = name;
+		resource.Width = width;
+		resource.Height = height;
+		resource.Format = format;
+		resource.ImportedTexture = nullptr;
+		resource.ImportedTarget = nullptr;
+		resource.Output = false;
+		resource.Physical = -1;
+		resource.FirstUse = resource.LastUse = -1;
+
+		mResources.push_back(resource);
+
+		return (int)mResources.size() - 1;
+	}
+
+	int FrameGraph::ImportTexture(const std::string& name, TextureBuffer* texture) {
+		if (!texture) return -1;
+
+		int resource = CreateTexture(name, texture->GetWidth(), texture->GetHeight(), texture->GetFormat());
+		mResources[resource].ImportedTexture = texture;
+
+		return resource;
+	}
+
+	int FrameGraph::ImportRenderBuffer(const std::string& name, RenderBuffer* target) {
+		if (!target) return -1;
+
+		int resource = CreateTexture(name, target->GetWidth(), target->GetHeight(), TextureFormat::TEXTURE_RGBA);
+		mResources[resource].ImportedTarget = target;
+
+		return resource;
+	}
+
+	FrameGraph* FrameGraph::MarkOutput(int resource) {
+		if (resource >= 0 && resource < (int)mResources.size()) mResources[resource].Output = true;
+
+		return this;
+	}
+
+	FrameGraphPass* FrameGraph::AddPass(const std::string& name, const FrameGraphExecute& execute) {
+		mPasses.push_back(FrameGraphPass());
+
+		FrameGraphPass* pass = &mPasses.back();
+		pass->mName = name;
+		pass->mExecute = execute;
+		pass->mGraph = this;
+
+		return pass;
+	}
+
+	void FrameGraph::Compile() {
+		mStats = FrameGraphStats();
+		mStats.Passes = (unsigned int)mPasses.size();
+
+		std::vector<std::vector<int>> dependencies, dataDependencies;
+		BuildDependencies(dependencies, dataDependencies);
+
+		CullPasses(dataDependencies);
+		OrderPasses(dependencies);
+		AliasTextures();
+		BuildTargets();
+
+		mCompiled = true;
+	}
+
+	void FrameGraph::Execute() {
+		if (!mCompiled) Compile();
+
+		RenderBuffer* lastTarget = nullptr;
+
+		for (auto pass : mOrder) {
+			if (pass->mTarget) {
+				if (pass->mTarget != lastTarget) mStats.RenderTargetChanges++;
+				lastTarget = pass->mTarget;
+
+				mContext->SetRenderbuffer(pass->mTarget);
+			}
+
+			mContext->BeginGpuScope(pass->mName);
+			if (pass->mExecute) pass->mExecute(mContext, pass);
+			mContext->EndGpuScope();
+		}
+	}
+
+	TextureBuffer* FrameGraph::GetTexture(int resource) {
+		if (resource < 0 || resource >= (int)mResources.size()) return nullptr;
+
+		Resource& res = mResources[resource];
+		if (res.ImportedTexture) return res.ImportedTexture;
+		if (res.Physical < 0) return nullptr;
+
+		return mPhysicalTargets[res.Physical].Texture;
+	}
+
+	void FrameGraph::BuildDependencies(std::vector<std::vector<int>>& dependencies, std::vector<std::vector<int>>& dataDependencies) {
+		// Declaration order is the program order, hazards against it become edges (from earlier to later passes)
+		dependencies.assign(mPasses.size(), std::vector<int>());
+		dataDependencies.assign(mPasses.size(), std::vector<int>());
+
+		std::vector<int> lastWriter(mResources.size(), -1);
+		std::vector<std::vector<int>> readersSinceWrite(mResources.size());
+
+		auto addEdge = [](std::vector<int>& list, int pass) {
+			if (pass >= 0 && std::find(list.begin(), list.end(), pass) == list.end()) list.push_back(pass);
+		};
+
+		for (int i = 0; i < (int)mPasses.size(); ++i) {
+			FrameGraphPass& pass = mPasses[i];
+
+			std::vector<int> writes = pass.mColorWrites;
+			if (pass.mDepthWrite >= 0) writes.push_back(pass.mDepthWrite);
+
+			// read after write
+			for (int resource : pass.mReads) {
+				addEdge(dependencies[i], lastWriter[resource]);
+				addEdge(dataDependencies[i], lastWriter[resource]);
+			}
+
+			for (int resource : writes) {
+				// write after write keeps the earlier content (e.g. a pass adding to a buffer), write after read only orders
+				addEdge(dependencies[i], lastWriter[resource]);
+				addEdge(dataDependencies[i], lastWriter[resource]);
+
+				for (int reader : readersSinceWrite[resource]) {
+					if (reader != i) addEdge(dependencies[i], reader);
+				}
+			}
+
+			for (int resource : pass.mReads) readersSinceWrite[resource].push_back(i);
+			for (int resource : writes) {
+				lastWriter[resource] = i;
+				readersSinceWrite[resource].clear();
+			}
+		}
+	}
+
+	void FrameGraph::CullPasses(const std::vector<std::vector<int>>& dataDependencies) {
+		std::vector<int> stack;
+
+		for (int i = 0; i < (int)mPasses.size(); ++i) {
+			FrameGraphPass& pass = mPasses[i];
+			bool needed = pass.mSideEffect;
+
+			std::vector<int> writes = pass.mColorWrites;
+			if (pass.mDepthWrite >= 0) writes.push_back(pass.mDepthWrite);
+
+			for (int resource : writes) {
+				Resource& res = mResources[resource];
+				if (res.Output || res.ImportedTexture || res.ImportedTarget) needed = true;
+			}
+
+			pass.mCulled = !needed;
+			if (needed) stack.push_back(i);
+		}
+
+		// Everything a needed pass consumes is needed as well
+		while (!stack.empty()) {
+			int i = stack.back();
+			stack.pop_back();
+
+			for (int dependency : dataDependencies[i]) {
+				if (!mPasses[dependency].mCulled) continue;
+
+				mPasses[dependency].mCulled = false;
+				stack.push_back(dependency);
+			}
+		}
+
+		for (auto& pass : mPasses) {
+			if (pass.mCulled) mStats.CulledPasses++;
+		}
+	}
+
+	void FrameGraph::OrderPasses(const std::vector<std::vector<int>>& dependencies) {
+		mOrder.clear();
+
+		std::vector<int> remaining(mPasses.size(), 0);
+		std::vector<std::vector<int>> dependents(mPasses.size());
+
+		for (int i = 0; i < (int)mPasses.size(); ++i) {
+			if (mPasses[i].mCulled) continue;
+
+			for (int dependency : dependencies[i]) {
+				if (mPasses[dependency].mCulled) continue;
+
+				remaining[i]++;
+				dependents[dependency].push_back(i);
+			}
+		}
+
+		std::vector<int> ready;
+		for (int i = 0; i < (int)mPasses.size(); ++i) {
+			if (!mPasses[i].mCulled && !remaining[i]) ready.push_back(i);
+		}
+
+		while (!ready.empty()) {
+			// Prefer a pass drawing into the same attachments as the last one, then declaration order
+			size_t pick = 0;
+			for (size_t j = 0; j < ready.size(); ++j) {
+				if (ready[j] < ready[pick]) pick = j;
+			}
+
+			if (!mOrder.empty()) {
+				for (size_t j = 0; j < ready.size(); ++j) {
+					if (SameAttachments(mOrder.back(), &mPasses[ready[j]]) && (!SameAttachments(mOrder.back(), &mPasses[ready[pick]]) || ready[j] < ready[pick])) pick = j;
+				}
+			}
+
+			int i = ready[pick];
+			ready.erase(ready.begin() + pick);
+			mOrder.push_back(&mPasses[i]);
+
+			for (int dependent : dependents[i]) {
+				if (--remaining[dependent] == 0) ready.push_back(dependent);
+			}
+		}
+	}
+
+	void FrameGraph::AliasTextures() {
+		// Lifetimes in execution order
+		for (int position = 0; position < (int)mOrder.size(); ++position) {
+			FrameGraphPass* pass = mOrder[position];
+
+			std::vector<int> used = pass->mReads;
+			used.insert(used.end(), pass->mColorWrites.begin(), pass->mColorWrites.end());
+			if (pass->mDepthWrite >= 0) used.push_back(pass->mDepthWrite);
+
+			for (int resource : used) {
+				Resource& res = mResources[resource];
+				if (res.FirstUse < 0) res.FirstUse = position;
+				res.LastUse = position;
+			}
+		}
+
+		std::vector<int> transients;
+		for (int i = 0; i < (int)mResources.size(); ++i) {
+			Resource& res = mResources[i];
+			if (!res.ImportedTexture && !res.ImportedTarget && res.FirstUse >= 0) transients.push_back(i);
+		}
+
+		std::sort(transients.begin(), transients.end(), [this](int a, int b) { return mResources[a].FirstUse < mResources[b].FirstUse; });
+
+		// A second Compile without Reset starts the assignment over
+		ReleaseTargets();
+
+		RenderTargetPool* pool = mContext->GetRenderTargetPool();
+
+		// Greedy interval assignment, a physical target is free again after the last pass using its current resource
+		for (int resource : transients) {
+			Resource& res = mResources[resource];
+
+			int physicalIndex = -1;
+			for (int j = 0; j < (int)mPhysicalTargets.size(); ++j) {
+				PhysicalTarget& physical = mPhysicalTargets[j];
+				if (physical.Width != res.Width || physical.Height != res.Height || physical.Format != res.Format) continue;
+				if (physical.BusyUntil >= res.FirstUse) continue;
+
+				physicalIndex = j;
+				break;
+			}
+
+			if (physicalIndex < 0) {
+				bool isDepth = res.Format >= TextureFormat::TEXTURE_DEPTH_16 && res.Format <= TextureFormat::TEXTURE_DEPTH_32;
+
+				RenderTargetDesc desc(res.Width, res.Height);
+				if (isDepth) desc.SetDepth(res.Format);
+				else desc.AddColor(res.Format);
+
+				PhysicalTarget physical;
+				physical.Target = pool->Acquire(desc);
+				if (!physical.Target) continue;
+
+				physical.Texture = physical.Target->GetSlot(isDepth ? "depth" : "color0")->Texture();
+				physical.Texture->SetFilterMinMag(TextureFilter::FILTER_LINEAR, TextureFilter::FILTER_LINEAR);
+				physical.Width = res.Width;
+				physical.Height = res.Height;
+				physical.Format = res.Format;
+
+				mPhysicalTargets.push_back(physical);
+				physicalIndex = (int)mPhysicalTargets.size() - 1;
+			}
+
+			mPhysicalTargets[physicalIndex].BusyUntil = res.LastUse;
+			res.Physical = physicalIndex;
+		}
+
+		mStats.TransientTextures = (unsigned int)transients.size();
+		mStats.PhysicalTextures = (unsigned int)mPhysicalTargets.size();
+	}
+
+	void FrameGraph::BuildTargets() {
+		for (auto pass : mOrder) {
+			pass->mTarget = nullptr;
+
+			// An imported render buffer is used as is
+			for (int resource : pass->mColorWrites) {
+				if (mResources[resource].ImportedTarget) pass->mTarget = mResources[resource].ImportedTarget;
+			}
+			if (pass->mTarget || (pass->mColorWrites.empty() && pass->mDepthWrite < 0)) continue;
+
+			// A single transient attachment is drawn into the pooled target holding it
+			int attachments = (int)pass->mColorWrites.size() + (pass->mDepthWrite >= 0 ? 1 : 0);
+			int single = pass->mColorWrites.empty() ? pass->mDepthWrite : pass->mColorWrites[0];
+			if (attachments == 1 && mResources[single].Physical >= 0) {
+				pass->mTarget = mPhysicalTargets[mResources[single].Physical].Target;
+				continue;
+			}
+
+			std::vector<TextureBuffer*> colors;
+			bool complete = true;
+			for (int resource : pass->mColorWrites) {
+				colors.push_back(GetTexture(resource));
+				if (!colors.back()) complete = false;
+			}
+
+			TextureBuffer* depth = pass->mDepthWrite >= 0 ? GetTexture(pass->mDepthWrite) : nullptr;
+			if (pass->mDepthWrite >= 0 && !depth) complete = false;
+
+			// Empty textures get no target, the pass runs on whatever is bound
+			if (complete) pass->mTarget = mContext->GetRenderTargetPool()->AcquireFramebuffer(colors, depth);
+		}
+	}
+
+	void FrameGraph::ReleaseTargets() {
+		for (auto& physical : mPhysicalTargets) {
+			mContext->ReleaseRenderTarget(physical.Target);
+		}
+
+		mPhysicalTargets.clear();
+	}
+
+	bool FrameGraph::SameAttachments(FrameGraphPass* a, FrameGraphPass* b) {
+		if (a->mColorWrites.empty() && a->mDepthWrite < 0) return false;
+
+		return a->mColorWrites == b->mColorWrites && a->mDepthWrite == b->mDepthWrite;
+	}
+
+}
@@ -0,0 +1,138 @@
+#ifndef FRAME_GRAPH_R_H
+#define FRAME_GRAPH_R_H
+
+#include "include.h"
+#include "TextureBuffer.h"
+#include <deque>
+#include <functional>
+
+namespace Backend {
+	class Context;
+	class FrameGraph;
+	class FrameGraphPass;
+	class RenderBuffer;
+
+	using FrameGraphExecute = std::function<void(Context*, FrameGraphPass*)>;
+
+	struct FrameGraphStats {
+		unsigned int Passes, CulledPasses;
+		unsigned int TransientTextures, PhysicalTextures; // transient textures aliased onto pooled render targets
+		unsigned int RenderTargetChanges;
+
+		FrameGraphStats() { Passes = CulledPasses = TransientTextures = PhysicalTextures = RenderTargetChanges = 0; }
+	};
+
+	class FrameGraphPass {
+		public:
+			// Resources are handles returned by FrameGraph::CreateTexture/Import*
+			FrameGraphPass* Read(int resource);
+			FrameGraphPass* Write(int resource); // color attachment, or an imported render buffer
+			FrameGraphPass* WriteDepth(int resource);
+			FrameGraphPass* SetSideEffect(bool sideEffect = true) { mSideEffect = sideEffect; return this; }
+
+			const std::string& Name() { return mName; }
+			bool IsCulled() { return mCulled; }
+
+		protected:
+			FrameGraphPass() { mDepthWrite = -1; mSideEffect = false; mCulled = false; mTarget = nullptr; mGraph = nullptr; }
+
+			std::string mName;
+			FrameGraphExecute mExecute;
+
+			std::vector<int> mReads, mColorWrites;
+			int mDepthWrite;
+			bool mSideEffect, mCulled;
+
+			RenderBuffer* mTarget;
+			FrameGraph* mGraph;
+
+			friend class FrameGraph;
+
+	};
+
+	// Passes declare the resources they read and write, Compile then:
+	//  - culls the passes that don't contribute to an imported resource, an output or a side effect
+	//  - orders the rest by their dependencies, keeping passes that draw into the same attachments next to each other
+	//  - aliases transient textures with the same size and format whose lifetimes don't overlap onto one render target
+	//    borrowed from the Context's RenderTargetPool, whose eviction and memory accounting apply
+	//  - draws passes with a single transient attachment into its pooled target, other attachment sets get a
+	//    framebuffer cached by the pool (RenderTargetPool::AcquireFramebuffer)
+	// Aliased textures keep the content of their previous user, a pass writing a transient texture has to clear it.
+	// Rebuild the graph every frame: Reset, declare, Compile, Execute.
+	class FrameGraph {
+		public:
+			~FrameGraph();
+
+			void Reset();
+
+			int CreateTexture(const std::string& name, int width, int height, TextureFormat format);
+			int ImportTexture(const std::string& name, TextureBuffer* texture);
+			int ImportRenderBuffer(const std::string& name, RenderBuffer* target);
+			FrameGraph* MarkOutput(int resource);
+
+			FrameGraphPass* AddPass(const std::string& name, const FrameGraphExecute& execute);
+
+			void Compile();
+			void Execute();
+
+			// Valid between Compile and the next Reset
+			TextureBuffer* GetTexture(int resource);
+
+			FrameGraphStats& GetStats() { return mStats; }
+
+		protected:
+			FrameGraph(Context* context);
+
+			void BuildDependencies(std::vector<std::vector<int>>& dependencies, std::vector<std::vector<int>>& dataDependencies);
+			void CullPasses(const std::vector<std::vector<int>>& dataDependencies);
+			void OrderPasses(const std::vector<std::vector<int>>& dependencies);
+			void AliasTextures();
+			void BuildTargets();
+			void ReleaseTargets();
+
+			bool SameAttachments(FrameGraphPass* a, FrameGraphPass* b);
+
+			struct Resource {
+				std::string Name;
+				int Width, Height;
+				TextureFormat Format;
+
+				TextureBuffer* ImportedTexture;
+				RenderBuffer* ImportedTarget;
+				bool Output;
+
+				int Physical; // index in mPhysicalTargets, -1 when imported or unused
+				int FirstUse, LastUse; // positions in mOrder
+			};
+
+			struct PhysicalTarget {
+				RenderBuffer* Target; // borrowed from the pool until the next Reset
+				TextureBuffer* Texture; // its only attachment
+				int Width, Height;
+				TextureFormat Format;
+
+				int BusyUntil; // last position in mOrder using it
+			};
+
+		protected:
+			std::vector<Resource> mResources;
+			std::deque<FrameGraphPass> mPasses;
+			std::vector<FrameGraphPass*> mOrder;
+
+			std::vector<PhysicalTarget> mPhysicalTargets;
+
+			bool mCompiled;
+
+			FrameGraphStats mStats;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+			friend class FrameGraphPass;
+
+	};
+
+}
+
+#endif
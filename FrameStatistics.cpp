@@ -0,0 +1,163 @@
+#include "FrameStatistics.h"
+#include "Context.h"
+#include "InternalStateManager.h"
+#include <fstream>
+#include <sstream>
+
+namespace Backend {
+
+	const char* FrameStatistics::StatNames[FrameStatType::NUM_FRAME_STATS] = {
+		"draws_lines", "draws_lines_strip", "draws_triangles",
+		"multi_draw_commands",
+		"vertices", "indices",
+		"instanced_draws", "instances",
+		"shader_binds_issued", "shader_binds_skipped",
+		"vao_binds_issued", "vao_binds_skipped",
+		"fbo_binds_issued", "fbo_binds_skipped",
+		"texture_binds_issued", "texture_binds_skipped",
+		"sampler_binds_issued", "sampler_binds_skipped",
+		"buffer_bytes_uploaded", "texture_bytes_uploaded",
+		"blits"
+	};
+
+	FrameStatistics::FrameStatistics(Context* context, unsigned int historySize) {
+		mContext = context;
+
+		memset(mCurrent, 0, sizeof(mCurrent));
+		memset(mIssuedAtBegin, 0, sizeof(mIssuedAtBegin));
+		memset(mFilteredAtBegin, 0, sizeof(mFilteredAtBegin));
+
+		mHistoryHead = 0;
+		mHistoryCount = 0;
+		SetHistorySize(historySize);
+	}
+
+	unsigned long long FrameStatistics::GetLast(FrameStatType type) {
+		if (!mHistoryCount) return 0;
+
+		return GetRecord(mHistoryCount - 1).Values[type];
+	}
+
+	double FrameStatistics::GetAverage(FrameStatType type) {
+		if (!mHistoryCount) return 0.0;
+
+		double sum = 0.0;
+		for (unsigned int i = 0; i < mHistoryCount; ++i) {
+			sum += (double)GetRecord(i).Values[type];
+		}
+
+		return sum / mHistoryCount;
+	}
+
+	double FrameStatistics::GetPercentile(FrameStatType type, float percentile) {
+		if (!mHistoryCount) return 0.0;
+
+		mScratch.resize(mHistoryCount);
+		for (unsigned int i = 0; i < mHistoryCount; ++i) {
+			mScratch[i] = GetRecord(i).Values[type];
+		}
+
+		// Nearest rank
+		percentile = std::min(std::max(percentile, 0.0f), 100.0f);
+		size_t rank = (size_t)(percentile / 100.0f * (mHistoryCount - 1) + 0.5f);
+
+		std::nth_element(mScratch.begin(), mScratch.begin() + rank, mScratch.end());
+
+		return (double)mScratch[rank];
+	}
+
+	unsigned long long FrameStatistics::GetMax(FrameStatType type) {
+		unsigned long long maxValue = 0;
+		for (unsigned int i = 0; i < mHistoryCount; ++i) {
+			maxValue = std::max(maxValue, GetRecord(i).Values[type]);
+		}
+
+		return maxValue;
+	}
+
+	void FrameStatistics::SetHistorySize(unsigned int frames) {
+		frames = std::max(frames, 1u);
+		if (frames == mHistory.size()) return;
+
+		// Keep the newest frames that still fit, oldest first
+		std::vector<FrameRecord> history;
+		unsigned int keep = std::min(mHistoryCount, frames);
+		for (unsigned int i = mHistoryCount - keep; i < mHistoryCount; ++i) {
+			history.push_back(GetRecord(i));
+		}
+
+		history.resize(frames);
+		mHistory.swap(history);
+
+		mHistoryCount = keep;
+		mHistoryHead = keep % frames;
+	}
+
+	std::string FrameStatistics::ExportCSV() {
+		std::ostringstream stream;
+
+		stream << "frame";
+		for (auto name : StatNames) {
+			stream << "," << name;
+		}
+		stream << "\n";
+
+		for (unsigned int i = 0; i < mHistoryCount; ++i) {
+			FrameRecord& record = GetRecord(i);
+
+			stream << record.FrameIndex;
+			for (auto value : record.Values) {
+				stream << "," << value;
+			}
+			stream << "\n";
+		}
+
+		return stream.str();
+	}
+
+	bool FrameStatistics::ExportCSV(const std::string& path) {
+		std::ofstream file(path);
+		if (!file.is_open()) return false;
+
+		file << ExportCSV();
+
+		return true;
+	}
+
+	void FrameStatistics::BeginFrame() {
+		memset(mCurrent, 0, sizeof(mCurrent));
+
+		// The state manager counters run for the lifetime of the Context, a frame is the difference between two snapshots
+		InternalStateManager* stateManager = mContext->StateManager();
+		for (int i = 0; i < StateCallType::NUM_STATE_CALLS; ++i) {
+			mIssuedAtBegin[i] = stateManager->GetIssuedCalls((StateCallType)i);
+			mFilteredAtBegin[i] = stateManager->GetFilteredCalls((StateCallType)i);
+		}
+	}
+
+	void FrameStatistics::EndFrame(unsigned long long frameIndex) {
+		// Bind counters come from the state manager filters, added to the binds the Context setters skipped before reaching it
+		InternalStateManager* stateManager = mContext->StateManager();
+		auto issued = [&](StateCallType type) { return (unsigned long long)(stateManager->GetIssuedCalls(type) - mIssuedAtBegin[type]); };
+		auto filtered = [&](StateCallType type) { return (unsigned long long)(stateManager->GetFilteredCalls(type) - mFilteredAtBegin[type]); };
+
+		mCurrent[STAT_SHADER_BINDS_ISSUED] += issued(STATE_CALL_PROGRAM);
+		mCurrent[STAT_SHADER_BINDS_SKIPPED] += filtered(STATE_CALL_PROGRAM);
+		mCurrent[STAT_VAO_BINDS_ISSUED] += issued(STATE_CALL_VERTEX_ARRAY);
+		mCurrent[STAT_VAO_BINDS_SKIPPED] += filtered(STATE_CALL_VERTEX_ARRAY);
+		mCurrent[STAT_FBO_BINDS_ISSUED] += issued(STATE_CALL_FRAMEBUFFER);
+		mCurrent[STAT_FBO_BINDS_SKIPPED] += filtered(STATE_CALL_FRAMEBUFFER);
+		mCurrent[STAT_TEXTURE_BINDS_ISSUED] += issued(STATE_CALL_TEXTURE);
+		mCurrent[STAT_TEXTURE_BINDS_SKIPPED] += filtered(STATE_CALL_TEXTURE);
+		mCurrent[STAT_SAMPLER_BINDS_ISSUED] += issued(STATE_CALL_SAMPLER);
+		mCurrent[STAT_SAMPLER_BINDS_SKIPPED] += filtered(STATE_CALL_SAMPLER);
+
+		FrameRecord& record = mHistory[mHistoryHead];
+		record.FrameIndex = frameIndex;
+		memcpy(record.Values, mCurrent, sizeof(mCurrent));
+
+		mHistoryHead = (mHistoryHead + 1) % mHistory.size();
+		mHistoryCount = std::min(mHistoryCount + 1, (unsigned int)mHistory.size());
+	}
+
+}
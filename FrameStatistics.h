@@ -0,0 +1,85 @@
+#ifndef FRAME_STATISTICS_R_H
+#define FRAME_STATISTICS_R_H
+
+#include "include.h"
+#include "InternalStateManager.h"
+
+namespace Backend {
+	class Context;
+	class FrameStatistics;
+
+	// Draw counters are split by RenderMode in the same order, so STAT_DRAWS_LINES + mode works
+	enum FrameStatType {
+		STAT_DRAWS_LINES, STAT_DRAWS_LINES_STRIP, STAT_DRAWS_TRIANGLES,
+		STAT_MULTI_DRAW_COMMANDS, // draws submitted inside glMultiDrawElementsIndirect calls
+		STAT_VERTICES, STAT_INDICES,
+		STAT_INSTANCED_DRAWS, STAT_INSTANCES, // instances / instanced draws gives the average instances per draw call
+		STAT_SHADER_BINDS_ISSUED, STAT_SHADER_BINDS_SKIPPED,
+		STAT_VAO_BINDS_ISSUED, STAT_VAO_BINDS_SKIPPED,
+		STAT_FBO_BINDS_ISSUED, STAT_FBO_BINDS_SKIPPED,
+		STAT_TEXTURE_BINDS_ISSUED, STAT_TEXTURE_BINDS_SKIPPED,
+		STAT_SAMPLER_BINDS_ISSUED, STAT_SAMPLER_BINDS_SKIPPED,
+		STAT_BUFFER_BYTES_UPLOADED, STAT_TEXTURE_BYTES_UPLOADED,
+		STAT_BLITS,
+		NUM_FRAME_STATS
+	};
+
+	// Counters of the frame in progress, reset at Context::FrameBegin and published to a ring of the last N frames at FrameEnd
+	class FrameStatistics {
+		public:
+			static const char* StatNames[FrameStatType::NUM_FRAME_STATS];
+
+		public:
+			void Add(FrameStatType type, unsigned long long value = 1) { mCurrent[type] += value; }
+
+			// Frame being recorded and last published frame
+			unsigned long long GetCurrent(FrameStatType type) { return mCurrent[type]; }
+			unsigned long long GetLast(FrameStatType type);
+
+			// Over the frames kept in the history
+			double GetAverage(FrameStatType type);
+			double GetPercentile(FrameStatType type, float percentile); // percentile in [0, 100]
+			unsigned long long GetMax(FrameStatType type);
+
+			void SetHistorySize(unsigned int frames);
+			unsigned int GetHistorySize() { return (unsigned int)mHistory.size(); }
+			unsigned int GetHistoryCount() { return mHistoryCount; }
+
+			// One row per frame in the history, oldest first
+			std::string ExportCSV();
+			bool ExportCSV(const std::string& path);
+
+		protected:
+			FrameStatistics(Context* context, unsigned int historySize);
+
+			void BeginFrame();
+			void EndFrame(unsigned long long frameIndex);
+
+		protected:
+			struct FrameRecord {
+				unsigned long long FrameIndex;
+				unsigned long long Values[FrameStatType::NUM_FRAME_STATS];
+			};
+
+			// i = 0 is the oldest frame kept
+			FrameRecord& GetRecord(unsigned int i) { return mHistory[(mHistoryHead + mHistory.size() - mHistoryCount + i) % mHistory.size()]; }
+
+			unsigned long long mCurrent[FrameStatType::NUM_FRAME_STATS];
+			unsigned int mIssuedAtBegin[StateCallType::NUM_STATE_CALLS], mFilteredAtBegin[StateCallType::NUM_STATE_CALLS];
+
+			std::vector<FrameRecord> mHistory;
+			unsigned int mHistoryHead; // next record to write
+			unsigned int mHistoryCount;
+
+			std::vector<unsigned long long> mScratch;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
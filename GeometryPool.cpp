@@ -0,0 +1,196 @@
+#include "GeometryPool.h"
+#include "Context.h"
+#include "DataBuffer.h"
+#include "InternalStateManager.h"
+
+namespace Backend {
+
+	GeometryPool::GeometryPool(Context* context, unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity) {
+		mContext = context;
+
+		mVertexStride = std::max(vertexStride, 1u);
+		mVertexAllocator.Reset(vertexCapacity);
+		mIndexAllocator.Reset(indexCapacity);
+
+		// Sub data slots, so uploads and defragmentation copies are ordered with the draws by GL
+		mDataBuffer = mContext->CreateDataBuffer();
+		mVertexSlot = mDataBuffer->AddBufferSlot("vertices", true);
+		mVertexSlot->ReserveSpace(vertexCapacity * mVertexStride);
+
+		if (indexCapacity) mDataBuffer->ReserveIndices(indexCapacity * sizeof(GLuint));
+
+		mNextMesh = INVALID_MESH + 1;
+
+		mDefragThreshold = 0.5f;
+		mDefragBytesPerUpdate = 1024 * 1024;
+		mBytesMoved = 0;
+	}
+
+	GeometryPool::~GeometryPool() {
+		if (mContext->Databuffer() == mDataBuffer) mContext->SetDatabuffer(nullptr);
+
+		delete mDataBuffer;
+	}
+
+	unsigned int GeometryPool::Allocate(unsigned int vertexCount, unsigned int indexCount) {
+		if (!vertexCount) return INVALID_MESH;
+
+		unsigned int baseVertex = mVertexAllocator.Allocate(vertexCount);
+		if (baseVertex == OffsetAllocator::INVALID_OFFSET) return INVALID_MESH;
+
+		unsigned int firstIndex = 0;
+		if (indexCount) {
+			firstIndex = mIndexAllocator.Allocate(indexCount);
+
+			if (firstIndex == OffsetAllocator::INVALID_OFFSET) {
+				mVertexAllocator.Free(baseVertex);
+				return INVALID_MESH;
+			}
+		}
+
+		GeometryAllocation allocation;
+		allocation.BaseVertex = baseVertex;
+		allocation.VertexCount = vertexCount;
+		allocation.FirstIndex = firstIndex;
+		allocation.IndexCount = indexCount;
+
+		unsigned int mesh = mNextMesh++;
+		mMeshes.insert({ mesh, allocation });
+
+		mVertexOwners[baseVertex] = mesh;
+		if (indexCount) mIndexOwners[firstIndex] = mesh;
+
+		return mesh;
+	}
+
+	unsigned int GeometryPool::Upload(const void* vertices, unsigned int vertexCount, const GLuint* indices, unsigned int indexCount) {
+		unsigned int mesh = Allocate(vertexCount, indices ? indexCount : 0);
+		if (mesh == INVALID_MESH) return INVALID_MESH;
+
+		UploadVertices(mesh, vertices, vertexCount);
+		if (indices) UploadIndices(mesh, indices, indexCount);
+
+		return mesh;
+	}
+
+	void GeometryPool::Free(unsigned int mesh) {
+		auto itr = mMeshes.find(mesh);
+		if (itr == mMeshes.end()) return;
+
+		GeometryAllocation& allocation = itr->second;
+
+		mVertexAllocator.Free(allocation.BaseVertex);
+		mVertexOwners.erase(allocation.BaseVertex);
+
+		if (allocation.IndexCount) {
+			mIndexAllocator.Free(allocation.FirstIndex);
+			mIndexOwners.erase(allocation.FirstIndex);
+		}
+
+		mMeshes.erase(itr);
+	}
+
+	void GeometryPool::UploadVertices(unsigned int mesh, const void* vertices, unsigned int vertexCount, unsigned int firstVertex) {
+		auto itr = mMeshes.find(mesh);
+		if (itr == mMeshes.end() || !vertices || firstVertex + vertexCount > itr->second.VertexCount) return;
+
+		mVertexSlot->UploadData(vertices, vertexCount * mVertexStride, (itr->second.BaseVertex + firstVertex) * mVertexStride);
+	}
+
+	void GeometryPool::UploadIndices(unsigned int mesh, const GLuint* indices, unsigned int indexCount, unsigned int firstIndex) {
+		auto itr = mMeshes.find(mesh);
+		if (itr == mMeshes.end() || !indices || firstIndex + indexCount > itr->second.IndexCount) return;
+
+		mDataBuffer->UploadIndices(indices, indexCount * sizeof(GLuint), (itr->second.FirstIndex + firstIndex) * sizeof(GLuint));
+	}
+
+	GeometryAllocation GeometryPool::GetAllocation(unsigned int mesh) {
+		auto itr = mMeshes.find(mesh);
+		if (itr == mMeshes.end()) return GeometryAllocation();
+
+		return itr->second;
+	}
+
+	void GeometryPool::Draw(RenderMode mode, unsigned int mesh) {
+		auto itr = mMeshes.find(mesh);
+		if (itr == mMeshes.end()) return;
+
+		GeometryAllocation& allocation = itr->second;
+
+		mContext->SetDatabuffer(mDataBuffer);
+
+		if (allocation.IndexCount) mContext->RenderI(mode, allocation.IndexCount, allocation.FirstIndex * sizeof(GLuint), allocation.BaseVertex);
+		else mContext->RenderV(mode, allocation.VertexCount, allocation.BaseVertex);
+	}
+
+	unsigned int GeometryPool::Defragment(unsigned int maxBytes) {
+		// Batched draws still reference the current offsets
+		mContext->FlushDrawBatch();
+
+		unsigned int bytesMoved = 0;
+		bool vertexMoved = true, indexMoved = true;
+
+		while (bytesMoved < maxBytes && (vertexMoved || indexMoved)) {
+			vertexMoved = MoveNext(mVertexAllocator, mVertexOwners, mVertexSlot->GetNativeHandle(), mVertexStride, true, bytesMoved);
+			if (bytesMoved >= maxBytes) break;
+
+			indexMoved = MoveNext(mIndexAllocator, mIndexOwners, mDataBuffer->GetIndicesNativeHandle(), sizeof(GLuint), false, bytesMoved);
+		}
+
+		mBytesMoved += bytesMoved;
+
+		return bytesMoved;
+	}
+
+	void GeometryPool::Update() {
+		if (mVertexAllocator.GetFragmentation() > mDefragThreshold || mIndexAllocator.GetFragmentation() > mDefragThreshold) {
+			Defragment(mDefragBytesPerUpdate);
+		}
+	}
+
+	GeometryPoolStats GeometryPool::GetStats() {
+		GeometryPoolStats stats;
+		stats.Meshes = (unsigned int)mMeshes.size();
+		stats.VerticesUsed = mVertexAllocator.GetUsedSize();
+		stats.VertexCapacity = mVertexAllocator.GetSize();
+		stats.IndicesUsed = mIndexAllocator.GetUsedSize();
+		stats.IndexCapacity = mIndexAllocator.GetSize();
+		stats.VertexFragmentation = mVertexAllocator.GetFragmentation();
+		stats.IndexFragmentation = mIndexAllocator.GetFragmentation();
+		stats.BytesMoved = mBytesMoved;
+
+		return stats;
+	}
+
+	bool GeometryPool::MoveNext(OffsetAllocator& allocator, std::map<unsigned int, unsigned int>& owners, GLuint handle, unsigned int elementSize, bool vertices, unsigned int& bytesMoved) {
+		unsigned int from, to;
+		if (!handle || !allocator.FindCompaction(from, to)) return false;
+
+		unsigned int size = allocator.GetAllocationSize(from) * elementSize;
+
+		// The destination is a free range below the source, the two never overlap
+		if (mContext->UsesDirectStateAccess()) {
+			glCopyNamedBufferSubData(handle, handle, (GLintptr)from * elementSize, (GLintptr)to * elementSize, size);
+		}
+		else {
+			InternalStateManager* stateManager = mContext->StateManager();
+			stateManager->BindBuffer(GL_COPY_READ_BUFFER, handle);
+			stateManager->BindBuffer(GL_COPY_WRITE_BUFFER, handle);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)from * elementSize, (GLintptr)to * elementSize, size);
+		}
+
+		allocator.Move(from, to);
+
+		unsigned int mesh = owners[from];
+		owners.erase(from);
+		owners[to] = mesh;
+
+		if (vertices) mMeshes[mesh].BaseVertex = to;
+		else mMeshes[mesh].FirstIndex = to;
+
+		bytesMoved += size;
+
+		return true;
+	}
+
+}
@@ -0,0 +1,103 @@
+#ifndef GEOMETRY_POOL_R_H
+#define GEOMETRY_POOL_R_H
+
+#include "include.h"
+#include "Context.h"
+#include "OffsetAllocator.h"
+
+namespace Backend {
+	class Context;
+	class DataBuffer;
+	class BufferSlot;
+	class GeometryPool;
+
+	// Where a mesh lives in the pool, in vertices and indices. Indices are relative to the mesh (drawn with BaseVertex)
+	struct GeometryAllocation {
+		unsigned int FirstIndex;
+		unsigned int IndexCount;
+		unsigned int BaseVertex;
+		unsigned int VertexCount;
+
+		GeometryAllocation() { FirstIndex = IndexCount = BaseVertex = VertexCount = 0; }
+	};
+
+	struct GeometryPoolStats {
+		unsigned int Meshes;
+		unsigned int VerticesUsed, VertexCapacity;
+		unsigned int IndicesUsed, IndexCapacity;
+		float VertexFragmentation, IndexFragmentation;
+		unsigned long long BytesMoved; // by defragmentation, since creation
+	};
+
+	// Vertices and indices of many meshes sharing one vertex layout, kept in one vertex buffer and one index buffer
+	// behind a single DataBuffer. Switching meshes only changes the first index and base vertex of the draw, so inside a
+	// draw batch (Context::BeginDrawBatch) all of them end up in one multi draw.
+	//
+	// Meshes are referenced by id since defragmentation moves them, read the allocation again after Update/Defragment.
+	class GeometryPool {
+		public:
+			static const unsigned int INVALID_MESH = 0;
+
+		public:
+			~GeometryPool();
+
+			// Declare the layout here, every descriptor with blockSize = the vertex stride
+			BufferSlot* GetVertexSlot() { return mVertexSlot; }
+			DataBuffer* GetDataBuffer() { return mDataBuffer; }
+
+			// Returns INVALID_MESH when the pool is full (or too fragmented, see Defragment)
+			unsigned int Allocate(unsigned int vertexCount, unsigned int indexCount);
+			unsigned int Upload(const void* vertices, unsigned int vertexCount, const GLuint* indices = nullptr, unsigned int indexCount = 0);
+			void Free(unsigned int mesh);
+
+			void UploadVertices(unsigned int mesh, const void* vertices, unsigned int vertexCount, unsigned int firstVertex = 0);
+			void UploadIndices(unsigned int mesh, const GLuint* indices, unsigned int indexCount, unsigned int firstIndex = 0);
+
+			bool IsValid(unsigned int mesh) { return mMeshes.find(mesh) != mMeshes.end(); }
+			GeometryAllocation GetAllocation(unsigned int mesh);
+
+			// Binds the pool's DataBuffer and draws the mesh (indexed if it has indices)
+			void Draw(RenderMode mode, unsigned int mesh);
+
+			// Moves meshes towards the start of the buffers with GPU copies, until maxBytes were copied or nothing can move.
+			// Returns the bytes copied
+			unsigned int Defragment(unsigned int maxBytes);
+
+			// Update defragments up to bytesPerUpdate while either buffer is more fragmented than threshold, call it once per frame
+			void SetDefragmentation(float threshold, unsigned int bytesPerUpdate) { mDefragThreshold = threshold; mDefragBytesPerUpdate = bytesPerUpdate; }
+			void Update();
+
+			unsigned int GetVertexStride() { return mVertexStride; }
+			GeometryPoolStats GetStats();
+
+		protected:
+			GeometryPool(Context* context, unsigned int vertexStride, unsigned int vertexCapacity, unsigned int indexCapacity);
+
+			// One compaction step of one buffer, false when it's compact
+			bool MoveNext(OffsetAllocator& allocator, std::map<unsigned int, unsigned int>& owners, GLuint handle, unsigned int elementSize, bool vertices, unsigned int& bytesMoved);
+
+		protected:
+			DataBuffer* mDataBuffer;
+			BufferSlot* mVertexSlot;
+
+			unsigned int mVertexStride;
+			OffsetAllocator mVertexAllocator, mIndexAllocator;
+
+			std::map<unsigned int, GeometryAllocation> mMeshes;
+			std::map<unsigned int, unsigned int> mVertexOwners, mIndexOwners; // offset, mesh
+			unsigned int mNextMesh;
+
+			float mDefragThreshold;
+			unsigned int mDefragBytesPerUpdate;
+			unsigned long long mBytesMoved;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,203 @@
+#include "GpuProfiler.h"
+#include "Context.h"
+#include <fstream>
+#include <sstream>
+
+namespace Backend {
+
+	GpuProfiler::GpuProfiler(Context* context) {
+		mContext = context;
+
+		for (auto& slot : mSlots) {
+			slot.FrameIndex = 0;
+			slot.QueriesUsed = 0;
+			slot.Recorded = false;
+		}
+
+		mCurrentSlot = 0;
+		mInFrame = false;
+		mHasResults = false;
+		mDroppedFrames = 0;
+
+		mEnabled = true;
+		mSupportsTimerQuery = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	}
+
+	GpuProfiler::~GpuProfiler() {
+		for (auto& slot : mSlots) {
+			if (!slot.Queries.empty()) glDeleteQueries((GLsizei)slot.Queries.size(), &slot.Queries[0]);
+		}
+	}
+
+	void GpuProfiler::BeginFrame(unsigned long long frameIndex) {
+		if (!mEnabled) return;
+
+		// The slot we are about to reuse holds the frame from LATENCY frames ago
+		mCurrentSlot = (unsigned int)(frameIndex % LATENCY);
+		FrameSlot& slot = mSlots[mCurrentSlot];
+
+		if (slot.Recorded) Resolve(mCurrentSlot);
+
+		slot.FrameIndex = frameIndex;
+		slot.Scopes.clear();
+		slot.QueriesUsed = 0;
+		slot.Recorded = false;
+
+		mScopeStack.clear();
+		mInFrame = true;
+
+		BeginScope("frame");
+	}
+
+	void GpuProfiler::EndFrame() {
+		if (!mInFrame) return;
+
+		// Close whatever was left open, the root scope included
+		while (!mScopeStack.empty()) EndScope();
+
+		mSlots[mCurrentSlot].Recorded = true;
+		mInFrame = false;
+	}
+
+	void GpuProfiler::BeginScope(const std::string& name) {
+		if (!mInFrame) return;
+
+		FrameSlot& slot = mSlots[mCurrentSlot];
+
+		PendingScope scope;
+		scope.Name = name;
+		scope.Depth = (int)mScopeStack.size();
+		scope.Parent = mScopeStack.empty() ? -1 : mScopeStack.back();
+		scope.BeginQuery = NextQuery(mCurrentSlot);
+		scope.EndQuery = NextQuery(mCurrentSlot);
+
+		// Timestamps instead of GL_TIME_ELAPSED, elapsed queries can't be nested
+		if (mSupportsTimerQuery) glQueryCounter(scope.BeginQuery, GL_TIMESTAMP);
+		scope.CpuBegin = Clock::now();
+
+		mScopeStack.push_back((int)slot.Scopes.size());
+		slot.Scopes.push_back(scope);
+	}
+
+	void GpuProfiler::EndScope() {
+		if (!mInFrame || mScopeStack.empty()) return;
+
+		PendingScope& scope = mSlots[mCurrentSlot].Scopes[mScopeStack.back()];
+		mScopeStack.pop_back();
+
+		scope.CpuEnd = Clock::now();
+		if (mSupportsTimerQuery) glQueryCounter(scope.EndQuery, GL_TIMESTAMP);
+	}
+
+	const GpuScopeResult* GpuProfiler::FindScope(const std::string& name) {
+		for (auto& scope : mLastResult.Scopes) {
+			if (scope.Name == name) return &scope;
+		}
+
+		return nullptr;
+	}
+
+	void GpuProfiler::Resolve(unsigned int slotIndex) {
+		FrameSlot& slot = mSlots[slotIndex];
+		if (slot.Scopes.empty()) return;
+
+		// The root end query is the last one issued, if it isn't there yet the GPU is too far behind: drop the frame
+		if (mSupportsTimerQuery) {
+			GLint available = 0;
+			glGetQueryObjectiv(slot.Scopes[0].EndQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+
+			if (!available) {
+				mDroppedFrames++;
+				return;
+			}
+		}
+
+		GLuint64 gpuFrameBegin = 0;
+		Clock::time_point cpuFrameBegin = slot.Scopes[0].CpuBegin;
+
+		mLastResult.FrameIndex = slot.FrameIndex;
+		mLastResult.Scopes.resize(slot.Scopes.size());
+
+		for (size_t i = 0; i < slot.Scopes.size(); ++i) {
+			PendingScope& pending = slot.Scopes[i];
+			GpuScopeResult& result = mLastResult.Scopes[i];
+
+			result.Name = pending.Name;
+			result.Depth = pending.Depth;
+			result.Parent = pending.Parent;
+
+			result.CpuStartMs = std::chrono::duration<double, std::milli>(pending.CpuBegin - cpuFrameBegin).count();
+			result.CpuTimeMs = std::chrono::duration<double, std::milli>(pending.CpuEnd - pending.CpuBegin).count();
+
+			result.GpuStartMs = result.GpuTimeMs = 0.0;
+			if (mSupportsTimerQuery) {
+				GLuint64 begin = 0, end = 0;
+				glGetQueryObjectui64v(pending.BeginQuery, GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(pending.EndQuery, GL_QUERY_RESULT, &end);
+
+				if (i == 0) gpuFrameBegin = begin;
+
+				result.GpuStartMs = (double)(begin - gpuFrameBegin) / 1000000.0;
+				result.GpuTimeMs = (double)(end - begin) / 1000000.0;
+			}
+		}
+
+		mHasResults = true;
+	}
+
+	GLuint GpuProfiler::NextQuery(unsigned int slotIndex) {
+		FrameSlot& slot = mSlots[slotIndex];
+
+		if (slot.QueriesUsed == slot.Queries.size()) {
+			GLuint query = 0;
+			if (mSupportsTimerQuery) glGenQueries(1, &query);
+			slot.Queries.push_back(query);
+		}
+
+		return slot.Queries[slot.QueriesUsed++];
+	}
+
+	std::string GpuProfiler::ExportJSON() {
+		std::ostringstream stream;
+
+		stream << "{\"frame\":" << mLastResult.FrameIndex << ",\"scopes\":[";
+		if (!mLastResult.Scopes.empty()) WriteScopeJSON(stream, 0);
+		stream << "]}";
+
+		return stream.str();
+	}
+
+	bool GpuProfiler::ExportJSON(const std::string& path) {
+		std::ofstream file(path);
+		if (!file.is_open()) return false;
+
+		file << ExportJSON();
+
+		return true;
+	}
+
+	void GpuProfiler::WriteScopeJSON(std::ostream& stream, int scopeIndex) {
+		GpuScopeResult& scope = mLastResult.Scopes[scopeIndex];
+
+		stream << "{\"name\":\"";
+		for (char c : scope.Name) {
+			if (c == '"' || c == '\\') stream << '\\';
+			stream << c;
+		}
+		stream << "\",\"gpu_start_ms\":" << scope.GpuStartMs << ",\"gpu_ms\":" << scope.GpuTimeMs;
+		stream << ",\"cpu_start_ms\":" << scope.CpuStartMs << ",\"cpu_ms\":" << scope.CpuTimeMs << ",\"children\":[";
+
+		// Children follow their parent in the flat list
+		bool first = true;
+		for (size_t i = scopeIndex + 1; i < mLastResult.Scopes.size() && mLastResult.Scopes[i].Depth > scope.Depth; ++i) {
+			if (mLastResult.Scopes[i].Parent != scopeIndex) continue;
+
+			if (!first) stream << ",";
+			WriteScopeJSON(stream, (int)i);
+			first = false;
+		}
+
+		stream << "]}";
+	}
+
+}
@@ -0,0 +1,107 @@
+#ifndef GPU_PROFILER_R_H
+#define GPU_PROFILER_R_H
+
+#include "include.h"
+#include <chrono>
+
+namespace Backend {
+	class Context;
+	class GpuProfiler;
+
+	// One resolved scope, Parent is the index of the enclosing scope in the frame (-1 for the frame root)
+	struct GpuScopeResult {
+		std::string Name;
+		int Depth;
+		int Parent;
+
+		double GpuStartMs, GpuTimeMs; // start is relative to the frame root
+		double CpuStartMs, CpuTimeMs;
+	};
+
+	// Scopes of one frame in the order they were opened, the first one is the whole frame
+	struct GpuFrameResult {
+		unsigned long long FrameIndex;
+		std::vector<GpuScopeResult> Scopes;
+
+		GpuFrameResult() { FrameIndex = 0; }
+
+		double GpuTimeMs() { return Scopes.empty() ? 0.0 : Scopes[0].GpuTimeMs; }
+		double CpuTimeMs() { return Scopes.empty() ? 0.0 : Scopes[0].CpuTimeMs; }
+	};
+
+	// Nested GPU/CPU timing scopes built on GL_TIMESTAMP queries.
+	// Every frame writes its queries into its own slot of a ring that is read back LATENCY frames later,
+	// and only if the results are already available, so the CPU never waits on the GPU.
+	class GpuProfiler {
+		public:
+			static const unsigned int LATENCY = 4;
+
+		public:
+			~GpuProfiler();
+
+			void BeginScope(const std::string& name);
+			void EndScope();
+
+			void SetEnabled(bool enabled) { mEnabled = enabled; }
+			bool IsEnabled() { return mEnabled; }
+
+			// Latest frame that made it back from the GPU
+			bool HasResults() { return mHasResults; }
+			GpuFrameResult& GetLastResult() { return mLastResult; }
+			const GpuScopeResult* FindScope(const std::string& name);
+
+			unsigned int GetDroppedFramesCount() { return mDroppedFrames; }
+
+			std::string ExportJSON();
+			bool ExportJSON(const std::string& path);
+
+		protected:
+			GpuProfiler(Context* context);
+
+			void BeginFrame(unsigned long long frameIndex);
+			void EndFrame();
+
+			void Resolve(unsigned int slotIndex);
+			GLuint NextQuery(unsigned int slotIndex);
+			void WriteScopeJSON(std::ostream& stream, int scopeIndex);
+
+		protected:
+			using Clock = std::chrono::high_resolution_clock;
+
+			struct PendingScope {
+				std::string Name;
+				int Depth, Parent;
+				GLuint BeginQuery, EndQuery;
+				Clock::time_point CpuBegin, CpuEnd;
+			};
+
+			struct FrameSlot {
+				unsigned long long FrameIndex;
+				std::vector<PendingScope> Scopes;
+				std::vector<GLuint> Queries; // pool, grows to the largest frame seen
+				unsigned int QueriesUsed;
+				bool Recorded;
+			};
+
+			FrameSlot mSlots[LATENCY];
+			unsigned int mCurrentSlot;
+			std::vector<int> mScopeStack;
+			bool mInFrame;
+
+			GpuFrameResult mLastResult;
+			bool mHasResults;
+			unsigned int mDroppedFrames;
+
+			bool mEnabled;
+			bool mSupportsTimerQuery;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,68 @@
+#include "IndirectDrawBatch.h"
+#include "Context.h"
+#include "InternalStateManager.h"
+
+namespace Backend {
+
+	IndirectDrawBatch::IndirectDrawBatch(Context* context, unsigned int maxDraws) {
+		mContext = context;
+
+		mMaxDraws = maxDraws;
+		mInstanceCount = 0;
+		mCommands.reserve(maxDraws);
+
+		if (mContext->UsesDirectStateAccess()) {
+			glCreateBuffers(1, &mBufferHandle);
+			glNamedBufferData(mBufferHandle, sizeof(DrawElementsIndirectCommand) * maxDraws, 0, GL_STREAM_DRAW);
+		}
+		else {
+			glGenBuffers(1, &mBufferHandle);
+			mContext->StateManager()->BindBuffer(GL_DRAW_INDIRECT_BUFFER, mBufferHandle);
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * maxDraws, 0, GL_STREAM_DRAW);
+		}
+	}
+
+	IndirectDrawBatch::~IndirectDrawBatch() {
+		mContext->StateManager()->BufferDeleted(mBufferHandle);
+		glDeleteBuffers(1, &mBufferHandle);
+	}
+
+	IndirectDrawBatch* IndirectDrawBatch::Add(int count, int indicesOffset, int verticesOffset, int instanceCount, unsigned int indexSize) {
+		if (Full() || count <= 0) return this;
+
+		DrawElementsIndirectCommand command;
+		command.Count = count;
+		command.InstanceCount = instanceCount;
+		command.FirstIndex = indicesOffset / indexSize; // offsets are passed in bytes, like RenderI
+		command.BaseVertex = verticesOffset;
+		command.BaseInstance = mInstanceCount;
+
+		mInstanceCount += instanceCount;
+		mCommands.push_back(command);
+
+		return this;
+	}
+
+	IndirectDrawBatch* IndirectDrawBatch::Clear() {
+		mCommands.clear();
+		mInstanceCount = 0;
+
+		return this;
+	}
+
+	void IndirectDrawBatch::Upload() {
+		// The draw reads the commands through the indirect binding either way
+		mContext->StateManager()->BindBuffer(GL_DRAW_INDIRECT_BUFFER, mBufferHandle);
+
+		// Orphan the previous storage so we never wait on draws still reading it
+		if (mContext->UsesDirectStateAccess()) {
+			glNamedBufferData(mBufferHandle, sizeof(DrawElementsIndirectCommand) * mMaxDraws, 0, GL_STREAM_DRAW);
+			glNamedBufferSubData(mBufferHandle, 0, sizeof(DrawElementsIndirectCommand) * mCommands.size(), &mCommands[0]);
+		}
+		else {
+			glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * mMaxDraws, 0, GL_STREAM_DRAW);
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * mCommands.size(), &mCommands[0]);
+		}
+	}
+
+}
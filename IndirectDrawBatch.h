@@ -0,0 +1,57 @@
+#ifndef INDIRECT_DRAW_BATCH_R_H
+#define INDIRECT_DRAW_BATCH_R_H
+
+#include "include.h"
+
+namespace Backend {
+	class Context;
+	class IndirectDrawBatch;
+
+	// Same layout as the GL spec, so the array can be uploaded as is
+	struct DrawElementsIndirectCommand {
+		GLuint Count;
+		GLuint InstanceCount;
+		GLuint FirstIndex;
+		GLint BaseVertex;
+		GLuint BaseInstance;
+	};
+
+	// A list of indexed draws sharing the same shader, DataBuffer and state, submitted with a single glMultiDrawElementsIndirect.
+	// Every draw gets its position in the batch as base instance, so shaders can fetch per draw data through gl_BaseInstance
+	// (or gl_DrawID with ARB_shader_draw_parameters) or through an attribute using an instance divisor of 1.
+	class IndirectDrawBatch {
+		public:
+			~IndirectDrawBatch();
+
+			// indexSize is the size of one index of the DataBuffer drawn with the batch (see DataBuffer::IndexSize)
+			IndirectDrawBatch* Add(int count, int indicesOffset = 0, int verticesOffset = 0, int instanceCount = 1, unsigned int indexSize = sizeof(GLuint));
+			IndirectDrawBatch* Clear();
+
+			bool Empty() { return mCommands.empty(); }
+			bool Full() { return mCommands.size() >= mMaxDraws; }
+			unsigned int Size() { return (unsigned int)mCommands.size(); }
+
+			GLuint GetNativeHandle() { return mBufferHandle; }
+
+		protected:
+			IndirectDrawBatch(Context* context, unsigned int maxDraws);
+
+			void Upload();
+
+		protected:
+			GLuint mBufferHandle;
+			unsigned int mMaxDraws;
+			unsigned int mInstanceCount;
+
+			std::vector<DrawElementsIndirectCommand> mCommands;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
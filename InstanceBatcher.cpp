@@ -0,0 +1,131 @@
+#include "InstanceBatcher.h"
+#include "Context.h"
+#include "DataBuffer.h"
+
+namespace Backend {
+
+	InstanceBatcher::InstanceBatcher(Context* context, unsigned int instanceStride, unsigned int maxInstancesPerFrame) {
+		mContext = context;
+
+		mInstanceStride = std::max(instanceStride, 1u);
+		mMaxInstances = std::max(maxInstancesPerFrame, 1u);
+		mPersistent = mContext->SupportsBaseInstance();
+
+		mGroup.Mesh = nullptr;
+		mGroup.Shader = nullptr;
+		mHasGroup = false;
+	}
+
+	InstanceBatcher::~InstanceBatcher() {
+		// The slots belong to the meshes
+	}
+
+	BufferSlot* InstanceBatcher::AttachTo(DataBuffer* mesh, const std::string& slotName) {
+		if (!mesh) return nullptr;
+
+		auto itr = mTargets.find(mesh);
+		if (itr != mTargets.end()) return itr->second.Slot;
+
+		MeshTarget target;
+		target.Slot = mesh->AddBufferSlot(slotName, true, mPersistent ? StreamingMode::STREAM_PERSISTENT : StreamingMode::STREAM_ORPHAN);
+		target.Slot->ReserveSpace(mInstanceStride * mMaxInstances);
+		target.Cursor = 0;
+		target.Frame = mContext->FrameCount();
+
+		mTargets.insert({ mesh, target });
+
+		return target.Slot;
+	}
+
+	void InstanceBatcher::Detach(DataBuffer* mesh) {
+		if (mHasGroup && mGroup.Mesh == mesh) {
+			mInstanceData.clear();
+			mHasGroup = false;
+		}
+
+		mTargets.erase(mesh);
+	}
+
+	void InstanceBatcher::Begin() {
+		mStats = InstanceBatcherStats();
+	}
+
+	void InstanceBatcher::End() {
+		Flush();
+	}
+
+	bool InstanceBatcher::Submit(DataBuffer* mesh, ShaderProgram* shader, const std::vector<std::pair<int, TextureBuffer*>>& textures, RenderMode mode, int count, int indicesOffset, int verticesOffset, const void* instanceData) {
+		if (mTargets.find(mesh) == mTargets.end()) return false;
+
+		if (mHasGroup && !Matches(mesh, shader, textures, mode, count, indicesOffset, verticesOffset)) Flush();
+
+		if (!mHasGroup) {
+			mGroup.Mesh = mesh;
+			mGroup.Shader = shader;
+			mGroup.Textures = textures;
+			mGroup.Mode = mode;
+			mGroup.Count = count;
+			mGroup.IndicesOffset = indicesOffset;
+			mGroup.VerticesOffset = verticesOffset;
+
+			mHasGroup = true;
+		}
+
+		const unsigned char* bytes = (const unsigned char*)instanceData;
+		mInstanceData.insert(mInstanceData.end(), bytes, bytes + mInstanceStride);
+
+		mStats.Submitted++;
+
+		// The slot can't take a bigger group anyway
+		if (mInstanceData.size() >= (size_t)mInstanceStride * mMaxInstances) Flush();
+
+		return true;
+	}
+
+	void InstanceBatcher::Flush() {
+		if (!mHasGroup) return;
+
+		MeshTarget& target = mTargets[mGroup.Mesh];
+		unsigned int instanceCount = (unsigned int)(mInstanceData.size() / mInstanceStride);
+		unsigned int baseInstance = 0;
+
+		if (mPersistent) {
+			// Each group takes the next range of this frame's region, so draws of the same frame don't overwrite each other
+			if (target.Frame != mContext->FrameCount()) {
+				target.Frame = mContext->FrameCount();
+				target.Cursor = 0;
+			}
+
+			unsigned int available = mMaxInstances - target.Cursor;
+			if (instanceCount > available) {
+				mStats.DroppedInstances += instanceCount - available;
+				instanceCount = available;
+			}
+
+			baseInstance = target.Cursor;
+			target.Cursor += instanceCount;
+		}
+
+		if (instanceCount) {
+			target.Slot->UploadData(&mInstanceData[0], instanceCount * mInstanceStride, baseInstance * mInstanceStride);
+
+			mContext->SetDatabuffer(mGroup.Mesh);
+			if (mGroup.Shader) mContext->SetShader(mGroup.Shader);
+			if (!mGroup.Textures.empty()) mContext->BindTextures(mGroup.Textures);
+
+			mContext->RenderIInstanced(mGroup.Mode, mGroup.Count, instanceCount, mGroup.IndicesOffset, mGroup.VerticesOffset, baseInstance);
+
+			mStats.Draws++;
+			mStats.Instances += instanceCount;
+		}
+
+		mInstanceData.clear();
+		mHasGroup = false;
+	}
+
+	bool InstanceBatcher::Matches(DataBuffer* mesh, ShaderProgram* shader, const std::vector<std::pair<int, TextureBuffer*>>& textures, RenderMode mode, int count, int indicesOffset, int verticesOffset) {
+		return mGroup.Mesh == mesh && mGroup.Shader == shader && mGroup.Mode == mode && mGroup.Count == count &&
+			mGroup.IndicesOffset == indicesOffset && mGroup.VerticesOffset == verticesOffset && mGroup.Textures == textures;
+	}
+
+}
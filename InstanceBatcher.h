@@ -0,0 +1,97 @@
+#ifndef INSTANCE_BATCHER_R_H
+#define INSTANCE_BATCHER_R_H
+
+#include "include.h"
+#include "Context.h"
+
+namespace Backend {
+	class Context;
+	class DataBuffer;
+	class BufferSlot;
+	class ShaderProgram;
+	class TextureBuffer;
+	class InstanceBatcher;
+
+	struct InstanceBatcherStats {
+		unsigned int Submitted; // Submit calls
+		unsigned int Draws; // instanced draws issued
+		unsigned int Instances;
+		unsigned int DroppedInstances; // over the per frame capacity of a mesh
+
+		InstanceBatcherStats() { Submitted = Draws = Instances = DroppedInstances = 0; }
+
+		float InstancesPerDraw() { return Draws ? (float)Instances / Draws : 0.0f; }
+	};
+
+	// Merges consecutive submits of the same mesh (DataBuffer and index range), shader, texture set and mode into one
+	// instanced draw. The per instance data of a group is appended to a streaming slot of the mesh, which holds the
+	// attributes with an instance divisor (see AttachTo). A group is drawn when a submit breaks it, on Flush and on End.
+	//
+	// With ARB_base_instance the slot is persistently mapped and every group gets its own range of the frame region,
+	// otherwise the slot is orphaned and rewritten for each group.
+	class InstanceBatcher {
+		public:
+			~InstanceBatcher();
+
+			// Adds the instance slot to the mesh, declare its attributes on the returned slot with an instance divisor of 1
+			// and blockSize = the instance stride. Attaching an attached mesh returns its slot
+			BufferSlot* AttachTo(DataBuffer* mesh, const std::string& slotName = "instances");
+			void Detach(DataBuffer* mesh); // call before deleting an attached mesh
+
+			void Begin();
+			void End();
+
+			// instanceData points to one instance (instanceStride bytes). Returns false if the mesh isn't attached
+			bool Submit(DataBuffer* mesh, ShaderProgram* shader, const std::vector<std::pair<int, TextureBuffer*>>& textures, RenderMode mode, int count, int indicesOffset, int verticesOffset, const void* instanceData);
+			bool Submit(DataBuffer* mesh, ShaderProgram* shader, const std::vector<std::pair<int, TextureBuffer*>>& textures, RenderMode mode, int count, const void* instanceData) { return Submit(mesh, shader, textures, mode, count, 0, 0, instanceData); }
+
+			void Flush();
+
+			unsigned int GetInstanceStride() { return mInstanceStride; }
+			unsigned int GetMaxInstancesPerFrame() { return mMaxInstances; }
+
+			// Counters since Begin
+			InstanceBatcherStats GetStats() { return mStats; }
+
+		protected:
+			InstanceBatcher(Context* context, unsigned int instanceStride, unsigned int maxInstancesPerFrame);
+
+			struct MeshTarget {
+				BufferSlot* Slot;
+				unsigned int Cursor; // instances written in the frame region
+				unsigned long long Frame;
+			};
+
+			struct Group {
+				DataBuffer* Mesh;
+				ShaderProgram* Shader;
+				std::vector<std::pair<int, TextureBuffer*>> Textures;
+				RenderMode Mode;
+				int Count, IndicesOffset, VerticesOffset;
+			};
+
+			bool Matches(DataBuffer* mesh, ShaderProgram* shader, const std::vector<std::pair<int, TextureBuffer*>>& textures, RenderMode mode, int count, int indicesOffset, int verticesOffset);
+
+		protected:
+			unsigned int mInstanceStride;
+			unsigned int mMaxInstances;
+			bool mPersistent;
+
+			std::map<DataBuffer*, MeshTarget> mTargets;
+
+			Group mGroup;
+			bool mHasGroup;
+			std::vector<unsigned char> mInstanceData; // instances of the open group
+
+			InstanceBatcherStats mStats;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -1,15 +1,491 @@
 #include "InternalStateManager.h"
 
-void InternalStateManager::BindShaderProgram(GLuint handle) {
-	if (handle != mShaderProgram) {
+namespace Backend {
+
+	InternalStateManager::InternalStateManager() {
+		mSupportsMultiBind = GLEW_VERSION_4_4 || GLEW_ARB_multi_bind;
+
+		mPendingFirst = MAX_TEXTURE_UNITS;
+		mPendingLast = -1;
+		memset(mPendingTextures, 0, sizeof(mPendingTextures));
+		memset(mPendingTargets, 0, sizeof(mPendingTargets));
+		for (auto& sampler : mPendingSamplers) sampler = UNKNOWN_HANDLE;
+
+		Invalidate();
+		ResetCounters();
+	}
+
+	void InternalStateManager::Invalidate() {
+		mShaderProgram = UNKNOWN_HANDLE;
+		mReadFramebuffer = mDrawFramebuffer = UNKNOWN_HANDLE;
+		mVertexArray = UNKNOWN_HANDLE;
+
+		for (auto& buffer : mBuffers) buffer = UNKNOWN_HANDLE;
+		mVertexArrayElementBuffers.clear();
+		for (auto& range : mBufferRanges) range[0] = range[1] = range[2] = -1;
+
+		mActiveTextureUnit = -1;
+		for (auto& unit : mTextures) {
+			for (auto& texture : unit) texture = UNKNOWN_HANDLE;
+		}
+		for (auto& sampler : mSamplers) sampler = UNKNOWN_HANDLE;
+
+		for (int i = 0; i < 4; ++i) mViewport[i] = mScissor[i] = -1;
+		for (auto& capability : mCapabilities) capability = -1;
+
+		mBlendSource = mBlendDestination = GL_NONE;
+		mDepthMask = -1;
+		mCullFace = GL_NONE;
+		mClearColorKnown = false;
+	}
+
+	bool InternalStateManager::Filter(StateCallType type, bool redundant) {
+		if (redundant) {
+			mFiltered[type]++;
+			return true;
+		}
+
+		mIssued[type]++;
+		return false;
+	}
+
+	void InternalStateManager::BindShaderProgram(GLuint handle) {
+		if (Filter(STATE_CALL_PROGRAM, handle == mShaderProgram)) return;
+
 		glUseProgram(handle);
 		mShaderProgram = handle;
 	}
-}
 
-void InternalStateManager::BindFramebuffer(GLuint handle) {
-	if (handle != mFramebuffer) {
-		//glBind(handle);
-		mShaderProgram = handle;
+	void InternalStateManager::BindFramebuffer(GLuint handle) {
+		if (Filter(STATE_CALL_FRAMEBUFFER, handle == mReadFramebuffer && handle == mDrawFramebuffer)) return;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, handle);
+		mReadFramebuffer = mDrawFramebuffer = handle;
+	}
+
+	void InternalStateManager::BindReadFramebuffer(GLuint handle) {
+		if (Filter(STATE_CALL_FRAMEBUFFER, handle == mReadFramebuffer)) return;
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, handle);
+		mReadFramebuffer = handle;
+	}
+
+	void InternalStateManager::BindDrawFramebuffer(GLuint handle) {
+		if (Filter(STATE_CALL_FRAMEBUFFER, handle == mDrawFramebuffer)) return;
+
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, handle);
+		mDrawFramebuffer = handle;
+	}
+
+	void InternalStateManager::BindVertexArray(GLuint handle) {
+		if (Filter(STATE_CALL_VERTEX_ARRAY, handle == mVertexArray)) return;
+
+		glBindVertexArray(handle);
+		mVertexArray = handle;
+
+		// The element array binding is part of the vertex array state
+		auto itr = mVertexArrayElementBuffers.find(handle);
+		mBuffers[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = (itr != mVertexArrayElementBuffers.end()) ? itr->second : UNKNOWN_HANDLE;
+	}
+
+	void InternalStateManager::BindBuffer(GLenum target, GLuint handle) {
+		int index = BufferTargetIndex(target);
+
+		if (Filter(STATE_CALL_BUFFER, index >= 0 && mBuffers[index] == handle)) return;
+
+		glBindBuffer(target, handle);
+
+		if (index >= 0) {
+			mBuffers[index] = handle;
+
+			if (target == GL_ELEMENT_ARRAY_BUFFER && mVertexArray != UNKNOWN_HANDLE) mVertexArrayElementBuffers[mVertexArray] = handle;
+		}
+	}
+
+	void InternalStateManager::VertexArrayElementBufferSet(GLuint vertexArray, GLuint handle) {
+		mVertexArrayElementBuffers[vertexArray] = handle;
+
+		if (vertexArray == mVertexArray) mBuffers[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = handle;
+	}
+
+	void InternalStateManager::BindBufferRange(GLenum target, GLuint index, GLuint handle, GLintptr offset, GLsizeiptr size) {
+		bool tracked = target == GL_UNIFORM_BUFFER && index < MAX_BUFFER_BINDINGS;
+
+		if (Filter(STATE_CALL_BUFFER, IsBufferRangeBound(target, index, handle, offset, size))) return;
+
+		glBindBufferRange(target, index, handle, offset, size);
+
+		// Indexed binds also replace the generic binding point
+		int targetIndex = BufferTargetIndex(target);
+		if (targetIndex >= 0) mBuffers[targetIndex] = handle;
+
+		if (tracked) {
+			mBufferRanges[index][0] = handle;
+			mBufferRanges[index][1] = offset;
+			mBufferRanges[index][2] = size;
+		}
+	}
+
+	bool InternalStateManager::IsBufferRangeBound(GLenum target, GLuint index, GLuint handle, GLintptr offset, GLsizeiptr size) {
+		if (target != GL_UNIFORM_BUFFER || index >= MAX_BUFFER_BINDINGS) return false;
+
+		return mBufferRanges[index][0] == (GLintptr)handle && mBufferRanges[index][1] == offset && mBufferRanges[index][2] == size;
+	}
+
+	void InternalStateManager::SetActiveTextureUnit(int unit) {
+		if (Filter(STATE_CALL_ACTIVE_TEXTURE, unit == mActiveTextureUnit)) return;
+
+		glActiveTexture(GL_TEXTURE0 + unit);
+		mActiveTextureUnit = unit;
+	}
+
+	void InternalStateManager::BindTexture(int unit, GLenum target, GLuint handle) {
+		int index = TextureTargetIndex(target);
+		bool tracked = index >= 0 && unit >= 0 && unit < MAX_TEXTURE_UNITS;
+
+		if (Filter(STATE_CALL_TEXTURE, tracked && mTextures[unit][index] == handle)) return;
+
+		SetActiveTextureUnit(unit);
+		glBindTexture(target, handle);
+
+		if (tracked) mTextures[unit][index] = handle;
+	}
+
+	void InternalStateManager::BindTextureForEdit(GLenum target, GLuint handle) {
+		if (mActiveTextureUnit < 0) SetActiveTextureUnit(0);
+
+		BindTexture(mActiveTextureUnit, target, handle);
+	}
+
+	void InternalStateManager::QueueTexture(int unit, GLenum target, GLuint handle) {
+		int index = TextureTargetIndex(target);
+		if (unit < 0 || unit >= MAX_TEXTURE_UNITS || index < 0) return;
+
+		// Already in place and nothing else queued for the unit
+		if (mTextures[unit][index] == handle && !mPendingTextures[unit]) {
+			mFiltered[STATE_CALL_TEXTURE]++;
+			return;
+		}
+
+		mPendingTextures[unit] = handle;
+		mPendingTargets[unit] = target;
+		mPendingFirst = std::min(mPendingFirst, unit);
+		mPendingLast = std::max(mPendingLast, unit);
+	}
+
+	void InternalStateManager::FlushTextures() {
+		if (!HasPendingTextures()) return;
+
+		FlushSamplers();
+
+		if (mSupportsMultiBind) {
+			// One call for the whole range, units in between get what they already have bound
+			GLuint handles[MAX_TEXTURE_UNITS];
+			int targets[MAX_TEXTURE_UNITS]; // target index of the handle passed for each unit, -1 for 0
+			bool complete = true;
+
+			for (int i = mPendingFirst; i <= mPendingLast; ++i) {
+				GLuint handle = mPendingTextures[i];
+				int target = handle ? TextureTargetIndex(mPendingTargets[i]) : -1;
+
+				for (int j = 0; j < NUM_TEXTURE_TARGETS && !handle; ++j) {
+					if (mTextures[i][j] == UNKNOWN_HANDLE) complete = false;
+					else if (mTextures[i][j]) {
+						handle = mTextures[i][j];
+						target = j;
+					}
+				}
+
+				handles[i - mPendingFirst] = handle;
+				targets[i - mPendingFirst] = target;
+			}
+
+			// A zero in the list unbinds every target of the unit, only safe when we know nothing else is bound there
+			if (complete) {
+				glBindTextures(mPendingFirst, mPendingLast - mPendingFirst + 1, handles);
+				mIssued[STATE_CALL_TEXTURE]++;
+
+				// Each unit keeps only the handle passed for it, GL unbinds the other targets of the unit
+				for (int i = mPendingFirst; i <= mPendingLast; ++i) {
+					for (int j = 0; j < NUM_TEXTURE_TARGETS; ++j) mTextures[i][j] = (j == targets[i - mPendingFirst]) ? handles[i - mPendingFirst] : 0;
+					mPendingTextures[i] = 0;
+				}
+
+				mPendingFirst = MAX_TEXTURE_UNITS;
+				mPendingLast = -1;
+				return;
+			}
+		}
+
+		for (int i = mPendingFirst; i <= mPendingLast; ++i) {
+			if (!mPendingTextures[i]) continue;
+
+			BindTexture(i, mPendingTargets[i], mPendingTextures[i]);
+			mPendingTextures[i] = 0;
+		}
+
+		mPendingFirst = MAX_TEXTURE_UNITS;
+		mPendingLast = -1;
+	}
+
+	void InternalStateManager::BindSampler(int unit, GLuint handle) {
+		if (unit < 0 || unit >= MAX_TEXTURE_UNITS) return;
+		if (Filter(STATE_CALL_SAMPLER, mSamplers[unit] == handle)) return;
+
+		// Sampler bindings take the unit directly, the active unit stays as it is
+		glBindSampler(unit, handle);
+		mSamplers[unit] = handle;
+	}
+
+	void InternalStateManager::QueueSampler(int unit, GLuint handle) {
+		if (unit < 0 || unit >= MAX_TEXTURE_UNITS) return;
+
+		if (mSamplers[unit] == handle && mPendingSamplers[unit] == UNKNOWN_HANDLE) {
+			mFiltered[STATE_CALL_SAMPLER]++;
+			return;
+		}
+
+		mPendingSamplers[unit] = handle;
+		mPendingFirst = std::min(mPendingFirst, unit);
+		mPendingLast = std::max(mPendingLast, unit);
+	}
+
+	void InternalStateManager::FlushSamplers() {
+		bool any = false, complete = true;
+		GLuint handles[MAX_TEXTURE_UNITS];
+
+		for (int i = mPendingFirst; i <= mPendingLast; ++i) {
+			GLuint handle = mPendingSamplers[i];
+			if (handle != UNKNOWN_HANDLE) any = true;
+			else handle = mSamplers[i];
+
+			if (handle == UNKNOWN_HANDLE) complete = false;
+			handles[i - mPendingFirst] = handle;
+		}
+
+		if (!any) return;
+
+		// Units in between get the sampler they already have, unless we don't know it
+		if (mSupportsMultiBind && complete) {
+			glBindSamplers(mPendingFirst, mPendingLast - mPendingFirst + 1, handles);
+			mIssued[STATE_CALL_SAMPLER]++;
+
+			for (int i = mPendingFirst; i <= mPendingLast; ++i) {
+				mSamplers[i] = handles[i - mPendingFirst];
+				mPendingSamplers[i] = UNKNOWN_HANDLE;
+			}
+			return;
+		}
+
+		for (int i = mPendingFirst; i <= mPendingLast; ++i) {
+			if (mPendingSamplers[i] == UNKNOWN_HANDLE) continue;
+
+			BindSampler(i, mPendingSamplers[i]);
+			mPendingSamplers[i] = UNKNOWN_HANDLE;
+		}
+	}
+
+	void InternalStateManager::UnbindAllTextures() {
+		bool anyBound = false;
+		for (auto& unit : mTextures) {
+			for (auto texture : unit) {
+				if (texture) anyBound = true;
+			}
+		}
+
+		if (Filter(STATE_CALL_TEXTURE, !anyBound)) return;
+
+		if (mSupportsMultiBind) {
+			glBindTextures(0, MAX_TEXTURE_UNITS, NULL);
+			memset(mTextures, 0, sizeof(mTextures));
+			return;
+		}
+
+		UnbindTextures(GL_TEXTURE_2D);
+		UnbindTextures(GL_TEXTURE_CUBE_MAP);
+		UnbindTextures(GL_TEXTURE_2D_ARRAY);
+	}
+
+	void InternalStateManager::UnbindTextures(GLenum target) {
+		int index = TextureTargetIndex(target);
+		if (index < 0) return;
+
+		for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+			if (mTextures[i][index] != 0) BindTexture(i, target, 0);
+		}
+	}
+
+	void InternalStateManager::SetViewport(int x, int y, int width, int height) {
+		if (Filter(STATE_CALL_VIEWPORT, mViewport[0] == x && mViewport[1] == y && mViewport[2] == width && mViewport[3] == height)) return;
+
+		glViewport(x, y, width, height);
+		mViewport[0] = x; mViewport[1] = y; mViewport[2] = width; mViewport[3] = height;
+	}
+
+	void InternalStateManager::SetScissor(int x, int y, int width, int height) {
+		if (Filter(STATE_CALL_SCISSOR, mScissor[0] == x && mScissor[1] == y && mScissor[2] == width && mScissor[3] == height)) return;
+
+		glScissor(x, y, width, height);
+		mScissor[0] = x; mScissor[1] = y; mScissor[2] = width; mScissor[3] = height;
+	}
+
+	void InternalStateManager::SetCapability(GLenum capability, bool enabled) {
+		int index = CapabilityIndex(capability);
+
+		if (Filter(STATE_CALL_CAPABILITY, index >= 0 && mCapabilities[index] == (int)enabled)) return;
+
+		if (enabled) glEnable(capability);
+		else glDisable(capability);
+
+		if (index >= 0) mCapabilities[index] = enabled;
 	}
+
+	void InternalStateManager::SetBlendFunc(GLenum source, GLenum destination) {
+		if (Filter(STATE_CALL_BLEND_FUNC, source == mBlendSource && destination == mBlendDestination)) return;
+
+		glBlendFunc(source, destination);
+		mBlendSource = source;
+		mBlendDestination = destination;
+	}
+
+	void InternalStateManager::SetDepthMask(bool write) {
+		if (Filter(STATE_CALL_DEPTH_MASK, mDepthMask == (int)write)) return;
+
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		mDepthMask = write;
+	}
+
+	void InternalStateManager::SetCullFace(GLenum face) {
+		if (Filter(STATE_CALL_CULL_FACE, face == mCullFace)) return;
+
+		glCullFace(face);
+		mCullFace = face;
+	}
+
+	void InternalStateManager::SetClearColor(float r, float g, float b, float a) {
+		if (Filter(STATE_CALL_CLEAR_COLOR, mClearColorKnown && mClearColor[0] == r && mClearColor[1] == g && mClearColor[2] == b && mClearColor[3] == a)) return;
+
+		glClearColor(r, g, b, a);
+		mClearColor[0] = r; mClearColor[1] = g; mClearColor[2] = b; mClearColor[3] = a;
+		mClearColorKnown = true;
+	}
+
+	void InternalStateManager::ProgramDeleted(GLuint handle) {
+		// The program in use stays alive until replaced, but its name can be reused by a new program that must not be filtered
+		if (mShaderProgram == handle) mShaderProgram = UNKNOWN_HANDLE;
+	}
+
+	void InternalStateManager::FramebufferDeleted(GLuint handle) {
+		if (mReadFramebuffer == handle) mReadFramebuffer = 0;
+		if (mDrawFramebuffer == handle) mDrawFramebuffer = 0;
+	}
+
+	void InternalStateManager::VertexArrayDeleted(GLuint handle) {
+		if (mVertexArray == handle) {
+			mVertexArray = 0;
+			mBuffers[BufferTargetIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN_HANDLE;
+		}
+
+		mVertexArrayElementBuffers.erase(handle);
+	}
+
+	void InternalStateManager::BufferDeleted(GLuint handle) {
+		for (auto& buffer : mBuffers) {
+			if (buffer == handle) buffer = 0;
+		}
+
+		for (auto& key : mVertexArrayElementBuffers) {
+			if (key.second == handle) key.second = 0;
+		}
+
+		for (auto& range : mBufferRanges) {
+			if (range[0] == (GLintptr)handle) range[0] = range[1] = range[2] = -1;
+		}
+	}
+
+	void InternalStateManager::TextureDeleted(GLuint handle) {
+		for (auto& unit : mTextures) {
+			for (auto& texture : unit) {
+				if (texture == handle) texture = 0;
+			}
+		}
+
+		for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+			if (mPendingTextures[i] == handle) mPendingTextures[i] = 0;
+		}
+	}
+
+	void InternalStateManager::SamplerDeleted(GLuint handle) {
+		for (int i = 0; i < MAX_TEXTURE_UNITS; ++i) {
+			if (mSamplers[i] == handle) mSamplers[i] = 0;
+			if (mPendingSamplers[i] == handle) mPendingSamplers[i] = 0;
+		}
+	}
+
+	GLuint InternalStateManager::GetBuffer(GLenum target) {
+		int index = BufferTargetIndex(target);
+		if (index < 0) return UNKNOWN_HANDLE;
+
+		return mBuffers[index];
+	}
+
+	GLuint InternalStateManager::GetTexture(int unit, GLenum target) {
+		int index = TextureTargetIndex(target);
+		if (index < 0 || unit < 0 || unit >= MAX_TEXTURE_UNITS) return UNKNOWN_HANDLE;
+
+		return mTextures[unit][index];
+	}
+
+	unsigned int InternalStateManager::GetIssuedCalls() {
+		unsigned int total = 0;
+		for (auto count : mIssued) total += count;
+
+		return total;
+	}
+
+	unsigned int InternalStateManager::GetFilteredCalls() {
+		unsigned int total = 0;
+		for (auto count : mFiltered) total += count;
+
+		return total;
+	}
+
+	void InternalStateManager::ResetCounters() {
+		memset(mIssued, 0, sizeof(mIssued));
+		memset(mFiltered, 0, sizeof(mFiltered));
+	}
+
+	int InternalStateManager::BufferTargetIndex(GLenum target) {
+		switch (target) {
+			case GL_ARRAY_BUFFER: return 0;
+			case GL_ELEMENT_ARRAY_BUFFER: return 1;
+			case GL_UNIFORM_BUFFER: return 2;
+			case GL_PIXEL_PACK_BUFFER: return 3;
+			case GL_PIXEL_UNPACK_BUFFER: return 4;
+			case GL_DRAW_INDIRECT_BUFFER: return 5;
+			case GL_COPY_READ_BUFFER: return 6;
+			case GL_COPY_WRITE_BUFFER: return 7;
+			default: return -1;
+		}
+	}
+
+	int InternalStateManager::TextureTargetIndex(GLenum target) {
+		switch (target) {
+			case GL_TEXTURE_2D: return 0;
+			case GL_TEXTURE_CUBE_MAP: return 1;
+			case GL_TEXTURE_2D_ARRAY: return 2;
+			default: return -1;
+		}
+	}
+
+	int InternalStateManager::CapabilityIndex(GLenum capability) {
+		switch (capability) {
+			case GL_CULL_FACE: return 0;
+			case GL_BLEND: return 1;
+			case GL_DEPTH_TEST: return 2;
+			case GL_SCISSOR_TEST: return 3;
+			default: return -1;
+		}
+	}
+
 }
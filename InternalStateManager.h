@@ -3,22 +3,138 @@
 
 #include "include.h"
 
-class InternalStateManager {
-	public:
-		InternalStateManager();
+namespace Backend {
 
-		// binders
-		void BindShaderProgram(GLuint handle);
-		void BindFramebuffer(GLuint handle);
+	// Kinds of state calls, used to split the issued/filtered counters
+	enum StateCallType {
+		STATE_CALL_PROGRAM, STATE_CALL_FRAMEBUFFER, STATE_CALL_VERTEX_ARRAY, STATE_CALL_BUFFER, STATE_CALL_ACTIVE_TEXTURE, STATE_CALL_TEXTURE,
+		STATE_CALL_VIEWPORT, STATE_CALL_SCISSOR, STATE_CALL_CAPABILITY, STATE_CALL_BLEND_FUNC, STATE_CALL_DEPTH_MASK, STATE_CALL_CULL_FACE, STATE_CALL_CLEAR_COLOR, STATE_CALL_SAMPLER,
+		NUM_STATE_CALLS
+	};
 
-		// getters
-		GLuint GetShaderProgram() { return mShaderProgram; }
-		GLuint GetFramebuffer() { return mFramebuffer; }
+	// Shadow of the GL state of one context. Every module binds through it, so redundant calls are filtered before
+	// they reach the driver and nobody has to query state back from GL.
+	class InternalStateManager {
+		public:
+			static const int MAX_TEXTURE_UNITS = 32;
+			static const int MAX_BUFFER_BINDINGS = 36;
+			static const GLuint UNKNOWN_HANDLE = 0xFFFFFFFF;
 
-	protected:
-		GLuint mShaderProgram;
-		GLuint mFramebuffer;
+		public:
+			InternalStateManager();
 
-};
+			// Forget everything, the next call of every kind reaches GL (use after foreign code touched the context)
+			void Invalidate();
+
+			// Program
+			void BindShaderProgram(GLuint handle);
+
+			// Framebuffers, GL_FRAMEBUFFER binds both read and draw
+			void BindFramebuffer(GLuint handle);
+			void BindReadFramebuffer(GLuint handle);
+			void BindDrawFramebuffer(GLuint handle);
+
+			// Vertex arrays and buffers, element array bindings are tracked per vertex array
+			void BindVertexArray(GLuint handle);
+			void BindBuffer(GLenum target, GLuint handle);
+			void BindBufferRange(GLenum target, GLuint index, GLuint handle, GLintptr offset, GLsizeiptr size);
+			void VertexArrayElementBufferSet(GLuint vertexArray, GLuint handle); // glVertexArrayElementBuffer, no bind involved
+			bool IsBufferRangeBound(GLenum target, GLuint index, GLuint handle, GLintptr offset, GLsizeiptr size);
+
+			// Textures
+			void SetActiveTextureUnit(int unit);
+			void BindTexture(int unit, GLenum target, GLuint handle);
+			void BindTextureForEdit(GLenum target, GLuint handle); // binds on whatever unit is active
+
+			void QueueTexture(int unit, GLenum target, GLuint handle);
+			bool HasPendingTextures() { return mPendingFirst <= mPendingLast; }
+			void FlushTextures(); // glBindTextures over the queued range when ARB_multi_bind is available, queued samplers included
+
+			// Samplers, bound per unit and flushed together with the queued textures
+			void BindSampler(int unit, GLuint handle);
+			void QueueSampler(int unit, GLuint handle);
+			void UnbindAllTextures();
+			void UnbindTextures(GLenum target);
+
+			// Fixed function state
+			void SetViewport(int x, int y, int width, int height);
+			void SetScissor(int x, int y, int width, int height);
+			void SetCapability(GLenum capability, bool enabled);
+			void SetBlendFunc(GLenum source, GLenum destination);
+			void SetDepthMask(bool write);
+			void SetCullFace(GLenum face);
+			void SetClearColor(float r, float g, float b, float a);
+
+			// Deleted objects lose all their bindings in GL, the shadow has to follow
+			void ProgramDeleted(GLuint handle);
+			void FramebufferDeleted(GLuint handle);
+			void VertexArrayDeleted(GLuint handle);
+			void BufferDeleted(GLuint handle);
+			void TextureDeleted(GLuint handle);
+			void SamplerDeleted(GLuint handle);
+
+			// getters
+			GLuint GetShaderProgram() { return mShaderProgram; }
+			GLuint GetFramebuffer() { return mDrawFramebuffer; }
+			GLuint GetReadFramebuffer() { return mReadFramebuffer; }
+			GLuint GetDrawFramebuffer() { return mDrawFramebuffer; }
+			GLuint GetVertexArray() { return mVertexArray; }
+			GLuint GetBuffer(GLenum target);
+			GLuint GetTexture(int unit, GLenum target);
+			GLuint GetSampler(int unit) { return (unit >= 0 && unit < MAX_TEXTURE_UNITS) ? mSamplers[unit] : UNKNOWN_HANDLE; }
+			int GetActiveTextureUnit() { return mActiveTextureUnit; }
+			void GetViewport(int* viewport) { memcpy(viewport, mViewport, sizeof(mViewport)); }
+
+			// Counters, running since the manager was created or last reset (FrameStatistics takes per frame differences)
+			unsigned int GetIssuedCalls(StateCallType type) { return mIssued[type]; }
+			unsigned int GetFilteredCalls(StateCallType type) { return mFiltered[type]; }
+			unsigned int GetIssuedCalls();
+			unsigned int GetFilteredCalls();
+			void ResetCounters();
+
+		protected:
+			static int BufferTargetIndex(GLenum target);
+			static int TextureTargetIndex(GLenum target);
+			static int CapabilityIndex(GLenum capability);
+
+			bool Filter(StateCallType type, bool redundant);
+			void FlushSamplers();
+
+		protected:
+			static const int NUM_BUFFER_TARGETS = 8;
+			static const int NUM_TEXTURE_TARGETS = 3;
+			static const int NUM_CAPABILITIES = 4;
+
+			GLuint mShaderProgram;
+			GLuint mReadFramebuffer, mDrawFramebuffer;
+			GLuint mVertexArray;
+			GLuint mBuffers[NUM_BUFFER_TARGETS];
+			std::map<GLuint, GLuint> mVertexArrayElementBuffers;
+			GLintptr mBufferRanges[MAX_BUFFER_BINDINGS][3]; // uniform buffer bindings: handle, offset, size
+
+			int mActiveTextureUnit;
+			GLuint mTextures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+			GLuint mPendingTextures[MAX_TEXTURE_UNITS];
+			GLenum mPendingTargets[MAX_TEXTURE_UNITS];
+			GLuint mSamplers[MAX_TEXTURE_UNITS];
+			GLuint mPendingSamplers[MAX_TEXTURE_UNITS]; // UNKNOWN_HANDLE when nothing is queued, 0 is a valid sampler binding
+			int mPendingFirst, mPendingLast;
+			bool mSupportsMultiBind;
+
+			int mViewport[4];
+			int mScissor[4];
+			int mCapabilities[NUM_CAPABILITIES]; // -1 unknown
+			GLenum mBlendSource, mBlendDestination;
+			int mDepthMask;
+			GLenum mCullFace;
+			float mClearColor[4];
+			bool mClearColorKnown;
+
+			unsigned int mIssued[NUM_STATE_CALLS];
+			unsigned int mFiltered[NUM_STATE_CALLS];
+
+	};
+
+}
 
 #endif
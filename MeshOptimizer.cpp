@@ -0,0 +1,452 @@
+#include "MeshOptimizer.h"
+#include "ParallelFor.h"
+
+#include <cmath>
+
+namespace Backend {
+
+	namespace {
+
+		// Forsyth's tuning
+		const int FORSYTH_CACHE_SIZE = 32;
+		const float FORSYTH_DECAY_POWER = 1.5f;
+		const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+		const float FORSYTH_VALENCE_SCALE = 2.0f;
+		const float FORSYTH_VALENCE_POWER = 0.5f;
+		const int FORSYTH_MAX_VALENCE = 64;
+
+		struct ForsythTables {
+			float CacheScore[FORSYTH_CACHE_SIZE];
+			float ValenceScore[FORSYTH_MAX_VALENCE];
+
+			ForsythTables() {
+				for (int i = 0; i < FORSYTH_CACHE_SIZE; ++i) {
+					// The last triangle's vertices get a fixed score, so the next one doesn't reuse them all again
+					if (i < 3) CacheScore[i] = FORSYTH_LAST_TRIANGLE_SCORE;
+					else CacheScore[i] = std::pow(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), FORSYTH_DECAY_POWER);
+				}
+
+				for (int i = 0; i < FORSYTH_MAX_VALENCE; ++i) {
+					ValenceScore[i] = i ? FORSYTH_VALENCE_SCALE * std::pow((float)i, -FORSYTH_VALENCE_POWER) : 0.0f;
+				}
+			}
+		};
+
+		const ForsythTables& GetForsythTables() {
+			static ForsythTables tables;
+			return tables;
+		}
+
+		float VertexScore(int cachePosition, unsigned int valence) {
+			if (!valence) return -1.0f;
+
+			const ForsythTables& tables = GetForsythTables();
+			float score = cachePosition >= 0 ? tables.CacheScore[cachePosition] : 0.0f;
+
+			return score + tables.ValenceScore[std::min(valence, (unsigned int)FORSYTH_MAX_VALENCE - 1)];
+		}
+
+		void ReadPosition(const float* positions, unsigned int stride, GLuint vertex, float* out) {
+			const float* position = (const float*)((const unsigned char*)positions + (size_t)vertex * stride);
+			out[0] = position[0];
+			out[1] = position[1];
+			out[2] = position[2];
+		}
+
+	}
+
+	MeshOptimizationReport MeshOptimizer::Optimize(std::vector<GLuint>& indices, unsigned int vertexCount, const float* positions, unsigned int positionStride, std::vector<VertexStream> streams, unsigned int threads) {
+		MeshOptimizationReport report;
+		report.Before = report.After = AnalyzeVertexCache(indices, vertexCount);
+		report.Clusters = 0;
+		report.ReferencedVertices = 0;
+
+		report.Valid = ValidateIndices(indices, vertexCount);
+		if (!report.Valid) return report;
+
+		OptimizeVertexCache(indices, vertexCount, threads);
+
+		// Reads the positions, before the streams (which may hold them) are remapped
+		if (positions) report.Clusters = OptimizeOverdraw(indices, vertexCount, positions, positionStride, 1.05f, threads);
+
+		std::vector<GLuint> remap = OptimizeVertexFetch(indices, vertexCount);
+		for (auto& stream : streams) {
+			RemapVertices(stream.Data, vertexCount, stream.Stride, remap);
+		}
+
+		report.After = AnalyzeVertexCache(indices, vertexCount);
+
+		// The fetch order puts the referenced vertices first
+		for (auto index : indices) report.ReferencedVertices = std::max(report.ReferencedVertices, index + 1);
+
+		return report;
+	}
+
+	bool MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, unsigned int vertexCount, unsigned int threads) {
+		// The chunks index per vertex scratch tables with the indices
+		if (!ValidateIndices(indices, vertexCount)) return false;
+
+		unsigned int triangles = (unsigned int)(indices.size() / 3);
+		if (!triangles) return true;
+
+		unsigned int chunks = (triangles + CHUNK_TRIANGLES - 1) / CHUNK_TRIANGLES;
+		std::vector<std::vector<int>> scratch(ParallelFor::ThreadsCount(chunks, threads));
+
+		ParallelFor::ForEachChunk(chunks, threads, [&](unsigned int chunk, unsigned int thread) {
+			if (scratch[thread].empty()) scratch[thread].assign(vertexCount, -1);
+
+			unsigned int first = chunk * CHUNK_TRIANGLES;
+			OptimizeVertexCacheChunk(&indices[first * 3], std::min(CHUNK_TRIANGLES, triangles - first), scratch[thread]);
+		});
+
+		return true;
+	}
+
+	unsigned int MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, unsigned int vertexCount, const float* positions, unsigned int positionStride, float threshold, unsigned int threads) {
+		unsigned int triangles = (unsigned int)(indices.size() / 3);
+		if (!triangles || !positions || !ValidateIndices(indices, vertexCount)) return 0;
+
+		// Center of the mesh, summed in index order so it doesn't depend on the threads
+		double center[3] = { 0.0, 0.0, 0.0 };
+		for (auto index : indices) {
+			float position[3];
+			ReadPosition(positions, positionStride, index, position);
+
+			for (int i = 0; i < 3; ++i) center[i] += position[i];
+		}
+		for (int i = 0; i < 3; ++i) center[i] /= indices.size();
+
+		unsigned int chunks = (triangles + CHUNK_TRIANGLES - 1) / CHUNK_TRIANGLES;
+		std::vector<std::vector<int>> scratch(ParallelFor::ThreadsCount(chunks, threads));
+		std::vector<unsigned int> clustersPerChunk(chunks, 0);
+
+		ParallelFor::ForEachChunk(chunks, threads, [&](unsigned int chunk, unsigned int thread) {
+			if (scratch[thread].empty()) scratch[thread].assign(vertexCount, -1);
+
+			unsigned int first = chunk * CHUNK_TRIANGLES;
+			unsigned int count = std::min(CHUNK_TRIANGLES, triangles - first);
+			GLuint* chunkIndices = &indices[first * 3];
+
+			std::vector<Cluster> clusters;
+			BuildClusters(chunkIndices, count, threshold, scratch[thread], clusters);
+
+			// Clusters facing away from the center are on the outside and hide the rest, so they go first
+			for (auto& cluster : clusters) {
+				double centroid[3] = { 0.0, 0.0, 0.0 }, normal[3] = { 0.0, 0.0, 0.0 }, area = 0.0;
+
+				for (unsigned int t = cluster.First; t < cluster.First + cluster.Count; ++t) {
+					float a[3], b[3], c[3];
+					ReadPosition(positions, positionStride, chunkIndices[t * 3 + 0], a);
+					ReadPosition(positions, positionStride, chunkIndices[t * 3 + 1], b);
+					ReadPosition(positions, positionStride, chunkIndices[t * 3 + 2], c);
+
+					double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+					double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+					double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+					double triangleArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+					for (int i = 0; i < 3; ++i) {
+						centroid[i] += (a[i] + b[i] + c[i]) / 3.0 * triangleArea;
+						normal[i] += n[i];
+					}
+					area += triangleArea;
+				}
+
+				double normalLength = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+				if (area <= 0.0 || normalLength <= 0.0) {
+					cluster.SortKey = 0.0f;
+					continue;
+				}
+
+				double key = 0.0;
+				for (int i = 0; i < 3; ++i) key += (centroid[i] / area - center[i]) * normal[i] / normalLength;
+
+				cluster.SortKey = (float)key;
+			}
+
+			std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.SortKey > b.SortKey; });
+
+			std::vector<GLuint> original(chunkIndices, chunkIndices + count * 3);
+			GLuint* output = chunkIndices;
+
+			for (auto& cluster : clusters) {
+				memcpy(output, &original[cluster.First * 3], cluster.Count * 3 * sizeof(GLuint));
+				output += cluster.Count * 3;
+			}
+
+			clustersPerChunk[chunk] = (unsigned int)clusters.size();
+		});
+
+		unsigned int clusters = 0;
+		for (auto count : clustersPerChunk) clusters += count;
+
+		return clusters;
+	}
+
+	bool MeshOptimizer::ValidateIndices(const std::vector<GLuint>& indices, unsigned int vertexCount) {
+		for (size_t i = 0; i < indices.size(); ++i) {
+			if (indices[i] < vertexCount) continue;
+
+			std::cerr << "[Error] Mesh optimizer: index " << indices[i] << " at " << i << " is out of range for " << vertexCount << " vertices" << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	std::vector<GLuint> MeshOptimizer::OptimizeVertexFetch(std::vector<GLuint>& indices, unsigned int vertexCount) {
+		const GLuint UNUSED = 0xFFFFFFFF;
+
+		std::vector<GLuint> remap(vertexCount, UNUSED);
+		GLuint next = 0;
+
+		for (auto& index : indices) {
+			if (index >= vertexCount) continue;
+
+			if (remap[index] == UNUSED) remap[index] = next++;
+			index = remap[index];
+		}
+
+		for (auto& vertex : remap) {
+			if (vertex == UNUSED) vertex = next++;
+		}
+
+		return remap;
+	}
+
+	void MeshOptimizer::RemapVertices(void* data, unsigned int vertexCount, unsigned int stride, const std::vector<GLuint>& remap) {
+		if (!data || remap.size() < vertexCount) return;
+
+		unsigned char* bytes = (unsigned char*)data;
+		std::vector<unsigned char> original(bytes, bytes + (size_t)vertexCount * stride);
+
+		for (unsigned int i = 0; i < vertexCount; ++i) {
+			memcpy(bytes + (size_t)remap[i] * stride, &original[(size_t)i * stride], stride);
+		}
+	}
+
+	VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<GLuint>& indices, unsigned int vertexCount, unsigned int cacheSize) {
+		VertexCacheStats stats;
+		stats.Triangles = (unsigned int)(indices.size() / 3);
+		stats.Misses = 0;
+
+		// FIFO cache: a vertex is in the cache while less than cacheSize misses happened since it was loaded
+		std::vector<unsigned int> loadedAt(vertexCount, 0);
+		unsigned int referenced = 0;
+
+		for (unsigned int i = 0; i < stats.Triangles * 3; ++i) {
+			GLuint index = indices[i];
+			if (index >= vertexCount) continue;
+
+			if (!loadedAt[index]) referenced++;
+
+			if (!loadedAt[index] || stats.Misses - loadedAt[index] >= cacheSize) {
+				stats.Misses++;
+				loadedAt[index] = stats.Misses;
+			}
+		}
+
+		stats.ACMR = stats.Triangles ? (float)stats.Misses / stats.Triangles : 0.0f;
+		stats.ATVR = referenced ? (float)stats.Misses / referenced : 0.0f;
+
+		return stats;
+	}
+
+	void MeshOptimizer::OptimizeVertexCacheChunk(GLuint* indices, unsigned int triangles, std::vector<int>& scratch) {
+		// Local vertex ids, so the work only scales with the chunk
+		std::vector<GLuint> globals;
+		std::vector<unsigned int> local(triangles * 3);
+
+		for (unsigned int i = 0; i < triangles * 3; ++i) {
+			GLuint index = indices[i];
+
+			if (scratch[index] < 0) {
+				scratch[index] = (int)globals.size();
+				globals.push_back(index);
+			}
+
+			local[i] = (unsigned int)scratch[index];
+		}
+
+		for (auto index : globals) scratch[index] = -1;
+
+		unsigned int vertices = (unsigned int)globals.size();
+
+		// Triangles of every vertex, live ones first
+		std::vector<unsigned int> valence(vertices, 0), adjacencyOffset(vertices + 1, 0), adjacency(triangles * 3);
+		for (auto vertex : local) valence[vertex]++;
+		for (unsigned int v = 0; v < vertices; ++v) adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+		std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (unsigned int i = 0; i < triangles * 3; ++i) adjacency[fill[local[i]]++] = i / 3;
+
+		std::vector<int> cachePosition(vertices, -1);
+		std::vector<float> vertexScore(vertices), triangleScore(triangles, 0.0f);
+		std::vector<bool> emitted(triangles, false);
+
+		for (unsigned int v = 0; v < vertices; ++v) vertexScore[v] = VertexScore(-1, valence[v]);
+		for (unsigned int i = 0; i < triangles * 3; ++i) triangleScore[i / 3] += vertexScore[local[i]];
+
+		std::vector<unsigned int> cache, newCache;
+		cache.reserve(FORSYTH_CACHE_SIZE + 3);
+		newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+
+		std::vector<GLuint> output;
+		output.reserve(triangles * 3);
+
+		int best = 0;
+		unsigned int cursor = 0;
+
+		for (unsigned int step = 0; step < triangles; ++step) {
+			// Nothing left around the cache, continue with the next triangle of the input
+			if (best < 0) {
+				while (emitted[cursor]) cursor++;
+				best = (int)cursor;
+			}
+
+			unsigned int triangle = (unsigned int)best;
+			emitted[triangle] = true;
+
+			newCache.clear();
+
+			for (int corner = 0; corner < 3; ++corner) {
+				unsigned int vertex = local[triangle * 3 + corner];
+				output.push_back(globals[vertex]);
+				newCache.push_back(vertex);
+
+				// Drop the triangle from the live ones
+				unsigned int begin = adjacencyOffset[vertex], end = begin + valence[vertex];
+				for (unsigned int i = begin; i < end; ++i) {
+					if (adjacency[i] == triangle) {
+						std::swap(adjacency[i], adjacency[end - 1]);
+						break;
+					}
+				}
+				valence[vertex]--;
+			}
+
+			for (auto vertex : cache) {
+				if (std::find(newCache.begin(), newCache.end(), vertex) == newCache.end()) newCache.push_back(vertex);
+			}
+
+			// Rescore everything that was or is in the cache, and pick the best live triangle around it
+			best = -1;
+			float bestScore = -1.0f;
+
+			for (unsigned int i = 0; i < newCache.size(); ++i) {
+				unsigned int vertex = newCache[i];
+				int position = i < (unsigned int)FORSYTH_CACHE_SIZE ? (int)i : -1;
+
+				cachePosition[vertex] = position;
+
+				float score = VertexScore(position, valence[vertex]);
+				float delta = score - vertexScore[vertex];
+				vertexScore[vertex] = score;
+
+				unsigned int begin = adjacencyOffset[vertex], end = begin + valence[vertex];
+				for (unsigned int j = begin; j < end; ++j) {
+					unsigned int adjacent = adjacency[j];
+					triangleScore[adjacent] += delta;
+				}
+			}
+
+			for (unsigned int i = 0; i < std::min((unsigned int)newCache.size(), (unsigned int)FORSYTH_CACHE_SIZE); ++i) {
+				unsigned int vertex = newCache[i];
+
+				unsigned int begin = adjacencyOffset[vertex], end = begin + valence[vertex];
+				for (unsigned int j = begin; j < end; ++j) {
+					unsigned int adjacent = adjacency[j];
+
+					if (triangleScore[adjacent] > bestScore || (triangleScore[adjacent] == bestScore && (int)adjacent < best)) {
+						best = (int)adjacent;
+						bestScore = triangleScore[adjacent];
+					}
+				}
+			}
+
+			if (newCache.size() > (size_t)FORSYTH_CACHE_SIZE) newCache.resize(FORSYTH_CACHE_SIZE);
+			std::swap(cache, newCache);
+		}
+
+		memcpy(indices, &output[0], output.size() * sizeof(GLuint));
+	}
+
+	void MeshOptimizer::BuildClusters(const GLuint* indices, unsigned int triangles, float threshold, std::vector<int>& scratch, std::vector<Cluster>& clusters) {
+		// scratch holds the miss count at which each vertex was loaded (-1 never), reset at the end
+		const int cacheSize = (int)DEFAULT_CACHE_SIZE;
+		int misses = 0;
+
+		auto simulate = [&](unsigned int triangle) {
+			int triangleMisses = 0;
+
+			for (int corner = 0; corner < 3; ++corner) {
+				GLuint index = indices[triangle * 3 + corner];
+
+				if (scratch[index] < 0 || misses - scratch[index] >= cacheSize) {
+					scratch[index] = misses++;
+					triangleMisses++;
+				}
+			}
+
+			return triangleMisses;
+		};
+
+		// Hard boundaries: triangles missing all their vertices, where the cache order restarts anyway
+		std::vector<Cluster> hard;
+		std::vector<int> hardMisses;
+
+		for (unsigned int t = 0; t < triangles; ++t) {
+			int triangleMisses = simulate(t);
+
+			if (t == 0 || triangleMisses == 3) {
+				Cluster cluster;
+				cluster.First = t;
+				cluster.Count = 0;
+				cluster.SortKey = 0.0f;
+
+				hard.push_back(cluster);
+				hardMisses.push_back(0);
+			}
+
+			hard.back().Count++;
+			hardMisses.back() += triangleMisses;
+		}
+
+		// Soft boundaries: split a cluster where the part so far, drawn from a cold cache, is within threshold of the whole
+		const unsigned int minTriangles = 32;
+
+		for (size_t c = 0; c < hard.size(); ++c) {
+			Cluster& cluster = hard[c];
+			float target = (float)hardMisses[c] / cluster.Count * threshold;
+
+			unsigned int start = cluster.First, end = cluster.First + cluster.Count;
+			int startMisses = misses += cacheSize; // cold cache
+
+			for (unsigned int t = start; t < end; ++t) {
+				simulate(t);
+
+				unsigned int count = t + 1 - start;
+				if (count < minTriangles || end - (t + 1) < minTriangles) continue;
+				if ((float)(misses - startMisses) / count > target) continue;
+
+				Cluster part;
+				part.First = start;
+				part.Count = count;
+				part.SortKey = 0.0f;
+				clusters.push_back(part);
+
+				start = t + 1;
+				startMisses = misses += cacheSize;
+			}
+
+			Cluster last;
+			last.First = start;
+			last.Count = end - start;
+			last.SortKey = 0.0f;
+			clusters.push_back(last);
+		}
+
+		for (unsigned int i = 0; i < triangles * 3; ++i) scratch[indices[i]] = -1;
+	}
+
+}
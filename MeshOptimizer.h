@@ -0,0 +1,78 @@
+#ifndef MESH_OPTIMIZER_R_H
+#define MESH_OPTIMIZER_R_H
+
+#include "include.h"
+
+namespace Backend {
+	class MeshOptimizer;
+
+	// Post transform cache efficiency of an index buffer, simulated with a FIFO cache
+	struct VertexCacheStats {
+		unsigned int Triangles;
+		unsigned int Misses; // vertex shader invocations
+		float ACMR; // misses per triangle, 0.5 at best for big regular meshes, 3 at worst
+		float ATVR; // misses per referenced vertex, 1 at best
+	};
+
+	struct MeshOptimizationReport {
+		bool Valid; // false when an index was out of range, nothing was touched then
+		VertexCacheStats Before, After;
+		unsigned int ReferencedVertices;
+		unsigned int Clusters; // of the overdraw pass, 0 without positions
+	};
+
+	// One vertex attribute array to keep in sync with the fetch order (one per BufferSlot, or per interleaved slot)
+	struct VertexStream {
+		void* Data;
+		unsigned int Stride;
+
+		VertexStream(void* data, unsigned int stride) { Data = data; Stride = stride; }
+	};
+
+	// CPU pass to run on indexed triangle lists before DataBuffer::UploadIndices / BufferSlot::UploadData:
+	//  - triangle order for the post transform vertex cache (Forsyth's linear speed algorithm)
+	//  - cluster order for overdraw, outward facing clusters first, inside the cache order
+	//  - vertex order for fetch locality, every stream is reordered to the first use in the index buffer
+	//
+	// Big meshes are split in chunks of CHUNK_TRIANGLES triangles that are optimized on several threads. The split only
+	// depends on the mesh, so the output is the same whatever the number of threads.
+	class MeshOptimizer {
+		public:
+			static const unsigned int CHUNK_TRIANGLES = 64 * 1024;
+			static const unsigned int DEFAULT_CACHE_SIZE = 16;
+
+		public:
+			// All the passes, positions (3 floats at positionStride bytes, may be null to skip the overdraw pass) and streams are
+			// rewritten in place. threads = 0 uses the hardware concurrency.
+			// The passes check every index against vertexCount first and leave the mesh alone if one is out of range
+			static MeshOptimizationReport Optimize(std::vector<GLuint>& indices, unsigned int vertexCount, const float* positions, unsigned int positionStride, std::vector<VertexStream> streams, unsigned int threads = 0);
+
+			static bool OptimizeVertexCache(std::vector<GLuint>& indices, unsigned int vertexCount, unsigned int threads = 0);
+
+			// threshold is how much worse than the cache order a cluster may get (1.05 = 5%) when splitting it in smaller ones,
+			// returns the number of clusters (0 for invalid indices)
+			static unsigned int OptimizeOverdraw(std::vector<GLuint>& indices, unsigned int vertexCount, const float* positions, unsigned int positionStride, float threshold = 1.05f, unsigned int threads = 0);
+
+			// Rewrites the indices and returns the remap table (old vertex -> new vertex), unreferenced vertices go last
+			static std::vector<GLuint> OptimizeVertexFetch(std::vector<GLuint>& indices, unsigned int vertexCount);
+			static void RemapVertices(void* data, unsigned int vertexCount, unsigned int stride, const std::vector<GLuint>& remap);
+
+			static VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, unsigned int vertexCount, unsigned int cacheSize = DEFAULT_CACHE_SIZE);
+
+			static bool ValidateIndices(const std::vector<GLuint>& indices, unsigned int vertexCount);
+
+		protected:
+			struct Cluster {
+				unsigned int First, Count; // in triangles
+				float SortKey;
+			};
+
+			// scratch is per thread, vertexCount entries of -1 (left that way)
+			static void OptimizeVertexCacheChunk(GLuint* indices, unsigned int triangles, std::vector<int>& scratch);
+			static void BuildClusters(const GLuint* indices, unsigned int triangles, float threshold, std::vector<int>& scratch, std::vector<Cluster>& clusters);
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "OffsetAllocator.h"
+
+namespace Backend {
+
+	OffsetAllocator::OffsetAllocator(unsigned int size) {
+		Reset(size);
+	}
+
+	void OffsetAllocator::Reset(unsigned int size) {
+		mSize = size;
+		mUsedSize = 0;
+
+		mAllocated.clear();
+		mFreeRanges.clear();
+		if (size) mFreeRanges.insert({ 0, size });
+	}
+
+	unsigned int OffsetAllocator::Allocate(unsigned int size, unsigned int alignment) {
+		if (!size) return INVALID_OFFSET;
+		alignment = std::max(alignment, 1u);
+
+		// Best fit, the smallest range left over wins and ties go to the lowest offset
+		auto best = mFreeRanges.end();
+		unsigned int bestOffset = 0, bestWaste = 0;
+
+		for (auto itr = mFreeRanges.begin(); itr != mFreeRanges.end(); ++itr) {
+			unsigned int offset = AlignUp(itr->first, alignment);
+			unsigned int end = itr->first + itr->second;
+			if (offset >= end || end - offset < size) continue;
+
+			unsigned int waste = itr->second - size;
+			if (best == mFreeRanges.end() || waste < bestWaste) {
+				best = itr;
+				bestOffset = offset;
+				bestWaste = waste;
+
+				if (!waste) break;
+			}
+		}
+
+		if (best == mFreeRanges.end()) return INVALID_OFFSET;
+
+		Carve(best->first, bestOffset, size);
+
+		Allocation allocation;
+		allocation.Size = size;
+		allocation.Alignment = alignment;
+		mAllocated.insert({ bestOffset, allocation });
+
+		mUsedSize += size;
+
+		return bestOffset;
+	}
+
+	void OffsetAllocator::Free(unsigned int offset) {
+		auto itr = mAllocated.find(offset);
+		if (itr == mAllocated.end()) return;
+
+		unsigned int size = itr->second.Size;
+		mAllocated.erase(itr);
+
+		mUsedSize -= size;
+		InsertFree(offset, size);
+	}
+
+	bool OffsetAllocator::FindCompaction(unsigned int& from, unsigned int& to) {
+		// Moving the last allocations into the first holes leaves the free space at the end, in one range
+		for (auto allocation = mAllocated.rbegin(); allocation != mAllocated.rend(); ++allocation) {
+			for (auto& range : mFreeRanges) {
+				if (range.first >= allocation->first) break;
+
+				unsigned int offset = AlignUp(range.first, allocation->second.Alignment);
+				unsigned int end = range.first + range.second;
+				if (offset >= end || end - offset < allocation->second.Size) continue;
+
+				from = allocation->first;
+				to = offset;
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void OffsetAllocator::Move(unsigned int from, unsigned int to) {
+		auto itr = mAllocated.find(from);
+		if (itr == mAllocated.end() || from == to) return;
+
+		// The destination has to lie in a free range
+		auto range = mFreeRanges.upper_bound(to);
+		if (range == mFreeRanges.begin()) return;
+		--range;
+		if (to + itr->second.Size > range->first + range->second) return;
+
+		Allocation allocation = itr->second;
+		mAllocated.erase(itr);
+
+		Carve(range->first, to, allocation.Size);
+		mAllocated.insert({ to, allocation });
+
+		InsertFree(from, allocation.Size);
+	}
+
+	unsigned int OffsetAllocator::GetAllocationSize(unsigned int offset) {
+		auto itr = mAllocated.find(offset);
+		if (itr == mAllocated.end()) return 0;
+
+		return itr->second.Size;
+	}
+
+	unsigned int OffsetAllocator::GetLargestFreeRange() {
+		unsigned int largest = 0;
+
+		for (auto& range : mFreeRanges) {
+			largest = std::max(largest, range.second);
+		}
+
+		return largest;
+	}
+
+	float OffsetAllocator::GetFragmentation() {
+		unsigned int freeSize = GetFreeSize();
+		if (!freeSize) return 0.0f;
+
+		return 1.0f - (float)GetLargestFreeRange() / freeSize;
+	}
+
+	void OffsetAllocator::Carve(unsigned int rangeOffset, unsigned int offset, unsigned int size) {
+		unsigned int rangeSize = mFreeRanges[rangeOffset];
+		mFreeRanges.erase(rangeOffset);
+
+		// Padding left by the alignment and the rest of the range stay free
+		if (offset > rangeOffset) mFreeRanges.insert({ rangeOffset, offset - rangeOffset });
+
+		unsigned int end = offset + size, rangeEnd = rangeOffset + rangeSize;
+		if (end < rangeEnd) mFreeRanges.insert({ end, rangeEnd - end });
+	}
+
+	void OffsetAllocator::InsertFree(unsigned int offset, unsigned int size) {
+		auto next = mFreeRanges.lower_bound(offset);
+
+		if (next != mFreeRanges.end() && next->first == offset + size) {
+			size += next->second;
+			next = mFreeRanges.erase(next);
+		}
+
+		if (next != mFreeRanges.begin()) {
+			auto previous = std::prev(next);
+
+			if (previous->first + previous->second == offset) {
+				previous->second += size;
+				return;
+			}
+		}
+
+		mFreeRanges.insert({ offset, size });
+	}
+
+}
@@ -0,0 +1,63 @@
+#ifndef OFFSET_ALLOCATOR_R_H
+#define OFFSET_ALLOCATOR_R_H
+
+#include "include.h"
+
+namespace Backend {
+	class OffsetAllocator;
+
+	// Hands out ranges of a linear space of units (bytes, vertices, indices..), without touching any memory.
+	// Best fit over an offset ordered free list, neighbouring free ranges are merged when a range is freed.
+	class OffsetAllocator {
+		public:
+			static const unsigned int INVALID_OFFSET = 0xFFFFFFFF;
+
+		public:
+			OffsetAllocator(unsigned int size = 0);
+
+			// Forgets every allocation
+			void Reset(unsigned int size);
+
+			unsigned int Allocate(unsigned int size, unsigned int alignment = 1);
+			void Free(unsigned int offset);
+
+			// Compaction, one range at a time: finds the last allocation fitting in a free range before it
+			bool FindCompaction(unsigned int& from, unsigned int& to);
+			void Move(unsigned int from, unsigned int to);
+
+			unsigned int GetAllocationSize(unsigned int offset);
+
+			unsigned int GetSize() { return mSize; }
+			unsigned int GetUsedSize() { return mUsedSize; }
+			unsigned int GetFreeSize() { return mSize - mUsedSize; }
+			unsigned int GetLargestFreeRange();
+			unsigned int GetAllocationsCount() { return (unsigned int)mAllocated.size(); }
+			unsigned int GetFreeRangesCount() { return (unsigned int)mFreeRanges.size(); }
+
+			// 0 when the free space is one range, close to 1 when it's scattered in small ones
+			float GetFragmentation();
+
+		protected:
+			struct Allocation {
+				unsigned int Size;
+				unsigned int Alignment;
+			};
+
+			static unsigned int AlignUp(unsigned int value, unsigned int alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+			// Takes [offset, offset + size) out of the free range starting at rangeOffset
+			void Carve(unsigned int rangeOffset, unsigned int offset, unsigned int size);
+			void InsertFree(unsigned int offset, unsigned int size);
+
+		protected:
+			unsigned int mSize;
+			unsigned int mUsedSize;
+
+			std::map<unsigned int, unsigned int> mFreeRanges; // offset, size
+			std::map<unsigned int, Allocation> mAllocated;
+
+	};
+
+}
+
+#endif
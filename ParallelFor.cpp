@@ -0,0 +1,34 @@
+#include "ParallelFor.h"
+
+#include <thread>
+#include <atomic>
+
+namespace Backend {
+
+	unsigned int ParallelFor::ThreadsCount(unsigned int chunks, unsigned int threads) {
+		if (!threads) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+		return std::max(std::min(threads, chunks), 1u);
+	}
+
+	void ParallelFor::ForEachChunk(unsigned int chunks, unsigned int threads, const std::function<void(unsigned int, unsigned int)>& task) {
+		threads = ThreadsCount(chunks, threads);
+
+		if (threads == 1) {
+			for (unsigned int chunk = 0; chunk < chunks; ++chunk) task(chunk, 0);
+			return;
+		}
+
+		std::atomic<unsigned int> nextChunk(0);
+		std::vector<std::thread> workers;
+
+		for (unsigned int thread = 0; thread < threads; ++thread) {
+			workers.emplace_back([&, thread]() {
+				for (unsigned int chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) task(chunk, thread);
+			});
+		}
+
+		for (auto& worker : workers) worker.join();
+	}
+
+}
@@ -0,0 +1,25 @@
+#ifndef PARALLEL_FOR_R_H
+#define PARALLEL_FOR_R_H
+
+#include "include.h"
+#include <functional>
+
+namespace Backend {
+	class ParallelFor;
+
+	// Chunked CPU work (MeshOptimizer, TextureCompressor) spread over threads started for the call.
+	// Every thread takes the next chunk left, so chunks of uneven cost still balance
+	class ParallelFor {
+		public:
+			// threads = 0 uses the hardware concurrency, there are never more threads than chunks
+			static unsigned int ThreadsCount(unsigned int chunks, unsigned int threads);
+
+			// Runs task(chunk, thread) for every chunk, spread over ThreadsCount(chunks, threads) threads.
+			// thread is below ThreadsCount, for per thread scratch memory
+			static void ForEachChunk(unsigned int chunks, unsigned int threads, const std::function<void(unsigned int, unsigned int)>& task);
+
+	};
+
+}
+
+#endif
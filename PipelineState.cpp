@@ -0,0 +1,46 @@
+#include "PipelineState.h"
+
+namespace Backend {
+
+	PipelineState::PipelineState(const PipelineDescription& description, unsigned int id) {
+		mDescription = description;
+		mId = id;
+		mHash = HashDescription(description);
+	}
+
+	unsigned int PipelineState::Diff(PipelineState* other) {
+		if (!other) return PipelineStateField::PIPELINE_ALL;
+		if (other == this) return 0;
+
+		const PipelineDescription& otherDesc = other->mDescription;
+		unsigned int mask = 0;
+
+		if (mDescription.CullMode != otherDesc.CullMode) mask |= PipelineStateField::PIPELINE_CULL;
+		if (mDescription.BlendMode != otherDesc.BlendMode) mask |= PipelineStateField::PIPELINE_BLEND;
+		if (mDescription.DepthMode != otherDesc.DepthMode) mask |= PipelineStateField::PIPELINE_DEPTH;
+		if (mDescription.Shader != otherDesc.Shader) mask |= PipelineStateField::PIPELINE_SHADER;
+		if (mDescription.Databuffer != otherDesc.Databuffer) mask |= PipelineStateField::PIPELINE_VERTEX_LAYOUT;
+
+		return mask;
+	}
+
+	unsigned long long PipelineState::HashDescription(const PipelineDescription& description) {
+		// FNV-1a over the fields, hashing the struct bytes directly would pick up padding
+		unsigned long long hash = 14695981039346656037ull;
+		auto mix = [&hash](unsigned long long value) {
+			for (int i = 0; i < 8; ++i) {
+				hash ^= (value >> (i * 8)) & 0xFF;
+				hash *= 1099511628211ull;
+			}
+		};
+
+		mix((unsigned long long)description.CullMode);
+		mix((unsigned long long)description.BlendMode);
+		mix((unsigned long long)description.DepthMode);
+		mix((unsigned long long)(uintptr_t)description.Shader);
+		mix((unsigned long long)(uintptr_t)description.Databuffer);
+
+		return hash;
+	}
+
+}
@@ -0,0 +1,75 @@
+#ifndef PIPELINE_STATE_R_H
+#define PIPELINE_STATE_R_H
+
+#include "include.h"
+#include "Context.h"
+
+namespace Backend {
+	class Context;
+	class PipelineState;
+
+	class DataBuffer;
+	class ShaderProgram;
+
+	// Bits of PipelineState::Diff, one per group of GL state
+	enum PipelineStateField {
+		PIPELINE_CULL = 1 << 0,
+		PIPELINE_BLEND = 1 << 1,
+		PIPELINE_DEPTH = 1 << 2,
+		PIPELINE_SHADER = 1 << 3,
+		PIPELINE_VERTEX_LAYOUT = 1 << 4,
+		PIPELINE_ALL = (1 << 5) - 1
+	};
+
+	struct PipelineDescription {
+		CullingMode CullMode;
+		BlendingMode BlendMode;
+		DepthTestMode DepthMode;
+		ShaderProgram* Shader;
+		DataBuffer* Databuffer; // vertex layout, nullptr leaves the bound one alone so meshes can share a pipeline
+
+		PipelineDescription() {
+			CullMode = CullingMode::CULL_NONE;
+			BlendMode = BlendingMode::BLEND_NONE;
+			DepthMode = DepthTestMode::DEPTH_READ_WRITE;
+			Shader = nullptr;
+			Databuffer = nullptr;
+		}
+
+		bool operator==(const PipelineDescription& other) const {
+			return CullMode == other.CullMode && BlendMode == other.BlendMode && DepthMode == other.DepthMode && Shader == other.Shader && Databuffer == other.Databuffer;
+		}
+	};
+
+	// Immutable combination of raster, blend, depth, shader and vertex layout state.
+	// Pipelines are created through Context::CreatePipelineState, which hands out the existing object for an equal description,
+	// so two pipelines are the same state exactly when they are the same pointer (or id).
+	class PipelineState {
+		public:
+			static const unsigned int INVALID_ID = 0;
+
+		public:
+			const PipelineDescription& Description() { return mDescription; }
+			unsigned int Id() { return mId; }
+			unsigned long long Hash() { return mHash; }
+
+			// Mask of PipelineStateField that differ, everything differs from a null pipeline
+			unsigned int Diff(PipelineState* other);
+
+			static unsigned long long HashDescription(const PipelineDescription& description);
+
+		protected:
+			PipelineState(const PipelineDescription& description, unsigned int id);
+
+		protected:
+			PipelineDescription mDescription;
+			unsigned int mId;
+			unsigned long long mHash;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+#include "ProgramBinaryCache.h"
+#include "Context.h"
+#include <fstream>
+#include <cstdio>
+
+namespace Backend {
+
+	static const unsigned int PROGRAM_CACHE_MAGIC = 0x42505a52; // "RZPB"
+	static const unsigned int PROGRAM_CACHE_VERSION = 1;
+
+	ProgramBinaryCache::ProgramBinaryCache(Context* context, const std::string& directory) {
+		mContext = context;
+
+		mDirectory = directory;
+		if (!mDirectory.empty() && mDirectory.back() != '/' && mDirectory.back() != '\\') mDirectory += '/';
+
+		GLint formatsCount = 0;
+		if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatsCount);
+		mSupported = formatsCount > 0;
+
+		// A binary is only valid for the driver that produced it
+		mDriverHash = HASH_SEED;
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+			const char* str = (const char*)glGetString(name);
+			if (str) mDriverHash = Hash(str, strlen(str), mDriverHash);
+		}
+	}
+
+	unsigned long long ProgramBinaryCache::Hash(const void* dataPtr, size_t dataSize, unsigned long long hash) {
+		// FNV-1a
+		const unsigned char* bytes = (const unsigned char*)dataPtr;
+		for (size_t i = 0; i < dataSize; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	bool ProgramBinaryCache::Load(unsigned long long key, GLuint programHandle) {
+		if (!mSupported) return false;
+
+		std::ifstream file(GetPath(key), std::ios::binary);
+		if (!file.is_open()) return false;
+
+		FileHeader header;
+		if (!file.read((char*)&header, sizeof(header)) || header.Magic != PROGRAM_CACHE_MAGIC || header.Version != PROGRAM_CACHE_VERSION || header.Key != key || header.BinaryLength <= 0) {
+			mStats.Rejected++;
+			return false;
+		}
+
+		mScratch.resize(header.BinaryLength);
+		if (!file.read(&mScratch[0], header.BinaryLength)) {
+			mStats.Rejected++;
+			return false;
+		}
+
+		glProgramBinary(programHandle, header.BinaryFormat, &mScratch[0], header.BinaryLength);
+
+		GLint success = 0;
+		glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+
+		if (!success) {
+			mStats.Rejected++;
+			return false;
+		}
+
+		return true;
+	}
+
+	bool ProgramBinaryCache::Store(unsigned long long key, GLuint programHandle) {
+		if (!mSupported) return false;
+
+		GLint binaryLength = 0;
+		glGetProgramiv(programHandle, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+		if (binaryLength <= 0) return false;
+
+		FileHeader header;
+		header.Magic = PROGRAM_CACHE_MAGIC;
+		header.Version = PROGRAM_CACHE_VERSION;
+		header.Key = key;
+		header.BinaryFormat = 0;
+		header.BinaryLength = 0;
+
+		mScratch.resize(binaryLength);
+		glGetProgramBinary(programHandle, binaryLength, &header.BinaryLength, &header.BinaryFormat, &mScratch[0]);
+		if (header.BinaryLength <= 0) return false;
+
+		// Write to a temporary file first, a crash halfway must not leave a truncated binary behind
+		std::string path = GetPath(key);
+		std::string tempPath = path + ".tmp";
+
+		{
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			if (!file.is_open()) return false;
+
+			file.write((const char*)&header, sizeof(header));
+			file.write(&mScratch[0], header.BinaryLength);
+			if (!file) return false;
+		}
+
+		std::remove(path.c_str());
+		if (std::rename(tempPath.c_str(), path.c_str()) != 0) return false;
+
+		mStats.Stored++;
+
+		return true;
+	}
+
+	void ProgramBinaryCache::RecordCompile(bool hit, double timeMs) {
+		if (hit) {
+			mStats.Hits++;
+			mStats.HitTimeMs += timeMs;
+		}
+		else {
+			mStats.Misses++;
+			mStats.MissTimeMs += timeMs;
+		}
+	}
+
+	std::string ProgramBinaryCache::GetPath(unsigned long long key) {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", key);
+
+		return mDirectory + name;
+	}
+
+}
@@ -0,0 +1,74 @@
+#ifndef PROGRAM_BINARY_CACHE_R_H
+#define PROGRAM_BINARY_CACHE_R_H
+
+#include "include.h"
+
+namespace Backend {
+	class Context;
+	class ProgramBinaryCache;
+
+	struct ProgramCacheStats {
+		unsigned int Hits, Misses, Rejected, Stored;
+		double HitTimeMs, MissTimeMs; // total time spent in Compile() for each case
+
+		ProgramCacheStats() { Hits = Misses = Rejected = Stored = 0; HitTimeMs = MissTimeMs = 0.0; }
+
+		// Estimated from the average time of a program built from source
+		double TimeSavedMs() { return Misses ? Hits * (MissTimeMs / Misses) - HitTimeMs : 0.0; }
+	};
+
+	// Linked program binaries stored on disk, one file per key.
+	// ShaderProgram::Compile hashes its sources, attribute bindings and the driver strings into the key,
+	// loads the binary on a hit and stores it after linking from source on a miss.
+	// A binary the driver rejects (e.g. after a driver update with the same strings) falls back to the source path and is overwritten.
+	class ProgramBinaryCache {
+		public:
+			static const unsigned long long HASH_SEED = 14695981039346656037ull;
+
+			static unsigned long long Hash(const void* dataPtr, size_t dataSize, unsigned long long hash = HASH_SEED);
+			static unsigned long long Hash(const std::string& str, unsigned long long hash = HASH_SEED) { return Hash(str.data(), str.size(), hash); }
+
+		public:
+			bool IsSupported() { return mSupported; }
+			const std::string& GetDirectory() { return mDirectory; }
+			unsigned long long GetDriverHash() { return mDriverHash; }
+
+			ProgramCacheStats& GetStats() { return mStats; }
+			void ResetStats() { mStats = ProgramCacheStats(); }
+
+		protected:
+			ProgramBinaryCache(Context* context, const std::string& directory);
+
+			bool Load(unsigned long long key, GLuint programHandle);
+			bool Store(unsigned long long key, GLuint programHandle);
+			void RecordCompile(bool hit, double timeMs);
+
+			std::string GetPath(unsigned long long key);
+
+			struct FileHeader {
+				unsigned int Magic;
+				unsigned int Version;
+				unsigned long long Key;
+				GLenum BinaryFormat;
+				GLint BinaryLength;
+			};
+
+		protected:
+			std::string mDirectory;
+			unsigned long long mDriverHash;
+			bool mSupported;
+
+			ProgramCacheStats mStats;
+			std::vector<char> mScratch;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+			friend class ShaderProgram;
+
+	};
+
+}
+
+#endif
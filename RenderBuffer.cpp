@@ -1,22 +1,37 @@
 #include "RenderBuffer.h"
 #include "Context.h"
+#include "InternalStateManager.h"
+#include "FrameStatistics.h"
 #include "TextureBuffer.h"
 
 namespace Backend {
 
 	unsigned int RenderBuffer::MAX_COLOR_ATTACHMENTS = 8;
 
-	RenderBuffer::RenderBuffer(int w, int h) {
-		glGenFramebuffers(1, &mBufferHandle);
+	RenderBuffer::RenderBuffer(Context* context, int w, int h) {
+		mContext = context;
+
+		if (mContext->UsesDirectStateAccess()) glCreateFramebuffers(1, &mBufferHandle);
+		else glGenFramebuffers(1, &mBufferHandle);
 
 		mWidth = w;
 		mHeight = h;
 
 		mColorAttachmentsCount = 0;
+		mOwnsHandle = true;
 	}
 
 	RenderBuffer::~RenderBuffer() {
-		//todo
+		for (auto& slot : mSlots) {
+			ReleaseSlotTexture(slot.second);
+			delete slot.second;
+		}
+
+		// The default render buffer wraps a framebuffer owned by the window
+		if (mOwnsHandle) {
+			mContext->StateManager()->FramebufferDeleted(mBufferHandle);
+			glDeleteFramebuffers(1, &mBufferHandle);
+		}
 	}
 
 	void RenderBuffer::Resize(int w, int h) {
@@ -25,8 +40,9 @@ namespace Backend {
 
 		for (auto slot : mSlots) {
 			if (slot.second->mOwnedByRenderbuffer) {
-				TextureFormat tempFormat = slot.second->mTexture->GetFormat();
-				slot.second->mTexture->CreateFromFormat(tempFormat, w, h);
+				// New storage comes with a new texture object, the texture attaches it again through TextureRecreated
+				TextureBuffer* tex = slot.second->mTexture;
+				tex->CreateFromFormat(tex->GetFormat(), w, h, tex->GetMipLevels() > 1 ? 0 : 1);
 			}
 		}
 	}
@@ -34,29 +50,27 @@ namespace Backend {
 	void RenderBuffer::Copy(RenderBuffer* destination, AttachmentType copyType) {
 		if (!destination) return;
 
-		// save the last state
-		int tempWidth, tempHeight;
-		GLint vp[4], tempHandleNative;
-		glGetIntegerv(GL_VIEWPORT, vp); tempWidth = vp[2]; tempHeight = vp[3];
-		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &tempHandleNative);
-
-		int destWidth = destination->GetWidth();
-		int destHeight = destination->GetHeight();
-		
-		if (destWidth != tempWidth || destHeight != tempHeight) {
-			glViewport(0, 0, destWidth, destHeight);
+		if (mContext->UsesDirectStateAccess()) {
+			glBlitNamedFramebuffer(mBufferHandle, destination->mBufferHandle, 0, 0, mWidth, mHeight, 0, 0, destination->mWidth, destination->mHeight, ConvertAttachmentToBitfield(copyType), GL_NEAREST);
+			mContext->Statistics()->Add(FrameStatType::STAT_BLITS);
+			return;
 		}
-		
-		glBindFramebuffer(GL_READ_FRAMEBUFFER, mBufferHandle);
-		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, destination->mBufferHandle);
+
+		InternalStateManager* stateManager = mContext->StateManager();
+
+		// save the last state, blits ignore the viewport so only the bindings matter
+		GLuint tempRead = stateManager->GetReadFramebuffer();
+		GLuint tempDraw = stateManager->GetDrawFramebuffer();
+
+		stateManager->BindReadFramebuffer(mBufferHandle);
+		stateManager->BindDrawFramebuffer(destination->mBufferHandle);
 
 		glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, destination->mWidth, destination->mHeight, ConvertAttachmentToBitfield(copyType), GL_NEAREST);
+		mContext->Statistics()->Add(FrameStatType::STAT_BLITS);
 
 		// restore the last state
-		if (destWidth != tempWidth || destHeight != tempHeight) {
-			glViewport(0, 0, tempWidth, tempWidth);
-		}
-		glBindFramebuffer(GL_FRAMEBUFFER, tempHandleNative);
+		if (tempRead != InternalStateManager::UNKNOWN_HANDLE) stateManager->BindReadFramebuffer(tempRead);
+		if (tempDraw != InternalStateManager::UNKNOWN_HANDLE) stateManager->BindDrawFramebuffer(tempDraw);
 	}
 
 	void RenderBuffer::AddSlotImpl(const std::string& name, AttachmentType type, TextureBuffer* tex, TextureFace face, int level, bool owned) {
@@ -79,35 +93,88 @@ namespace Backend {
 		slot->mOwnedByRenderbuffer = owned;
 
 		mSlots.insert({ name, slot });
+		tex->mRenderBuffers.push_back(this);
 
+		if (type == AttachmentType::ATTACHMENT_COLOR) slot->mColorAttID = mColorAttachmentsCount++;
+
+		AttachTexture(slot, tex, face, level);
+	}
+
+	void RenderBuffer::AttachTexture(RenderBufferSlot* slot, TextureBuffer* tex, TextureFace face, int level) {
 		GLenum attachmentTypeNative;
-		if (type == AttachmentType::ATTACHMENT_DEPTH) {
+		if (slot->mType == AttachmentType::ATTACHMENT_DEPTH) {
 			attachmentTypeNative = GL_DEPTH_ATTACHMENT;
 		}
-		else if (type == AttachmentType::ATTACHMENT_STENCIL) {
+		else if (slot->mType == AttachmentType::ATTACHMENT_STENCIL) {
 			attachmentTypeNative = GL_STENCIL_ATTACHMENT;
 		}
-		else if (type == AttachmentType::ATTACHMENT_COLOR) {
-			slot->mColorAttID = mColorAttachmentsCount++;
+		else if (slot->mType == AttachmentType::ATTACHMENT_COLOR) {
 			attachmentTypeNative = GL_COLOR_ATTACHMENT0 + slot->mColorAttID;
 		}
 		else return;
 
-		// Setup the slot
-		Bind();
+		if (tex->GetType() == TextureType::TEXTURE_CUBE && face == TextureFace::TEXTURE_FACE_PLANE) face = TextureFace::TEXTURE_FACE_POSITIVE_X;
 
-		if (tex->GetType() == TextureType::TEXTURE_STANDARD) {
-			glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentTypeNative, GL_TEXTURE_2D, tex->GetNativeHandle(), level);
+		// Cube faces are layers of the cube map for the named calls
+		if (mContext->UsesDirectStateAccess()) {
+			if (tex->GetType() == TextureType::TEXTURE_STANDARD) {
+				glNamedFramebufferTexture(mBufferHandle, attachmentTypeNative, tex->GetNativeHandle(), level);
+			}
+			else if (tex->GetType() == TextureType::TEXTURE_CUBE) {
+				glNamedFramebufferTextureLayer(mBufferHandle, attachmentTypeNative, tex->GetNativeHandle(), level, face);
+			}
 		}
-		else if(tex->GetType() == TextureType::TEXTURE_CUBE) {
-			if (face == TextureFace::TEXTURE_FACE_PLANE) face = TextureFace::TEXTURE_FACE_POSITIVE_X;
+		else {
+			Bind();
 
-			glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentTypeNative, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, tex->GetNativeHandle(), level);
+			if (tex->GetType() == TextureType::TEXTURE_STANDARD) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentTypeNative, GL_TEXTURE_2D, tex->GetNativeHandle(), level);
+			}
+			else if (tex->GetType() == TextureType::TEXTURE_CUBE) {
+				glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentTypeNative, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, tex->GetNativeHandle(), level);
+			}
 		}
 
 		slot->mFace = face;
 	}
 
+	void RenderBuffer::ReleaseSlotTexture(RenderBufferSlot* slot) {
+		TextureBuffer* tex = slot->mTexture;
+		if (!tex) return;
+
+		auto itr = std::find(tex->mRenderBuffers.begin(), tex->mRenderBuffers.end(), this);
+		if (itr != tex->mRenderBuffers.end()) tex->mRenderBuffers.erase(itr);
+
+		if (slot->mOwnedByRenderbuffer) delete tex;
+		slot->mTexture = nullptr;
+	}
+
+	void RenderBuffer::TextureRecreated(TextureBuffer* tex) {
+		for (auto& slot : mSlots) {
+			if (slot.second->mTexture == tex) AttachTexture(slot.second, tex, slot.second->mFace, slot.second->mLevel);
+		}
+	}
+
+	void RenderBuffer::TextureDeleted(TextureBuffer* tex) {
+		for (auto& slot : mSlots) {
+			if (slot.second->mTexture == tex) slot.second->mTexture = nullptr;
+		}
+	}
+
+	void RenderBuffer::SetDrawBuffers(const std::vector<GLenum>& drawBuffersNative) {
+		if (mContext->UsesDirectStateAccess()) {
+			if (drawBuffersNative.empty()) glNamedFramebufferDrawBuffer(mBufferHandle, GL_NONE);
+			else glNamedFramebufferDrawBuffers(mBufferHandle, (int)drawBuffersNative.size(), &drawBuffersNative[0]);
+			return;
+		}
+
+		// Draw buffers are framebuffer state
+		Bind();
+
+		if (drawBuffersNative.empty()) glDrawBuffer(GL_NONE);
+		else glDrawBuffers((int)drawBuffersNative.size(), &drawBuffersNative[0]);
+	}
+
 	GLbitfield RenderBuffer::ConvertAttachmentToBitfield(AttachmentType type) {
 		if (type == AttachmentType::ATTACHMENT_DEPTH) {
 			return GL_DEPTH_BUFFER_BIT;
@@ -121,7 +188,7 @@ namespace Backend {
 	}
 
 	void RenderBuffer::Bind() {
-		glBindFramebuffer(GL_FRAMEBUFFER, mBufferHandle);
+		mContext->StateManager()->BindFramebuffer(mBufferHandle);
 	}
 
 	RenderBuffer* RenderBuffer::AddSlot(const std::string& name, AttachmentType type, TextureBuffer* tex, TextureFace face, int level) {
@@ -158,10 +225,9 @@ namespace Backend {
 		if (itr != mSlots.end()) {
 			RenderBufferSlot* slot = mSlots[name];
 
-			if (slot->mOwnedByRenderbuffer) {
-				delete slot->mTexture;
-			}
+			ReleaseSlotTexture(slot);
 
+			delete slot;
 			mSlots.erase(itr);
 		}
 
@@ -189,46 +255,21 @@ namespace Backend {
 
 		auto slot = mSlots[name];
 
-		if (slot->mOwnedByRenderbuffer) {
-			delete slot->mTexture;
-		}
+		ReleaseSlotTexture(slot);
 
 		slot->mOwnedByRenderbuffer = false;
 		slot->mTexture = tex;
 		slot->mLevel = level;
+		tex->mRenderBuffers.push_back(this);
 
-		GLenum attachmentTypeNative;
-		if (slot->mType == AttachmentType::ATTACHMENT_DEPTH) {
-			attachmentTypeNative = GL_DEPTH_ATTACHMENT;
-		}
-		else if (slot->mType == AttachmentType::ATTACHMENT_STENCIL) {
-			attachmentTypeNative = GL_STENCIL_ATTACHMENT;
-		}
-		else if (slot->mType == AttachmentType::ATTACHMENT_COLOR) {
-			attachmentTypeNative = GL_COLOR_ATTACHMENT0 + slot->mColorAttID;
-		}
-		else return this;
-
-		// Setup the slot
-		Bind();
-
-		if (tex->GetType() == TextureType::TEXTURE_STANDARD) {
-			glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentTypeNative, GL_TEXTURE_2D, tex->GetNativeHandle(), level);
-		}
-		else if (tex->GetType() == TextureType::TEXTURE_CUBE) {
-			if (face == TextureFace::TEXTURE_FACE_PLANE) face = TextureFace::TEXTURE_FACE_POSITIVE_X;
-
-			glFramebufferTexture2D(GL_FRAMEBUFFER, attachmentTypeNative, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, tex->GetNativeHandle(), level);
-		}
-
-		slot->mFace = face;
+		AttachTexture(slot, tex, face, level);
 
 		return this;
 	}
 
 	RenderBuffer* RenderBuffer::SetSlotsUsedToDraw(const std::vector<std::string>& slots) {
-		std::vector<GLuint> drawBuffersNative;
-		
+		std::vector<GLenum> drawBuffersNative;
+
 		for (auto& key : slots) {
 			if (mSlots.find(key) != mSlots.end()) {
 				if (mSlots[key]->Type() != AttachmentType::ATTACHMENT_COLOR) continue;
@@ -237,19 +278,13 @@ namespace Backend {
 			}
 		}
 
-		if (drawBuffersNative.empty()) {
-			glDrawBuffer(GL_NONE);
-		}
-		else {
-			glDrawBuffers((int)drawBuffersNative.size(), &drawBuffersNative[0]);
-		}
-
+		SetDrawBuffers(drawBuffersNative);
 
 		return this;
 	}
 
 	RenderBuffer* RenderBuffer::UseAllSlotsToDraw() {
-		std::vector<GLuint> drawBuffersNative;
+		std::vector<GLenum> drawBuffersNative;
 
 		for (auto slot : mSlots) {
 			if (slot.second->Type() != AttachmentType::ATTACHMENT_COLOR) continue;
@@ -257,7 +292,7 @@ namespace Backend {
 			drawBuffersNative.push_back(GL_COLOR_ATTACHMENT0 + slot.second->mColorAttID);
 		}
 
-		glDrawBuffers((int)drawBuffersNative.size(), &drawBuffersNative[0]);
+		SetDrawBuffers(drawBuffersNative);
 
 		return this;
 	}
@@ -37,7 +37,7 @@ namespace Backend {
 			static unsigned int MAX_COLOR_ATTACHMENTS;
 
 		public:
-			RenderBuffer(int w, int h);
+			RenderBuffer(Context* context, int w, int h);
 			~RenderBuffer();
 
 			void Resize(int w, int h);
@@ -67,6 +67,12 @@ namespace Backend {
 
 		private:
 			void AddSlotImpl(const std::string& name, AttachmentType type, TextureBuffer* tex, TextureFace face, int level, bool owned);
+			void AttachTexture(RenderBufferSlot* slot, TextureBuffer* tex, TextureFace face, int level);
+			void ReleaseSlotTexture(RenderBufferSlot* slot); // deletes the texture if owned
+			// Called by the texture when its handle changes or it is deleted
+			void TextureRecreated(TextureBuffer* tex);
+			void TextureDeleted(TextureBuffer* tex);
+			void SetDrawBuffers(const std::vector<GLenum>& drawBuffersNative);
 			static GLbitfield ConvertAttachmentToBitfield(AttachmentType type);
 
 			void Bind();
@@ -77,11 +83,13 @@ namespace Backend {
 
 			std::map<std::string, RenderBufferSlot*> mSlots;
 			unsigned int mColorAttachmentsCount;
+			bool mOwnsHandle;
 
 		protected:
 			Context* mContext;
 
 			friend class Context;
+			friend class TextureBuffer;
 
 	};
 
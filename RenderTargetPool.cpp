@@ -0,0 +1,173 @@
+#include "RenderTargetPool.h"
+#include "Context.h"
+
+namespace Backend {
+
+	unsigned long long RenderTargetDesc::MemorySize() const {
+		unsigned long long texelSize = 0;
+		for (auto format : ColorFormats) {
+			texelSize += TextureBuffer::GetFormatSize(format);
+		}
+		if (HasDepth) texelSize += TextureBuffer::GetFormatSize(DepthFormat);
+
+		return texelSize * Width * Height;
+	}
+
+	RenderTargetPool::RenderTargetPool(Context* context) {
+		mContext = context;
+
+		mCurrentFrame = 0;
+		mEvictionFrames = 8;
+		mResidentMemory = 0;
+	}
+
+	RenderTargetPool::~RenderTargetPool() {
+		for (auto& framebuffer : mFramebuffers) {
+			delete framebuffer.second.Target;
+		}
+		mFramebuffers.clear(); // the pooled targets below delete their textures
+
+		for (auto& entry : mEntries) {
+			delete entry.Target;
+		}
+	}
+
+	RenderBuffer* RenderTargetPool::Acquire(const RenderTargetDesc& desc) {
+		if (desc.Width <= 0 || desc.Height <= 0) return nullptr;
+
+		for (auto& entry : mEntries) {
+			if (entry.InUse || !(entry.Desc == desc)) continue;
+
+			entry.InUse = true;
+			entry.LastUsedFrame = mCurrentFrame;
+			mStats.Hits++;
+
+			return entry.Target;
+		}
+
+		RenderBuffer* target = mContext->CreateRenderBuffer(desc.Width, desc.Height);
+
+		for (size_t i = 0; i < desc.ColorFormats.size(); ++i) {
+			target->AddSlot("color" + std::to_string(i), AttachmentType::ATTACHMENT_COLOR, desc.ColorFormats[i]);
+		}
+		if (desc.HasDepth) target->AddSlot("depth", AttachmentType::ATTACHMENT_DEPTH, desc.DepthFormat);
+
+		if (desc.ColorFormats.empty()) target->SetSlotsUsedToDraw({});
+		else target->UseAllSlotsToDraw();
+
+		PoolEntry entry;
+		entry.Target = target;
+		entry.Desc = desc;
+		entry.LastUsedFrame = mCurrentFrame;
+		entry.InUse = true;
+
+		mEntries.push_back(entry);
+		mResidentMemory += desc.MemorySize();
+		mStats.Misses++;
+
+		return target;
+	}
+
+	void RenderTargetPool::Release(RenderBuffer* target) {
+		for (auto& entry : mEntries) {
+			if (entry.Target == target) {
+				entry.InUse = false;
+				return;
+			}
+		}
+	}
+
+	RenderBuffer* RenderTargetPool::AcquireFramebuffer(const std::vector<TextureBuffer*>& colors, TextureBuffer* depth) {
+		std::vector<TextureBuffer*> key = colors;
+		key.push_back(depth);
+
+		TextureBuffer* first = colors.empty() ? depth : colors[0];
+		if (!first) return nullptr;
+
+		auto itr = mFramebuffers.find(key);
+		if (itr != mFramebuffers.end()) {
+			itr->second.LastUsedFrame = mCurrentFrame;
+			return itr->second.Target;
+		}
+
+		RenderBuffer* target = mContext->CreateRenderBuffer(first->GetWidth(), first->GetHeight());
+
+		std::vector<std::string> drawSlots;
+		for (size_t i = 0; i < colors.size(); ++i) {
+			std::string slotName = "color" + std::to_string(i);
+			target->AddSlot(slotName, AttachmentType::ATTACHMENT_COLOR, colors[i]);
+			drawSlots.push_back(slotName);
+		}
+		if (depth) target->AddSlot("depth", AttachmentType::ATTACHMENT_DEPTH, depth);
+
+		target->SetSlotsUsedToDraw(drawSlots);
+
+		FramebufferEntry entry;
+		entry.Target = target;
+		entry.LastUsedFrame = mCurrentFrame;
+		mFramebuffers.insert({ key, entry });
+
+		return target;
+	}
+
+	unsigned int RenderTargetPool::GetInUseCount() {
+		unsigned int count = 0;
+		for (auto& entry : mEntries) {
+			if (entry.InUse) count++;
+		}
+
+		return count;
+	}
+
+	void RenderTargetPool::EndFrame(unsigned long long frameIndex) {
+		for (auto itr = mFramebuffers.begin(); itr != mFramebuffers.end(); ) {
+			if (frameIndex - itr->second.LastUsedFrame < mEvictionFrames) {
+				++itr;
+				continue;
+			}
+
+			DeleteTarget(itr->second.Target);
+			itr = mFramebuffers.erase(itr);
+		}
+
+		for (size_t i = 0; i < mEntries.size(); ) {
+			PoolEntry& entry = mEntries[i];
+			entry.InUse = false;
+
+			if (frameIndex - entry.LastUsedFrame < mEvictionFrames) {
+				i++;
+				continue;
+			}
+
+			mResidentMemory -= entry.Desc.MemorySize();
+			mStats.Evictions++;
+
+			// Its textures go with it, taking the framebuffers over them (see TextureDeleted)
+			DeleteTarget(entry.Target);
+
+			mEntries[i] = mEntries.back();
+			mEntries.pop_back();
+		}
+
+		mCurrentFrame = frameIndex + 1;
+	}
+
+	void RenderTargetPool::TextureDeleted(TextureBuffer* texture) {
+		for (auto itr = mFramebuffers.begin(); itr != mFramebuffers.end(); ) {
+			if (std::find(itr->first.begin(), itr->first.end(), texture) != itr->first.end()) {
+				DeleteTarget(itr->second.Target);
+				itr = mFramebuffers.erase(itr);
+			}
+			else {
+				++itr;
+			}
+		}
+	}
+
+	void RenderTargetPool::DeleteTarget(RenderBuffer* target) {
+		if (mContext->Renderbuffer() == target) mContext->SetRenderbuffer(nullptr);
+
+		delete target;
+	}
+
+}
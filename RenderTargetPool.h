@@ -0,0 +1,101 @@
+#ifndef RENDER_TARGET_POOL_R_H
+#define RENDER_TARGET_POOL_R_H
+
+#include "include.h"
+#include "RenderBuffer.h"
+
+namespace Backend {
+	class Context;
+	class RenderTargetPool;
+
+	// Size and attachment set of a pooled target. Color slots are named "color0", "color1"... and the depth slot "depth"
+	struct RenderTargetDesc {
+		int Width, Height;
+		std::vector<TextureFormat> ColorFormats;
+		TextureFormat DepthFormat;
+		bool HasDepth;
+
+		RenderTargetDesc(int width = 0, int height = 0) { Width = width; Height = height; DepthFormat = TextureFormat::TEXTURE_DEPTH_24; HasDepth = false; }
+
+		RenderTargetDesc& AddColor(TextureFormat format) { ColorFormats.push_back(format); return *this; }
+		RenderTargetDesc& SetDepth(TextureFormat format) { DepthFormat = format; HasDepth = true; return *this; }
+
+		unsigned long long MemorySize() const;
+
+		bool operator==(const RenderTargetDesc& other) const {
+			return Width == other.Width && Height == other.Height && ColorFormats == other.ColorFormats && HasDepth == other.HasDepth && (!HasDepth || DepthFormat == other.DepthFormat);
+		}
+	};
+
+	struct RenderTargetPoolStats {
+		unsigned int Hits, Misses, Evictions;
+
+		RenderTargetPoolStats() { Hits = Misses = Evictions = 0; }
+
+		float HitRate() { return (Hits + Misses) ? (float)Hits / (Hits + Misses) : 0.0f; }
+	};
+
+	// Render targets borrowed for the current frame. Everything acquired goes back to the pool at Context::FrameEnd
+	// (or earlier through Release) and is reused by later requests with the same description,
+	// targets nobody asked for during the last N frames are deleted.
+	class RenderTargetPool {
+		public:
+			~RenderTargetPool();
+
+			RenderBuffer* Acquire(const RenderTargetDesc& desc);
+			void Release(RenderBuffer* target);
+
+			// Framebuffer over textures that already exist, e.g. the color and depth textures of two pooled targets.
+			// It owns no memory and isn't borrowed, it is cached by attachments and deleted after N unused frames
+			// or as soon as one of its textures is deleted
+			RenderBuffer* AcquireFramebuffer(const std::vector<TextureBuffer*>& colors, TextureBuffer* depth);
+			unsigned int GetFramebufferCount() { return (unsigned int)mFramebuffers.size(); }
+
+			RenderTargetPool* SetEvictionFrames(unsigned int frames) { mEvictionFrames = frames; return this; }
+
+			RenderTargetPoolStats& GetStats() { return mStats; }
+			unsigned long long GetResidentMemory() { return mResidentMemory; }
+			unsigned int GetResidentCount() { return (unsigned int)mEntries.size(); }
+			unsigned int GetInUseCount();
+
+		protected:
+			RenderTargetPool(Context* context);
+
+			void EndFrame(unsigned long long frameIndex);
+
+			struct PoolEntry {
+				RenderBuffer* Target;
+				RenderTargetDesc Desc;
+				unsigned long long LastUsedFrame;
+				bool InUse;
+			};
+
+			struct FramebufferEntry {
+				RenderBuffer* Target;
+				unsigned long long LastUsedFrame;
+			};
+
+			// Called by the TextureBuffer destructor, drops the cached framebuffers using it
+			void TextureDeleted(TextureBuffer* texture);
+			void DeleteTarget(RenderBuffer* target);
+
+		protected:
+			std::vector<PoolEntry> mEntries;
+			std::map<std::vector<TextureBuffer*>, FramebufferEntry> mFramebuffers; // keyed by the color textures then depth (nullptr when none)
+			unsigned long long mCurrentFrame;
+			unsigned int mEvictionFrames;
+
+			RenderTargetPoolStats mStats;
+			unsigned long long mResidentMemory;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+			friend class TextureBuffer;
+
+	};
+
+}
+
+#endif
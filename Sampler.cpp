@@ -0,0 +1,76 @@
+#include "Sampler.h"
+#include "Context.h"
+#include "InternalStateManager.h"
+
+namespace Backend {
+
+	Sampler::Sampler(Context* context, const SamplerDescription& description) {
+		mContext = context;
+		mDescription = description;
+
+		// Sampler parameters never needed a bind, only the creation differs
+		if (mContext->UsesDirectStateAccess()) glCreateSamplers(1, &mSamplerHandle);
+		else glGenSamplers(1, &mSamplerHandle);
+
+		glSamplerParameteri(mSamplerHandle, GL_TEXTURE_WRAP_S, ConvertWrapToNative(description.VWrap));
+		glSamplerParameteri(mSamplerHandle, GL_TEXTURE_WRAP_T, ConvertWrapToNative(description.HWrap));
+		glSamplerParameteri(mSamplerHandle, GL_TEXTURE_MIN_FILTER, ConvertFilterToNative(description.MinFilter, description.MinMipmapFilter));
+		glSamplerParameteri(mSamplerHandle, GL_TEXTURE_MAG_FILTER, ConvertFilterToNative(description.MagFilter, MipmapFilter::MIPMAP_FILTER_NONE));
+
+		if (description.VWrap == TextureWrapType::WRAP_NONE || description.HWrap == TextureWrapType::WRAP_NONE) {
+			glSamplerParameterfv(mSamplerHandle, GL_TEXTURE_BORDER_COLOR, description.BorderColor);
+		}
+	}
+
+	Sampler::~Sampler() {
+		mContext->StateManager()->SamplerDeleted(mSamplerHandle);
+		glDeleteSamplers(1, &mSamplerHandle);
+	}
+
+	unsigned long long Sampler::HashDescription(const SamplerDescription& description) {
+		// FNV-1a over the fields, like the pipeline hash
+		unsigned long long hash = 14695981039346656037ull;
+		auto mix = [&hash](unsigned long long value) {
+			for (int i = 0; i < 8; ++i) {
+				hash ^= (value >> (i * 8)) & 0xFF;
+				hash *= 1099511628211ull;
+			}
+		};
+
+		mix((unsigned long long)description.VWrap);
+		mix((unsigned long long)description.HWrap);
+		mix((unsigned long long)description.MinFilter);
+		mix((unsigned long long)description.MagFilter);
+		mix((unsigned long long)description.MinMipmapFilter);
+
+		for (int i = 0; i < 4; ++i) {
+			unsigned int bits;
+			memcpy(&bits, &description.BorderColor[i], sizeof(bits));
+			mix(bits);
+		}
+
+		return hash;
+	}
+
+	GLint Sampler::ConvertWrapToNative(TextureWrapType wrapType) {
+		if (wrapType == TextureWrapType::WRAP_NONE) return GL_CLAMP_TO_BORDER;
+		if (wrapType == TextureWrapType::WRAP_REPEAT) return GL_REPEAT;
+
+		return GL_CLAMP_TO_EDGE;
+	}
+
+	GLint Sampler::ConvertFilterToNative(TextureFilter filter, MipmapFilter mipmapFilter) {
+		if (filter == TextureFilter::FILTER_LINEAR) {
+			if (mipmapFilter == MipmapFilter::MIPMAP_FILTER_LINEAR) return GL_LINEAR_MIPMAP_LINEAR;
+			if (mipmapFilter == MipmapFilter::MIPMAP_FILTER_NEAREST) return GL_LINEAR_MIPMAP_NEAREST;
+
+			return GL_LINEAR;
+		}
+
+		if (mipmapFilter == MipmapFilter::MIPMAP_FILTER_LINEAR) return GL_NEAREST_MIPMAP_LINEAR;
+		if (mipmapFilter == MipmapFilter::MIPMAP_FILTER_NEAREST) return GL_NEAREST_MIPMAP_NEAREST;
+
+		return GL_NEAREST;
+	}
+
+}
@@ -0,0 +1,61 @@
+#ifndef SAMPLER_R_H
+#define SAMPLER_R_H
+
+#include "include.h"
+#include "TextureBuffer.h"
+
+namespace Backend {
+	class Context;
+	class Sampler;
+
+	struct SamplerDescription {
+		TextureWrapType VWrap, HWrap;
+		TextureFilter MinFilter, MagFilter;
+		MipmapFilter MinMipmapFilter; // magnification never reads the mip chain
+		float BorderColor[4];
+
+		SamplerDescription() {
+			VWrap = HWrap = TextureWrapType::WRAP_REPEAT;
+			MinFilter = MagFilter = TextureFilter::FILTER_NEAREST;
+			MinMipmapFilter = MipmapFilter::MIPMAP_FILTER_NONE;
+			BorderColor[0] = BorderColor[1] = BorderColor[2] = 0.0f;
+			BorderColor[3] = 1.0f;
+		}
+
+		bool operator==(const SamplerDescription& other) const {
+			return VWrap == other.VWrap && HWrap == other.HWrap && MinFilter == other.MinFilter && MagFilter == other.MagFilter && MinMipmapFilter == other.MinMipmapFilter &&
+				memcmp(BorderColor, other.BorderColor, sizeof(BorderColor)) == 0;
+		}
+	};
+
+	// Immutable GL sampler object, bound per texture unit next to the texture.
+	// Samplers are created through Context::CreateSampler, which hands out the existing object for an equal description,
+	// so every texture with the same wrap/filter setup shares one sampler and no texture carries its own parameters.
+	class Sampler {
+		public:
+			const SamplerDescription& Description() { return mDescription; }
+			GLuint GetNativeHandle() { return mSamplerHandle; }
+
+			static unsigned long long HashDescription(const SamplerDescription& description);
+
+		protected:
+			Sampler(Context* context, const SamplerDescription& description);
+			~Sampler();
+
+			static GLint ConvertWrapToNative(TextureWrapType wrapType);
+			static GLint ConvertFilterToNative(TextureFilter filter, MipmapFilter mipmapFilter);
+
+		protected:
+			SamplerDescription mDescription;
+			GLuint mSamplerHandle;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include "ShaderLibrary.h"
+#include "Context.h"
+#include <fstream>
+#include <sstream>
+
+namespace Backend {
+
+	ShaderLibrary::ShaderLibrary(Context* context) {
+		mContext = context;
+
+		mAsyncCompile = false;
+	}
+
+	ShaderLibrary::~ShaderLibrary() {
+		for (auto& variant : mVariants) {
+			delete variant.second;
+		}
+	}
+
+	ShaderLibrary* ShaderLibrary::AddInclude(const std::string& name, const std::string& source) {
+		mIncludes[name] = source;
+
+		return this;
+	}
+
+	ShaderLibrary* ShaderLibrary::SetIncludeDirectory(const std::string& directory) {
+		mIncludeDirectory = directory;
+		if (!mIncludeDirectory.empty() && mIncludeDirectory.back() != '/' && mIncludeDirectory.back() != '\\') mIncludeDirectory += '/';
+
+		return this;
+	}
+
+	unsigned int ShaderLibrary::AddSource(const std::string& name, const std::string& vertexSource, const std::string& fragmentSource, const std::vector<std::string>& features,
+		const std::vector<std::string>& attributes, const std::string& geometrySource) {
+		if (features.size() > MAX_FEATURES || GetSourceId(name) != INVALID_SOURCE) return INVALID_SOURCE;
+
+		ShaderSource source;
+		source.Name = name;
+		source.Stages[ShaderSlotType::SHADER_VERTEX_SLOT] = vertexSource;
+		source.Stages[ShaderSlotType::SHADER_FRAGMENT_SLOT] = fragmentSource;
+		source.Stages[ShaderSlotType::SHADER_GEOMETRY_SLOT] = geometrySource;
+		source.Features = features;
+		source.Attributes = attributes;
+
+		mSources.push_back(source);
+
+		return (unsigned int)mSources.size() - 1;
+	}
+
+	unsigned int ShaderLibrary::GetSourceId(const std::string& name) {
+		for (unsigned int i = 0; i < mSources.size(); ++i) {
+			if (mSources[i].Name == name) return i;
+		}
+
+		return INVALID_SOURCE;
+	}
+
+	unsigned long long ShaderLibrary::GetFeatureMask(unsigned int sourceId, const std::vector<std::string>& features) {
+		if (sourceId >= mSources.size()) return 0;
+
+		std::vector<std::string>& sourceFeatures = mSources[sourceId].Features;
+		unsigned long long mask = 0;
+
+		for (auto& feature : features) {
+			auto itr = std::find(sourceFeatures.begin(), sourceFeatures.end(), feature);
+			if (itr != sourceFeatures.end()) mask |= 1ull << (itr - sourceFeatures.begin());
+		}
+
+		return mask;
+	}
+
+	ShaderProgram* ShaderLibrary::GetVariant(unsigned int sourceId, unsigned long long mask) {
+		if (sourceId >= mSources.size()) return nullptr;
+
+		ShaderSource& source = mSources[sourceId];
+
+		// Bits without a feature don't make a different program
+		if (source.Features.size() < MAX_FEATURES) mask &= (1ull << source.Features.size()) - 1;
+
+		auto key = std::make_pair(sourceId, mask);
+		auto itr = mVariants.find(key);
+		if (itr != mVariants.end()) return itr->second;
+
+		std::vector<std::string> defines = GetDefines(source, mask);
+
+		ShaderProgram* program = mContext->CreateShaderProgram();
+		for (int type = 0; type < 3; ++type) {
+			if (source.Stages[type].empty()) continue;
+
+			program->AddSlot(Preprocess(source.Stages[type], defines), (ShaderSlotType)type);
+		}
+
+		if (!source.Attributes.empty()) program->SetAttributes(source.Attributes);
+
+		if (mAsyncCompile) program->CompileAsync();
+		else program->Compile();
+
+		mVariants.insert({ key, program });
+
+		return program;
+	}
+
+	ShaderLibrary* ShaderLibrary::ReloadSource(unsigned int sourceId, const std::string& vertexSource, const std::string& fragmentSource, const std::string& geometrySource) {
+		if (sourceId >= mSources.size()) return this;
+
+		ShaderSource& source = mSources[sourceId];
+		source.Stages[ShaderSlotType::SHADER_VERTEX_SLOT] = vertexSource;
+		source.Stages[ShaderSlotType::SHADER_FRAGMENT_SLOT] = fragmentSource;
+		source.Stages[ShaderSlotType::SHADER_GEOMETRY_SLOT] = geometrySource;
+
+		// The programs are recompiled in place, callers, draw queues and pipelines keep their pointers
+		for (auto& variant : mVariants) {
+			if (variant.first.first != sourceId) continue;
+
+			ShaderProgram* program = variant.second;
+
+			// Let a compile still in flight land before its slots are replaced
+			if (program->GetStatus() == ProgramStatus::PROGRAM_COMPILING) program->Compile();
+
+			std::vector<std::string> defines = GetDefines(source, variant.first.second);
+
+			for (int type = 0; type < 3; ++type) {
+				std::string stageSource = source.Stages[type].empty() ? "" : Preprocess(source.Stages[type], defines);
+
+				// An empty source removes the slot
+				if (program->HasSlot((ShaderSlotType)type)) program->ReloadSlot(stageSource, (ShaderSlotType)type);
+				else program->AddSlot(stageSource, (ShaderSlotType)type);
+			}
+
+			if (mAsyncCompile) program->CompileAsync();
+			else program->Compile();
+		}
+
+		return this;
+	}
+
+	std::vector<std::string> ShaderLibrary::GetDefines(const ShaderSource& source, unsigned long long mask) {
+		std::vector<std::string> defines;
+		for (unsigned int i = 0; i < source.Features.size(); ++i) {
+			if (mask & (1ull << i)) defines.push_back(source.Features[i]);
+		}
+
+		return defines;
+	}
+
+	std::string ShaderLibrary::Preprocess(const std::string& source, const std::vector<std::string>& defines) {
+		std::string expanded;
+		std::vector<std::string> includeStack, included;
+
+		if (!ExpandIncludes(source, expanded, includeStack, included)) return "";
+
+		// The defines go right after #version, which has to stay the first statement
+		std::string defineBlock;
+		for (auto& define : defines) {
+			defineBlock += "#define " + define + " 1\n";
+		}
+
+		size_t insertAt = 0;
+		size_t versionPos = expanded.find("#version");
+		if (versionPos != std::string::npos) {
+			size_t lineEnd = expanded.find('\n', versionPos);
+			insertAt = (lineEnd == std::string::npos) ? expanded.size() : lineEnd + 1;
+
+			if (lineEnd == std::string::npos) defineBlock = "\n" + defineBlock;
+		}
+
+		// Keep the error line numbers pointing at the original source
+		if (!defineBlock.empty()) {
+			int versionLine = (int)std::count(expanded.begin(), expanded.begin() + insertAt, '\n');
+			defineBlock += "#line " + std::to_string(versionLine + 1) + "\n";
+		}
+
+		expanded.insert(insertAt, defineBlock);
+
+		return expanded;
+	}
+
+	bool ShaderLibrary::ExpandIncludes(const std::string& source, std::string& output, std::vector<std::string>& includeStack, std::vector<std::string>& included) {
+		std::istringstream stream(source);
+		std::string line;
+		int lineNumber = 0;
+
+		while (std::getline(stream, line)) {
+			lineNumber++;
+
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+				output += line;
+				output += '\n';
+				continue;
+			}
+
+			size_t nameBegin = line.find_first_of("\"<", start + 8);
+			size_t nameEnd = (nameBegin == std::string::npos) ? std::string::npos : line.find_first_of("\">", nameBegin + 1);
+			if (nameEnd == std::string::npos) {
+				std::cerr << "[Error] Shader include: malformed line " << lineNumber << ": " << line << std::endl;
+				return false;
+			}
+
+			std::string name = line.substr(nameBegin + 1, nameEnd - nameBegin - 1);
+
+			if (std::find(includeStack.begin(), includeStack.end(), name) != includeStack.end()) {
+				std::cerr << "[Error] Shader include: recursive include of " << name << std::endl;
+				return false;
+			}
+
+			// Every file is pasted once per shader, like an implicit include guard
+			if (std::find(included.begin(), included.end(), name) == included.end()) {
+				std::string includeSource;
+				if (!LoadInclude(name, includeSource)) {
+					std::cerr << "[Error] Shader include: can't find " << name << std::endl;
+					return false;
+				}
+
+				included.push_back(name);
+				includeStack.push_back(name);
+
+				// Errors inside the include report its own line numbers
+				output += "#line 1\n";
+
+				if (!ExpandIncludes(includeSource, output, includeStack, included)) return false;
+
+				includeStack.pop_back();
+			}
+
+			output += "#line " + std::to_string(lineNumber + 1) + "\n";
+		}
+
+		return true;
+	}
+
+	bool ShaderLibrary::LoadInclude(const std::string& name, std::string& source) {
+		auto itr = mIncludes.find(name);
+		if (itr != mIncludes.end()) {
+			source = itr->second;
+			return true;
+		}
+
+		if (mIncludeDirectory.empty()) return false;
+
+		std::ifstream file(mIncludeDirectory + name);
+		if (!file.is_open()) return false;
+
+		std::stringstream buffer;
+		buffer << file.rdbuf();
+		source = buffer.str();
+
+		// Cache it, every variant includes the same files
+		mIncludes[name] = source;
+
+		return true;
+	}
+
+}
@@ -0,0 +1,78 @@
+#ifndef SHADER_LIBRARY_R_H
+#define SHADER_LIBRARY_R_H
+
+#include "include.h"
+#include "ShaderProgram.h"
+
+namespace Backend {
+	class Context;
+	class ShaderLibrary;
+
+	// Shader sources compiled into one ShaderProgram per feature mask.
+	// Sources go through a small preprocessor that resolves #include "name" and injects a #define for every feature bit set,
+	// so each variant is specialised at compile time instead of branching on uniforms.
+	// Variants are created on first use and cached by (source id, mask), every permutation is compiled once.
+	class ShaderLibrary {
+		public:
+			static const unsigned int INVALID_SOURCE = 0xFFFFFFFF;
+			static const unsigned int MAX_FEATURES = 64;
+
+		public:
+			~ShaderLibrary();
+
+			// Includes are looked up here first, then in the include directory
+			ShaderLibrary* AddInclude(const std::string& name, const std::string& source);
+			ShaderLibrary* SetIncludeDirectory(const std::string& directory);
+
+			// features[i] is the name defined when bit i of the mask is set
+			unsigned int AddSource(const std::string& name, const std::string& vertexSource, const std::string& fragmentSource, const std::vector<std::string>& features,
+				const std::vector<std::string>& attributes = {}, const std::string& geometrySource = "");
+			unsigned int GetSourceId(const std::string& name);
+
+			unsigned long long GetFeatureMask(unsigned int sourceId, const std::vector<std::string>& features);
+
+			// Compiled on the first request, with async compiles check ShaderProgram::IsReady before drawing
+			ShaderProgram* GetVariant(unsigned int sourceId, unsigned long long mask);
+			ShaderLibrary* SetAsyncCompile(bool async) { mAsyncCompile = async; return this; }
+
+			// Recompiles every variant of a source in place, e.g. after editing it. Program pointers stay valid, uniform handles don't
+			ShaderLibrary* ReloadSource(unsigned int sourceId, const std::string& vertexSource, const std::string& fragmentSource, const std::string& geometrySource = "");
+
+			std::string Preprocess(const std::string& source, const std::vector<std::string>& defines);
+
+			unsigned int GetVariantsCount() { return (unsigned int)mVariants.size(); }
+
+		protected:
+			ShaderLibrary(Context* context);
+
+			bool ExpandIncludes(const std::string& source, std::string& output, std::vector<std::string>& includeStack, std::vector<std::string>& included);
+			bool LoadInclude(const std::string& name, std::string& source);
+
+			struct ShaderSource {
+				std::string Name;
+				std::string Stages[3]; // ShaderSlotType order, empty when unused
+				std::vector<std::string> Features;
+				std::vector<std::string> Attributes;
+			};
+
+			std::vector<std::string> GetDefines(const ShaderSource& source, unsigned long long mask);
+
+		protected:
+			std::vector<ShaderSource> mSources;
+			std::map<std::pair<unsigned int, unsigned long long>, ShaderProgram*> mVariants;
+
+			std::map<std::string, std::string> mIncludes;
+			std::string mIncludeDirectory;
+
+			bool mAsyncCompile;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -1,35 +1,164 @@
 #include "ShaderProgram.h"
 #include "Context.h"
+#include "InternalStateManager.h"
+#include "ProgramBinaryCache.h"
 #include <ostream>
 
 namespace Backend {
 
-	ShaderProgram::ShaderProgram() {
+	std::map<std::string, unsigned int> ShaderProgram::UniformBlockBindings;
+
+	unsigned int ShaderProgram::RegisterUniformBlock(const std::string& blockName, int binding) {
+		if (binding < 0) {
+			int existingBinding = GetUniformBlockBinding(blockName);
+			if (existingBinding >= 0) return existingBinding;
+
+			// Pick the first binding point nobody claimed yet
+			binding = 0;
+			for (bool taken = true; taken; ) {
+				taken = false;
+				for (auto& key : UniformBlockBindings) {
+					if (key.second == (unsigned int)binding) { taken = true; binding++; break; }
+				}
+			}
+		}
+
+		UniformBlockBindings[blockName] = binding;
+
+		return binding;
+	}
+
+	int ShaderProgram::GetUniformBlockBinding(const std::string& blockName) {
+		auto itr = UniformBlockBindings.find(blockName);
+		if (itr == UniformBlockBindings.end()) return -1;
+
+		return itr->second;
+	}
+
+	ShaderProgram::ShaderProgram(Context* context) {
+		mContext = context;
+
 		mProgramHandle = glCreateProgram();
-		mIsPrepared = false;
+		mStatus = ProgramStatus::PROGRAM_NOT_COMPILED;
+		mFromCache = false;
+		mBinaryKey = 0;
 	}
 
 	ShaderProgram::~ShaderProgram() {
-		//todo: delete slots
+		if (mStatus == ProgramStatus::PROGRAM_COMPILING) mContext->CancelProgramCompile(this);
 
+		for (auto& key : mSlots) {
+			delete key.second;
+		}
+
+		mContext->StateManager()->ProgramDeleted(mProgramHandle);
 		glDeleteProgram(mProgramHandle);
 	}
 
 	void ShaderProgram::Compile() {
+		if (mStatus != ProgramStatus::PROGRAM_COMPILING) {
+			if (!SubmitStages()) return;
+			SubmitLink();
+		}
+
+		// Blocking, the status queries wait for the driver
+		FinishCompile();
+	}
+
+	void ShaderProgram::CompileAsync() {
+		mContext->CompileProgramsAsync({ this });
+	}
+
+	bool ShaderProgram::IsCompileDone() {
+		if (mStatus != ProgramStatus::PROGRAM_COMPILING) return true;
+		if (mFromCache || !mContext->mSupportsParallelCompile) return true;
+
+		GLint done = GL_FALSE;
+		glGetProgramiv(mProgramHandle, GL_COMPLETION_STATUS_KHR, &done);
+
+		return done == GL_TRUE;
+	}
+
+	bool ShaderProgram::SubmitStages() {
 		if (!HasSlot(ShaderSlotType::SHADER_VERTEX_SLOT) || !HasSlot(ShaderSlotType::SHADER_FRAGMENT_SLOT)) {
-			mIsPrepared = false;
-			return;
+			mStatus = ProgramStatus::PROGRAM_FAILED;
+			return false;
 		}
 
+		mCompileStart = std::chrono::high_resolution_clock::now();
+		mStatus = ProgramStatus::PROGRAM_COMPILING;
+		mFromCache = false;
+
+		ProgramBinaryCache* cache = mContext->GetProgramCache();
+		if (cache && cache->IsSupported()) {
+			mBinaryKey = ComputeBinaryKey(cache->GetDriverHash());
+			mFromCache = cache->Load(mBinaryKey, mProgramHandle);
+
+			if (mFromCache) return true;
+		}
+
+		// No status query here, the driver can work on every stage of every program submitted in the same batch
+		for (auto& key : mSlots) {
+			key.second->SubmitCompile();
+		}
+
+		return true;
+	}
+
+	void ShaderProgram::SubmitLink() {
+		if (mStatus != ProgramStatus::PROGRAM_COMPILING || mFromCache) return;
+
+		ProgramBinaryCache* cache = mContext->GetProgramCache();
+		if (cache && cache->IsSupported()) glProgramParameteri(mProgramHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
 		glLinkProgram(mProgramHandle);
-		
-		if (CheckForErrors(std::cout, GL_LINK_STATUS)) {
-			mIsPrepared = false;
+	}
+
+	void ShaderProgram::FinishCompile() {
+		if (mStatus != ProgramStatus::PROGRAM_COMPILING) return;
+
+		ProgramBinaryCache* cache = mContext->GetProgramCache();
+		bool useCache = cache && cache->IsSupported();
+
+		bool success = mFromCache;
+		if (!mFromCache) {
+			success = true;
+			for (auto& key : mSlots) {
+				if (!key.second->CheckCompile()) success = false;
+			}
+
+			if (success) success = !CheckForErrors(std::cout, GL_LINK_STATUS);
+			if (success && useCache) cache->Store(mBinaryKey, mProgramHandle);
 		}
-		else {
-			glValidateProgram(mProgramHandle);
-			mIsPrepared = true;
+
+		mStatus = success ? ProgramStatus::PROGRAM_READY : ProgramStatus::PROGRAM_FAILED;
+		if (!success) return;
+
+		// Async compiles include the time spent waiting for the frames in between
+		if (useCache) cache->RecordCompile(mFromCache, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - mCompileStart).count());
+
+		glValidateProgram(mProgramHandle);
+
+		ReflectUniforms();
+		ReflectUniformBlocks();
+	}
+
+	unsigned long long ShaderProgram::ComputeBinaryKey(unsigned long long driverHash) {
+		unsigned long long key = driverHash;
+
+		// mSlots is ordered by type, so the key doesn't depend on the order the slots were added
+		for (auto& slot : mSlots) {
+			unsigned int type = (unsigned int)slot.first;
+			key = ProgramBinaryCache::Hash(&type, sizeof(type), key);
+			key = ProgramBinaryCache::Hash(slot.second->mSource, key);
 		}
+
+		// Attribute names are separated so {"ab", "c"} and {"a", "bc"} differ
+		for (auto& attrib : mAttributes) {
+			key = ProgramBinaryCache::Hash(attrib.c_str(), attrib.size() + 1, key);
+		}
+
+		return key;
 	}
 
 	bool ShaderProgram::HasSlot(ShaderSlotType type) {
@@ -56,6 +185,7 @@ namespace Backend {
 		if (mSlots.find(type) == mSlots.end()) return this;
 
 		glDetachShader(mProgramHandle, mSlots[type]->mShaderHandle);
+		delete mSlots[type];
 		mSlots.erase(type);
 
 		return AddSlot(source, type);
@@ -73,58 +203,264 @@ namespace Backend {
 	}
 
 	ShaderProgram* ShaderProgram::SetInt(const std::string& uniformName, int value) {
-		glUniform1i(GetUniform(uniformName)->mBindingHandle, value);
+		return SetInt(GetUniformHandle(uniformName), value);
+	}
+
+	ShaderProgram* ShaderProgram::SetFloat(const std::string& uniformName, float value) {
+		return SetFloat(GetUniformHandle(uniformName), value);
+	}
+
+	ShaderProgram* ShaderProgram::SetFloat2(const std::string& uniformName, float value1, float value2) {
+		return SetFloat2(GetUniformHandle(uniformName), value1, value2);
+	}
+
+	ShaderProgram* ShaderProgram::SetFloat3(const std::string& uniformName, float value1, float value2, float value3) {
+		return SetFloat3(GetUniformHandle(uniformName), value1, value2, value3);
+	}
+
+	ShaderProgram* ShaderProgram::SetFloat4(const std::string& uniformName, float value1, float value2, float value3, float value4) {
+		return SetFloat4(GetUniformHandle(uniformName), value1, value2, value3, value4);
+	}
+
+	ShaderProgram* ShaderProgram::SetMatrix4x4(const std::string& uniformName, float* matrix) {
+		return SetMatrix4x4(GetUniformHandle(uniformName), matrix);
+	}
+
+	UniformHandle ShaderProgram::GetUniformHandle(const std::string& uniformName) {
+		auto itr = std::lower_bound(mUniforms.begin(), mUniforms.end(), uniformName, [](const ShaderUniform& uniform, const std::string& name) { return uniform.mBindingName < name; });
+
+		if (itr == mUniforms.end() || itr->mBindingName != uniformName) {
+			// The plain name of an array is its first element, like glGetUniformLocation
+			auto alias = mUniformAliases.find(uniformName);
+			if (alias != mUniformAliases.end()) return UniformHandle(alias->second);
+
+			return UniformHandle();
+		}
+
+		return UniformHandle((int)(itr - mUniforms.begin()));
+	}
+
+	ShaderProgram* ShaderProgram::SetInt(UniformHandle handle, int value) {
+		ShaderUniform* uniform = ShadowUniform(handle, &value, sizeof(value));
+		if (!uniform) return this;
+
+		if (mContext->SupportsProgramUniform()) {
+			glProgramUniform1i(mProgramHandle, uniform->mBindingHandle, value);
+		}
+		else {
+			GLuint previous = BindForUniformWrite();
+			glUniform1i(uniform->mBindingHandle, value);
+			RestoreAfterUniformWrite(previous);
+		}
 
 		return this;
 	}
 
-	ShaderProgram* ShaderProgram::SetFloat(const std::string& uniformName, float value) {
-		glUniform1f(GetUniform(uniformName)->mBindingHandle, value);
+	ShaderProgram* ShaderProgram::SetFloat(UniformHandle handle, float value) {
+		ShaderUniform* uniform = ShadowUniform(handle, &value, sizeof(value));
+		if (!uniform) return this;
+
+		if (mContext->SupportsProgramUniform()) {
+			glProgramUniform1f(mProgramHandle, uniform->mBindingHandle, value);
+		}
+		else {
+			GLuint previous = BindForUniformWrite();
+			glUniform1f(uniform->mBindingHandle, value);
+			RestoreAfterUniformWrite(previous);
+		}
 
 		return this;
 	}
 
-	ShaderProgram* ShaderProgram::SetFloat2(const std::string& uniformName, float value1, float value2) {
-		glUniform2f(GetUniform(uniformName)->mBindingHandle, value1, value2);
-		
+	ShaderProgram* ShaderProgram::SetFloat2(UniformHandle handle, float value1, float value2) {
+		float values[2] = { value1, value2 };
+
+		ShaderUniform* uniform = ShadowUniform(handle, values, sizeof(values));
+		if (!uniform) return this;
+
+		if (mContext->SupportsProgramUniform()) {
+			glProgramUniform2f(mProgramHandle, uniform->mBindingHandle, value1, value2);
+		}
+		else {
+			GLuint previous = BindForUniformWrite();
+			glUniform2f(uniform->mBindingHandle, value1, value2);
+			RestoreAfterUniformWrite(previous);
+		}
+
 		return this;
 	}
 
-	ShaderProgram* ShaderProgram::SetFloat3(const std::string& uniformName, float value1, float value2, float value3) {
-		glUniform3f(GetUniform(uniformName)->mBindingHandle, value1, value2, value3);
-		
+	ShaderProgram* ShaderProgram::SetFloat3(UniformHandle handle, float value1, float value2, float value3) {
+		float values[3] = { value1, value2, value3 };
+
+		ShaderUniform* uniform = ShadowUniform(handle, values, sizeof(values));
+		if (!uniform) return this;
+
+		if (mContext->SupportsProgramUniform()) {
+			glProgramUniform3f(mProgramHandle, uniform->mBindingHandle, value1, value2, value3);
+		}
+		else {
+			GLuint previous = BindForUniformWrite();
+			glUniform3f(uniform->mBindingHandle, value1, value2, value3);
+			RestoreAfterUniformWrite(previous);
+		}
+
 		return this;
 	}
 
-	ShaderProgram* ShaderProgram::SetFloat4(const std::string& uniformName, float value1, float value2, float value3, float value4) {
-		glUniform4f(GetUniform(uniformName)->mBindingHandle, value1, value2, value3, value4);
-		
+	ShaderProgram* ShaderProgram::SetFloat4(UniformHandle handle, float value1, float value2, float value3, float value4) {
+		float values[4] = { value1, value2, value3, value4 };
+
+		ShaderUniform* uniform = ShadowUniform(handle, values, sizeof(values));
+		if (!uniform) return this;
+
+		if (mContext->SupportsProgramUniform()) {
+			glProgramUniform4f(mProgramHandle, uniform->mBindingHandle, value1, value2, value3, value4);
+		}
+		else {
+			GLuint previous = BindForUniformWrite();
+			glUniform4f(uniform->mBindingHandle, value1, value2, value3, value4);
+			RestoreAfterUniformWrite(previous);
+		}
+
 		return this;
 	}
 
-	ShaderProgram* ShaderProgram::SetMatrix4x4(const std::string& uniformName, float* matrix) {
-		glUniformMatrix4fv(GetUniform(uniformName)->mBindingHandle, 1, GL_FALSE, matrix);
+	ShaderProgram* ShaderProgram::SetMatrix4x4(UniformHandle handle, float* matrix) {
+		ShaderUniform* uniform = ShadowUniform(handle, matrix, sizeof(float) * 16);
+		if (!uniform) return this;
+
+		if (mContext->SupportsProgramUniform()) {
+			glProgramUniformMatrix4fv(mProgramHandle, uniform->mBindingHandle, 1, GL_FALSE, matrix);
+		}
+		else {
+			GLuint previous = BindForUniformWrite();
+			glUniformMatrix4fv(uniform->mBindingHandle, 1, GL_FALSE, matrix);
+			RestoreAfterUniformWrite(previous);
+		}
 
 		return this;
 	}
 
 	void ShaderProgram::BindForRendering() {
-		if (!mIsPrepared) return;
+		if (mStatus != ProgramStatus::PROGRAM_READY) return;
+
+		mContext->StateManager()->BindShaderProgram(mProgramHandle);
+	}
+
+	GLuint ShaderProgram::BindForUniformWrite() {
+		// glUniform* writes to the program in use, which may be another one
+		InternalStateManager* stateManager = mContext->StateManager();
+		GLuint previous = stateManager->GetShaderProgram();
+
+		stateManager->BindShaderProgram(mProgramHandle);
+
+		return previous;
+	}
 
-		glUseProgram(mProgramHandle);
+	void ShaderProgram::RestoreAfterUniformWrite(GLuint previous) {
+		// The Context still thinks its shader is bound, put it back
+		if (previous != InternalStateManager::UNKNOWN_HANDLE) mContext->StateManager()->BindShaderProgram(previous);
 	}
 
-	ShaderUniform* ShaderProgram::GetUniform(const std::string& uniformName) {
-		if (mUniforms.find(uniformName) == mUniforms.end()) {
-			ShaderUniform* uniform = new ShaderUniform;
+	ShaderUniform* ShaderProgram::ShadowUniform(UniformHandle handle, const void* valuePtr, unsigned int valueSize) {
+		if (!handle.Valid() || handle.Index >= (int)mUniforms.size()) return nullptr;
 
-			uniform->mBindingHandle = glGetUniformLocation(mProgramHandle, uniformName.c_str());
-			uniform->mBindingName = uniformName;
+		ShaderUniform& uniform = mUniforms[handle.Index];
+		if (uniform.mHasValue && memcmp(uniform.mValue, valuePtr, valueSize) == 0) return nullptr;
 
-			mUniforms.insert({ uniformName, uniform });
+		memcpy(uniform.mValue, valuePtr, valueSize);
+		uniform.mHasValue = true;
+
+		// Draws batched so far were recorded with the old value, they have to reach GL before it changes
+		mContext->FlushDrawBatch();
+
+		return &uniform;
+	}
+
+	void ShaderProgram::ReflectUniforms() {
+		mUniforms.clear();
+
+		GLint uniformCount = 0;
+		glGetProgramiv(mProgramHandle, GL_ACTIVE_UNIFORMS, &uniformCount);
+
+		for (GLint i = 0; i < uniformCount; ++i) {
+			GLchar name[256] = { 0 };
+			GLsizei nameLength = 0;
+
+			ShaderUniform uniform;
+			glGetActiveUniform(mProgramHandle, i, sizeof(name), &nameLength, &uniform.mSize, &uniform.mType, name);
+
+			// Uniforms inside blocks have no location, they are handled by ReflectUniformBlocks
+			uniform.mBindingHandle = glGetUniformLocation(mProgramHandle, name);
+			if (uniform.mBindingHandle < 0) continue;
+
+			uniform.mBindingName.assign(name, nameLength);
+
+			// Arrays are reported once as "name[0]", every element gets its own entry so "name[i]" resolves and is shadowed on its own
+			bool isArray = nameLength > 3 && uniform.mBindingName.compare(nameLength - 3, 3, "[0]") == 0;
+			if (!isArray && uniform.mSize <= 1) {
+				mUniforms.push_back(uniform);
+				continue;
+			}
+
+			std::string baseName = isArray ? uniform.mBindingName.substr(0, nameLength - 3) : uniform.mBindingName;
+			GLint elementCount = uniform.mSize;
+
+			for (GLint element = 0; element < elementCount; ++element) {
+				uniform.mBindingName = baseName + "[" + std::to_string(element) + "]";
+				uniform.mSize = 1;
+
+				// Locations of the elements aren't guaranteed to be consecutive, ask for each of them
+				if (element > 0) uniform.mBindingHandle = glGetUniformLocation(mProgramHandle, uniform.mBindingName.c_str());
+				if (uniform.mBindingHandle < 0) continue;
+
+				mUniforms.push_back(uniform);
+			}
 		}
 
-		return mUniforms[uniformName];
+		std::sort(mUniforms.begin(), mUniforms.end(), [](const ShaderUniform& a, const ShaderUniform& b) { return a.mBindingName < b.mBindingName; });
+
+		// Resolved once here, the plain name shares the entry (and the shadowed value) of element 0
+		mUniformAliases.clear();
+		for (int i = 0; i < (int)mUniforms.size(); ++i) {
+			const std::string& name = mUniforms[i].mBindingName;
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) mUniformAliases[name.substr(0, name.size() - 3)] = i;
+		}
+	}
+
+	ShaderUniformBlock* ShaderProgram::GetUniformBlock(const std::string& blockName) {
+		for (auto& block : mUniformBlocks) {
+			if (block.mName == blockName) return &block;
+		}
+
+		return nullptr;
+	}
+
+	void ShaderProgram::ReflectUniformBlocks() {
+		mUniformBlocks.clear();
+
+		GLint blockCount = 0;
+		glGetProgramiv(mProgramHandle, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+
+		for (GLint i = 0; i < blockCount; ++i) {
+			GLchar name[256] = { 0 };
+			glGetActiveUniformBlockName(mProgramHandle, i, sizeof(name), NULL, name);
+
+			ShaderUniformBlock block;
+			block.mName = name;
+			block.mIndex = i;
+			block.mBinding = RegisterUniformBlock(block.mName);
+			glGetActiveUniformBlockiv(mProgramHandle, i, GL_UNIFORM_BLOCK_DATA_SIZE, &block.mDataSize);
+
+			// The binding points are shared by every program, so too many distinct block names run out of them
+			if (block.mBinding >= mContext->MaxUniformBufferBindings()) {
+				std::cerr << "[Error] Uniform block " << block.mName << " got binding " << block.mBinding << ", over GL_MAX_UNIFORM_BUFFER_BINDINGS (" << mContext->MaxUniformBufferBindings() << ")" << std::endl;
+			}
+			else glUniformBlockBinding(mProgramHandle, block.mIndex, block.mBinding);
+
+			mUniformBlocks.push_back(block);
+		}
 	}
 
 	bool ShaderProgram::CheckForErrors(std::ostream& stream, GLuint flag) {
@@ -145,6 +481,10 @@ namespace Backend {
 	ShaderSlot::ShaderSlot(ShaderSlotType type, const std::string& source) {
 		mShaderHandle = glCreateShader(ConvertTypeToNative(type));
 
+		mType = type;
+		mSource = source;
+		mIsCompiled = mIsChecked = false;
+
 		if (source.empty()) {
 			mIsLoaded = false;
 		}
@@ -153,12 +493,27 @@ namespace Backend {
 			GLint shaderSourceSize = (GLint)source.length();
 
 			glShaderSource(mShaderHandle, 1, &shaderSourcePtr, &shaderSourceSize);
-			glCompileShader(mShaderHandle);
 
-			mIsLoaded = !CheckErrors(GL_COMPILE_STATUS);
+			mIsLoaded = true;
 		}
 	}
 
+	void ShaderSlot::SubmitCompile() {
+		if (mIsCompiled || !mIsLoaded) return;
+
+		glCompileShader(mShaderHandle);
+		mIsCompiled = true;
+	}
+
+	bool ShaderSlot::CheckCompile() {
+		if (mIsChecked || !mIsCompiled) return mIsLoaded;
+
+		mIsLoaded = !CheckErrors(GL_COMPILE_STATUS);
+		mIsChecked = true;
+
+		return mIsLoaded;
+	}
+
 	GLenum ShaderSlot::ConvertTypeToNative(ShaderSlotType type) {
 		if (type == ShaderSlotType::SHADER_VERTEX_SLOT) {
 			return GL_VERTEX_SHADER;
@@ -173,7 +528,7 @@ namespace Backend {
 	}
 
 	ShaderSlot::~ShaderSlot() {
-
+		glDeleteShader(mShaderHandle);
 	}
 
 	bool ShaderSlot::CheckErrors(GLuint flag) {
@@ -2,6 +2,7 @@
 #define SHADER_PROGRAM_R_H
 
 #include "include.h"
+#include <chrono>
 
 #define MATPTR(mat) ((float*)&mat[0][0])
 
@@ -9,9 +10,11 @@ namespace Backend {
 	class Context;
 	class ShaderProgram;
 	class ShaderUniform;
+	class ShaderUniformBlock;
 	class ShaderSlot;
 
 	enum ShaderSlotType { SHADER_VERTEX_SLOT, SHADER_FRAGMENT_SLOT, SHADER_GEOMETRY_SLOT };
+	enum ProgramStatus { PROGRAM_NOT_COMPILED, PROGRAM_COMPILING, PROGRAM_READY, PROGRAM_FAILED };
 
 	class ShaderSlot {
 		public:
@@ -19,10 +22,16 @@ namespace Backend {
 
 			ShaderSlotType Type() { return mType; }
 			bool Loaded() { return mIsLoaded; }
+			bool Compiled() { return mIsCompiled; }
 
 		private:
 			ShaderSlot(ShaderSlotType type, const std::string& source);
 
+			// Compiling is deferred to ShaderProgram::Compile, a program loaded from the binary cache never compiles its slots.
+			// Submitting and checking are split so the status query doesn't stall right after the compile
+			void SubmitCompile();
+			bool CheckCompile();
+
 			GLenum ConvertTypeToNative(ShaderSlotType type);
 			bool CheckErrors(GLuint flag);
 
@@ -30,28 +39,77 @@ namespace Backend {
 			GLuint mShaderHandle;
 
 			ShaderSlotType mType;
-			bool mIsLoaded;
+			std::string mSource;
+			bool mIsLoaded, mIsCompiled, mIsChecked;
 
 			friend class ShaderProgram;
 
 	};
 
+	// Index into the uniform table of a linked program, resolve it once and keep it instead of passing names on the hot path.
+	// Handles are invalidated when the program is compiled again.
+	struct UniformHandle {
+		int Index;
+
+		UniformHandle(int index = -1) { Index = index; }
+
+		bool Valid() const { return Index >= 0; }
+	};
+
 	class ShaderUniform {
+		public:
+			const std::string& Name() { return mBindingName; }
+			GLenum Type() { return mType; }
+
 		protected:
-			ShaderUniform() { mBindingHandle = 0; }
+			ShaderUniform() { mBindingHandle = -1; mType = 0; mSize = 0; mHasValue = false; }
 
 			std::string mBindingName;
 			GLint mBindingHandle;
+			GLenum mType;
+			GLint mSize;
+
+			// CPU side copy of the last value sent, large enough for a 4x4 matrix
+			unsigned char mValue[64];
+			bool mHasValue;
+
+			friend class ShaderProgram;
+	};
+
+	class ShaderUniformBlock {
+		public:
+			const std::string& Name() { return mName; }
+			GLuint Binding() { return mBinding; }
+			GLint DataSize() { return mDataSize; }
+
+		protected:
+			ShaderUniformBlock() { mIndex = mBinding = 0; mDataSize = 0; }
+
+			std::string mName;
+			GLuint mIndex;
+			GLuint mBinding;
+			GLint mDataSize;
 
 			friend class ShaderProgram;
 	};
 
 	class ShaderProgram {
 		public:
-			ShaderProgram();
+			// Uniform blocks with the same name share a binding point across every program
+			static unsigned int RegisterUniformBlock(const std::string& blockName, int binding = -1);
+			static int GetUniformBlockBinding(const std::string& blockName);
+
+		public:
+			ShaderProgram(Context* context);
 			~ShaderProgram();
 
+			// Blocks until the program is linked
 			void Compile();
+			// Returns right away, the Context polls the program every frame (see Context::CompileProgramsAsync)
+			void CompileAsync();
+
+			ProgramStatus GetStatus() { return mStatus; }
+			bool IsReady() { return mStatus == ProgramStatus::PROGRAM_READY; }
 
 			// Slots and attribs
 			bool HasSlot(ShaderSlotType type);
@@ -60,7 +118,7 @@ namespace Backend {
 			
 			ShaderProgram* SetAttributes(const std::vector<std::string>& attribs);
 
-			// Uniform setters
+			// Uniform setters, values equal to the last one uploaded are skipped. A changed value flushes the Context's draw batch
 			ShaderProgram* SetInt(const std::string& uniformName, int value);
 			ShaderProgram* SetFloat(const std::string& uniformName, float value);
 			ShaderProgram* SetFloat2(const std::string& uniformName, float value1, float value2);
@@ -68,20 +126,53 @@ namespace Backend {
 			ShaderProgram* SetFloat4(const std::string& uniformName, float value1, float value2, float value3, float value4);
 			ShaderProgram* SetMatrix4x4(const std::string& uniformName, float* matrix);
 
+			UniformHandle GetUniformHandle(const std::string& uniformName);
+
+			ShaderProgram* SetInt(UniformHandle handle, int value);
+			ShaderProgram* SetFloat(UniformHandle handle, float value);
+			ShaderProgram* SetFloat2(UniformHandle handle, float value1, float value2);
+			ShaderProgram* SetFloat3(UniformHandle handle, float value1, float value2, float value3);
+			ShaderProgram* SetFloat4(UniformHandle handle, float value1, float value2, float value3, float value4);
+			ShaderProgram* SetMatrix4x4(UniformHandle handle, float* matrix);
+
+			unsigned int GetUniformsCount() { return (unsigned int)mUniforms.size(); }
+
+			// Uniform blocks, reflected when the program is linked
+			ShaderUniformBlock* GetUniformBlock(const std::string& blockName);
+			const std::vector<ShaderUniformBlock>& GetUniformBlocks() { return mUniformBlocks; }
+
 			// PLACEHOLDER
 			void BindForRendering();
 
 		private:
-			ShaderUniform* GetUniform(const std::string& uniformName);
+			ShaderUniform* ShadowUniform(UniformHandle handle, const void* valuePtr, unsigned int valueSize);
+			// Without glProgramUniform* the program is bound for the write, returns the program that was in use
+			GLuint BindForUniformWrite();
+			void RestoreAfterUniformWrite(GLuint previous);
+			bool SubmitStages();
+			void SubmitLink();
+			bool IsCompileDone();
+			void FinishCompile();
+			unsigned long long ComputeBinaryKey(unsigned long long driverHash);
 			bool CheckForErrors(std::ostream& stream, GLuint flag);
+			void ReflectUniforms();
+			void ReflectUniformBlocks();
 
 		private:
 			GLuint mProgramHandle;
-			bool mIsPrepared;
+			ProgramStatus mStatus;
+
+			bool mFromCache;
+			unsigned long long mBinaryKey;
+			std::chrono::high_resolution_clock::time_point mCompileStart;
 
-			std::map<std::string, ShaderUniform*> mUniforms;
+			std::vector<ShaderUniform> mUniforms; // sorted by name
+			std::map<std::string, int> mUniformAliases; // array name without [0] -> index of its first element
 			std::map<ShaderSlotType, ShaderSlot*> mSlots;
 			std::vector<std::string> mAttributes;
+			std::vector<ShaderUniformBlock> mUniformBlocks;
+
+			static std::map<std::string, unsigned int> UniformBlockBindings;
 
 		protected:
 			Context* mContext;
@@ -0,0 +1,39 @@
+#include "Tests.h"
+#include "VertexPacking.h"
+#include "TextureCompressor.h"
+
+#include <iomanip>
+
+using namespace Backend;
+
+namespace {
+
+	const char* PathNames[] = { "scalar", "sse2", "avx2" };
+
+	const char* FormatName(TextureFormat format) {
+		if (format == TextureFormat::TEXTURE_BC1) return "BC1";
+		if (format == TextureFormat::TEXTURE_BC3) return "BC3";
+		if (format == TextureFormat::TEXTURE_BC5) return "BC5";
+
+		return "?";
+	}
+
+}
+
+namespace Tests {
+
+	void RunBenchmarks() {
+		std::cout << std::fixed << std::setprecision(1);
+
+		std::cout << "VertexPacking (MFloats/s)" << std::endl;
+		for (auto& result : VertexPacking::Benchmark()) {
+			std::cout << "  " << std::setw(20) << std::left << result.Function << std::setw(8) << PathNames[result.Path] << std::right << std::setw(10) << result.MegaFloatsPerSecond << std::endl;
+		}
+
+		std::cout << "TextureCompressor (MPixels/s, RMSE)" << std::endl;
+		for (auto& result : TextureCompressor::Benchmark()) {
+			std::cout << "  " << FormatName(result.Format) << (result.Quality == CompressionQuality::COMPRESSION_HIGH ? " high " : " fast ") << std::setw(8) << std::left << PathNames[result.Path] << std::right << std::setw(3) << result.Threads << " thread(s)" << std::setw(10) << result.MegaPixelsPerSecond << std::setw(8) << std::setprecision(2) << result.Rmse << std::setprecision(1) << std::endl;
+		}
+	}
+
+}
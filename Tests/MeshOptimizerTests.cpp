@@ -0,0 +1,151 @@
+#include "Tests.h"
+#include "MeshOptimizer.h"
+
+#include <array>
+
+using namespace Backend;
+
+namespace {
+
+	struct TestMesh {
+		std::vector<GLuint> Indices;
+		std::vector<float> Positions; // xyz
+		std::vector<GLuint> Ids; // original vertex id, remapped along with the positions
+		unsigned int VertexCount;
+	};
+
+	// Grid of quads with its triangles shuffled, big enough to be split in several chunks
+	TestMesh MakeShuffledGrid(unsigned int size) {
+		TestMesh mesh;
+		mesh.VertexCount = (size + 1) * (size + 1);
+
+		for (unsigned int y = 0; y <= size; ++y) {
+			for (unsigned int x = 0; x <= size; ++x) {
+				mesh.Positions.push_back((float)x);
+				mesh.Positions.push_back((float)y);
+				mesh.Positions.push_back(0.01f * (float)((x * 7 + y * 13) % 5));
+			}
+		}
+
+		std::vector<std::array<GLuint, 3>> triangles;
+		for (unsigned int y = 0; y < size; ++y) {
+			for (unsigned int x = 0; x < size; ++x) {
+				GLuint v = y * (size + 1) + x;
+				triangles.push_back({ v, v + 1, v + size + 1 });
+				triangles.push_back({ v + 1, v + size + 2, v + size + 1 });
+			}
+		}
+
+		unsigned int seed = 12345;
+		for (size_t i = triangles.size() - 1; i > 0; --i) {
+			seed = seed * 1664525u + 1013904223u;
+			std::swap(triangles[i], triangles[(seed >> 8) % (i + 1)]);
+		}
+
+		for (auto& triangle : triangles) mesh.Indices.insert(mesh.Indices.end(), triangle.begin(), triangle.end());
+
+		for (GLuint i = 0; i < mesh.VertexCount; ++i) mesh.Ids.push_back(i);
+
+		return mesh;
+	}
+
+	MeshOptimizationReport OptimizeMesh(TestMesh& mesh, unsigned int threads) {
+		// Positions are read before the streams are remapped, so they can be one of them
+		std::vector<VertexStream> streams = { VertexStream(&mesh.Positions[0], sizeof(float) * 3), VertexStream(&mesh.Ids[0], sizeof(GLuint)) };
+
+		return MeshOptimizer::Optimize(mesh.Indices, mesh.VertexCount, &mesh.Positions[0], sizeof(float) * 3, streams, threads);
+	}
+
+	// Triangles in original vertex ids, rotated to start at their lowest id so the winding is kept
+	std::vector<std::array<GLuint, 3>> TriangleSet(const std::vector<GLuint>& indices, const std::vector<GLuint>& ids) {
+		std::vector<std::array<GLuint, 3>> triangles;
+
+		for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+			std::array<GLuint, 3> triangle = { ids[indices[i]], ids[indices[i + 1]], ids[indices[i + 2]] };
+			while (triangle[0] > triangle[1] || triangle[0] > triangle[2]) std::rotate(triangle.begin(), triangle.begin() + 1, triangle.end());
+
+			triangles.push_back(triangle);
+		}
+
+		std::sort(triangles.begin(), triangles.end());
+
+		return triangles;
+	}
+
+	void TestThreadsGiveSameOutput() {
+		TestMesh single = MakeShuffledGrid(300);
+		TestMesh multi = single;
+
+		OptimizeMesh(single, 1);
+		OptimizeMesh(multi, 4);
+
+		TEST_CHECK(single.Indices == multi.Indices);
+		TEST_CHECK(single.Positions == multi.Positions);
+		TEST_CHECK(single.Ids == multi.Ids);
+	}
+
+	void TestCacheEfficiency() {
+		TestMesh mesh = MakeShuffledGrid(300);
+		MeshOptimizationReport report = OptimizeMesh(mesh, 0);
+
+		TEST_CHECK(report.Valid);
+		TEST_CHECK(report.After.ACMR <= report.Before.ACMR);
+		TEST_CHECK(report.After.Misses == MeshOptimizer::AnalyzeVertexCache(mesh.Indices, mesh.VertexCount).Misses);
+
+		// The vertex cache pass alone must not make an already good order worse either
+		std::vector<GLuint> indices = mesh.Indices;
+		float before = MeshOptimizer::AnalyzeVertexCache(indices, mesh.VertexCount).ACMR;
+		TEST_CHECK(MeshOptimizer::OptimizeVertexCache(indices, mesh.VertexCount));
+		TEST_CHECK(MeshOptimizer::AnalyzeVertexCache(indices, mesh.VertexCount).ACMR <= before + 0.01f);
+	}
+
+	void TestTrianglesKept() {
+		TestMesh mesh = MakeShuffledGrid(300);
+		std::vector<std::array<GLuint, 3>> before = TriangleSet(mesh.Indices, mesh.Ids);
+
+		OptimizeMesh(mesh, 0);
+
+		TEST_CHECK(TriangleSet(mesh.Indices, mesh.Ids) == before);
+
+		// The fetch order numbers the vertices by first use
+		GLuint next = 0;
+		bool ordered = true;
+		for (auto index : mesh.Indices) {
+			if (index > next) ordered = false;
+			if (index == next) next++;
+		}
+		TEST_CHECK(ordered);
+	}
+
+	void TestInvalidIndices() {
+		TestMesh mesh = MakeShuffledGrid(8);
+		mesh.Indices[10] = mesh.VertexCount;
+
+		std::vector<GLuint> original = mesh.Indices;
+		std::vector<float> positions = mesh.Positions;
+
+		TEST_CHECK(!OptimizeMesh(mesh, 0).Valid);
+		TEST_CHECK(mesh.Indices == original);
+		TEST_CHECK(mesh.Positions == positions);
+
+		TEST_CHECK(!MeshOptimizer::OptimizeVertexCache(mesh.Indices, mesh.VertexCount, 4));
+		TEST_CHECK(MeshOptimizer::OptimizeOverdraw(mesh.Indices, mesh.VertexCount, &mesh.Positions[0], sizeof(float) * 3) == 0);
+		TEST_CHECK(mesh.Indices == original);
+	}
+
+}
+
+namespace Tests {
+
+	int RunMeshOptimizerTests() {
+		unsigned int failures = Failures;
+
+		TestThreadsGiveSameOutput();
+		TestCacheEfficiency();
+		TestTrianglesKept();
+		TestInvalidIndices();
+
+		return (int)(Failures - failures);
+	}
+
+}
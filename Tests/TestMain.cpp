@@ -0,0 +1,26 @@
+#include "Tests.h"
+
+#include <string>
+
+namespace Tests {
+	unsigned int Failures = 0;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && std::string(argv[1]) == "--bench") {
+		Tests::RunBenchmarks();
+		return 0;
+	}
+
+	Tests::RunMeshOptimizerTests();
+	Tests::RunVertexPackingTests();
+
+	if (Tests::Failures) {
+		std::cerr << Tests::Failures << " check(s) failed" << std::endl;
+		return 1;
+	}
+
+	std::cout << "All tests passed" << std::endl;
+
+	return 0;
+}
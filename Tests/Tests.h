@@ -0,0 +1,26 @@
+#ifndef TESTS_R_H
+#define TESTS_R_H
+
+#include <iostream>
+
+// Minimal checks for the CPU only parts of the backend, no GL context is created.
+// A failed check prints its location and makes the test executable return 1.
+// With --bench the executable prints the VertexPacking and TextureCompressor throughput instead
+namespace Tests {
+	extern unsigned int Failures;
+
+	int RunMeshOptimizerTests();
+	int RunVertexPackingTests();
+
+	void RunBenchmarks();
+}
+
+#define TEST_CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::cerr << "[Error] " << __FILE__ << ":" << __LINE__ << ": " << #condition << std::endl; \
+			Tests::Failures++; \
+		} \
+	} while (0)
+
+#endif
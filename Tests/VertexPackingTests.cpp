@@ -0,0 +1,131 @@
+#include "Tests.h"
+#include "VertexPacking.h"
+
+#include <cmath>
+#include <limits>
+
+using namespace Backend;
+
+namespace {
+
+	const char* PathNames[] = { "scalar", "sse2", "avx2" };
+
+	// Edge values first, then random ones. The odd count leaves a tail for the scalar fallback of the SIMD paths
+	std::vector<float> MakeInputs() {
+		const float inf = std::numeric_limits<float>::infinity();
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+		const float denormal = std::numeric_limits<float>::denorm_min();
+
+		std::vector<float> inputs = {
+			0.0f, -0.0f, denormal, -denormal, 1e-39f, -1e-39f, std::numeric_limits<float>::min(),
+			inf, -inf, nan, -nan,
+			1.0f, -1.0f, 1.0001f, -1.0001f, 0.5f, -0.5f, 2.0f, -2.0f, 1e30f, -1e30f,
+			// Halfway between two codes of the normalized formats
+			0.5f / 127.0f, 1.5f / 127.0f, 0.5f / 255.0f, 2.5f / 255.0f, 0.5f / 32767.0f, 0.5f / 511.0f, -0.5f / 511.0f,
+			// Half range, subnormals and rounding to even
+			65504.0f, 65519.0f, 65520.0f, -65520.0f, 1e5f, -1e5f, 6.1e-5f, 5.96e-8f, 2.98e-8f, 2.99e-8f, 1e-8f,
+			1.0f + 1.0f / 2048.0f, 1.0f + 3.0f / 2048.0f, 2049.0f, 2051.0f
+		};
+
+		unsigned int seed = 4321;
+		while (inputs.size() < 1003) {
+			seed = seed * 1664525u + 1013904223u;
+			inputs.push_back(((float)(seed >> 8) / (float)(1 << 24)) * 3.0f - 1.5f);
+		}
+
+		return inputs;
+	}
+
+	template <typename T, typename Pack>
+	void ComparePaths(const char* name, const std::vector<float>& inputs, size_t count, Pack pack) {
+		std::vector<T> expected(count), result(count);
+
+		VertexPacking::SetPath(PackingPath::PACKING_SCALAR);
+		pack(inputs.data(), expected.data(), count);
+
+		for (int path = PackingPath::PACKING_SSE2; path <= VertexPacking::GetSupportedPath(); ++path) {
+			VertexPacking::SetPath((PackingPath)path);
+			pack(inputs.data(), result.data(), count);
+
+			for (size_t i = 0; i < count; ++i) {
+				if (result[i] == expected[i]) continue;
+
+				std::cerr << "[Error] " << name << " " << PathNames[path] << " gives " << (long long)result[i] << " instead of " << (long long)expected[i] << " for input " << i << std::endl;
+				Tests::Failures++;
+				break;
+			}
+		}
+	}
+
+	void TestPathsGiveSameBytes() {
+		std::vector<float> inputs = MakeInputs();
+
+		ComparePaths<GLushort>("PackHalf", inputs, inputs.size(), VertexPacking::PackHalf);
+		ComparePaths<GLbyte>("PackSnorm8", inputs, inputs.size(), VertexPacking::PackSnorm8);
+		ComparePaths<GLubyte>("PackUnorm8", inputs, inputs.size(), VertexPacking::PackUnorm8);
+		ComparePaths<GLshort>("PackSnorm16", inputs, inputs.size(), VertexPacking::PackSnorm16);
+		ComparePaths<GLushort>("PackUnorm16", inputs, inputs.size(), VertexPacking::PackUnorm16);
+		ComparePaths<GLuint>("PackSnorm2_10_10_10", inputs, inputs.size() / 4, VertexPacking::PackSnorm2_10_10_10);
+
+		VertexPacking::SetPath(VertexPacking::GetSupportedPath());
+	}
+
+	void TestScalarEdgeValues() {
+		const float inf = std::numeric_limits<float>::infinity();
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+
+		TEST_CHECK(VertexPacking::FloatToHalf(0.0f) == 0x0000);
+		TEST_CHECK(VertexPacking::FloatToHalf(-0.0f) == 0x8000);
+		TEST_CHECK(VertexPacking::FloatToHalf(std::numeric_limits<float>::denorm_min()) == 0x0000);
+		TEST_CHECK(VertexPacking::FloatToHalf(65504.0f) == 0x7BFF);
+		TEST_CHECK(VertexPacking::FloatToHalf(65519.0f) == 0x7BFF);
+		TEST_CHECK(VertexPacking::FloatToHalf(65520.0f) == 0x7C00);
+		TEST_CHECK(VertexPacking::FloatToHalf(-1e5f) == 0xFC00);
+		TEST_CHECK(VertexPacking::FloatToHalf(inf) == 0x7C00);
+		TEST_CHECK((VertexPacking::FloatToHalf(nan) & 0x7E00) == 0x7E00);
+		TEST_CHECK(VertexPacking::FloatToHalf(1.0f + 1.0f / 2048.0f) == 0x3C00); // ties go to even
+		TEST_CHECK(VertexPacking::FloatToHalf(1.0f + 3.0f / 2048.0f) == 0x3C02);
+
+		// Every half that is not NaN survives the round trip
+		for (unsigned int value = 0; value < 0x10000; ++value) {
+			if ((value & 0x7C00) == 0x7C00 && (value & 0x3FF)) continue;
+
+			GLushort half = (GLushort)value;
+			if (VertexPacking::FloatToHalf(VertexPacking::HalfToFloat(half)) != half) {
+				std::cerr << "[Error] Half " << value << " does not survive the round trip" << std::endl;
+				Tests::Failures++;
+				break;
+			}
+		}
+
+		// NaN goes to the lower bound of the normalized formats
+		float values[4] = { nan, inf, -inf, -0.0f };
+		GLbyte snorm8[4];
+		GLubyte unorm8[4];
+		GLuint packed;
+
+		VertexPacking::SetPath(PackingPath::PACKING_SCALAR);
+		VertexPacking::PackSnorm8(values, snorm8, 4);
+		VertexPacking::PackUnorm8(values, unorm8, 4);
+		VertexPacking::PackSnorm2_10_10_10(values, &packed, 1);
+		VertexPacking::SetPath(VertexPacking::GetSupportedPath());
+
+		TEST_CHECK(snorm8[0] == -127 && snorm8[1] == 127 && snorm8[2] == -127 && snorm8[3] == 0);
+		TEST_CHECK(unorm8[0] == 0 && unorm8[1] == 255 && unorm8[2] == 0 && unorm8[3] == 0);
+		TEST_CHECK(packed == (0x201u | (0x1FFu << 10) | (0x201u << 20)));
+	}
+
+}
+
+namespace Tests {
+
+	int RunVertexPackingTests() {
+		unsigned int failures = Failures;
+
+		TestScalarEdgeValues();
+		TestPathsGiveSameBytes();
+
+		return (int)(Failures - failures);
+	}
+
+}
@@ -0,0 +1,137 @@
+#include "TextureArrayAtlas.h"
+#include "Context.h"
+
+namespace Backend {
+
+	TextureArrayAtlas::TextureArrayAtlas(Context* context, int layersPerArray, bool mipmapped) {
+		mContext = context;
+
+		mLayersPerArray = std::max(layersPerArray, 1);
+		mMipmapped = mipmapped;
+		mUsedLayers = 0;
+	}
+
+	TextureArrayAtlas::~TextureArrayAtlas() {
+		for (auto& bucket : mBuckets) {
+			for (auto& page : bucket.second) {
+				delete page.Array;
+			}
+		}
+	}
+
+	TextureAtlasEntry TextureArrayAtlas::Allocate(TextureFormat format, int width, int height) {
+		TextureAtlasEntry entry;
+		if (width <= 0 || height <= 0) return entry;
+
+		std::vector<AtlasPage>& pages = mBuckets[{ format, width, height }];
+
+		// Reuse freed layers first, so arrays fill up before a new one gets created
+		AtlasPage* page = nullptr;
+		for (auto& candidate : pages) {
+			if (!candidate.FreeLayers.empty()) {
+				page = &candidate;
+				break;
+			}
+		}
+
+		if (!page) {
+			// Compressed layers can't have their levels generated, they only get level 0
+			int mipLevels = 1;
+			if (mMipmapped && !TextureBuffer::IsCompressed(format)) {
+				for (int size = std::max(width, height); size > 1; size >>= 1) mipLevels++;
+			}
+
+			AtlasPage newPage;
+			newPage.MipmapsDirty = false;
+			newPage.Array = mContext->CreateTextureBuffer(TextureType::TEXTURE_ARRAY);
+			newPage.Array->CreateArray(format, width, height, mLayersPerArray, mipLevels);
+			if (mipLevels > 1) newPage.Array->SetFilterMinMag(TextureFilter::FILTER_LINEAR, TextureFilter::FILTER_LINEAR, MipmapFilter::MIPMAP_FILTER_LINEAR);
+
+			// Hand out the low layers first
+			for (int i = mLayersPerArray - 1; i >= 0; --i) newPage.FreeLayers.push_back(i);
+
+			pages.push_back(newPage);
+			page = &pages.back();
+		}
+
+		entry.Array = page->Array;
+		entry.Layer = page->FreeLayers.back();
+		page->FreeLayers.pop_back();
+
+		mUsedLayers++;
+
+		return entry;
+	}
+
+	void TextureArrayAtlas::Free(const TextureAtlasEntry& entry) {
+		if (!entry.Array) return;
+
+		auto itr = mBuckets.find({ entry.Array->GetFormat(), entry.Array->GetWidth(), entry.Array->GetHeight() });
+		if (itr == mBuckets.end()) return;
+
+		std::vector<AtlasPage>& pages = itr->second;
+		for (size_t i = 0; i < pages.size(); ++i) {
+			AtlasPage& page = pages[i];
+			if (page.Array != entry.Array) continue;
+
+			if (entry.Layer < 0 || entry.Layer >= mLayersPerArray || std::find(page.FreeLayers.begin(), page.FreeLayers.end(), entry.Layer) != page.FreeLayers.end()) {
+				std::cerr << "[Error] Texture atlas layer " << entry.Layer << " is not allocated" << std::endl;
+				return;
+			}
+
+			page.FreeLayers.push_back(entry.Layer);
+			mUsedLayers--;
+
+			// Nothing left on the array, give its memory back
+			if ((int)page.FreeLayers.size() == mLayersPerArray) {
+				delete page.Array;
+				pages.erase(pages.begin() + i);
+
+				if (pages.empty()) mBuckets.erase(itr);
+			}
+
+			return;
+		}
+	}
+
+	TextureAtlasEntry TextureArrayAtlas::Upload(const void* dataPtr, TextureFormat format, int width, int height) {
+		TextureAtlasEntry entry = Allocate(format, width, height);
+
+		if (entry.Valid()) {
+			entry.Array->UploadSubData(dataPtr, width, height, 0, 0, TextureFace::TEXTURE_FACE_PLANE, entry.Layer);
+
+			// Only level 0 was written, the rest of the chain samples undefined texels until GenerateMipmaps.
+			// glGenerateMipmap rebuilds every layer, so it runs once per array for the whole batch
+			if (entry.Array->GetMipLevels() > 1) {
+				for (auto& page : mBuckets[{ format, width, height }]) {
+					if (page.Array == entry.Array) page.MipmapsDirty = true;
+				}
+			}
+		}
+
+		return entry;
+	}
+
+	void TextureArrayAtlas::GenerateMipmaps() {
+		for (auto& bucket : mBuckets) {
+			for (auto& page : bucket.second) {
+				if (!page.MipmapsDirty) continue;
+
+				page.Array->GenerateMipmap();
+				page.MipmapsDirty = false;
+			}
+		}
+	}
+
+	unsigned int TextureArrayAtlas::GetArraysCount() {
+		unsigned int count = 0;
+		for (auto& bucket : mBuckets) count += (unsigned int)bucket.second.size();
+
+		return count;
+	}
+
+	unsigned int TextureArrayAtlas::GetUsedLayersCount() {
+		return mUsedLayers;
+	}
+
+}
@@ -0,0 +1,77 @@
+#ifndef TEXTURE_ARRAY_ATLAS_R_H
+#define TEXTURE_ARRAY_ATLAS_R_H
+
+#include "include.h"
+#include "TextureBuffer.h"
+
+namespace Backend {
+	class Context;
+	class TextureArrayAtlas;
+
+	struct TextureAtlasEntry {
+		TextureBuffer* Array;
+		int Layer;
+
+		TextureAtlasEntry() { Array = nullptr; Layer = -1; }
+
+		bool Valid() { return Array != nullptr; }
+	};
+
+	// Packs same size/same format textures as layers of shared TEXTURE_ARRAY objects.
+	// Materials that only differ by texture end up on the same array, so their draws need a single bind
+	// and can be batched, passing the layer as per draw/per instance data.
+	class TextureArrayAtlas {
+		public:
+			~TextureArrayAtlas();
+
+			// Mipmapped atlases allocate a full chain (level 0 only for compressed formats), fill every level of the layer or call GenerateMipmap
+			TextureAtlasEntry Allocate(TextureFormat format, int width, int height);
+			// An array is deleted with its last layer, freeing a layer twice is an error and ignored
+			void Free(const TextureAtlasEntry& entry);
+
+			// Allocates a layer and fills level 0 in one go. The levels below are left to GenerateMipmaps
+			TextureAtlasEntry Upload(const void* dataPtr, TextureFormat format, int width, int height);
+			// Generates the levels of the arrays uploaded to since the last call, once per array whatever the number of
+			// layers written. Call it after a batch of Upload, before sampling them
+			void GenerateMipmaps();
+
+			unsigned int GetArraysCount();
+			unsigned int GetUsedLayersCount();
+
+		protected:
+			TextureArrayAtlas(Context* context, int layersPerArray, bool mipmapped);
+
+			struct AtlasPage {
+				TextureBuffer* Array;
+				std::vector<int> FreeLayers;
+				bool MipmapsDirty;
+			};
+
+			struct AtlasBucketKey {
+				TextureFormat Format;
+				int Width, Height;
+
+				bool operator<(const AtlasBucketKey& other) const {
+					if (Format != other.Format) return Format < other.Format;
+					if (Width != other.Width) return Width < other.Width;
+					return Height < other.Height;
+				}
+			};
+
+		protected:
+			int mLayersPerArray;
+			bool mMipmapped;
+
+			std::map<AtlasBucketKey, std::vector<AtlasPage>> mBuckets;
+			unsigned int mUsedLayers;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
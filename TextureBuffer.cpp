@@ -1,101 +1,260 @@
 #include "TextureBuffer.h"
+#include "Context.h"
+#include "InternalStateManager.h"
+#include "FrameStatistics.h"
+#include "Sampler.h"
+#include "RenderBuffer.h"
+#include "RenderTargetPool.h"
 
 namespace Backend {
-	const GLenum TextureBuffer::TextureTypeConvertNative[2] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP };
-	const GLenum TextureBuffer::InternalFormatConvertNative[TextureFormat::NUM_FORMATS] = { GL_R16F, GL_RED, GL_RG16F, GL_RG, GL_RGB16F, GL_RGB, GL_RGBA16F, GL_RGBA, GL_SRGB, GL_SRGB_ALPHA, GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT32 };
-	const GLenum TextureBuffer::FormatConvertNative[TextureFormat::NUM_FORMATS] = { GL_RED, GL_RED, GL_RG, GL_RG, GL_RGB, GL_RGB, GL_RGBA, GL_RGBA, GL_RGB, GL_RGBA, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT };
+	const GLenum TextureBuffer::TextureTypeConvertNative[TextureType::NUM_TEXTURE_TYPES] = { GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY };
+	const GLenum TextureBuffer::SizedFormatConvertNative[TextureFormat::NUM_FORMATS] = { GL_R16F, GL_R8, GL_RG16F, GL_RG8, GL_RGB16F, GL_RGB8, GL_RGBA16F, GL_RGBA8, GL_SRGB8, GL_SRGB8_ALPHA8, GL_DEPTH_COMPONENT16, GL_DEPTH_COMPONENT24, GL_DEPTH_COMPONENT32, GL_STENCIL_INDEX8,
+		GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, GL_COMPRESSED_RED_RGTC1, GL_COMPRESSED_RG_RGTC2, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM,
+		GL_COMPRESSED_RGB8_ETC2, GL_COMPRESSED_SRGB8_ETC2, GL_COMPRESSED_RGBA8_ETC2_EAC, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC };
+	static const unsigned int FormatSizeBytes[TextureFormat::NUM_FORMATS] = { 2, 1, 4, 2, 8, 4, 8, 4, 4, 4, 2, 4, 4, 1 }; // 3 component and 24 bit formats are padded by most drivers
+	static const unsigned int BlockSizeBytes[TextureFormat::NUM_FORMATS] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 8, 16, 16, 8, 16, 16, 16, 8, 8, 16, 16 };
 
-	TextureBuffer::TextureBuffer(TextureType type) {
-		glGenTextures(1, &mTextureRef);
+	const GLenum TextureBuffer::FormatConvertNative[TextureFormat::NUM_FORMATS] = { GL_RED, GL_RED, GL_RG, GL_RG, GL_RGB, GL_RGB, GL_RGBA, GL_RGBA, GL_RGB, GL_RGBA, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_DEPTH_COMPONENT, GL_STENCIL_INDEX,
+		GL_RGBA, GL_RGBA, GL_RGBA, GL_RGBA, GL_RED, GL_RG, GL_RGBA, GL_RGBA, GL_RGB, GL_RGB, GL_RGBA, GL_RGBA };
 
+	unsigned int TextureBuffer::GetFormatSize(TextureFormat format) {
+		if (format >= TextureFormat::NUM_FORMATS) return 0;
+
+		return FormatSizeBytes[format];
+	}
+
+	unsigned int TextureBuffer::GetImageSize(TextureFormat format, int width, int height) {
+		if (format >= TextureFormat::NUM_FORMATS || width <= 0 || height <= 0) return 0;
+
+		if (IsCompressed(format)) return ((width + 3) / 4) * ((height + 3) / 4) * BlockSizeBytes[format];
+
+		return width * height * FormatSizeBytes[format];
+	}
+
+	unsigned int TextureBuffer::GetBlockSize(TextureFormat format) {
+		if (format >= TextureFormat::NUM_FORMATS) return 0;
+
+		return BlockSizeBytes[format];
+	}
+
+	bool TextureBuffer::IsFormatSupported(TextureFormat format) {
+		switch (format) {
+			case TextureFormat::TEXTURE_BC1:
+			case TextureFormat::TEXTURE_BC3:
+				return GLEW_EXT_texture_compression_s3tc;
+			case TextureFormat::TEXTURE_BC1_SRGB:
+			case TextureFormat::TEXTURE_BC3_SRGB:
+				return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+			case TextureFormat::TEXTURE_BC7:
+			case TextureFormat::TEXTURE_BC7_SRGB:
+				return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+			case TextureFormat::TEXTURE_ETC2_RGB:
+			case TextureFormat::TEXTURE_ETC2_SRGB:
+			case TextureFormat::TEXTURE_ETC2_RGBA:
+			case TextureFormat::TEXTURE_ETC2_SRGBA:
+				return GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
+			default:
+				// RGTC (BC4, BC5) is core since 3.0
+				return format < TextureFormat::NUM_FORMATS;
+		}
+	}
+
+	TextureBuffer::TextureBuffer(Context* context, TextureType type) {
+		mContext = context;
 		mType = type;
 
-		SetWrapVH(TextureWrapType::WRAP_REPEAT, TextureWrapType::WRAP_REPEAT);
-		SetFilterMinMag(TextureFilter::FILTER_NEAREST, TextureFilter::FILTER_NEAREST);
+		CreateHandle();
+
+		mFormat = TextureFormat::TEXTURE_RGBA;
+		mWidth = mHeight = 0;
+		mLayers = mMipLevels = 1;
+		mHasStorage = false;
+
+		mPendingStreams = 0;
+
+		// No GL calls for the sampling state, the sampler is picked on the first bind
+		mVWrap = mHWrap = TextureWrapType::WRAP_REPEAT;
+		mMinFilter = mMagFilter = TextureFilter::FILTER_NEAREST;
+		mMinMipmapFilter = mMagMipmapFilter = MipmapFilter::MIPMAP_FILTER_NONE;
+		mBorderColor[0] = mBorderColor[1] = mBorderColor[2] = 0.0f;
+		mBorderColor[3] = 1.0f;
+		mSampler = nullptr;
 	}
 
 
 	TextureBuffer::~TextureBuffer() {
+		if (mPendingStreams > 0) mContext->CancelTextureStreams(this);
+
+		// Cached framebuffers are keyed by texture address, a later texture at the same address must not find them
+		if (mContext->GetRenderTargetPool()) mContext->GetRenderTargetPool()->TextureDeleted(this);
+
+		// Still attached somewhere, the slots must not keep a dangling pointer
+		for (auto renderBuffer : mRenderBuffers) renderBuffer->TextureDeleted(this);
+
+		mContext->StateManager()->TextureDeleted(mTextureRef);
+
 		glDeleteTextures(1, &mTextureRef);
 	}
 
-	TextureBuffer* TextureBuffer::CreateFromFormat(TextureFormat format, int width, int height) {
-		mFormat = format;
+	int TextureBuffer::GetFullMipLevels(int width, int height) {
+		int levels = 1;
+		for (int size = std::max(width, height); size > 1; size >>= 1) levels++;
 
-		Bind();
+		return levels;
+	}
 
-		if (mType == TextureType::TEXTURE_STANDARD) {
-			glTexImage2D(TextureTypeConvertNative[mType], 0, InternalFormatConvertNative[format], width, height, 0, FormatConvertNative[format], GetDatatypeFromFormat(), NULL);
+	TextureBuffer* TextureBuffer::CreateFromFormat(TextureFormat format, int width, int height, int mipLevels) {
+		if (mType == TextureType::TEXTURE_ARRAY) return CreateArray(format, width, height, mLayers, mipLevels);
+		if (width <= 0 || height <= 0) return this;
+
+		mipLevels = (mipLevels <= 0) ? GetFullMipLevels(width, height) : std::min(mipLevels, GetFullMipLevels(width, height));
+
+		// Same storage already in place, keep the handle (render targets resized to their current size)
+		if (mHasStorage && format == mFormat && width == mWidth && height == mHeight && mipLevels == mMipLevels) return this;
+
+		bool recreated = mHasStorage;
+		if (recreated) RecreateHandle();
+
+		mFormat = format;
+		mWidth = width;
+		mHeight = height;
+		mMipLevels = mipLevels;
+		mHasStorage = true;
+
+		// A cube map allocates its 6 faces at once
+		if (mContext->UsesDirectStateAccess()) {
+			glTextureStorage2D(mTextureRef, mipLevels, SizedFormatConvertNative[format], width, height);
 		}
-		else if (mType == TextureType::TEXTURE_CUBE) {
-			for (int i = 0; i < 6; ++i) {
-				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, InternalFormatConvertNative[format], width, height, 0, FormatConvertNative[format], GetDatatypeFromFormat(), NULL);
-				
-			}
+		else {
+			Bind();
+			glTexStorage2D(TextureTypeConvertNative[mType], mipLevels, SizedFormatConvertNative[format], width, height);
 		}
 
+		if (recreated) ReattachRenderBuffers();
+
 		return this;
 	}
 
-	TextureBuffer* TextureBuffer::UploadSubData(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face, int layer) {
-		Bind();
-		
-		if (mType == TextureType::TEXTURE_STANDARD) {
-			glTexSubImage2D(TextureTypeConvertNative[mType], layer, xOffset, yOffset, width, height, FormatConvertNative[mFormat], GetDatatypeFromFormat(), dataPtr);
-		}
-		else if (mType == TextureType::TEXTURE_CUBE) {
-			if (face == TextureFace::TEXTURE_FACE_PLANE) return this;
+	TextureBuffer* TextureBuffer::CreateArray(TextureFormat format, int width, int height, int layers, int mipLevels) {
+		if (mType != TextureType::TEXTURE_ARRAY || layers <= 0 || width <= 0 || height <= 0) return this;
 
-			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, layer, xOffset, yOffset, width, height, FormatConvertNative[mFormat], GetDatatypeFromFormat(), dataPtr);
+		mipLevels = (mipLevels <= 0) ? GetFullMipLevels(width, height) : std::min(mipLevels, GetFullMipLevels(width, height));
+
+		if (mHasStorage && format == mFormat && width == mWidth && height == mHeight && layers == mLayers && mipLevels == mMipLevels) return this;
+
+		bool recreated = mHasStorage;
+		if (recreated) RecreateHandle();
+
+		mFormat = format;
+		mWidth = width;
+		mHeight = height;
+		mLayers = layers;
+		mMipLevels = mipLevels;
+		mHasStorage = true;
+
+		if (mContext->UsesDirectStateAccess()) {
+			glTextureStorage3D(mTextureRef, mipLevels, SizedFormatConvertNative[format], width, height, layers);
+		}
+		else {
+			Bind();
+			glTexStorage3D(GL_TEXTURE_2D_ARRAY, mipLevels, SizedFormatConvertNative[format], width, height, layers);
 		}
 
+		if (recreated) ReattachRenderBuffers();
+
 		return this;
 	}
 
-	TextureBuffer* TextureBuffer::UploadData(const void* dataPtr, int width, int height, int numComponents, bool srgb, TextureFace face, int layer) {
-		Bind();
+	TextureBuffer* TextureBuffer::UploadSubData(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face, int layer, int level) {
+		if (dataPtr) mContext->Statistics()->Add(FrameStatType::STAT_TEXTURE_BYTES_UPLOADED, GetUploadSize(width, height));
+
+		UploadSubDataImpl(dataPtr, width, height, xOffset, yOffset, face, layer, level);
 
+		return this;
+	}
+
+	TextureBuffer* TextureBuffer::UploadData(const void* dataPtr, int width, int height, int numComponents, bool srgb, TextureFace face, int layer) {
+		// Compared against the current format to decide if the storage has to be reallocated
+		TextureFormat format;
 		if (numComponents == 4) {
-			if (srgb) mFormat = TextureFormat::TEXTURE_SRGBA;
-			else mFormat = TextureFormat::TEXTURE_RGBA;
+			if (srgb) format = TextureFormat::TEXTURE_SRGBA;
+			else format = TextureFormat::TEXTURE_RGBA;
 		}
 		else if (numComponents == 3) {
-			if (srgb) mFormat = TextureFormat::TEXTURE_SRGB;
-			else mFormat = TextureFormat::TEXTURE_RGB;
+			if (srgb) format = TextureFormat::TEXTURE_SRGB;
+			else format = TextureFormat::TEXTURE_RGB;
 		}
 		else if (numComponents == 2) {
-			mFormat = TextureFormat::TEXTURE_RG;
+			format = TextureFormat::TEXTURE_RG;
 		}
 		else {
-			mFormat = TextureFormat::TEXTURE_R;
+			format = TextureFormat::TEXTURE_R;
 		}
 
-		UploadDataImpl(dataPtr, width, height, mFormat, face, layer);
+		UploadDataImpl(dataPtr, width, height, format, face, layer);
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::UploadData(const void* dataPtr, int width, int height, TextureFormat format, TextureFace face, int layer) {
-		Bind();
-
 		UploadDataImpl(dataPtr, width, height, format, face, layer);
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::GenerateMipmap() {
-		glGenerateMipmap(TextureTypeConvertNative[mType]);
+		if (mContext->UsesDirectStateAccess()) {
+			glGenerateTextureMipmap(mTextureRef);
+		}
+		else {
+			Bind();
+			glGenerateMipmap(TextureTypeConvertNative[mType]);
+		}
 
 		return this;
 	}
 
+	Sampler* TextureBuffer::GetSampler() {
+		if (mSampler) return mSampler;
+
+		SamplerDescription description;
+		description.VWrap = mVWrap;
+		description.HWrap = mHWrap;
+		description.MinFilter = mMinFilter;
+		description.MagFilter = mMagFilter;
+		description.MinMipmapFilter = mMinMipmapFilter;
+
+		// The border color only matters when clamping to the border, leave the default otherwise so more textures share
+		if (mVWrap == TextureWrapType::WRAP_NONE || mHWrap == TextureWrapType::WRAP_NONE) memcpy(description.BorderColor, mBorderColor, sizeof(mBorderColor));
+
+		mSampler = mContext->CreateSampler(description);
+
+		return mSampler;
+	}
+
+	void TextureBuffer::CreateHandle() {
+		if (mContext->UsesDirectStateAccess()) glCreateTextures(TextureTypeConvertNative[mType], 1, &mTextureRef);
+		else glGenTextures(1, &mTextureRef);
+	}
+
+	void TextureBuffer::RecreateHandle() {
+		mContext->StateManager()->TextureDeleted(mTextureRef);
+
+		glDeleteTextures(1, &mTextureRef);
+		CreateHandle();
+	}
+
 	void TextureBuffer::Bind() {
-		glBindTexture(TextureTypeConvertNative[mType], mTextureRef);
+		mContext->StateManager()->BindTextureForEdit(TextureTypeConvertNative[mType], mTextureRef);
 	}
 
-	void TextureBuffer::BindForRendering(int level) {
-		glActiveTexture(GL_TEXTURE0 + level);
-		Bind();
+	void TextureBuffer::ReattachRenderBuffers() {
+		// A RenderBuffer with several slots on this texture is listed once per slot, one call reattaches all of them
+		std::vector<RenderBuffer*> renderBuffers = mRenderBuffers;
+		std::sort(renderBuffers.begin(), renderBuffers.end());
+		renderBuffers.erase(std::unique(renderBuffers.begin(), renderBuffers.end()), renderBuffers.end());
+
+		for (auto renderBuffer : renderBuffers) renderBuffer->TextureRecreated(this);
 	}
 
 	GLenum TextureBuffer::GetDatatypeFromFormat() {
@@ -106,144 +265,186 @@ namespace Backend {
 		return GL_UNSIGNED_BYTE;
 	}
 
-	void TextureBuffer::SetWrapImpl(GLenum wrap, TextureWrapType wrapType) {
-		GLint wrapTypeNative = 0;
-		if (wrapType == TextureWrapType::WRAP_NONE) {
-			wrapTypeNative = GL_CLAMP_TO_BORDER;
+	unsigned int TextureBuffer::GetPixelDataSize() {
+		unsigned int components = 1;
 
-			SetBorderColorImpl(0.0f, 0.0f, 0.0f, 1.0f);
+		GLenum formatNative = FormatConvertNative[mFormat];
+		if (formatNative == GL_RG) components = 2;
+		else if (formatNative == GL_RGB) components = 3;
+		else if (formatNative == GL_RGBA) components = 4;
+
+		return components * (GetDatatypeFromFormat() == GL_FLOAT ? 4 : 1);
+	}
+
+	unsigned int TextureBuffer::GetUploadSize(int width, int height) {
+		if (IsCompressed(mFormat)) return GetImageSize(mFormat, width, height);
+
+		return (unsigned int)width * height * GetPixelDataSize();
+	}
+
+	void TextureBuffer::SetWrapImpl(TextureWrapType& wrap, TextureWrapType wrapType) {
+		wrap = wrapType;
+
+		// Clamping to the border starts with an opaque black border
+		if (wrapType == TextureWrapType::WRAP_NONE) {
+			mBorderColor[0] = mBorderColor[1] = mBorderColor[2] = 0.0f;
+			mBorderColor[3] = 1.0f;
 		}
-		else if (wrapType == TextureWrapType::WRAP_REPEAT) {
-			wrapTypeNative = GL_REPEAT;
+
+		mSampler = nullptr;
+	}
+
+	void TextureBuffer::UploadDataImpl(const void* dataPtr, int width, int height, TextureFormat format, TextureFace face, int layer) {
+		// Arrays reallocate with the new size and fill the requested layer
+		if (mType == TextureType::TEXTURE_ARRAY) {
+			if (!mHasStorage || format != mFormat || width != mWidth || height != mHeight || layer >= mLayers) CreateArray(format, width, height, std::max(mLayers, layer + 1), mMipLevels);
+			UploadSubData(dataPtr, width, height, 0, 0, face, layer);
+			return;
 		}
-		else {
-			wrapTypeNative = GL_CLAMP_TO_EDGE;
+
+		if (mType == TextureType::TEXTURE_CUBE && face == TextureFace::TEXTURE_FACE_PLANE) return;
+
+		// layer is the mip level here, only the base level decides the storage. Magnification never samples the mips
+		bool mipmapped = mMinMipmapFilter != MipmapFilter::MIPMAP_FILTER_NONE;
+
+		if (layer == 0) {
+			// The driver can't generate compressed levels, more than one is allocated up front with CreateFromFormat by the caller uploading them
+			bool fullChain = !IsCompressed(format) && (mipmapped || mMipLevels > 1);
+			if (!mHasStorage || format != mFormat || width != mWidth || height != mHeight) CreateFromFormat(format, width, height, fullChain ? 0 : 1);
 		}
+		else if (!mHasStorage || layer >= mMipLevels) return;
+
+		if (!dataPtr) return;
+
+		UploadSubData(dataPtr, width, height, 0, 0, face, layer);
 
-		glTexParameteri(TextureTypeConvertNative[mType], wrap, wrapTypeNative);
+		// Compressed levels are uploaded like the base level
+		if (layer == 0 && mipmapped && mMipLevels > 1 && !IsCompressed(format)) GenerateMipmap();
 	}
 
-	void TextureBuffer::SetFilterImpl(GLenum filter, TextureFilter filterType, MipmapFilter mipmapType) {
-		GLuint filterTypeNative = 0;
-		if (filterType == TextureFilter::FILTER_LINEAR) {
-			if (mipmapType == MipmapFilter::MIPMAP_FILTER_LINEAR) {
-				filterTypeNative = GL_LINEAR_MIPMAP_LINEAR;
-			}
-			else if (mipmapType == MipmapFilter::MIPMAP_FILTER_NEAREST) {
-				filterTypeNative = GL_LINEAR_MIPMAP_NEAREST;
-			}
-			else if (mipmapType == MipmapFilter::MIPMAP_FILTER_NONE) {
-				filterTypeNative = GL_LINEAR;
-			}
-			else return;
+	void TextureBuffer::UploadSubDataImpl(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face, int layer, int level) {
+		if (mType == TextureType::TEXTURE_CUBE && face == TextureFace::TEXTURE_FACE_PLANE) return;
+
+		if (IsCompressed(mFormat)) {
+			UploadCompressedSubDataImpl(dataPtr, width, height, xOffset, yOffset, face, layer, level);
+			return;
 		}
-		else if (filterType == TextureFilter::FILTER_NEAREST) {
-			if (mipmapType == MipmapFilter::MIPMAP_FILTER_LINEAR) {
-				filterTypeNative = GL_NEAREST_MIPMAP_LINEAR;
+
+		// dataPtr is an offset when a pixel unpack buffer is bound
+		if (mContext->UsesDirectStateAccess()) {
+			GLenum formatNative = FormatConvertNative[mFormat];
+
+			// Cube faces and array slices are layers of the texture
+			if (mType == TextureType::TEXTURE_STANDARD) {
+				glTextureSubImage2D(mTextureRef, layer, xOffset, yOffset, width, height, formatNative, GetDatatypeFromFormat(), dataPtr);
 			}
-			else if (mipmapType == MipmapFilter::MIPMAP_FILTER_NEAREST) {
-				filterTypeNative = GL_NEAREST_MIPMAP_NEAREST;
+			else if (mType == TextureType::TEXTURE_CUBE) {
+				glTextureSubImage3D(mTextureRef, layer, xOffset, yOffset, face, width, height, 1, formatNative, GetDatatypeFromFormat(), dataPtr);
 			}
-			else if (mipmapType == MipmapFilter::MIPMAP_FILTER_NONE) {
-				filterTypeNative = GL_NEAREST;
+			else if (mType == TextureType::TEXTURE_ARRAY) {
+				glTextureSubImage3D(mTextureRef, level, xOffset, yOffset, layer, width, height, 1, formatNative, GetDatatypeFromFormat(), dataPtr);
 			}
-			else return;
+
+			return;
 		}
-		else return;
 
-		glTexParameteri(TextureTypeConvertNative[mType], filter, filterTypeNative);
-	}
+		Bind();
 
-	void TextureBuffer::SetBorderColorImpl(float r, float g, float b, float a) {
-		float color[4] = { r, g, b, a };
-		glTexParameterfv(TextureTypeConvertNative[mType], GL_TEXTURE_BORDER_COLOR, &color[0]);
+		if (mType == TextureType::TEXTURE_STANDARD) {
+			glTexSubImage2D(TextureTypeConvertNative[mType], layer, xOffset, yOffset, width, height, FormatConvertNative[mFormat], GetDatatypeFromFormat(), dataPtr);
+		}
+		else if (mType == TextureType::TEXTURE_CUBE) {
+			glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, layer, xOffset, yOffset, width, height, FormatConvertNative[mFormat], GetDatatypeFromFormat(), dataPtr);
+		}
+		else if (mType == TextureType::TEXTURE_ARRAY) {
+			// For arrays the layer is the array slice
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, xOffset, yOffset, layer, width, height, 1, FormatConvertNative[mFormat], GetDatatypeFromFormat(), dataPtr);
+		}
 	}
 
-	void TextureBuffer::UploadDataImpl(const void* dataPtr, int width, int height, TextureFormat format, TextureFace face, int layer) {
-		mFormat = format;
+	void TextureBuffer::UploadCompressedSubDataImpl(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face, int layer, int level) {
+		// Compressed uploads name the internal format and the byte size of the blocks
+		GLenum formatNative = SizedFormatConvertNative[mFormat];
+		GLsizei imageSize = (GLsizei)GetImageSize(mFormat, width, height);
+
+		if (mContext->UsesDirectStateAccess()) {
+			if (mType == TextureType::TEXTURE_STANDARD) {
+				glCompressedTextureSubImage2D(mTextureRef, layer, xOffset, yOffset, width, height, formatNative, imageSize, dataPtr);
+			}
+			else if (mType == TextureType::TEXTURE_CUBE) {
+				glCompressedTextureSubImage3D(mTextureRef, layer, xOffset, yOffset, face, width, height, 1, formatNative, imageSize, dataPtr);
+			}
+			else if (mType == TextureType::TEXTURE_ARRAY) {
+				glCompressedTextureSubImage3D(mTextureRef, level, xOffset, yOffset, layer, width, height, 1, formatNative, imageSize, dataPtr);
+			}
+
+			return;
+		}
 
-		GLenum internalFormatNative = InternalFormatConvertNative[format];
-		GLenum formatNative = FormatConvertNative[format];
+		Bind();
 
 		if (mType == TextureType::TEXTURE_STANDARD) {
-			glTexImage2D(TextureTypeConvertNative[mType], layer, internalFormatNative, width, height, 0, formatNative, GetDatatypeFromFormat(), dataPtr);
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, layer, xOffset, yOffset, width, height, formatNative, imageSize, dataPtr);
 		}
 		else if (mType == TextureType::TEXTURE_CUBE) {
-			if (face == TextureFace::TEXTURE_FACE_PLANE) return;
-
-			//do the smart conversion
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, layer, internalFormatNative, width, height, 0, formatNative, GetDatatypeFromFormat(), dataPtr);
+			glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, layer, xOffset, yOffset, width, height, formatNative, imageSize, dataPtr);
+		}
+		else if (mType == TextureType::TEXTURE_ARRAY) {
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, xOffset, yOffset, layer, width, height, 1, formatNative, imageSize, dataPtr);
 		}
-
-		if (mMinMipmapFilter != MipmapFilter::MIPMAP_FILTER_NONE || mMagMipmapFilter != MipmapFilter::MIPMAP_FILTER_NONE) GenerateMipmap();
 	}
 
 	TextureBuffer* TextureBuffer::SetWrapV(TextureWrapType type) {
-		Bind();
-
-		mVWrap = type;
-		SetWrapImpl(GL_TEXTURE_WRAP_S, type);
+		SetWrapImpl(mVWrap, type);
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::SetWrapH(TextureWrapType type) {
-		Bind();
-
-		mHWrap = type;
-		SetWrapImpl(GL_TEXTURE_WRAP_T, type);
+		SetWrapImpl(mHWrap, type);
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::SetWrapVH(TextureWrapType vWrapType, TextureWrapType hWrapType) {
-		Bind();
-
-		mVWrap = vWrapType;
-		mHWrap = hWrapType;
-		SetWrapImpl(GL_TEXTURE_WRAP_S, vWrapType);
-		SetWrapImpl(GL_TEXTURE_WRAP_T, hWrapType);
+		SetWrapImpl(mVWrap, vWrapType);
+		SetWrapImpl(mHWrap, hWrapType);
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::SetBorderColor(float r, float g, float b, float a) {
-		Bind();
+		mBorderColor[0] = r;
+		mBorderColor[1] = g;
+		mBorderColor[2] = b;
+		mBorderColor[3] = a;
+		mSampler = nullptr;
 
-		SetBorderColorImpl(r, g, b, a);
-		
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::SetFilterMin(TextureFilter filter, MipmapFilter mipmapFilter) {
-		Bind();
-
 		mMinFilter = filter;
 		mMinMipmapFilter = mipmapFilter;
-		SetFilterImpl(GL_TEXTURE_MIN_FILTER, filter, mipmapFilter);
+		mSampler = nullptr;
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::SetFilterMag(TextureFilter filter, MipmapFilter mipmapFilter) {
-		Bind();
-
 		mMagFilter = filter;
 		mMagMipmapFilter = mipmapFilter;
-		SetFilterImpl(GL_TEXTURE_MAG_FILTER, filter, mipmapFilter);
+		mSampler = nullptr;
 
 		return this;
 	}
 
 	TextureBuffer* TextureBuffer::SetFilterMinMag(TextureFilter minFilter, TextureFilter magFilter, MipmapFilter minMipmapFilter, MipmapFilter magMipmapFilter) {
-		Bind();
-
 		mMinFilter = minFilter;
 		mMinMipmapFilter = minMipmapFilter;
 		mMagFilter = magFilter;
 		mMagMipmapFilter = magMipmapFilter;
-		SetFilterImpl(GL_TEXTURE_MIN_FILTER, minFilter, minMipmapFilter);
-		SetFilterImpl(GL_TEXTURE_MAG_FILTER, magFilter, magMipmapFilter);
+		mSampler = nullptr;
 
 		return this;
 	}
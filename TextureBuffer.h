@@ -2,13 +2,22 @@
 #define TEXTURE_BUFFER_R_H
 
 #include "include.h"
+#include <atomic>
 
 namespace Backend {
 	class Context;
+	class Sampler;
+	class RenderBuffer;
 
 	enum TextureFace { TEXTURE_FACE_POSITIVE_X, TEXTURE_FACE_NEGATIVE_X, TEXTURE_FACE_POSITIVE_Y, TEXTURE_FACE_NEGATIVE_Y, TEXTURE_FACE_POSITIVE_Z, TEXTURE_FACE_NEGATIVE_Z, TEXTURE_FACE_PLANE };
-	enum TextureType { TEXTURE_STANDARD, TEXTURE_CUBE };
-	enum TextureFormat { TEXTURE_R_16, TEXTURE_R, TEXTURE_RG_16, TEXTURE_RG, TEXTURE_RGB_16, TEXTURE_RGB, TEXTURE_RGBA_16, TEXTURE_RGBA, TEXTURE_SRGB, TEXTURE_SRGBA, TEXTURE_DEPTH_16, TEXTURE_DEPTH_24, TEXTURE_DEPTH_32, TEXTURE_STENCIL, NUM_FORMATS };
+	enum TextureType { TEXTURE_STANDARD, TEXTURE_CUBE, TEXTURE_ARRAY, NUM_TEXTURE_TYPES };
+	// Block compressed formats come last, they store 4x4 texel blocks of 8 (BC1, BC4, ETC2 RGB) or 16 bytes
+	enum TextureFormat {
+		TEXTURE_R_16, TEXTURE_R, TEXTURE_RG_16, TEXTURE_RG, TEXTURE_RGB_16, TEXTURE_RGB, TEXTURE_RGBA_16, TEXTURE_RGBA, TEXTURE_SRGB, TEXTURE_SRGBA, TEXTURE_DEPTH_16, TEXTURE_DEPTH_24, TEXTURE_DEPTH_32, TEXTURE_STENCIL,
+		TEXTURE_BC1, TEXTURE_BC1_SRGB, TEXTURE_BC3, TEXTURE_BC3_SRGB, TEXTURE_BC4, TEXTURE_BC5, TEXTURE_BC7, TEXTURE_BC7_SRGB,
+		TEXTURE_ETC2_RGB, TEXTURE_ETC2_SRGB, TEXTURE_ETC2_RGBA, TEXTURE_ETC2_SRGBA,
+		NUM_FORMATS
+	};
 	enum TextureWrapType { WRAP_NONE, WRAP_REPEAT, WRAP_CLAMP };
 	enum TextureFilter { FILTER_NEAREST, FILTER_LINEAR };
 	enum MipmapFilter { MIPMAP_FILTER_NONE, MIPMAP_FILTER_NEAREST, MIPMAP_FILTER_LINEAR };
@@ -17,7 +26,20 @@ namespace Backend {
 
 	class TextureBuffer {
 		public:
-			TextureBuffer(TextureType type = TextureType::TEXTURE_STANDARD);
+			// GPU bytes per texel of a format, for memory accounting (0 for block compressed formats, see GetImageSize)
+			static unsigned int GetFormatSize(TextureFormat format);
+			// GPU bytes of one width x height image, whole 4x4 blocks for the compressed formats
+			static unsigned int GetImageSize(TextureFormat format, int width, int height);
+
+			static bool IsCompressed(TextureFormat format) { return format >= TextureFormat::TEXTURE_BC1 && format < TextureFormat::NUM_FORMATS; }
+			static unsigned int GetBlockSize(TextureFormat format); // bytes per 4x4 block, 0 if not compressed
+			// Compressed formats depend on extensions (S3TC, BPTC, ES3 compatibility for ETC2)
+			static bool IsFormatSupported(TextureFormat format);
+			// Levels of a full mip chain down to 1x1
+			static int GetFullMipLevels(int width, int height);
+
+		public:
+			TextureBuffer(Context* context, TextureType type = TextureType::TEXTURE_STANDARD);
 			~TextureBuffer();
 
 			GLuint& GetNativeHandle() { return mTextureRef; }
@@ -25,13 +47,32 @@ namespace Backend {
 			TextureType GetType() { return mType; }
 			TextureFormat GetFormat() { return mFormat; }
 
-			// Data
-			TextureBuffer* CreateFromFormat(TextureFormat format, int width, int height);
-			TextureBuffer* UploadSubData(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face = TextureFace::TEXTURE_FACE_PLANE, int layer = 0);
+			int GetWidth() { return mWidth; }
+			int GetHeight() { return mHeight; }
+			int GetLayers() { return mLayers; }
+			int GetMipLevels() { return mMipLevels; }
+
+			// False while TextureStreamer uploads are pending for this texture
+			bool IsReady() { return mPendingStreams == 0; }
+
+			// Data, the storage is immutable (glTexStorage*): a new format or size starts over with a fresh texture object,
+			// so the native handle changes. RenderBuffer slots using the texture are attached again, other copies of the handle go stale.
+			// mipLevels <= 0 allocates the full chain
+			TextureBuffer* CreateFromFormat(TextureFormat format, int width, int height, int mipLevels = 1);
+			// Fill the layers with UploadSubData(..., layer)
+			TextureBuffer* CreateArray(TextureFormat format, int width, int height, int layers, int mipLevels = 1);
+			// For standard and cube textures layer is the mip level, arrays take the slice from layer and the mip level from level.
+			// Compressed data is whole blocks, offsets are multiples of 4
+			TextureBuffer* UploadSubData(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face = TextureFace::TEXTURE_FACE_PLANE, int layer = 0, int level = 0);
+			// Allocates the storage on a level 0 upload of a new format or size, with a full mip chain when a min mipmap filter is set or the texture already had one.
+			// Compressed data gets a single level, CreateFromFormat with the level count first to upload more
 			TextureBuffer* UploadData(const void* dataPtr, int width, int height, int numComponents, bool srgb = false, TextureFace face = TextureFace::TEXTURE_FACE_PLANE, int layer = 0);
 			TextureBuffer* UploadData(const void* dataPtr, int width, int height, TextureFormat format, TextureFace face = TextureFace::TEXTURE_FACE_PLANE, int layer = 0);
 			TextureBuffer* GenerateMipmap();
 
+			// Shared sampler object matching the wrap/filter setup, looked up again after a setter changed it
+			Sampler* GetSampler();
+
 			// Wrap
 			TextureBuffer* SetWrapV(TextureWrapType type);
 			TextureBuffer* SetWrapH(TextureWrapType type);
@@ -45,15 +86,19 @@ namespace Backend {
 			TextureBuffer* SetFilterMinMag(TextureFilter minFilter, TextureFilter magFilter, MipmapFilter minMipmapFilter = MipmapFilter::MIPMAP_FILTER_NONE, MipmapFilter magMipmapFilter = MipmapFilter::MIPMAP_FILTER_NONE);
 
 		private:
-			void Bind();
-			void BindForRendering(int level = 0);
+			void CreateHandle();
+			void RecreateHandle(); // immutable storage can't be specified twice
+			void ReattachRenderBuffers();
+			void Bind(); // edits on the bind-to-edit path
 
 			GLenum GetDatatypeFromFormat();
+			unsigned int GetPixelDataSize(); // bytes per pixel of the client data
+			unsigned int GetUploadSize(int width, int height); // bytes of client data for a width x height upload
 
-			void SetWrapImpl(GLenum wrap, TextureWrapType wrapType);
-			void SetFilterImpl(GLenum filter, TextureFilter filterType, MipmapFilter mipmapFilterType);
-			void SetBorderColorImpl(float r, float g, float b, float a);
+			void SetWrapImpl(TextureWrapType& wrap, TextureWrapType wrapType);
 			void UploadDataImpl(const void* dataPtr, int width, int height, TextureFormat format, TextureFace face, int layer);
+			void UploadSubDataImpl(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face, int layer, int level = 0);
+			void UploadCompressedSubDataImpl(const void* dataPtr, int width, int height, int xOffset, int yOffset, TextureFace face, int layer, int level);
 
 		private:
 			GLuint mTextureRef;
@@ -61,18 +106,30 @@ namespace Backend {
 			TextureType mType;
 
 			TextureFormat mFormat;
+			int mWidth, mHeight, mLayers, mMipLevels;
+			bool mHasStorage;
+
+			// Sampling state, turned into a shared Sampler on the next bind
 			TextureWrapType mVWrap, mHWrap;
 			TextureFilter mMinFilter, mMagFilter;
 			MipmapFilter mMinMipmapFilter, mMagMipmapFilter;
+			float mBorderColor[4];
+			Sampler* mSampler;
+
+			std::atomic<int> mPendingStreams; // requested from worker threads
+
+			std::vector<RenderBuffer*> mRenderBuffers; // one entry per RenderBuffer slot using this texture
 
-			static const GLenum TextureTypeConvertNative[2];
-			static const GLenum InternalFormatConvertNative[TextureFormat::NUM_FORMATS];
+			static const GLenum TextureTypeConvertNative[TextureType::NUM_TEXTURE_TYPES];
+			static const GLenum SizedFormatConvertNative[TextureFormat::NUM_FORMATS];
 			static const GLenum FormatConvertNative[TextureFormat::NUM_FORMATS];
 			
 		protected:
 			Context* mContext;
 
 			friend class Context;
+			friend class TextureStreamer;
+			friend class RenderBuffer;
 
 	};
 
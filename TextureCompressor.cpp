@@ -0,0 +1,676 @@
+#include "TextureCompressor.h"
+#include "ParallelFor.h"
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define TEXTURE_COMPRESSOR_X86
+#include <emmintrin.h>
+#endif
+
+namespace Backend {
+
+	namespace {
+
+		int sForcedPath = -1;
+
+		// 4 color mode weights of c0 per index, c1 gets the rest
+		const float ColorWeights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+
+		struct ColorCandidate {
+			unsigned short C0, C1;
+			unsigned int Indices, Error;
+		};
+
+		inline int Clamp255(int value) {
+			return value < 0 ? 0 : (value > 255 ? 255 : value);
+		}
+
+		inline int Quantize(float value, int maxValue) {
+			int quantized = (int)std::floor(value * maxValue / 255.0f + 0.5f);
+			return quantized < 0 ? 0 : (quantized > maxValue ? maxValue : quantized);
+		}
+
+		inline unsigned short Pack565(const float color[3]) {
+			return (unsigned short)((Quantize(color[0], 31) << 11) | (Quantize(color[1], 63) << 5) | Quantize(color[2], 31));
+		}
+
+		inline void Unpack565(unsigned short color, int rgb[3]) {
+			int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+			rgb[0] = (r << 3) | (r >> 2);
+			rgb[1] = (g << 2) | (g >> 4);
+			rgb[2] = (b << 3) | (b >> 2);
+		}
+
+		void BuildColorPalette(unsigned short c0, unsigned short c1, int palette[4][3]) {
+			Unpack565(c0, palette[0]);
+			Unpack565(c1, palette[1]);
+
+			for (int i = 0; i < 3; ++i) {
+				palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+				palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+			}
+		}
+
+		// BC4 palettes, 8 interpolated values when e0 > e1, otherwise 6 and the two extremes
+		void BuildAlphaPalette(int e0, int e1, int palette[8]) {
+			palette[0] = e0;
+			palette[1] = e1;
+
+			if (e0 > e1) {
+				for (int i = 1; i < 7; ++i) palette[i + 1] = ((7 - i) * e0 + i * e1) / 7;
+			}
+			else {
+				for (int i = 1; i < 5; ++i) palette[i + 1] = ((5 - i) * e0 + i * e1) / 5;
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+		}
+
+		// Scalar
+
+		void ColorBoundsScalar(const unsigned char* texels, int low[3], int high[3]) {
+			for (int c = 0; c < 3; ++c) {
+				low[c] = 255;
+				high[c] = 0;
+			}
+
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 3; ++c) {
+					low[c] = std::min(low[c], (int)texels[i * 4 + c]);
+					high[c] = std::max(high[c], (int)texels[i * 4 + c]);
+				}
+			}
+		}
+
+		// Ties go to the lowest index, like the vector version
+		unsigned int SelectColorIndicesScalar(const unsigned char* texels, const int palette[4][3], unsigned int& error) {
+			unsigned int indices = 0;
+			error = 0;
+
+			for (int i = 0; i < 16; ++i) {
+				const unsigned char* texel = texels + i * 4;
+				unsigned int best = 0xFFFFFFFF, bestIndex = 0;
+
+				for (unsigned int k = 0; k < 4; ++k) {
+					int dr = texel[0] - palette[k][0], dg = texel[1] - palette[k][1], db = texel[2] - palette[k][2];
+					unsigned int distance = (unsigned int)(dr * dr + dg * dg + db * db);
+
+					if (distance < best) {
+						best = distance;
+						bestIndex = k;
+					}
+				}
+
+				indices |= bestIndex << (i * 2);
+				error += best;
+			}
+
+			return indices;
+		}
+
+		void SelectAlphaIndicesScalar(const unsigned char* values, const int palette[8], unsigned char* indices) {
+			for (int i = 0; i < 16; ++i) {
+				int best = 256, bestIndex = 0;
+
+				for (int k = 0; k < 8; ++k) {
+					int distance = std::abs(values[i] - palette[k]);
+
+					if (distance < best) {
+						best = distance;
+						bestIndex = k;
+					}
+				}
+
+				indices[i] = (unsigned char)bestIndex;
+			}
+		}
+
+		// SSE2
+
+#ifdef TEXTURE_COMPRESSOR_X86
+
+		inline __m128i Select(__m128i mask, __m128i a, __m128i b) {
+			return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+		}
+
+		void ColorBoundsSSE2(const unsigned char* texels, int low[3], int high[3]) {
+			__m128i minimum = _mm_loadu_si128((const __m128i*)texels);
+			__m128i maximum = minimum;
+
+			for (int i = 1; i < 4; ++i) {
+				__m128i row = _mm_loadu_si128((const __m128i*)(texels + i * 16));
+				minimum = _mm_min_epu8(minimum, row);
+				maximum = _mm_max_epu8(maximum, row);
+			}
+
+			// Fold the 4 texels of the register down to the first one
+			minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 8));
+			minimum = _mm_min_epu8(minimum, _mm_srli_si128(minimum, 4));
+			maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 8));
+			maximum = _mm_max_epu8(maximum, _mm_srli_si128(maximum, 4));
+
+			unsigned int lowBits = (unsigned int)_mm_cvtsi128_si32(minimum);
+			unsigned int highBits = (unsigned int)_mm_cvtsi128_si32(maximum);
+
+			for (int c = 0; c < 3; ++c) {
+				low[c] = (lowBits >> (c * 8)) & 0xFF;
+				high[c] = (highBits >> (c * 8)) & 0xFF;
+			}
+		}
+
+		unsigned int SelectColorIndicesSSE2(const unsigned char* texels, const int palette[4][3], unsigned int& error) {
+			const __m128i zero = _mm_setzero_si128();
+			const __m128i colorMask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+
+			__m128i best[4], bestIndex[4];
+
+			for (int k = 0; k < 4; ++k) {
+				__m128i entry = _mm_set_epi16(0, (short)palette[k][2], (short)palette[k][1], (short)palette[k][0], 0, (short)palette[k][2], (short)palette[k][1], (short)palette[k][0]);
+
+				for (int group = 0; group < 4; ++group) {
+					__m128i row = _mm_loadu_si128((const __m128i*)(texels + group * 16));
+
+					// 16 bit differences with alpha masked out, madd squares and sums them in pairs (r+g, b+0)
+					__m128i low = _mm_and_si128(_mm_sub_epi16(_mm_unpacklo_epi8(row, zero), entry), colorMask);
+					__m128i high = _mm_and_si128(_mm_sub_epi16(_mm_unpackhi_epi8(row, zero), entry), colorMask);
+					__m128 sumsLow = _mm_castsi128_ps(_mm_madd_epi16(low, low));
+					__m128 sumsHigh = _mm_castsi128_ps(_mm_madd_epi16(high, high));
+
+					__m128i distance = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(sumsLow, sumsHigh, _MM_SHUFFLE(2, 0, 2, 0))), _mm_castps_si128(_mm_shuffle_ps(sumsLow, sumsHigh, _MM_SHUFFLE(3, 1, 3, 1))));
+
+					if (k == 0) {
+						best[group] = distance;
+						bestIndex[group] = zero;
+					}
+					else {
+						__m128i less = _mm_cmplt_epi32(distance, best[group]);
+						best[group] = Select(less, distance, best[group]);
+						bestIndex[group] = Select(less, _mm_set1_epi32(k), bestIndex[group]);
+					}
+				}
+			}
+
+			int indices[16], distances[16];
+			for (int group = 0; group < 4; ++group) {
+				_mm_storeu_si128((__m128i*)(indices + group * 4), bestIndex[group]);
+				_mm_storeu_si128((__m128i*)(distances + group * 4), best[group]);
+			}
+
+			unsigned int packed = 0;
+			error = 0;
+			for (int i = 0; i < 16; ++i) {
+				packed |= (unsigned int)indices[i] << (i * 2);
+				error += (unsigned int)distances[i];
+			}
+
+			return packed;
+		}
+
+		void SelectAlphaIndicesSSE2(const unsigned char* values, const int palette[8], unsigned char* indices) {
+			__m128i block = _mm_loadu_si128((const __m128i*)values);
+			__m128i best = _mm_set1_epi8((char)0xFF);
+			__m128i bestIndex = _mm_setzero_si128();
+
+			for (int k = 0; k < 8; ++k) {
+				__m128i entry = _mm_set1_epi8((char)palette[k]);
+				__m128i distance = _mm_or_si128(_mm_subs_epu8(block, entry), _mm_subs_epu8(entry, block));
+
+				// Unsigned distance < best, the first entry always wins over the 255 start
+				__m128i less = _mm_andnot_si128(_mm_cmpeq_epi8(distance, best), _mm_cmpeq_epi8(_mm_min_epu8(distance, best), distance));
+				if (k == 0) less = _mm_set1_epi8((char)0xFF);
+
+				best = Select(less, distance, best);
+				bestIndex = Select(less, _mm_set1_epi8((char)k), bestIndex);
+			}
+
+			_mm_storeu_si128((__m128i*)indices, bestIndex);
+		}
+
+#endif
+
+		// The path is resolved once per Compress call and passed down, the workers never read the forced path
+		void ColorBounds(PackingPath path, const unsigned char* texels, int low[3], int high[3]) {
+#ifdef TEXTURE_COMPRESSOR_X86
+			if (path != PackingPath::PACKING_SCALAR) return ColorBoundsSSE2(texels, low, high);
+#endif
+			ColorBoundsScalar(texels, low, high);
+		}
+
+		unsigned int SelectColorIndices(PackingPath path, const unsigned char* texels, const int palette[4][3], unsigned int& error) {
+#ifdef TEXTURE_COMPRESSOR_X86
+			if (path != PackingPath::PACKING_SCALAR) return SelectColorIndicesSSE2(texels, palette, error);
+#endif
+			return SelectColorIndicesScalar(texels, palette, error);
+		}
+
+		void SelectAlphaIndices(PackingPath path, const unsigned char* values, const int palette[8], unsigned char* indices) {
+#ifdef TEXTURE_COMPRESSOR_X86
+			if (path != PackingPath::PACKING_SCALAR) return SelectAlphaIndicesSSE2(values, palette, indices);
+#endif
+			SelectAlphaIndicesScalar(values, palette, indices);
+		}
+
+		// Color blocks
+
+		ColorCandidate EvaluateColor(PackingPath path, const unsigned char* texels, const float endpoint0[3], const float endpoint1[3]) {
+			ColorCandidate candidate;
+			candidate.C0 = Pack565(endpoint0);
+			candidate.C1 = Pack565(endpoint1);
+
+			// c0 > c1 selects the 4 color mode, BC1 would switch to 3 colors and transparent black otherwise
+			if (candidate.C0 < candidate.C1) std::swap(candidate.C0, candidate.C1);
+
+			int palette[4][3];
+			BuildColorPalette(candidate.C0, candidate.C1, palette);
+			candidate.Indices = SelectColorIndices(path, texels, palette, candidate.Error);
+
+			// Equal endpoints decode in 3 color mode, only index 0 is safe there
+			if (candidate.C0 == candidate.C1) candidate.Indices = 0;
+
+			return candidate;
+		}
+
+		bool PrincipalAxisEndpoints(const unsigned char* texels, float endpoint0[3], float endpoint1[3]) {
+			float mean[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 3; ++c) mean[c] += texels[i * 4 + c];
+			}
+			for (int c = 0; c < 3; ++c) mean[c] /= 16.0f;
+
+			float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr rg rb gg gb bb
+			for (int i = 0; i < 16; ++i) {
+				float r = texels[i * 4] - mean[0], g = texels[i * 4 + 1] - mean[1], b = texels[i * 4 + 2] - mean[2];
+				covariance[0] += r * r; covariance[1] += r * g; covariance[2] += r * b;
+				covariance[3] += g * g; covariance[4] += g * b; covariance[5] += b * b;
+			}
+
+			// Power iteration from the diagonal of the covariance
+			float axis[3] = { covariance[0], covariance[3], covariance[5] };
+			for (int iteration = 0; iteration < 8; ++iteration) {
+				float x = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+				float y = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+				float z = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+
+				float length = std::max(std::fabs(x), std::max(std::fabs(y), std::fabs(z)));
+				if (length < 1e-6f) return false;
+
+				axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+			}
+
+			float lowest = 1e30f, highest = -1e30f;
+			for (int i = 0; i < 16; ++i) {
+				float projection = (texels[i * 4] - mean[0]) * axis[0] + (texels[i * 4 + 1] - mean[1]) * axis[1] + (texels[i * 4 + 2] - mean[2]) * axis[2];
+				lowest = std::min(lowest, projection);
+				highest = std::max(highest, projection);
+			}
+
+			float lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+			for (int c = 0; c < 3; ++c) {
+				endpoint0[c] = mean[c] + axis[c] * highest / lengthSquared;
+				endpoint1[c] = mean[c] + axis[c] * lowest / lengthSquared;
+			}
+
+			return true;
+		}
+
+		// Endpoints minimizing the squared error for fixed indices
+		bool LeastSquaresEndpoints(const unsigned char* texels, unsigned int indices, float endpoint0[3], float endpoint1[3]) {
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+			float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+
+			for (int i = 0; i < 16; ++i) {
+				float a = ColorWeights[(indices >> (i * 2)) & 3];
+				float b = 1.0f - a;
+
+				aa += a * a; bb += b * b; ab += a * b;
+				for (int c = 0; c < 3; ++c) {
+					ax[c] += a * texels[i * 4 + c];
+					bx[c] += b * texels[i * 4 + c];
+				}
+			}
+
+			float determinant = aa * bb - ab * ab;
+			if (std::fabs(determinant) < 1e-6f) return false;
+
+			for (int c = 0; c < 3; ++c) {
+				endpoint0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+				endpoint1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+			}
+
+			return true;
+		}
+
+		void EncodeColorBlock(PackingPath path, const unsigned char* texels, CompressionQuality quality, unsigned char* output) {
+			int low[3], high[3];
+			ColorBounds(path, texels, low, high);
+
+			// Bounding box inset by 1/16 so the interpolated colors land inside the block
+			float endpoint0[3], endpoint1[3];
+			for (int c = 0; c < 3; ++c) {
+				float inset = (high[c] - low[c]) / 16.0f;
+				endpoint0[c] = high[c] - inset;
+				endpoint1[c] = low[c] + inset;
+			}
+
+			ColorCandidate best = EvaluateColor(path, texels, endpoint0, endpoint1);
+
+			if (quality == CompressionQuality::COMPRESSION_HIGH && best.Error) {
+				if (PrincipalAxisEndpoints(texels, endpoint0, endpoint1)) {
+					ColorCandidate candidate = EvaluateColor(path, texels, endpoint0, endpoint1);
+					if (candidate.Error < best.Error) best = candidate;
+				}
+
+				for (int iteration = 0; iteration < 2 && best.Error && best.C0 != best.C1; ++iteration) {
+					if (!LeastSquaresEndpoints(texels, best.Indices, endpoint0, endpoint1)) break;
+
+					ColorCandidate candidate = EvaluateColor(path, texels, endpoint0, endpoint1);
+					if (candidate.Error >= best.Error) break;
+
+					best = candidate;
+				}
+			}
+
+			output[0] = (unsigned char)(best.C0 & 0xFF);
+			output[1] = (unsigned char)(best.C0 >> 8);
+			output[2] = (unsigned char)(best.C1 & 0xFF);
+			output[3] = (unsigned char)(best.C1 >> 8);
+			for (int i = 0; i < 4; ++i) output[4 + i] = (unsigned char)(best.Indices >> (i * 8));
+		}
+
+		// Single channel blocks (BC4, BC3 alpha, BC5 channels)
+
+		unsigned int EvaluateAlpha(PackingPath path, const unsigned char* values, int e0, int e1, unsigned char* indices) {
+			int palette[8];
+			BuildAlphaPalette(e0, e1, palette);
+			SelectAlphaIndices(path, values, palette, indices);
+
+			unsigned int error = 0;
+			for (int i = 0; i < 16; ++i) {
+				int difference = values[i] - palette[indices[i]];
+				error += (unsigned int)(difference * difference);
+			}
+
+			return error;
+		}
+
+		void EncodeAlphaBlock(PackingPath path, const unsigned char* values, CompressionQuality quality, unsigned char* output) {
+			int low = 255, high = 0, innerLow = 255, innerHigh = 0;
+			for (int i = 0; i < 16; ++i) {
+				low = std::min(low, (int)values[i]);
+				high = std::max(high, (int)values[i]);
+
+				if (values[i] != 0 && values[i] != 255) {
+					innerLow = std::min(innerLow, (int)values[i]);
+					innerHigh = std::max(innerHigh, (int)values[i]);
+				}
+			}
+
+			unsigned char indices[16], candidateIndices[16];
+			int bestE0 = high, bestE1 = low;
+			unsigned int bestError = EvaluateAlpha(path, values, high, low, indices);
+
+			if (quality == CompressionQuality::COMPRESSION_HIGH && bestError) {
+				auto tryEndpoints = [&](int e0, int e1) {
+					unsigned int error = EvaluateAlpha(path, values, e0, e1, candidateIndices);
+					if (error >= bestError) return;
+
+					bestError = error;
+					bestE0 = e0;
+					bestE1 = e1;
+					memcpy(indices, candidateIndices, sizeof(indices));
+				};
+
+				// Pulling the ends in a little often fits the inner values better
+				for (int e0 = high; e0 >= std::max(high - 2, low + 1); --e0) {
+					for (int e1 = low; e1 <= std::min(low + 2, e0 - 1); ++e1) {
+						if (e0 != high || e1 != low) tryEndpoints(e0, e1);
+					}
+				}
+
+				// 6 value mode keeps exact 0 and 255 for blocks that have them next to other values
+				if ((low == 0 || high == 255) && innerLow <= innerHigh) tryEndpoints(innerLow, innerHigh);
+			}
+
+			output[0] = (unsigned char)bestE0;
+			output[1] = (unsigned char)bestE1;
+
+			unsigned long long bits = 0;
+			for (int i = 0; i < 16; ++i) bits |= (unsigned long long)indices[i] << (i * 3);
+			for (int i = 0; i < 6; ++i) output[2 + i] = (unsigned char)(bits >> (i * 8));
+		}
+
+		// Decoding
+
+		void DecodeColorBlock(const unsigned char* block, unsigned char* texels, bool threeColorMode) {
+			unsigned short c0 = (unsigned short)(block[0] | (block[1] << 8));
+			unsigned short c1 = (unsigned short)(block[2] | (block[3] << 8));
+			unsigned int indices = (unsigned int)block[4] | ((unsigned int)block[5] << 8) | ((unsigned int)block[6] << 16) | ((unsigned int)block[7] << 24);
+
+			int palette[4][3];
+			int alpha[4] = { 255, 255, 255, 255 };
+			BuildColorPalette(c0, c1, palette);
+
+			if (threeColorMode && c0 <= c1) {
+				for (int c = 0; c < 3; ++c) {
+					palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+					palette[3][c] = 0;
+				}
+				alpha[3] = 0;
+			}
+
+			for (int i = 0; i < 16; ++i) {
+				unsigned int index = (indices >> (i * 2)) & 3;
+				for (int c = 0; c < 3; ++c) texels[i * 4 + c] = (unsigned char)palette[index][c];
+				texels[i * 4 + 3] = (unsigned char)alpha[index];
+			}
+		}
+
+		void DecodeAlphaBlock(const unsigned char* block, unsigned char* texels, int channel) {
+			int palette[8];
+			BuildAlphaPalette(block[0], block[1], palette);
+
+			unsigned long long bits = 0;
+			for (int i = 0; i < 6; ++i) bits |= (unsigned long long)block[2 + i] << (i * 8);
+
+			for (int i = 0; i < 16; ++i) texels[i * 4 + channel] = (unsigned char)palette[(bits >> (i * 3)) & 7];
+		}
+
+		void LoadBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, unsigned char* texels) {
+			for (int y = 0; y < 4; ++y) {
+				int sourceY = std::min(blockY * 4 + y, height - 1);
+
+				for (int x = 0; x < 4; ++x) {
+					int sourceX = std::min(blockX * 4 + x, width - 1);
+					memcpy(texels + (y * 4 + x) * 4, rgba + ((size_t)sourceY * width + sourceX) * 4, 4);
+				}
+			}
+		}
+
+	}
+
+	PackingPath TextureCompressor::GetSupportedPath() {
+		static PackingPath supported = (PackingPath)std::min((int)VertexPacking::GetSupportedPath(), (int)PackingPath::PACKING_SSE2);
+		return supported;
+	}
+
+	PackingPath TextureCompressor::GetPath() {
+		if (sForcedPath >= 0) return (PackingPath)sForcedPath;
+
+		return GetSupportedPath();
+	}
+
+	void TextureCompressor::SetPath(PackingPath path) {
+		sForcedPath = std::min((int)path, (int)GetSupportedPath());
+	}
+
+	bool TextureCompressor::CanCompress(TextureFormat format) {
+		return format == TextureFormat::TEXTURE_BC1 || format == TextureFormat::TEXTURE_BC1_SRGB || format == TextureFormat::TEXTURE_BC3 || format == TextureFormat::TEXTURE_BC3_SRGB ||
+			format == TextureFormat::TEXTURE_BC4 || format == TextureFormat::TEXTURE_BC5;
+	}
+
+	bool TextureCompressor::Compress(TextureFormat format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& output, CompressionQuality quality, unsigned int threads) {
+		if (!CanCompress(format) || !rgba || width <= 0 || height <= 0) return false;
+
+		int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		unsigned int blockSize = TextureBuffer::GetBlockSize(format);
+
+		output.resize((size_t)blocksX * blocksY * blockSize);
+		unsigned char* outputPtr = &output[0];
+		PackingPath path = GetPath();
+
+		// One row of blocks per chunk
+		ParallelFor::ForEachChunk((unsigned int)blocksY, threads, [&](unsigned int blockY, unsigned int) {
+			unsigned char texels[64], channel[16];
+			unsigned char* blockPtr = outputPtr + (size_t)blockY * blocksX * blockSize;
+
+			for (int blockX = 0; blockX < blocksX; ++blockX, blockPtr += blockSize) {
+				LoadBlock(rgba, width, height, blockX, (int)blockY, texels);
+
+				if (format == TextureFormat::TEXTURE_BC1 || format == TextureFormat::TEXTURE_BC1_SRGB) {
+					EncodeColorBlock(path, texels, quality, blockPtr);
+				}
+				else if (format == TextureFormat::TEXTURE_BC3 || format == TextureFormat::TEXTURE_BC3_SRGB) {
+					for (int i = 0; i < 16; ++i) channel[i] = texels[i * 4 + 3];
+
+					EncodeAlphaBlock(path, channel, quality, blockPtr);
+					EncodeColorBlock(path, texels, quality, blockPtr + 8);
+				}
+				else {
+					int channels = format == TextureFormat::TEXTURE_BC5 ? 2 : 1;
+
+					for (int c = 0; c < channels; ++c) {
+						for (int i = 0; i < 16; ++i) channel[i] = texels[i * 4 + c];
+
+						EncodeAlphaBlock(path, channel, quality, blockPtr + c * 8);
+					}
+				}
+			}
+		});
+
+		return true;
+	}
+
+	bool TextureCompressor::Decompress(TextureFormat format, const unsigned char* blocks, int width, int height, std::vector<unsigned char>& rgba) {
+		if (!CanCompress(format) || !blocks || width <= 0 || height <= 0) return false;
+
+		int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		unsigned int blockSize = TextureBuffer::GetBlockSize(format);
+
+		rgba.assign((size_t)width * height * 4, 0);
+
+		unsigned char texels[64];
+		for (int blockY = 0; blockY < blocksY; ++blockY) {
+			for (int blockX = 0; blockX < blocksX; ++blockX) {
+				const unsigned char* block = blocks + ((size_t)blockY * blocksX + blockX) * blockSize;
+
+				if (format == TextureFormat::TEXTURE_BC1 || format == TextureFormat::TEXTURE_BC1_SRGB) {
+					DecodeColorBlock(block, texels, true);
+				}
+				else if (format == TextureFormat::TEXTURE_BC3 || format == TextureFormat::TEXTURE_BC3_SRGB) {
+					DecodeColorBlock(block + 8, texels, false);
+					DecodeAlphaBlock(block, texels, 3);
+				}
+				else {
+					memset(texels, 0, sizeof(texels));
+					for (int i = 0; i < 16; ++i) texels[i * 4 + 3] = 255;
+
+					DecodeAlphaBlock(block, texels, 0);
+					if (format == TextureFormat::TEXTURE_BC5) DecodeAlphaBlock(block + 8, texels, 1);
+				}
+
+				for (int y = 0; y < 4 && blockY * 4 + y < height; ++y) {
+					for (int x = 0; x < 4 && blockX * 4 + x < width; ++x) {
+						memcpy(&rgba[((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4], texels + (y * 4 + x) * 4, 4);
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	std::vector<CompressionBenchmarkResult> TextureCompressor::Benchmark(int width, int height, unsigned int repeats) {
+		std::vector<CompressionBenchmarkResult> results;
+
+		width = std::max(width, 4);
+		height = std::max(height, 4);
+		repeats = std::max(repeats, 1u);
+
+		// Smooth gradients with a grid of hard edges and some noise, alpha fades out from the center
+		std::vector<unsigned char> source((size_t)width * height * 4);
+		unsigned int seed = 12345;
+		for (int y = 0; y < height; ++y) {
+			for (int x = 0; x < width; ++x) {
+				seed = seed * 1664525u + 1013904223u;
+				int noise = (int)((seed >> 24) & 15) - 8;
+				bool edge = ((x / 37) + (y / 29)) & 1;
+
+				unsigned char* texel = &source[((size_t)y * width + x) * 4];
+				texel[0] = (unsigned char)Clamp255(x * 255 / width + noise);
+				texel[1] = (unsigned char)Clamp255((edge ? 200 : 40) + y * 55 / height + noise);
+				texel[2] = (unsigned char)Clamp255((int)(128 + 100 * std::sin(x * 0.05f + y * 0.03f)));
+
+				float dx = (x - width * 0.5f) / width, dy = (y - height * 0.5f) / height;
+				texel[3] = (unsigned char)Clamp255((int)(255 - 600 * (dx * dx + dy * dy)));
+			}
+		}
+
+		const TextureFormat formats[3] = { TextureFormat::TEXTURE_BC1, TextureFormat::TEXTURE_BC3, TextureFormat::TEXTURE_BC5 };
+		const int channels[3] = { 3, 4, 2 };
+
+		unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		std::vector<unsigned int> threadCounts = { 1 };
+		if (hardwareThreads > 1) threadCounts.push_back(hardwareThreads);
+
+		std::vector<unsigned char> blocks, decoded;
+		int previousPath = sForcedPath;
+
+		for (int f = 0; f < 3; ++f) {
+			for (int quality = CompressionQuality::COMPRESSION_FAST; quality <= CompressionQuality::COMPRESSION_HIGH; ++quality) {
+				for (int path = PackingPath::PACKING_SCALAR; path <= GetSupportedPath(); ++path) {
+					sForcedPath = path;
+
+					for (auto threads : threadCounts) {
+						double best = 0.0;
+
+						for (unsigned int i = 0; i < repeats; ++i) {
+							auto start = std::chrono::high_resolution_clock::now();
+							Compress(formats[f], &source[0], width, height, blocks, (CompressionQuality)quality, threads);
+							double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+							if (seconds > 0.0) best = std::max(best, (double)width * height / seconds / 1000000.0);
+						}
+
+						// The output is the same on every path, but it costs little to measure what was actually produced
+						Decompress(formats[f], &blocks[0], width, height, decoded);
+
+						double squaredError = 0.0;
+						for (size_t t = 0; t < (size_t)width * height; ++t) {
+							for (int c = 0; c < channels[f]; ++c) {
+								double difference = (double)source[t * 4 + c] - decoded[t * 4 + c];
+								squaredError += difference * difference;
+							}
+						}
+
+						CompressionBenchmarkResult result;
+						result.Format = formats[f];
+						result.Quality = (CompressionQuality)quality;
+						result.Path = (PackingPath)path;
+						result.Threads = threads;
+						result.MegaPixelsPerSecond = best;
+						result.Rmse = std::sqrt(squaredError / ((double)width * height * channels[f]));
+						results.push_back(result);
+					}
+				}
+			}
+		}
+
+		sForcedPath = previousPath;
+
+		return results;
+	}
+
+}
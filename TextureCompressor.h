@@ -0,0 +1,50 @@
+#ifndef TEXTURE_COMPRESSOR_R_H
+#define TEXTURE_COMPRESSOR_R_H
+
+#include "include.h"
+#include "TextureBuffer.h"
+#include "VertexPacking.h"
+
+namespace Backend {
+	class TextureCompressor;
+
+	// FAST takes the bounding box of the block, HIGH also tries the principal axis and refines the endpoints by least squares
+	enum CompressionQuality { COMPRESSION_FAST, COMPRESSION_HIGH };
+
+	struct CompressionBenchmarkResult {
+		TextureFormat Format;
+		CompressionQuality Quality;
+		PackingPath Path;
+		unsigned int Threads;
+		double MegaPixelsPerSecond;
+		double Rmse; // over the channels the format keeps, in 8 bit units
+	};
+
+	// CPU encoder for runtime generated content: BC1 (opaque), BC3, BC4 (red) and BC5 (red, green), sRGB variants included
+	// (the texels are encoded as they are, the format only tells GL how to read them).
+	// Rows of 4x4 blocks are spread over threads. The SSE2 path (also used on AVX2 CPUs) vectorizes the bounding box
+	// and the index selection, the endpoint fitting is shared scalar code, so every path and thread count gives the same bytes.
+	class TextureCompressor {
+		public:
+			static PackingPath GetSupportedPath();
+			static PackingPath GetPath();
+			static void SetPath(PackingPath path); // clamped to the supported path
+
+			static bool CanCompress(TextureFormat format);
+
+			// rgba is width x height texels of 4 bytes with tightly packed rows, partial blocks at the edges repeat the last texels.
+			// output gets the blocks row by row, TextureBuffer::GetImageSize bytes, ready for UploadData/UploadSubData.
+			// threads = 0 uses the hardware concurrency
+			static bool Compress(TextureFormat format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& output, CompressionQuality quality = CompressionQuality::COMPRESSION_HIGH, unsigned int threads = 0);
+			// Back to rgba texels, missing channels are 0 (alpha 255), for quality checks
+			static bool Decompress(TextureFormat format, const unsigned char* blocks, int width, int height, std::vector<unsigned char>& rgba);
+
+			// BC1, BC3 and BC5 at both qualities, on every supported path, with one thread and with all of them.
+			// Best of repeats runs over a synthetic image of gradients, edges and noise
+			static std::vector<CompressionBenchmarkResult> Benchmark(int width = 1024, int height = 1024, unsigned int repeats = 4);
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include "TextureLoader.h"
+#include "Context.h"
+#include <fstream>
+
+namespace Backend {
+
+	namespace {
+
+		const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+		const size_t KTX2_HEADER_SIZE = 80;
+		const size_t KTX2_LEVEL_SIZE = 24;
+
+		const size_t DDS_HEADER_SIZE = 128; // magic included
+		const size_t DDS_DX10_HEADER_SIZE = 20;
+
+		const unsigned int MAX_LAYERS = 2048; // GL_MAX_ARRAY_TEXTURE_LAYERS guaranteed by GL 4.5, also keeps the counts in an int
+
+		// Both containers are little endian, read byte by byte so nothing has to be aligned
+		unsigned int ReadU32(const unsigned char* dataPtr) {
+			return (unsigned int)dataPtr[0] | ((unsigned int)dataPtr[1] << 8) | ((unsigned int)dataPtr[2] << 16) | ((unsigned int)dataPtr[3] << 24);
+		}
+
+		unsigned long long ReadU64(const unsigned char* dataPtr) {
+			return (unsigned long long)ReadU32(dataPtr) | ((unsigned long long)ReadU32(dataPtr + 4) << 32);
+		}
+
+		unsigned int FourCC(const char* code) {
+			return (unsigned int)code[0] | ((unsigned int)code[1] << 8) | ((unsigned int)code[2] << 16) | ((unsigned int)code[3] << 24);
+		}
+
+		bool ConvertVkFormat(unsigned int vkFormat, TextureFormat& format) {
+			switch (vkFormat) {
+				case 9: format = TextureFormat::TEXTURE_R; return true; // R8_UNORM
+				case 16: format = TextureFormat::TEXTURE_RG; return true; // R8G8_UNORM
+				case 23: format = TextureFormat::TEXTURE_RGB; return true; // R8G8B8_UNORM
+				case 29: format = TextureFormat::TEXTURE_SRGB; return true; // R8G8B8_SRGB
+				case 37: format = TextureFormat::TEXTURE_RGBA; return true; // R8G8B8A8_UNORM
+				case 43: format = TextureFormat::TEXTURE_SRGBA; return true; // R8G8B8A8_SRGB
+				case 131: case 133: format = TextureFormat::TEXTURE_BC1; return true; // BC1_RGB/RGBA_UNORM_BLOCK
+				case 132: case 134: format = TextureFormat::TEXTURE_BC1_SRGB; return true;
+				case 137: format = TextureFormat::TEXTURE_BC3; return true;
+				case 138: format = TextureFormat::TEXTURE_BC3_SRGB; return true;
+				case 139: format = TextureFormat::TEXTURE_BC4; return true;
+				case 141: format = TextureFormat::TEXTURE_BC5; return true;
+				case 145: format = TextureFormat::TEXTURE_BC7; return true;
+				case 146: format = TextureFormat::TEXTURE_BC7_SRGB; return true;
+				case 147: format = TextureFormat::TEXTURE_ETC2_RGB; return true; // ETC2_R8G8B8_UNORM_BLOCK
+				case 148: format = TextureFormat::TEXTURE_ETC2_SRGB; return true;
+				case 151: format = TextureFormat::TEXTURE_ETC2_RGBA; return true; // ETC2_R8G8B8A8_UNORM_BLOCK
+				case 152: format = TextureFormat::TEXTURE_ETC2_SRGBA; return true;
+				default: return false;
+			}
+		}
+
+		bool ConvertDxgiFormat(unsigned int dxgiFormat, TextureFormat& format) {
+			switch (dxgiFormat) {
+				case 28: format = TextureFormat::TEXTURE_RGBA; return true; // R8G8B8A8_UNORM
+				case 29: format = TextureFormat::TEXTURE_SRGBA; return true;
+				case 49: format = TextureFormat::TEXTURE_RG; return true; // R8G8_UNORM
+				case 61: format = TextureFormat::TEXTURE_R; return true; // R8_UNORM
+				case 71: format = TextureFormat::TEXTURE_BC1; return true;
+				case 72: format = TextureFormat::TEXTURE_BC1_SRGB; return true;
+				case 77: format = TextureFormat::TEXTURE_BC3; return true;
+				case 78: format = TextureFormat::TEXTURE_BC3_SRGB; return true;
+				case 80: format = TextureFormat::TEXTURE_BC4; return true;
+				case 83: format = TextureFormat::TEXTURE_BC5; return true;
+				case 98: format = TextureFormat::TEXTURE_BC7; return true;
+				case 99: format = TextureFormat::TEXTURE_BC7_SRGB; return true;
+				default: return false;
+			}
+		}
+
+		bool Fail(const char* message) {
+			std::cerr << "[Error] Texture loader: " << message << std::endl;
+			return false;
+		}
+
+	}
+
+	size_t TextureLoader::GetFileImageSize(TextureFormat format, int width, int height) {
+		if (TextureBuffer::IsCompressed(format)) return TextureBuffer::GetImageSize(format, width, height);
+
+		size_t components = 4;
+		if (format == TextureFormat::TEXTURE_R) components = 1;
+		else if (format == TextureFormat::TEXTURE_RG) components = 2;
+		else if (format == TextureFormat::TEXTURE_RGB || format == TextureFormat::TEXTURE_SRGB) components = 3;
+
+		return (size_t)width * height * components;
+	}
+
+	bool TextureLoader::Parse(const unsigned char* dataPtr, size_t dataSize, TextureFileDescription& description) {
+		if (dataSize >= sizeof(KTX2_IDENTIFIER) && memcmp(dataPtr, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0) return ParseKTX2(dataPtr, dataSize, description);
+		if (dataSize >= 4 && ReadU32(dataPtr) == FourCC("DDS ")) return ParseDDS(dataPtr, dataSize, description);
+
+		return Fail("unknown container");
+	}
+
+	bool TextureLoader::ParseKTX2(const unsigned char* dataPtr, size_t dataSize, TextureFileDescription& description) {
+		if (dataSize < KTX2_HEADER_SIZE || memcmp(dataPtr, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) return Fail("not a KTX2 file");
+
+		unsigned int vkFormat = ReadU32(dataPtr + 12);
+		unsigned int width = ReadU32(dataPtr + 20);
+		unsigned int height = ReadU32(dataPtr + 24);
+		unsigned int depth = ReadU32(dataPtr + 28);
+		unsigned int layers = ReadU32(dataPtr + 32);
+		unsigned int faces = ReadU32(dataPtr + 36);
+		unsigned int levels = ReadU32(dataPtr + 40);
+		unsigned int supercompression = ReadU32(dataPtr + 44);
+
+		if (!ConvertVkFormat(vkFormat, description.Format)) return Fail("unsupported KTX2 format");
+		if (supercompression != 0) return Fail("KTX2 supercompression is not supported");
+		if (!width || !height || depth > 1 || width > 65536 || height > 65536) return Fail("only 2D KTX2 textures are supported");
+		if (faces != 1 && faces != 6) return Fail("bad KTX2 face count");
+		if (faces == 6 && layers > 0) return Fail("cube map arrays are not supported");
+		if (layers > MAX_LAYERS) return Fail("too many KTX2 layers");
+
+		description.Width = (int)width;
+		description.Height = (int)height;
+		description.Layers = (int)std::max(layers, 1u);
+		description.GenerateMipmaps = levels == 0;
+		description.MipLevels = (int)std::max(levels, 1u);
+		description.Type = faces == 6 ? TextureType::TEXTURE_CUBE : (layers > 0 ? TextureType::TEXTURE_ARRAY : TextureType::TEXTURE_STANDARD);
+		description.Images.clear();
+
+		if (description.MipLevels > TextureBuffer::GetFullMipLevels(description.Width, description.Height)) return Fail("too many KTX2 levels");
+		if (dataSize < KTX2_HEADER_SIZE + KTX2_LEVEL_SIZE * description.MipLevels) return Fail("truncated KTX2 level index");
+
+		// Each level holds every layer, and every face of the layer, back to back
+		for (int level = 0; level < description.MipLevels; ++level) {
+			const unsigned char* levelIndex = dataPtr + KTX2_HEADER_SIZE + KTX2_LEVEL_SIZE * level;
+			unsigned long long offset = ReadU64(levelIndex);
+			unsigned long long length = ReadU64(levelIndex + 8);
+
+			int levelWidth = std::max(description.Width >> level, 1);
+			int levelHeight = std::max(description.Height >> level, 1);
+			size_t imageSize = GetFileImageSize(description.Format, levelWidth, levelHeight);
+
+			if (offset > dataSize || length > dataSize - offset || length < (unsigned long long)imageSize * description.Layers * faces) return Fail("truncated KTX2 level");
+
+			for (int layer = 0; layer < description.Layers; ++layer) {
+				for (int face = 0; face < (int)faces; ++face) {
+					TextureFileImage image;
+					image.Level = level;
+					image.Face = faces == 6 ? face : (int)TextureFace::TEXTURE_FACE_PLANE;
+					image.Layer = layer;
+					image.Width = levelWidth;
+					image.Height = levelHeight;
+					image.Offset = (size_t)offset + imageSize * (layer * faces + face);
+					image.Size = imageSize;
+
+					description.Images.push_back(image);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	bool TextureLoader::ParseDDS(const unsigned char* dataPtr, size_t dataSize, TextureFileDescription& description) {
+		if (dataSize < DDS_HEADER_SIZE || ReadU32(dataPtr) != FourCC("DDS ") || ReadU32(dataPtr + 4) != 124) return Fail("not a DDS file");
+
+		unsigned int flags = ReadU32(dataPtr + 8);
+		unsigned int height = ReadU32(dataPtr + 12);
+		unsigned int width = ReadU32(dataPtr + 16);
+		unsigned int levels = (flags & 0x20000) ? ReadU32(dataPtr + 28) : 1; // DDSD_MIPMAPCOUNT
+		unsigned int formatFlags = ReadU32(dataPtr + 80);
+		unsigned int fourCC = ReadU32(dataPtr + 84);
+		unsigned int bitCount = ReadU32(dataPtr + 88);
+		unsigned int redMask = ReadU32(dataPtr + 92);
+		unsigned int greenMask = ReadU32(dataPtr + 96);
+		unsigned int blueMask = ReadU32(dataPtr + 100);
+		unsigned int caps2 = ReadU32(dataPtr + 112);
+
+		if (!width || !height || width > 65536 || height > 65536) return Fail("bad DDS size");
+		if (caps2 & 0x200000) return Fail("volume DDS textures are not supported");
+
+		size_t dataOffset = DDS_HEADER_SIZE;
+		unsigned int faces = 1, layers = 1;
+		bool isArray = false;
+
+		if (formatFlags & 0x4) { // DDPF_FOURCC
+			if (fourCC == FourCC("DX10")) {
+				if (dataSize < DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE) return Fail("truncated DDS header");
+
+				unsigned int dxgiFormat = ReadU32(dataPtr + 128);
+				unsigned int dimension = ReadU32(dataPtr + 132);
+				unsigned int miscFlags = ReadU32(dataPtr + 136);
+				layers = std::max(ReadU32(dataPtr + 140), 1u);
+
+				if (!ConvertDxgiFormat(dxgiFormat, description.Format)) return Fail("unsupported DXGI format");
+				if (dimension != 3) return Fail("only 2D DDS textures are supported"); // D3D10_RESOURCE_DIMENSION_TEXTURE2D
+
+				if (miscFlags & 0x4) faces = 6; // D3D10_RESOURCE_MISC_TEXTURECUBE
+				isArray = layers > 1;
+				dataOffset += DDS_DX10_HEADER_SIZE;
+			}
+			else if (fourCC == FourCC("DXT1")) description.Format = TextureFormat::TEXTURE_BC1;
+			else if (fourCC == FourCC("DXT5")) description.Format = TextureFormat::TEXTURE_BC3;
+			else if (fourCC == FourCC("ATI1") || fourCC == FourCC("BC4U")) description.Format = TextureFormat::TEXTURE_BC4;
+			else if (fourCC == FourCC("ATI2") || fourCC == FourCC("BC5U")) description.Format = TextureFormat::TEXTURE_BC5;
+			else return Fail("unsupported DDS FourCC");
+		}
+		// Only the layouts GL reads as they are, BGRA files would need swizzling
+		else if (bitCount == 32 && redMask == 0xFF && greenMask == 0xFF00 && blueMask == 0xFF0000) description.Format = TextureFormat::TEXTURE_RGBA;
+		else if (bitCount == 8 && redMask == 0xFF) description.Format = TextureFormat::TEXTURE_R;
+		else return Fail("unsupported DDS pixel format");
+
+		// Legacy cube maps flag their faces in the caps, only complete ones are usable
+		if ((caps2 & 0x200) && faces == 1) {
+			if ((caps2 & 0xFC00) != 0xFC00) return Fail("partial DDS cube maps are not supported");
+			faces = 6;
+		}
+
+		if (faces == 6 && layers > 1) return Fail("cube map arrays are not supported");
+		if (layers > MAX_LAYERS) return Fail("too many DDS layers");
+
+		description.Width = (int)width;
+		description.Height = (int)height;
+		description.Layers = (int)layers;
+		description.GenerateMipmaps = false;
+		description.MipLevels = (int)std::max(levels, 1u);
+		description.Type = faces == 6 ? TextureType::TEXTURE_CUBE : (isArray ? TextureType::TEXTURE_ARRAY : TextureType::TEXTURE_STANDARD);
+		description.Images.clear();
+
+		if (description.MipLevels > TextureBuffer::GetFullMipLevels(description.Width, description.Height)) return Fail("too many DDS levels");
+
+		// Every layer, and every face of the layer, stores its whole mip chain
+		size_t offset = dataOffset;
+		for (int layer = 0; layer < description.Layers; ++layer) {
+			for (int face = 0; face < (int)faces; ++face) {
+				for (int level = 0; level < description.MipLevels; ++level) {
+					TextureFileImage image;
+					image.Level = level;
+					image.Face = faces == 6 ? face : (int)TextureFace::TEXTURE_FACE_PLANE;
+					image.Layer = layer;
+					image.Width = std::max(description.Width >> level, 1);
+					image.Height = std::max(description.Height >> level, 1);
+					image.Offset = offset;
+					image.Size = GetFileImageSize(description.Format, image.Width, image.Height);
+
+					if (image.Size > dataSize - offset) return Fail("truncated DDS data");
+
+					offset += image.Size;
+					description.Images.push_back(image);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	TextureBuffer* TextureLoader::Upload(Context* context, const TextureFileDescription& description, const unsigned char* dataPtr) {
+		if (!TextureBuffer::IsFormatSupported(description.Format)) {
+			Fail("texture format not supported by the driver");
+			return nullptr;
+		}
+
+		bool compressed = TextureBuffer::IsCompressed(description.Format);
+		int mipLevels = (description.GenerateMipmaps && !compressed) ? 0 : description.MipLevels;
+
+		TextureBuffer* texture = context->CreateTextureBuffer(description.Type);
+
+		if (description.Type == TextureType::TEXTURE_ARRAY) texture->CreateArray(description.Format, description.Width, description.Height, description.Layers, mipLevels);
+		else texture->CreateFromFormat(description.Format, description.Width, description.Height, mipLevels);
+
+		// Rows of the small uncompressed levels aren't 4 byte aligned in the files
+		if (!compressed) glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		for (auto& image : description.Images) {
+			const unsigned char* imagePtr = dataPtr + image.Offset;
+
+			// UploadSubData takes the mip level as layer, except for arrays
+			if (description.Type == TextureType::TEXTURE_ARRAY) texture->UploadSubData(imagePtr, image.Width, image.Height, 0, 0, TextureFace::TEXTURE_FACE_PLANE, image.Layer, image.Level);
+			else texture->UploadSubData(imagePtr, image.Width, image.Height, 0, 0, (TextureFace)image.Face, image.Level);
+		}
+
+		if (!compressed) glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		if (texture->GetMipLevels() > description.MipLevels) texture->GenerateMipmap();
+
+		texture->SetFilterMinMag(TextureFilter::FILTER_LINEAR, TextureFilter::FILTER_LINEAR, texture->GetMipLevels() > 1 ? MipmapFilter::MIPMAP_FILTER_LINEAR : MipmapFilter::MIPMAP_FILTER_NONE);
+
+		return texture;
+	}
+
+	TextureBuffer* TextureLoader::LoadFromMemory(Context* context, const unsigned char* dataPtr, size_t dataSize) {
+		TextureFileDescription description;
+		if (!dataPtr || !Parse(dataPtr, dataSize, description)) return nullptr;
+
+		return Upload(context, description, dataPtr);
+	}
+
+	TextureBuffer* TextureLoader::Load(Context* context, const std::string& path) {
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file.is_open()) {
+			std::cerr << "[Error] Texture loader: can't open " << path << std::endl;
+			return nullptr;
+		}
+
+		std::vector<unsigned char> data((size_t)file.tellg());
+		file.seekg(0);
+		if (data.empty() || !file.read((char*)&data[0], data.size())) {
+			std::cerr << "[Error] Texture loader: can't read " << path << std::endl;
+			return nullptr;
+		}
+
+		return LoadFromMemory(context, &data[0], data.size());
+	}
+
+}
@@ -0,0 +1,49 @@
+#ifndef TEXTURE_LOADER_R_H
+#define TEXTURE_LOADER_R_H
+
+#include "include.h"
+#include "TextureBuffer.h"
+
+namespace Backend {
+	class Context;
+	class TextureLoader;
+
+	// One level of one face/layer, Offset and Size are in bytes from the start of the file
+	struct TextureFileImage {
+		int Level, Face, Layer;
+		int Width, Height;
+		size_t Offset, Size;
+	};
+
+	struct TextureFileDescription {
+		TextureType Type;
+		TextureFormat Format;
+		int Width, Height, Layers, MipLevels;
+		bool GenerateMipmaps; // KTX2 files without levels ask for them to be generated
+		std::vector<TextureFileImage> Images;
+	};
+
+	// KTX2 and DDS containers. Parsing only reads the headers (no GL, so it can run on a worker thread),
+	// Upload creates the texture with immutable storage for every level of the file and uploads the images as they are stored.
+	// Supported: BC1/3/4/5/7 (KTX2 adds ETC2) and the 8 bit per channel R, RG, RGB (KTX2 only) and RGBA formats.
+	// No supercompression, 3D textures or cube arrays.
+	class TextureLoader {
+		public:
+			static bool Parse(const unsigned char* dataPtr, size_t dataSize, TextureFileDescription& description); // picks the container from the magic
+			static bool ParseKTX2(const unsigned char* dataPtr, size_t dataSize, TextureFileDescription& description);
+			static bool ParseDDS(const unsigned char* dataPtr, size_t dataSize, TextureFileDescription& description);
+
+			// nullptr when the format isn't supported by the driver, dataPtr is the whole file the description was parsed from
+			static TextureBuffer* Upload(Context* context, const TextureFileDescription& description, const unsigned char* dataPtr);
+
+			static TextureBuffer* LoadFromMemory(Context* context, const unsigned char* dataPtr, size_t dataSize);
+			static TextureBuffer* Load(Context* context, const std::string& path);
+
+			// Bytes of a width x height image in the file, tightly packed rows or whole 4x4 blocks
+			static size_t GetFileImageSize(TextureFormat format, int width, int height);
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include "TextureStreamer.h"
+#include "Context.h"
+#include "InternalStateManager.h"
+#include "FrameStatistics.h"
+
+namespace Backend {
+
+	TextureStreamer::TextureStreamer(Context* context, unsigned int stagingSize, unsigned int bytesPerFrame) {
+		mContext = context;
+
+		mStagingSize = (stagingSize + 255) & ~255u;
+		mFrameBudget = bytesPerFrame;
+		mBytesStreamed = 0;
+
+		mHead = mTail = 0;
+		mFull = false;
+		mNextId = 1;
+
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		if (mContext->UsesDirectStateAccess()) {
+			glCreateBuffers(1, &mBufferHandle);
+			glNamedBufferStorage(mBufferHandle, mStagingSize, 0, flags);
+
+			mMappedPtr = (unsigned char*)glMapNamedBufferRange(mBufferHandle, 0, mStagingSize, flags);
+		}
+		else {
+			glGenBuffers(1, &mBufferHandle);
+			mContext->StateManager()->BindBuffer(GL_PIXEL_UNPACK_BUFFER, mBufferHandle);
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, mStagingSize, 0, flags);
+
+			mMappedPtr = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, mStagingSize, flags);
+
+			// Client pointer uploads must not read from the staging buffer
+			mContext->StateManager()->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+
+	TextureStreamer::~TextureStreamer() {
+		for (auto& request : mRequests) {
+			if (request.Fence) glDeleteSync(request.Fence);
+		}
+
+		mContext->StateManager()->BufferDeleted(mBufferHandle);
+		glDeleteBuffers(1, &mBufferHandle);
+	}
+
+	TextureStreamTicket TextureStreamer::Request(TextureBuffer* texture, int width, int height, int xOffset, int yOffset, TextureFace face, int layer) {
+		TextureStreamTicket ticket;
+		if (!mMappedPtr || !texture || width <= 0 || height <= 0) return ticket;
+
+		unsigned int size = texture->GetUploadSize(width, height);
+		unsigned int alignedSize = (size + 255) & ~255u;
+		if (alignedSize > mStagingSize) return ticket;
+
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		if (mRequests.empty()) mHead = mTail = 0;
+
+		// Live space is [mTail, mHead), possibly wrapped around the end of the ring
+		unsigned int offset;
+		if (mFull) {
+			return ticket;
+		}
+		else if (mHead >= mTail) {
+			if (mHead + alignedSize <= mStagingSize) offset = mHead;
+			else if (alignedSize <= mTail) offset = 0;
+			else return ticket;
+		}
+		else {
+			if (mHead + alignedSize <= mTail) offset = mHead;
+			else return ticket;
+		}
+
+		mHead = offset + alignedSize;
+		if (mHead == mStagingSize) mHead = 0;
+		mFull = mHead == mTail;
+
+		StreamRequest request;
+		request.Id = mNextId++;
+		request.State = RequestState::REQUEST_ALLOCATED;
+		request.Texture = texture;
+		request.Width = width;
+		request.Height = height;
+		request.XOffset = xOffset;
+		request.YOffset = yOffset;
+		request.Face = face;
+		request.Layer = layer;
+		request.Offset = offset;
+		request.Size = size;
+		request.End = mHead;
+		request.Fence = 0;
+
+		mRequests.push_back(request);
+		texture->mPendingStreams++;
+
+		ticket.Ptr = mMappedPtr + offset;
+		ticket.Size = size;
+		ticket.Id = request.Id;
+
+		return ticket;
+	}
+
+	void TextureStreamer::Commit(const TextureStreamTicket& ticket) {
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// Ids are consecutive and only retired from the front
+		if (mRequests.empty() || ticket.Id < mRequests.front().Id) return;
+
+		unsigned long long index = ticket.Id - mRequests.front().Id;
+		if (index >= mRequests.size()) return;
+
+		StreamRequest& request = mRequests[(size_t)index];
+		if (request.State == RequestState::REQUEST_ALLOCATED) request.State = RequestState::REQUEST_COMMITTED;
+	}
+
+	void TextureStreamer::Cancel(TextureBuffer* texture) {
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// A worker may still be writing an allocated request, so nothing is removed here, Update retires them without an upload
+		for (auto& request : mRequests) {
+			if (request.Texture != texture) continue;
+
+			request.Texture = nullptr;
+			texture->mPendingStreams--;
+		}
+	}
+
+	unsigned int TextureStreamer::GetPendingCount() {
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		return (unsigned int)mRequests.size();
+	}
+
+	void TextureStreamer::Update() {
+		std::lock_guard<std::mutex> lock(mMutex);
+
+		// Retire finished uploads in order, giving their staging space back
+		while (!mRequests.empty() && mRequests.front().State == RequestState::REQUEST_ISSUED) {
+			StreamRequest& request = mRequests.front();
+
+			if (request.Fence) {
+				if (glClientWaitSync(request.Fence, 0, 0) == GL_TIMEOUT_EXPIRED) break;
+
+				glDeleteSync(request.Fence);
+			}
+
+			if (request.Texture) request.Texture->mPendingStreams--;
+
+			mTail = request.End;
+			mFull = false;
+
+			mRequests.pop_front();
+		}
+
+		// Issue what the workers finished writing, at least one upload per frame so big images still make progress
+		InternalStateManager* stateManager = mContext->StateManager();
+		unsigned int issuedBytes = 0;
+		bool bound = false;
+
+		for (auto& request : mRequests) {
+			if (request.State != RequestState::REQUEST_COMMITTED) continue;
+
+			// Cancelled, nothing to upload or wait for
+			if (!request.Texture) {
+				request.State = RequestState::REQUEST_ISSUED;
+				continue;
+			}
+
+			if (issuedBytes && issuedBytes + request.Size > mFrameBudget) break;
+
+			// The staging slots hold tightly packed rows, RGB/R/RG rows aren't 4 byte aligned
+			if (!bound) {
+				stateManager->BindBuffer(GL_PIXEL_UNPACK_BUFFER, mBufferHandle);
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+				bound = true;
+			}
+
+			request.Texture->UploadSubDataImpl((const void*)(uintptr_t)request.Offset, request.Width, request.Height, request.XOffset, request.YOffset, request.Face, request.Layer);
+			request.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			request.State = RequestState::REQUEST_ISSUED;
+
+			issuedBytes += request.Size;
+		}
+
+		if (bound) {
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			stateManager->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		mBytesStreamed += issuedBytes;
+		mContext->Statistics()->Add(FrameStatType::STAT_TEXTURE_BYTES_UPLOADED, issuedBytes);
+	}
+
+}
@@ -0,0 +1,92 @@
+#ifndef TEXTURE_STREAMER_R_H
+#define TEXTURE_STREAMER_R_H
+
+#include "include.h"
+#include "TextureBuffer.h"
+#include <deque>
+#include <mutex>
+
+namespace Backend {
+	class Context;
+	class TextureStreamer;
+
+	// Staging memory handed to a worker, write the texels tightly packed into Ptr then Commit the ticket
+	struct TextureStreamTicket {
+		unsigned char* Ptr;
+		unsigned int Size;
+		unsigned long long Id;
+
+		TextureStreamTicket() { Ptr = nullptr; Size = 0; Id = 0; }
+
+		bool Valid() { return Ptr != nullptr; }
+	};
+
+	// Streams texels to textures through a persistently mapped pixel unpack buffer used as a ring.
+	// Request/Commit are thread safe and never touch GL, so workers can decode straight into staging memory.
+	// The Context issues committed uploads on the GL thread at FrameBegin, within a byte budget per frame,
+	// and gives the staging space back (marking the texture ready) once the fence of the upload signaled.
+	// The texture storage has to exist beforehand (CreateFromFormat/CreateArray on the GL thread).
+	class TextureStreamer {
+		public:
+			~TextureStreamer();
+
+			// Invalid ticket when the staging ring is full, try again next frame
+			TextureStreamTicket Request(TextureBuffer* texture, int width, int height, int xOffset = 0, int yOffset = 0, TextureFace face = TextureFace::TEXTURE_FACE_PLANE, int layer = 0);
+			void Commit(const TextureStreamTicket& ticket);
+			// Drops every request of a texture about to be deleted, their staging space is given back in order like the others
+			void Cancel(TextureBuffer* texture);
+
+			void SetFrameBudget(unsigned int bytesPerFrame) { mFrameBudget = bytesPerFrame; }
+			unsigned int GetFrameBudget() { return mFrameBudget; }
+
+			unsigned int GetStagingSize() { return mStagingSize; }
+			unsigned int GetPendingCount();
+			unsigned long long GetBytesStreamed() { return mBytesStreamed; }
+
+		protected:
+			TextureStreamer(Context* context, unsigned int stagingSize, unsigned int bytesPerFrame);
+
+			// GL thread only
+			void Update();
+
+			enum RequestState { REQUEST_ALLOCATED, REQUEST_COMMITTED, REQUEST_ISSUED };
+
+			struct StreamRequest {
+				unsigned long long Id;
+				RequestState State;
+
+				TextureBuffer* Texture; // nullptr once cancelled
+				int Width, Height, XOffset, YOffset, Layer;
+				TextureFace Face;
+
+				unsigned int Offset, Size; // in the staging buffer
+				unsigned int End; // ring head after this request, the tail moves here once it retires
+				GLsync Fence;
+			};
+
+		protected:
+			GLuint mBufferHandle;
+			unsigned char* mMappedPtr;
+			unsigned int mStagingSize;
+
+			// Requests are retired in order, so the live staging space is always [mTail, mHead) on the ring
+			unsigned int mHead, mTail;
+			bool mFull;
+
+			std::deque<StreamRequest> mRequests;
+			unsigned long long mNextId;
+			std::mutex mMutex;
+
+			unsigned int mFrameBudget;
+			unsigned long long mBytesStreamed;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
@@ -0,0 +1,66 @@
+#include "UniformBufferRing.h"
+#include "Context.h"
+#include "InternalStateManager.h"
+
+namespace Backend {
+
+	UniformBufferRing::UniformBufferRing(Context* context, unsigned int regionSize) {
+		mContext = context;
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		mAlignment = (unsigned int)std::max(alignment, 16);
+
+		mRegionSize = (regionSize + mAlignment - 1) / mAlignment * mAlignment;
+		mCurrentRegion = mContext->FrameRegion();
+		mCurrentFrame = mContext->FrameCount();
+		mHead = 0;
+
+		GLsizeiptr totalSize = (GLsizeiptr)mRegionSize * Context::FRAMES_IN_FLIGHT;
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		if (mContext->UsesDirectStateAccess()) {
+			glCreateBuffers(1, &mBufferHandle);
+			glNamedBufferStorage(mBufferHandle, totalSize, 0, flags);
+
+			mMappedPtr = (unsigned char*)glMapNamedBufferRange(mBufferHandle, 0, totalSize, flags);
+		}
+		else {
+			glGenBuffers(1, &mBufferHandle);
+			mContext->StateManager()->BindBuffer(GL_UNIFORM_BUFFER, mBufferHandle);
+			glBufferStorage(GL_UNIFORM_BUFFER, totalSize, 0, flags);
+
+			mMappedPtr = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, totalSize, flags);
+		}
+	}
+
+	UniformBufferRing::~UniformBufferRing() {
+		mContext->StateManager()->BufferDeleted(mBufferHandle);
+		glDeleteBuffers(1, &mBufferHandle);
+	}
+
+	UniformAllocation UniformBufferRing::Allocate(unsigned int size) {
+		UniformAllocation allocation;
+
+		// A new frame starts over at the beginning of its own region. Keyed on the frame count, the region
+		// alone repeats every FRAMES_IN_FLIGHT frames and misses the reset when allocations skip frames
+		unsigned long long frame = mContext->FrameCount();
+		if (frame != mCurrentFrame) {
+			mCurrentFrame = frame;
+			mCurrentRegion = mContext->FrameRegion();
+			mHead = 0;
+		}
+
+		unsigned int alignedSize = (size + mAlignment - 1) / mAlignment * mAlignment;
+		if (!mMappedPtr || !size || mHead + alignedSize > mRegionSize) return allocation;
+
+		allocation.Offset = (GLintptr)mCurrentRegion * mRegionSize + mHead;
+		allocation.Ptr = mMappedPtr + allocation.Offset;
+		allocation.Size = size;
+
+		mHead += alignedSize;
+
+		return allocation;
+	}
+
+}
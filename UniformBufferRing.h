@@ -0,0 +1,55 @@
+#ifndef UNIFORM_BUFFER_RING_R_H
+#define UNIFORM_BUFFER_RING_R_H
+
+#include "include.h"
+
+namespace Backend {
+	class Context;
+	class UniformBufferRing;
+
+	struct UniformAllocation {
+		unsigned char* Ptr; // mapped memory, write the std140 data here
+		GLintptr Offset;
+		GLsizeiptr Size;
+
+		UniformAllocation() { Ptr = nullptr; Offset = 0; Size = 0; }
+
+		bool Valid() { return Ptr != nullptr; }
+	};
+
+	// One large persistently mapped uniform buffer, split in a region per frame in flight.
+	// Blocks are sub-allocated linearly from the region of the current frame and bound with glBindBufferRange,
+	// the Context frame fences make sure a region is only rewritten after the GPU consumed it.
+	class UniformBufferRing {
+		public:
+			~UniformBufferRing();
+
+			UniformAllocation Allocate(unsigned int size);
+
+			GLuint GetNativeHandle() { return mBufferHandle; }
+			unsigned int RegionSize() { return mRegionSize; }
+			unsigned int UsedSize() { return mHead; }
+
+		protected:
+			UniformBufferRing(Context* context, unsigned int regionSize);
+
+		protected:
+			GLuint mBufferHandle;
+			unsigned char* mMappedPtr;
+
+			unsigned int mRegionSize;
+			unsigned int mAlignment;
+			unsigned int mCurrentRegion;
+			unsigned int mHead;
+			unsigned long long mCurrentFrame;
+
+		protected:
+			Context* mContext;
+
+			friend class Context;
+
+	};
+
+}
+
+#endif
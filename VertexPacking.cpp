@@ -0,0 +1,469 @@
+#include "VertexPacking.h"
+
+#include <cmath>
+#include <chrono>
+#include <functional>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define VERTEX_PACKING_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define VERTEX_PACKING_AVX2_TARGET
+#else
+#include <cpuid.h>
+#define VERTEX_PACKING_AVX2_TARGET __attribute__((target("avx2,f16c")))
+#endif
+#endif
+
+namespace Backend {
+
+	namespace {
+
+		int sForcedPath = -1;
+
+		// Same clamping as SSE max/min: the bound wins over NaN
+		inline float Clamp(float value, float low, float high) {
+			value = value > low ? value : low;
+			return value < high ? value : high;
+		}
+
+		inline int Round(float value) {
+			return (int)std::nearbyint(value);
+		}
+
+		PackingPath DetectPath() {
+#ifdef VERTEX_PACKING_X86
+			unsigned int regs1[4] = { 0 }, regs7[4] = { 0 };
+			unsigned long long xcr0 = 0;
+
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			int maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			memcpy(regs1, info, sizeof(info));
+
+			if (maxLeaf >= 7) {
+				__cpuidex(info, 7, 0);
+				memcpy(regs7, info, sizeof(info));
+			}
+
+			if (regs1[2] & (1u << 27)) xcr0 = _xgetbv(0);
+#else
+			unsigned int maxLeaf = __get_cpuid_max(0, nullptr);
+
+			__cpuid(1, regs1[0], regs1[1], regs1[2], regs1[3]);
+			if (maxLeaf >= 7) __cpuid_count(7, 0, regs7[0], regs7[1], regs7[2], regs7[3]);
+
+			if (regs1[2] & (1u << 27)) {
+				unsigned int eax, edx;
+				__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+				xcr0 = ((unsigned long long)edx << 32) | eax;
+			}
+#endif
+
+			// AVX needs the OS to save the ymm registers
+			bool osAvx = (regs1[2] & (1u << 28)) && (xcr0 & 6) == 6;
+			bool f16c = (regs1[2] & (1u << 29)) != 0;
+			bool avx2 = (regs7[1] & (1u << 5)) != 0;
+
+			if (osAvx && f16c && avx2) return PackingPath::PACKING_AVX2;
+			if (regs1[3] & (1u << 26)) return PackingPath::PACKING_SSE2;
+#endif
+
+			return PackingPath::PACKING_SCALAR;
+		}
+
+		// Scalar
+
+		void PackHalfScalar(const float* source, GLushort* destination, size_t count) {
+			for (size_t i = 0; i < count; ++i) destination[i] = VertexPacking::FloatToHalf(source[i]);
+		}
+
+		void PackSnorm8Scalar(const float* source, GLbyte* destination, size_t count) {
+			for (size_t i = 0; i < count; ++i) destination[i] = (GLbyte)Round(Clamp(source[i], -1.0f, 1.0f) * 127.0f);
+		}
+
+		void PackUnorm8Scalar(const float* source, GLubyte* destination, size_t count) {
+			for (size_t i = 0; i < count; ++i) destination[i] = (GLubyte)Round(Clamp(source[i], 0.0f, 1.0f) * 255.0f);
+		}
+
+		void PackSnorm16Scalar(const float* source, GLshort* destination, size_t count) {
+			for (size_t i = 0; i < count; ++i) destination[i] = (GLshort)Round(Clamp(source[i], -1.0f, 1.0f) * 32767.0f);
+		}
+
+		void PackUnorm16Scalar(const float* source, GLushort* destination, size_t count) {
+			for (size_t i = 0; i < count; ++i) destination[i] = (GLushort)Round(Clamp(source[i], 0.0f, 1.0f) * 65535.0f);
+		}
+
+		void PackSnorm2_10_10_10Scalar(const float* source, GLuint* destination, size_t count) {
+			for (size_t i = 0; i < count; ++i) {
+				const float* v = source + i * 4;
+
+				GLuint x = (GLuint)Round(Clamp(v[0], -1.0f, 1.0f) * 511.0f) & 0x3FF;
+				GLuint y = (GLuint)Round(Clamp(v[1], -1.0f, 1.0f) * 511.0f) & 0x3FF;
+				GLuint z = (GLuint)Round(Clamp(v[2], -1.0f, 1.0f) * 511.0f) & 0x3FF;
+				GLuint w = (GLuint)Round(Clamp(v[3], -1.0f, 1.0f)) & 0x3;
+
+				destination[i] = x | (y << 10) | (z << 20) | (w << 30);
+			}
+		}
+
+#ifdef VERTEX_PACKING_X86
+
+		// SSE2, the tails go through the scalar versions
+
+		inline __m128i ScaleSSE2(const float* source, __m128 low, __m128 high, __m128 scale) {
+			__m128 value = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(source), low), high);
+			return _mm_cvtps_epi32(_mm_mul_ps(value, scale));
+		}
+
+		void PackSnorm8SSE2(const float* source, GLbyte* destination, size_t count) {
+			__m128 low = _mm_set1_ps(-1.0f), high = _mm_set1_ps(1.0f), scale = _mm_set1_ps(127.0f);
+			size_t i = 0;
+
+			for (; i + 16 <= count; i += 16) {
+				__m128i a = ScaleSSE2(source + i, low, high, scale), b = ScaleSSE2(source + i + 4, low, high, scale);
+				__m128i c = ScaleSSE2(source + i + 8, low, high, scale), d = ScaleSSE2(source + i + 12, low, high, scale);
+
+				_mm_storeu_si128((__m128i*)(destination + i), _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+			}
+
+			PackSnorm8Scalar(source + i, destination + i, count - i);
+		}
+
+		void PackUnorm8SSE2(const float* source, GLubyte* destination, size_t count) {
+			__m128 low = _mm_setzero_ps(), high = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f);
+			size_t i = 0;
+
+			for (; i + 16 <= count; i += 16) {
+				__m128i a = ScaleSSE2(source + i, low, high, scale), b = ScaleSSE2(source + i + 4, low, high, scale);
+				__m128i c = ScaleSSE2(source + i + 8, low, high, scale), d = ScaleSSE2(source + i + 12, low, high, scale);
+
+				_mm_storeu_si128((__m128i*)(destination + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+			}
+
+			PackUnorm8Scalar(source + i, destination + i, count - i);
+		}
+
+		void PackSnorm16SSE2(const float* source, GLshort* destination, size_t count) {
+			__m128 low = _mm_set1_ps(-1.0f), high = _mm_set1_ps(1.0f), scale = _mm_set1_ps(32767.0f);
+			size_t i = 0;
+
+			for (; i + 8 <= count; i += 8) {
+				__m128i a = ScaleSSE2(source + i, low, high, scale), b = ScaleSSE2(source + i + 4, low, high, scale);
+
+				_mm_storeu_si128((__m128i*)(destination + i), _mm_packs_epi32(a, b));
+			}
+
+			PackSnorm16Scalar(source + i, destination + i, count - i);
+		}
+
+		void PackUnorm16SSE2(const float* source, GLushort* destination, size_t count) {
+			__m128 low = _mm_setzero_ps(), high = _mm_set1_ps(1.0f), scale = _mm_set1_ps(65535.0f);
+			__m128i bias = _mm_set1_epi32(32768), flip = _mm_set1_epi16((short)0x8000);
+			size_t i = 0;
+
+			// No unsigned 32 to 16 pack before SSE4.1, so shift to the signed range and back
+			for (; i + 8 <= count; i += 8) {
+				__m128i a = _mm_sub_epi32(ScaleSSE2(source + i, low, high, scale), bias);
+				__m128i b = _mm_sub_epi32(ScaleSSE2(source + i + 4, low, high, scale), bias);
+
+				_mm_storeu_si128((__m128i*)(destination + i), _mm_xor_si128(_mm_packs_epi32(a, b), flip));
+			}
+
+			PackUnorm16Scalar(source + i, destination + i, count - i);
+		}
+
+		void PackSnorm2_10_10_10SSE2(const float* source, GLuint* destination, size_t count) {
+			__m128 low = _mm_set1_ps(-1.0f), high = _mm_set1_ps(1.0f), scale = _mm_setr_ps(511.0f, 511.0f, 511.0f, 1.0f);
+			__m128i mask = _mm_setr_epi32(0x3FF, 0x3FF, 0x3FF, 0x3);
+			alignas(16) GLuint components[4];
+
+			for (size_t i = 0; i < count; ++i) {
+				_mm_store_si128((__m128i*)components, _mm_and_si128(ScaleSSE2(source + i * 4, low, high, scale), mask));
+
+				destination[i] = components[0] | (components[1] << 10) | (components[2] << 20) | (components[3] << 30);
+			}
+		}
+
+		// AVX2 + F16C
+
+		VERTEX_PACKING_AVX2_TARGET inline __m256i ScaleAVX2(const float* source, __m256 low, __m256 high, __m256 scale) {
+			__m256 value = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(source), low), high);
+			return _mm256_cvtps_epi32(_mm256_mul_ps(value, scale));
+		}
+
+		VERTEX_PACKING_AVX2_TARGET void PackHalfAVX2(const float* source, GLushort* destination, size_t count) {
+			size_t i = 0;
+
+			for (; i + 8 <= count; i += 8) {
+				_mm_storeu_si128((__m128i*)(destination + i), _mm256_cvtps_ph(_mm256_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT));
+			}
+
+			PackHalfScalar(source + i, destination + i, count - i);
+		}
+
+		// The 256 bit packs work per 128 bit lane, the permutes put the results back in order
+		VERTEX_PACKING_AVX2_TARGET void PackBytesAVX2(const float* source, GLubyte* destination, size_t count, float lowValue, float scaleValue, bool isSigned) {
+			__m256 low = _mm256_set1_ps(lowValue), high = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(scaleValue);
+			__m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+			size_t i = 0;
+
+			for (; i + 32 <= count; i += 32) {
+				__m256i a = ScaleAVX2(source + i, low, high, scale), b = ScaleAVX2(source + i + 8, low, high, scale);
+				__m256i c = ScaleAVX2(source + i + 16, low, high, scale), d = ScaleAVX2(source + i + 24, low, high, scale);
+
+				__m256i ab = _mm256_packs_epi32(a, b), cd = _mm256_packs_epi32(c, d);
+				__m256i bytes = isSigned ? _mm256_packs_epi16(ab, cd) : _mm256_packus_epi16(ab, cd);
+
+				_mm256_storeu_si256((__m256i*)(destination + i), _mm256_permutevar8x32_epi32(bytes, order));
+			}
+
+			if (isSigned) PackSnorm8Scalar(source + i, (GLbyte*)destination + i, count - i);
+			else PackUnorm8Scalar(source + i, destination + i, count - i);
+		}
+
+		VERTEX_PACKING_AVX2_TARGET void PackSnorm16AVX2(const float* source, GLshort* destination, size_t count) {
+			__m256 low = _mm256_set1_ps(-1.0f), high = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(32767.0f);
+			size_t i = 0;
+
+			for (; i + 16 <= count; i += 16) {
+				__m256i a = ScaleAVX2(source + i, low, high, scale), b = ScaleAVX2(source + i + 8, low, high, scale);
+
+				_mm256_storeu_si256((__m256i*)(destination + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+			}
+
+			PackSnorm16Scalar(source + i, destination + i, count - i);
+		}
+
+		VERTEX_PACKING_AVX2_TARGET void PackUnorm16AVX2(const float* source, GLushort* destination, size_t count) {
+			__m256 low = _mm256_setzero_ps(), high = _mm256_set1_ps(1.0f), scale = _mm256_set1_ps(65535.0f);
+			size_t i = 0;
+
+			for (; i + 16 <= count; i += 16) {
+				__m256i a = ScaleAVX2(source + i, low, high, scale), b = ScaleAVX2(source + i + 8, low, high, scale);
+
+				_mm256_storeu_si256((__m256i*)(destination + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8));
+			}
+
+			PackUnorm16Scalar(source + i, destination + i, count - i);
+		}
+
+		VERTEX_PACKING_AVX2_TARGET void PackSnorm2_10_10_10AVX2(const float* source, GLuint* destination, size_t count) {
+			__m256 low = _mm256_set1_ps(-1.0f), high = _mm256_set1_ps(1.0f);
+			__m256 scale = _mm256_setr_ps(511.0f, 511.0f, 511.0f, 1.0f, 511.0f, 511.0f, 511.0f, 1.0f);
+			__m256i mask = _mm256_setr_epi32(0x3FF, 0x3FF, 0x3FF, 0x3, 0x3FF, 0x3FF, 0x3FF, 0x3);
+			__m256i shifts = _mm256_setr_epi32(0, 10, 20, 30, 0, 10, 20, 30);
+			size_t i = 0;
+
+			// Two vectors per iteration, the fields don't overlap so the horizontal adds work as ors
+			for (; i + 2 <= count; i += 2) {
+				__m256i fields = _mm256_sllv_epi32(_mm256_and_si256(ScaleAVX2(source + i * 4, low, high, scale), mask), shifts);
+				fields = _mm256_hadd_epi32(fields, fields);
+				fields = _mm256_hadd_epi32(fields, fields);
+
+				destination[i] = (GLuint)_mm256_extract_epi32(fields, 0);
+				destination[i + 1] = (GLuint)_mm256_extract_epi32(fields, 4);
+			}
+
+			PackSnorm2_10_10_10Scalar(source + i * 4, destination + i, count - i);
+		}
+
+#endif
+
+	}
+
+	PackingPath VertexPacking::GetSupportedPath() {
+		static PackingPath supported = DetectPath();
+		return supported;
+	}
+
+	PackingPath VertexPacking::GetPath() {
+		if (sForcedPath >= 0) return (PackingPath)sForcedPath;
+
+		return GetSupportedPath();
+	}
+
+	void VertexPacking::SetPath(PackingPath path) {
+		sForcedPath = std::min((int)path, (int)GetSupportedPath());
+	}
+
+	void VertexPacking::PackHalf(const float* source, GLushort* destination, size_t count) {
+#ifdef VERTEX_PACKING_X86
+		if (GetPath() == PackingPath::PACKING_AVX2) return PackHalfAVX2(source, destination, count);
+#endif
+		PackHalfScalar(source, destination, count);
+	}
+
+	void VertexPacking::PackSnorm8(const float* source, GLbyte* destination, size_t count) {
+#ifdef VERTEX_PACKING_X86
+		PackingPath path = GetPath();
+		if (path == PackingPath::PACKING_AVX2) return PackBytesAVX2(source, (GLubyte*)destination, count, -1.0f, 127.0f, true);
+		if (path == PackingPath::PACKING_SSE2) return PackSnorm8SSE2(source, destination, count);
+#endif
+		PackSnorm8Scalar(source, destination, count);
+	}
+
+	void VertexPacking::PackUnorm8(const float* source, GLubyte* destination, size_t count) {
+#ifdef VERTEX_PACKING_X86
+		PackingPath path = GetPath();
+		if (path == PackingPath::PACKING_AVX2) return PackBytesAVX2(source, destination, count, 0.0f, 255.0f, false);
+		if (path == PackingPath::PACKING_SSE2) return PackUnorm8SSE2(source, destination, count);
+#endif
+		PackUnorm8Scalar(source, destination, count);
+	}
+
+	void VertexPacking::PackSnorm16(const float* source, GLshort* destination, size_t count) {
+#ifdef VERTEX_PACKING_X86
+		PackingPath path = GetPath();
+		if (path == PackingPath::PACKING_AVX2) return PackSnorm16AVX2(source, destination, count);
+		if (path == PackingPath::PACKING_SSE2) return PackSnorm16SSE2(source, destination, count);
+#endif
+		PackSnorm16Scalar(source, destination, count);
+	}
+
+	void VertexPacking::PackUnorm16(const float* source, GLushort* destination, size_t count) {
+#ifdef VERTEX_PACKING_X86
+		PackingPath path = GetPath();
+		if (path == PackingPath::PACKING_AVX2) return PackUnorm16AVX2(source, destination, count);
+		if (path == PackingPath::PACKING_SSE2) return PackUnorm16SSE2(source, destination, count);
+#endif
+		PackUnorm16Scalar(source, destination, count);
+	}
+
+	void VertexPacking::PackSnorm2_10_10_10(const float* source, GLuint* destination, size_t count) {
+#ifdef VERTEX_PACKING_X86
+		PackingPath path = GetPath();
+		if (path == PackingPath::PACKING_AVX2) return PackSnorm2_10_10_10AVX2(source, destination, count);
+		if (path == PackingPath::PACKING_SSE2) return PackSnorm2_10_10_10SSE2(source, destination, count);
+#endif
+		PackSnorm2_10_10_10Scalar(source, destination, count);
+	}
+
+	GLushort VertexPacking::FloatToHalf(float value) {
+		unsigned int bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		unsigned int sign = (bits >> 16) & 0x8000;
+		unsigned int exponent = (bits >> 23) & 0xFF;
+		unsigned int mantissa = bits & 0x7FFFFF;
+
+		// Inf stays inf, NaN keeps the top of its payload and becomes quiet (like F16C)
+		if (exponent == 0xFF) return (GLushort)(sign | 0x7C00 | (mantissa ? 0x200 | (mantissa >> 13) : 0));
+
+		int halfExponent = (int)exponent - 127 + 15;
+		if (halfExponent >= 31) return (GLushort)(sign | 0x7C00);
+
+		unsigned int half, rest, halfway;
+
+		if (halfExponent <= 0) {
+			// Subnormal half
+			if (halfExponent < -10) return (GLushort)sign;
+
+			mantissa |= 0x800000;
+			unsigned int shift = 14 - halfExponent;
+
+			half = mantissa >> shift;
+			rest = mantissa & ((1u << shift) - 1);
+			halfway = 1u << (shift - 1);
+		}
+		else {
+			half = ((unsigned int)halfExponent << 10) | (mantissa >> 13);
+			rest = mantissa & 0x1FFF;
+			halfway = 0x1000;
+		}
+
+		// Round to nearest even, a carry into the exponent is still the right value
+		if (rest > halfway || (rest == halfway && (half & 1))) half++;
+
+		return (GLushort)(sign | half);
+	}
+
+	float VertexPacking::HalfToFloat(GLushort value) {
+		unsigned int sign = (unsigned int)(value & 0x8000) << 16;
+		unsigned int exponent = (value >> 10) & 0x1F;
+		unsigned int mantissa = value & 0x3FF;
+		unsigned int bits;
+
+		if (exponent == 0x1F) {
+			bits = sign | 0x7F800000 | (mantissa << 13);
+		}
+		else if (exponent) {
+			bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+		}
+		else if (mantissa) {
+			// Subnormal, normalize it
+			exponent = 127 - 15 + 1;
+			while (!(mantissa & 0x400)) {
+				mantissa <<= 1;
+				exponent--;
+			}
+
+			bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+		}
+		else {
+			bits = sign;
+		}
+
+		float result;
+		memcpy(&result, &bits, sizeof(result));
+
+		return result;
+	}
+
+	std::vector<PackingBenchmarkResult> VertexPacking::Benchmark(unsigned int floatCount, unsigned int repeats) {
+		std::vector<PackingBenchmarkResult> results;
+
+		floatCount = std::max(floatCount & ~3u, 4u);
+		repeats = std::max(repeats, 1u);
+
+		std::vector<float> source(floatCount);
+		unsigned int seed = 12345;
+		for (auto& value : source) {
+			seed = seed * 1664525u + 1013904223u;
+			value = ((seed >> 8) / 16777215.0f) * 3.0f - 1.5f;
+		}
+
+		std::vector<GLuint> destination(floatCount);
+		void* destinationPtr = &destination[0];
+
+		int previousPath = sForcedPath;
+
+		for (int path = PackingPath::PACKING_SCALAR; path <= GetSupportedPath(); ++path) {
+			sForcedPath = path;
+
+			auto run = [&](const char* name, const std::function<void()>& pack) {
+				double best = 0.0;
+
+				for (unsigned int i = 0; i < repeats; ++i) {
+					auto start = std::chrono::high_resolution_clock::now();
+					pack();
+					double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+					if (seconds > 0.0) best = std::max(best, floatCount / seconds / 1000000.0);
+				}
+
+				PackingBenchmarkResult result;
+				result.Function = name;
+				result.Path = (PackingPath)path;
+				result.MegaFloatsPerSecond = best;
+				results.push_back(result);
+			};
+
+			run("half", [&]() { PackHalf(&source[0], (GLushort*)destinationPtr, floatCount); });
+			run("snorm8", [&]() { PackSnorm8(&source[0], (GLbyte*)destinationPtr, floatCount); });
+			run("unorm8", [&]() { PackUnorm8(&source[0], (GLubyte*)destinationPtr, floatCount); });
+			run("snorm16", [&]() { PackSnorm16(&source[0], (GLshort*)destinationPtr, floatCount); });
+			run("unorm16", [&]() { PackUnorm16(&source[0], (GLushort*)destinationPtr, floatCount); });
+			run("snorm_2_10_10_10", [&]() { PackSnorm2_10_10_10(&source[0], (GLuint*)destinationPtr, floatCount / 4); });
+		}
+
+		sForcedPath = previousPath;
+
+		return results;
+	}
+
+}
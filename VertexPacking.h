@@ -0,0 +1,47 @@
+#ifndef VERTEX_PACKING_R_H
+#define VERTEX_PACKING_R_H
+
+#include "include.h"
+
+namespace Backend {
+	class VertexPacking;
+
+	enum PackingPath { PACKING_SCALAR, PACKING_SSE2, PACKING_AVX2 };
+
+	struct PackingBenchmarkResult {
+		std::string Function;
+		PackingPath Path;
+		double MegaFloatsPerSecond;
+	};
+
+	// Float to compact attribute converters, to fill slots declared with the small BufferDataTypes at upload time.
+	// The best path the CPU supports is picked on first use (AVX2 needs F16C as well). Every path rounds to nearest even
+	// and clamps to the range of the format (NaN goes to the lower bound), so they all give the same bytes.
+	// PackHalf has no SSE2 version, it runs the scalar one on that path.
+	class VertexPacking {
+		public:
+			static PackingPath GetSupportedPath();
+			static PackingPath GetPath();
+			static void SetPath(PackingPath path); // clamped to the supported path
+
+			// count is the number of floats
+			static void PackHalf(const float* source, GLushort* destination, size_t count);
+			static void PackSnorm8(const float* source, GLbyte* destination, size_t count);
+			static void PackUnorm8(const float* source, GLubyte* destination, size_t count);
+			static void PackSnorm16(const float* source, GLshort* destination, size_t count);
+			static void PackUnorm16(const float* source, GLushort* destination, size_t count);
+
+			// count is the number of xyzw vectors, w is a 2 bit snorm (DATA_INT_2_10_10_10_REV with normalized = true)
+			static void PackSnorm2_10_10_10(const float* source, GLuint* destination, size_t count);
+
+			static GLushort FloatToHalf(float value);
+			static float HalfToFloat(GLushort value);
+
+			// Every function on every supported path over floatCount floats in [-1.5, 1.5], best of repeats runs
+			static std::vector<PackingBenchmarkResult> Benchmark(unsigned int floatCount = 1 << 20, unsigned int repeats = 16);
+
+	};
+
+}
+
+#endif
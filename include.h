@@ -7,6 +7,7 @@
 #include <string>
 #include <algorithm>
 #include <memory>
+#include <cstring>
 
 // GLM
 #include <glm/glm.hpp>